@@ -11,6 +11,10 @@
 #include <esp8266/esp8266.h>
 #include "geolocate.h"
 
+#if MYNEWT_VAL(SERVER_SENML)
+#error WIFI_GEOLOCATION payloads are in the thethings.io format, not SenML.  Disable SERVER_SENML.
+#endif  //  MYNEWT_VAL(SERVER_SENML)
+
 #define MAX_WIFI_AP 3  //  Scan at most 3 WiFi access points.
 #define ANY -1         //  Wildcard in a MAC address pattern that matches any value for a byte.
 #define LAST_MAC_PATTERN { 0, 0, 0, 0, 0, 0 }  //  skip_ssid must end with LAST_MAC_PATTERN
@@ -70,7 +74,7 @@ int geolocate(const char *network_device, const char *uri, const char *device_st
     //  Post the CoAP message to the CoAP Background Task for transmission.  After posting the
     //  message to the background task, we release a semaphore that unblocks other requests
     //  to compose and post CoAP messages.
-    rc = do_server_post();  assert(rc != 0);
+    if (!do_server_post()) { return SYS_ERANGE; }  //  Payload too big for every Network Interface, message dropped.
     console_printf("GEO view your geolocation at \nhttps://blue-pill-geolocate.appspot.com?device=%s\n", device_str);
 
     //  The CoAP Background Task will call oc_tx_ucast() in the ESP8266 driver to 
@@ -146,6 +150,7 @@ static void write_wifi_access_points(const char *device_str, const nsapi_wifi_ap
     //    {"key":"rssi2",  "value":-43.0}
     //  ]}
     //  We use float instead of int for rssi because int doesn't support negative values.
+    //  If SERVER_FLAT is enabled, the same code writes {"device":"...", "ssid0":"...", "rssi0":-43.0, ...}
     assert(device_str);  assert(access_points);  assert(length > 0);
     int i, len;
     //  Compose the CoAP Payload in JSON using the CP macros.  Also works for CBOR.
@@ -139,13 +139,18 @@ static int read_temperature(struct sensor* sensor, void *arg, void *sensor_data,
     //  to be transmitted.
     rc = send_sensor_data(&temp_sensor_value, device_name);
 
-    //  SYS_EAGAIN means that the Network Task is still starting up the ESP8266.
-    //  We drop the sensor data and send at the next poll.
+    //  SYS_EAGAIN means that the Network Task is still starting up the ESP8266, or all compose
+    //  contexts are busy.  We drop the sensor data and send at the next poll.
     if (rc == SYS_EAGAIN) {
         console_printf("TMP network not ready\n");
         return 0; 
     }
-    assert(rc == 0);
+    //  Other errors mean that the sensor data was dropped, e.g. the payload doesn't fit any Network Interface
+    //  or the batch failed to flush.  We log the error and send at the next poll.
+    if (rc != 0) {
+        console_printf("TMP dropped %d\n", rc);
+        return 0;
+    }
 #endif  //  MYNEWT_VAL(SENSOR_COAP)
 
     return rc;
@@ -9,6 +9,9 @@
 #include <console/console.h>  //  Actually points to libs/semihosting_console
 #include "send_coap.h"        //  For start_network_task()
 #include "listen_sensor.h"    //  For start_sensor_listener()
+#if MYNEWT_VAL(SENSOR_NETWORK_JOIN)  //  If Sensor Nodes may join over the air...
+#include <config/config.h>    //  For conf_load()
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_JOIN)
 
 ///////////////////////////////////////////////////////////////////////////////
 //  Read Sensor Data from Temperature Sensor and Send to CoAP Server or Collector Node
@@ -24,6 +27,13 @@ int main(int argc, char **argv) {
     //  bin/targets/bluepill_my_sensor/generated/src/bluepill_my_sensor-sysinit-app.c
     sysinit();  console_flush();
 
+#if MYNEWT_VAL(SENSOR_NETWORK_JOIN)  //  If Sensor Nodes may join over the air...
+    //  For Collector Node: Restore the Sensor Nodes that joined before.  The config storage is ready only after
+    //  sysinit().  Missing storage is not an error: The nodes will join again.
+    int rc0 = conf_load();
+    if (rc0) { console_printf("config load failed %d\n", rc0); }
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_JOIN)
+
 #if defined(SERVER_NETWORK_INTERFACE) || defined(SENSOR_NETWORK_INTERFACE)  //  If the ESP8266 or nRF24L01 is enabled...
     //  Start the Network Task in the background.  The Network Task prepares the ESP8266 or nRF24L01 transceiver for
     //  sending CoAP messages.  We connect the ESP8266 to the WiFi access point and register
@@ -16,12 +16,20 @@
 #include <console/console.h>
 #include <sensor_network/sensor_network.h>  //  For Sensor Network library
 #include <sensor_coap/sensor_coap.h>        //  For Sensor CoAP library
+#if MYNEWT_VAL(REMOTE_SENSOR)
+#include <remote_sensor/remote_sensor.h>    //  For remote_sensor_lookup_key()
+#endif  //  MYNEWT_VAL(REMOTE_SENSOR)
 #include "geolocate.h"                      //  For geolocate()
 #include "send_coap.h"
 
 static int send_sensor_data_to_server(struct sensor_value *val, const char *sensor_node);
 static int send_sensor_data_to_collector(struct sensor_value *val, const char *sensor_node);
 
+#if MYNEWT_VAL(SERVER_BATCH) && MYNEWT_VAL(ESP8266)  //  If we are batching the sensor data for CoAP Server...
+static struct sensor_coap_batch server_batch;  //  Sensor values to be sent to CoAP Server in a single message.
+static int init_server_batch(void);
+#endif  //  MYNEWT_VAL(SERVER_BATCH) && MYNEWT_VAL(ESP8266)
+
 ///////////////////////////////////////////////////////////////////////////////
 //  Network Task
 
@@ -76,16 +84,32 @@ static void network_task_func(void *arg) {
 
 #if MYNEWT_VAL(WIFI_GEOLOCATION)  //  If WiFi Geolocation is enabled...
     //  Geolocate the device by sending WiFi Access Point info.  Returns number of access points sent.
-    const char *device_id = get_device_id();  assert(device_id);
-    rc = geolocate(SERVER_NETWORK_INTERFACE, NULL, device_id);  assert(rc >= 0);
+    const char *device_id = get_device_token();  assert(device_id);  //  First message of the session, so it's the full Device ID.
+    rc = geolocate(SERVER_NETWORK_INTERFACE, NULL, device_id);
+    if (rc < 0) { console_printf("GEO dropped %d\n", rc); }  //  Message dropped.  Continue without geolocation.
 #endif  //  MYNEWT_VAL(WIFI_GEOLOCATION)
 
+#if MYNEWT_VAL(SERVER_BATCH) && MYNEWT_VAL(ESP8266)  //  If we are batching the sensor data for CoAP Server...
+    if (is_standalone_node() || is_collector_node()) {
+        rc = init_server_batch();  assert(rc == 0);
+    }
+#endif  //  MYNEWT_VAL(SERVER_BATCH) && MYNEWT_VAL(ESP8266)
+
     //  Network Task has successfully started the ESP8266 or nRF24L01 transceiver. The Sensor Listener will still continue to
     //  run in the background and send sensor data to the server.
     network_is_ready = true;  //  Indicate that network is ready.
 
     while (true) {  //  Loop forever...        
         console_printf("NET free mbuf %d\n", os_msys_num_free());  //  Display number of free mbufs, to catch CoAP memory leaks.
+#if MYNEWT_VAL(TX_TASK)  //  If we are transmitting in the Transmit Task...
+        //  Display the transmit queue depths (alert, normal, bulk) and dropped messages, to catch a backed up radio.
+        struct sensor_network_tx_stats tx_stats;
+        sensor_network_tx_stats(&tx_stats);
+        console_printf("NET tx queue %d %d %d max %d %d %d dropped %d\n",
+            tx_stats.depth[0], tx_stats.depth[1], tx_stats.depth[2],
+            tx_stats.max_depth[0], tx_stats.max_depth[1], tx_stats.max_depth[2],
+            (int) (tx_stats.dropped[0] + tx_stats.dropped[1] + tx_stats.dropped[2]));
+#endif  //  MYNEWT_VAL(TX_TASK)
         os_time_delay(10 * OS_TICKS_PER_SEC);                      //  Wait 10 seconds before repeating.
     }
     assert(false);  //  Never comes here.  If this task function terminates, the program will crash.
@@ -100,7 +124,7 @@ int send_sensor_data(struct sensor_value *val, const char *sensor_node) {
     //  the sensor data (like "b3b4b5b6f1")
     //  The message will be enqueued for transmission by the CoAP / OIC Background Task 
     //  so this function will return without waiting for the message to be transmitted.  
-    //  Return 0 if successful, SYS_EAGAIN if network is not ready yet.
+    //  Return 0 if successful, SYS_EAGAIN if network is not ready yet or busy.
 
     //  For Sensor Node: Transmit the sensor data to the Collector Node as CBOR.
     if (should_send_to_collector(val, sensor_node)) { 
@@ -115,6 +139,132 @@ int send_sensor_data(struct sensor_value *val, const char *sensor_node) {
 
 #if MYNEWT_VAL(ESP8266)  //  If ESP8266 WiFi is enabled...
 
+#if MYNEWT_VAL(SERVER_BATCH)  //  If we are batching the sensor data for CoAP Server...
+
+static int send_batch_to_server(struct sensor_coap_batch *batch, void *arg);
+
+//  For Collector Node: Number of Sensor Nodes to wait for before sending the batch.  By default all Sensor Nodes.
+//  A batch holds at most SENSOR_COAP_BATCH_COUNT readings, so it can't wait for more nodes than that.
+#if MYNEWT_VAL(SERVER_BATCH_NODES) < 0  //  If we are waiting for all Sensor Nodes...
+#define SERVER_BATCH_NODES  MYNEWT_VAL(SENSOR_NETWORK_NODES)
+#else
+#define SERVER_BATCH_NODES  MYNEWT_VAL(SERVER_BATCH_NODES)
+#endif  //  MYNEWT_VAL(SERVER_BATCH_NODES) < 0
+#define SERVER_BATCH_GROUP  ((SERVER_BATCH_NODES < MYNEWT_VAL(SENSOR_COAP_BATCH_COUNT)) ? SERVER_BATCH_NODES : MYNEWT_VAL(SENSOR_COAP_BATCH_COUNT))
+
+#if !MYNEWT_VAL(SERVER_SENML)  //  If we are sending the thethings.io format to the CoAP Server...
+//  Constant payload prefix for the batched CoAP Server messages, rendered once.  Only the device ID changes.
+SENSOR_COAP_SKELETON(batch_skeleton,
+    CP_SKELETON_STR("device")   //  {"key":"device", "value":<device_id>}
+);
+#endif  //  !MYNEWT_VAL(SERVER_SENML)
+
+static int send_sensor_data_to_server(struct sensor_value *val, const char *node_id) {
+    //  Add the Sensor Key (field name) and Value in val to the batch for the CoAP server.  The batch
+    //  will be sent as a single CoAP JSON message when the payload is nearly full (SERVER_BATCH_BYTES), when the
+    //  batch is full (SENSOR_COAP_BATCH_COUNT) or when the oldest value has waited SERVER_BATCH_LATENCY milliseconds.
+    //  Return 0 if successful, SYS_EAGAIN if network is not ready yet.
+    assert(val);  assert(node_id);
+    if (!network_is_ready) { return SYS_EAGAIN; }  //  If network is not ready, tell caller (Sensor Listener) to try later.
+    int rc = sensor_coap_batch_add(&server_batch, val, node_id);
+    return rc;
+}
+
+static int init_server_batch(void) {
+    //  Init the batch for the CoAP server.  Reserve payload space for the device ID, which is longer than the Device Token.  Return 0 if successful.
+    //  Must leave room for the CoAP header, unless the payload is sent in Block1 blocks.
+    assert(MYNEWT_VAL(SENSOR_COAP_BLOCK1) || MYNEWT_VAL(SERVER_BATCH_BYTES) < ESP8266_TX_BUFFER_SIZE);
+    const char *device_id = get_device_id();  assert(device_id);
+    int rc = sensor_coap_batch_init(&server_batch, MYNEWT_VAL(SERVER_BATCH_BYTES), 
+        sensor_coap_batch_item_size("device", device_id),
+        MYNEWT_VAL(SERVER_BATCH_LATENCY), send_batch_to_server, NULL);
+    assert(rc == 0);
+#if MYNEWT_VAL(SERVER_SENML)  //  If we are sending SenML to the CoAP Server...
+    //  The device ID is the prefix of the SenML base name, which is repeated whenever the node changes.
+    rc = sensor_coap_batch_use_senml(&server_batch, device_id);  assert(rc == 0);
+#endif  //  MYNEWT_VAL(SERVER_SENML)
+#if MYNEWT_VAL(SERVER_FLAT)  //  If we are sending the flat layout to the CoAP Server...
+    //  The payload is composed as {"device": <device_id>,"node": ...,"t": ...}, without the "values" items.
+    rc = sensor_coap_batch_use_flat(&server_batch, sensor_coap_batch_pair_size("device", device_id));  assert(rc == 0);
+#endif  //  MYNEWT_VAL(SERVER_FLAT)
+    if (is_collector_node() && SERVER_BATCH_GROUP > 0) {
+        //  For Collector Node: Merge the readings forwarded by the Sensor Nodes into one message per cycle.  Each Sensor
+        //  Node appears once in the payload, and the batch is sent as soon as SERVER_BATCH_GROUP Sensor Nodes have
+        //  reported, or after SERVER_BATCH_LATENCY milliseconds if some Sensor Nodes are silent.
+        rc = sensor_coap_batch_group_nodes(&server_batch, SERVER_BATCH_GROUP);  assert(rc == 0);
+    }
+    return rc;
+}
+
+static int send_batch_to_server(struct sensor_coap_batch *batch, void *arg) {
+    //  Compose a CoAP JSON message with the batched Sensor Keys and Values and send to the CoAP server and URI.
+    //  Called by the batch when it's time to flush.  The payload looks like:
+    //  {"values":[
+    //    {"key":"device", "value":"0102030405060708090a0b0c0d0e0f10"},
+    //    {"key":"node",   "value":"b3b4b5b6f1"},
+    //    {"key":"t",      "value":1715},
+    //    {"key":"t",      "value":1716},
+    //    {"key":"node",   "value":"b3b4b5b6f2"},
+    //    {"key":"t",      "value":1698},
+    //    ... ]}
+    //  If DEVICE_TOKEN is enabled, "device" carries the short Device Token after the Device ID has been announced.
+    //  If SERVER_FLAT is enabled, the same skeleton writes {"device": "0102...","node": "b3b4b5b6f1","t": 1715,...}
+    const char *device_id = get_device_id();  assert(device_id);
+
+    //  Don't compose the message if the radio is backed up, since the message would be dropped.
+    if (!sensor_network_tx_ready(SENSOR_COAP_PRIORITY_BULK)) { return SYS_EAGAIN; }
+
+    //  Start composing the CoAP Server message.  Don't wait for a compose context while the batch is locked:
+    //  If none is free, the batch keeps the readings and tries again later.
+    int rc = try_server_post(NULL);
+    if (rc) { return rc; }
+    //  Batches are sent after alerts and single readings.
+    rc = sensor_coap_set_priority(sensor_coap_current(), SENSOR_COAP_PRIORITY_BULK);  assert(rc == 0);
+    const char *device_token = get_device_token();  assert(device_token);
+
+#if MYNEWT_VAL(SERVER_SENML)  //  If we are sending SenML to the CoAP Server...
+    //  Compose the payload as a SenML pack.  The base name and base time are written only when the node changes
+    //  and in the first record, so each record carries just the key, value and time relative to the first reading:
+    //  [{"bn": "0102030405060708090a0b0c0d0e0f10:b3b4b5b6f1:","bt": -25,"n": "t","v": 1715},
+    //   {"n": "t","v": 1716,"t": 10},
+    //   {"bn": "0102030405060708090a0b0c0d0e0f10:b3b4b5b6f2:","n": "t","v": 1698,"t": 12}, ... ]
+#if MYNEWT_VAL(RAW_TEMP)  //  If we are using raw temperature (integer) instead of computed temperature (float)...
+    CP_SENML_BATCH(device_token, batch, CP_SENML_INT_VAL);
+#else
+    CP_SENML_BATCH(device_token, batch, CP_SENML_FLOAT_VAL);
+#endif  //  MYNEWT_VAL(RAW_TEMP)
+#else  //  If we are sending the thethings.io format to the CoAP Server...
+    //  Copy the constant payload prefix {"values":[{"key":"device", "value":<device>} from batch_skeleton and
+    //  fill in the Device ID or Device Token.  Then append the batched values, each preceded by
+    //  {"key":"node", ...} when the node changes, and close the payload.  Same output as CP_ROOT,
+    //  CP_ARRAY(root, values, ...) with CP_ITEM_STR(values, "device", device_token) and CP_BATCH_ITEMS.
+    struct sensor_coap_slot slots[1];
+    slots[0].text_val = device_token;
+    CP_SKELETON_BATCH(batch_skeleton, slots, batch);
+#endif  //  MYNEWT_VAL(SERVER_SENML)
+
+    //  Post the CoAP Server message to the CoAP Background Task for transmission.
+    if (!do_server_post()) { return SYS_ERANGE; }  //  Payload too big for every Network Interface, message dropped.
+
+    console_printf("NET view your sensor at \nhttps://blue-pill-geolocate.appspot.com?device=%s\n", device_id);
+    return 0;
+}
+
+#else  //  If we are not batching the sensor data for CoAP Server...
+
+#if !MYNEWT_VAL(SERVER_SENML)  //  If we are sending the thethings.io format to the CoAP Server...
+//  Payload skeleton for the CoAP Server message.  Only the device ID, node ID, Sensor Key and Sensor Value change.
+SENSOR_COAP_SKELETON(server_skeleton,
+    CP_SKELETON_STR("device"),  //  {"key":"device", "value":<device_id>}
+    CP_SKELETON_STR("node"),    //  {"key":"node",   "value":<node_id>}
+#if MYNEWT_VAL(RAW_TEMP)        //  {"key":<val->key>, "value":<val->int_val>} for raw temperature (integer)
+    CP_SKELETON_INT(NULL)
+#else                           //  {"key":<val->key>, "value":<val->float_val>} for computed temperature (float)
+    CP_SKELETON_FLOAT(NULL)
+#endif  //  MYNEWT_VAL(RAW_TEMP)
+);
+#endif  //  !MYNEWT_VAL(SERVER_SENML)
+
 static int send_sensor_data_to_server(struct sensor_value *val, const char *node_id) {
     //  Compose a CoAP JSON message with the Sensor Key (field name) and Value in val 
     //  and send to the CoAP server and URI.  The Sensor Value may be integer or float.
@@ -122,7 +272,7 @@ static int send_sensor_data_to_server(struct sensor_value *val, const char *node
     //  or "tmp" for computed temperature (float).
     //  The message will be enqueued for transmission by the CoAP / OIC 
     //  Background Task so this function will return without waiting for the message 
-    //  to be transmitted.  Return 0 if successful, SYS_EAGAIN if network is not ready yet.
+    //  to be transmitted.  Return 0 if successful, SYS_EAGAIN if network is not ready yet or busy.
 
     //  For the CoAP server hosted at thethings.io, the CoAP payload should be encoded in JSON like this:
     //  {"values":[
@@ -130,53 +280,63 @@ static int send_sensor_data_to_server(struct sensor_value *val, const char *node
     //    {"key":"tmp",    "value":28.7},
     //    {"key":"...",    "value":... },
     //    ... ]}
+    //  If SERVER_FLAT is enabled, init_server_post() selects the flat layout and the payload looks like:
+    //  {"device": "0102030405060708090a0b0c0d0e0f10","node": "b3b4b5b6f1","tmp": 28.70}
     assert(val);  assert(node_id);
     if (!network_is_ready) { return SYS_EAGAIN; }  //  If network is not ready, tell caller (Sensor Listener) to try later.
     const char *device_id = get_device_id();  assert(device_id);
 
-    //  Start composing the CoAP Server message with the sensor data in the payload.  This will 
-    //  block other tasks from composing and posting CoAP messages (through a semaphore).
-    //  We only have 1 memory buffer for composing CoAP messages so it needs to be locked.
-    int rc = init_server_post(NULL);  assert(rc != 0);
-
-    //  Compose the CoAP Payload in JSON using the CP macros.  Also works for CBOR.
-    CP_ROOT({                     //  Create the payload root
-        CP_ARRAY(root, values, {  //  Create "values" as an array of items under the root
-            //  Append to the "values" array:
-            //    {"key":"device", "value":"0102030405060708090a0b0c0d0e0f10"},
-            CP_ITEM_STR(values, "device", device_id);
-
-            //    {"key":"node", "value":"b3b4b5b6f1"},
-            CP_ITEM_STR(values, "node", node_id);
+    //  Start composing the CoAP Server message with the sensor data in the payload.  Don't wait if all compose
+    //  contexts are busy, e.g. while the ESP8266 is sending a slow message.  The Sensor Listener will drop the
+    //  sensor data and send at the next poll.  Also drop the sensor data if the radio is backed up.
+    if (!sensor_network_tx_ready(SENSOR_COAP_PRIORITY_NORMAL)) { return SYS_EAGAIN; }
+    int rc = try_server_post(NULL);
+    if (rc == SYS_EAGAIN) { return SYS_EAGAIN; }
+    assert(rc == 0);
 
+    //  Compose the CoAP Payload in JSON by filling the slots of server_skeleton.  Also works for CBOR.
+    //  The output is the same as CP_ROOT, CP_ARRAY(root, values, ...) with CP_ITEM_STR(values, "device", device_id),
+    //  CP_ITEM_STR(values, "node", node_id) and CP_ITEM_INT_VAL / CP_ITEM_FLOAT_VAL(values, val).
+    //  For a payload with a variable shape, use the CP macros: apps/my_sensor_app/src/geolocate.c
+#if MYNEWT_VAL(SERVER_SENML)  //  If we are sending SenML to the CoAP Server...
+    //  Compose the payload as a SenML pack with 1 record: [{"bn": "<device_id>:<node_id>:","n": "t","v": 2870}]
+    CP_SENML_ROOT(0, {
+        CP_SENML_BASE_NAME(get_device_token(), node_id);
 #if MYNEWT_VAL(RAW_TEMP)  //  If we are using raw temperature (integer) instead of computed temperature (float)...
-            //  Append to the "values" array the Sensor Key and Sensor Value, depending on the value type:
-            //    {"key":"t",   "value":2870} for raw temperature (integer)
-            CP_ITEM_INT_VAL(values, val);
-#else       //    {"key":"tmp", "value":28.7} for computed temperature (float)
-            CP_ITEM_FLOAT_VAL(values, val);
+        CP_SENML_INT_VAL(val, 0);
+#else
+        CP_SENML_FLOAT_VAL(val, 0);
 #endif  //  MYNEWT_VAL(RAW_TEMP)
-
-            //  If there are more sensor values, add them here with
-            //  CP_ITEM_VAL, CP_ITEM_INT, CP_ITEM_UINT, CP_ITEM_FLOAT or CP_ITEM_STR
-            //  Check geolocate() for a more complex payload: apps/my_sensor_app/src/geolocate.c
-
-        });                       //  End CP_ARRAY: Close the "values" array
-    });                           //  End CP_ROOT:  Close the payload root
+    });
+#else  //  If we are sending the thethings.io format to the CoAP Server...
+    struct sensor_coap_slot slots[4];
+    slots[0].text_val = get_device_token();  //  {"key":"device", "value":"0102030405060708090a0b0c0d0e0f10"} or "AQIDBA",
+    slots[1].text_val = node_id;    //  {"key":"node",   "value":"b3b4b5b6f1"},
+    slots[2].text_val = val->key;   //  {"key":"t",      "value":2870} or {"key":"tmp", "value":28.7}
+#if MYNEWT_VAL(RAW_TEMP)  //  If we are using raw temperature (integer) instead of computed temperature (float)...
+    assert(val->val_type == SENSOR_VALUE_TYPE_INT32);
+    slots[3].int_val = val->int_val;
+#else
+    assert(val->val_type == SENSOR_VALUE_TYPE_FLOAT);
+    slots[3].float_val = val->float_val;
+#endif  //  MYNEWT_VAL(RAW_TEMP)
+    CP_SKELETON(server_skeleton, slots);
+#endif  //  MYNEWT_VAL(SERVER_SENML)
 
     //  Post the CoAP Server message to the CoAP Background Task for transmission.  After posting the
     //  message to the background task, we release a semaphore that unblocks other requests
     //  to compose and post CoAP messages.
-    rc = do_server_post();  assert(rc != 0);
+    if (!do_server_post()) { return SYS_ERANGE; }  //  Payload too big for every Network Interface, message dropped.
 
     console_printf("NET view your sensor at \nhttps://blue-pill-geolocate.appspot.com?device=%s\n", device_id);
     //  console_printf("NET send data: tmp "); console_printfloat(tmp); console_printf("\n");  ////
 
-    //  The CoAP Background Task will call oc_tx_ucast() in the ESP8266 driver to 
+    //  The CoAP Background Task (or the Transmit Task if TX_TASK is enabled) will call oc_tx_ucast() in the ESP8266 driver to
     //  transmit the message: libs/esp8266/src/transport.cpp
     return 0;
 }
 
+#endif  //  MYNEWT_VAL(SERVER_BATCH)
 #endif  //  MYNEWT_VAL(ESP8266)
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -191,31 +351,41 @@ static int send_sensor_data_to_collector(struct sensor_value *val, const char *n
     //  For temperature, the Sensor Key is "t" for raw temperature (integer, from 0 to 4095).
     //  The message will be enqueued for transmission by the CoAP / OIC 
     //  Background Task so this function will return without waiting for the message 
-    //  to be transmitted.  Return 0 if successful, SYS_EAGAIN if network is not ready yet.
+    //  to be transmitted.  Return 0 if successful, SYS_EAGAIN if network is not ready yet or busy.
     //  The CoAP payload needs to be very compact (under 32 bytes) so it will be encoded in CBOR like this:
     //    { t: 2870 }
+    //  Or like this with REMOTE_SENSOR_INT_KEYS, where 1 is the Remote Sensor Type number for "t":
+    //    { 1: 2870 }
     assert(val);
     if (!network_is_ready) { return SYS_EAGAIN; }  //  If network is not ready, tell caller (Sensor Listener) to try later.
 
-    //  Start composing the CoAP Collector message with the sensor data in the payload.  This will 
-    //  block other tasks from composing and posting CoAP messages (through a semaphore).
-    //  We only have 1 memory buffer for composing CoAP messages so it needs to be locked.
-    int rc = init_collector_post();  assert(rc != 0);
+    //  Start composing the CoAP Collector message with the sensor data in the payload.  Don't wait if all compose
+    //  contexts are busy or the radio is backed up.  The Sensor Listener will drop the sensor data and send at the next poll.
+    if (!sensor_network_tx_ready(SENSOR_COAP_PRIORITY_NORMAL)) { return SYS_EAGAIN; }
+    int rc = try_collector_post();
+    if (rc == SYS_EAGAIN) { return SYS_EAGAIN; }
+    assert(rc == 0);
 
     //  Compose the CoAP Payload in CBOR using the CBOR macros.
     CP_ROOT({  //  Create the payload root
+#if MYNEWT_VAL(REMOTE_SENSOR_INT_KEYS)
+        //  Set the integer Sensor Key and integer Sensor Value, e.g. { 1: 2870 }
+        unsigned key = remote_sensor_lookup_key(val->key);  assert(key);
+        CP_SET_INT_VAL_UKEY(root, key, val);
+#else
         //  Set the Sensor Key and integer Sensor Value, e.g. { t: 2870 }
         CP_SET_INT_VAL(root, val);
+#endif  //  MYNEWT_VAL(REMOTE_SENSOR_INT_KEYS)
     });  //  End CP_ROOT:  Close the payload root
 
     //  Post the CoAP Collector message to the CoAP Background Task for transmission.  After posting the
     //  message to the background task, we release a semaphore that unblocks other requests
     //  to compose and post CoAP messages.
-    rc = do_collector_post();  assert(rc != 0);
+    if (!do_collector_post()) { return SYS_ERANGE; }  //  Payload too big for every Network Interface, message dropped.
 
     console_printf("NRF send to collector: rawtmp %d\n", val->int_val);  ////
 
-    //  The CoAP Background Task will call oc_tx_ucast() in the nRF24L01 driver to 
+    //  The CoAP Background Task (or the Transmit Task if TX_TASK is enabled) will call oc_tx_ucast() in the nRF24L01 driver to
     //  transmit the message: libs/nrf24l01/src/transport.cpp
     return 0;
 }
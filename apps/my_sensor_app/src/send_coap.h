@@ -37,7 +37,8 @@ int start_network_task(void);
 //  the sensor data (like "b3b4b5b6f1")
 //  The message will be enqueued for transmission by the CoAP / OIC Background Task 
 //  so this function will return without waiting for the message to be transmitted.  
-//  Return 0 if successful, SYS_EAGAIN if network is not ready yet.
+//  Return 0 if successful, SYS_EAGAIN if network is not ready yet, or another error if the sensor data was dropped,
+//  e.g. SYS_ERANGE if the payload doesn't fit any Network Interface.
 int send_sensor_data(struct sensor_value *val, const char *device_name);
 
 #ifdef __cplusplus
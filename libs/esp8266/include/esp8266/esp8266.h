@@ -18,6 +18,11 @@ extern "C" {  //  Expose the types and functions below to C functions.
 #define ESP8266_RX_BUFFER_SIZE      256
 #define ESP8266_PARSER_BUFFER_SIZE  256
 
+//  Largest CoAP Payload that fits into the TX Buffer, after the CoAP header: 4 fixed bytes, token, Uri-Path,
+//  Content-Format and Accept options, payload marker.
+#define ESP8266_COAP_HEADER_SIZE     80
+#define ESP8266_MAX_PAYLOAD         (ESP8266_TX_BUFFER_SIZE - ESP8266_COAP_HEADER_SIZE)
+
 //  Various timeouts for different ESP8266 operations, in milliseconds.
 #define ESP8266_CONNECT_TIMEOUT     10000  //  10  seconds: Timeout for connecting to WiFi access point
 #define ESP8266_SEND_TIMEOUT        10000  //  10  seconds: Timeout for sending a packet
@@ -30,6 +30,11 @@ struct esp8266_server {
 //  network_device is the ESP8266 device name e.g. "esp8266_0".  Return 0 if successful.
 int esp8266_register_transport(const char *network_device, struct esp8266_server *server0, const char *host, uint16_t port);
 
+//  Register another CoAP server for the ESP8266 transport, e.g. a local historian that receives a copy of each
+//  message.  Must be called after esp8266_register_transport().  Each server uses one of the ESP8266_SOCKET_COUNT
+//  sockets.  Return 0 if successful.
+int esp8266_register_server(struct esp8266_server *server0, const char *host, uint16_t port);
+
 //  Init the endpoint before use.  Returns 0.
 int init_esp8266_endpoint(struct esp8266_endpoint *endpoint, const char *host, uint16_t port);  
 
@@ -11,6 +11,7 @@
 #include "esp8266/transport.h"
 
 static int register_transport(const char *network_device, void *server_endpoint, const char *host, uint16_t port, uint8_t server_endpoint_size);
+static int register_server(const char *network_device, void *server_endpoint, const char *host, uint16_t port, uint8_t server_endpoint_size);
 
 static ESP8266 controller;  //  The single ESP8266 controller instance.  TODO: Support multiple ESP8266 instances.
 static char esp8266_tx_buffer[ESP8266_TX_BUFFER_SIZE];  //  TX Buffer
@@ -28,6 +29,10 @@ static const struct sensor_network_interface network_iface = {
     ESP8266_DEVICE,                  //  const char *network_device; Network device name.  Must be a static string.
     sizeof(struct esp8266_server),   //  uint8_t server_endpoint_size; Server Endpoint size
     register_transport,              //  int (*register_transport_func)(const char *network_device0, void *server_endpoint, const char *host, uint16_t port, uint8_t server_endpoint_size);  //  Register transport function
+    register_server,                 //  int (*register_server_func)(const char *network_device0, void *server_endpoint, const char *host, uint16_t port, uint8_t server_endpoint_size);  //  Register another server
+    0,                               //  int encoding; Default encoding for CoAP Server
+    ESP8266_MAX_PAYLOAD,             //  uint16_t mtu; Largest payload that fits into the TX Buffer
+    MYNEWT_VAL(ESP8266_COST),        //  uint8_t cost; Cost of sending a message
 };
 
 /////////////////////////////////////////////////////////
@@ -112,6 +117,13 @@ static int register_transport(const char *network_device, void *server_endpoint,
     return rc;
 }
 
+static int register_server(const char *network_device, void *server_endpoint, const char *host, uint16_t port, uint8_t server_endpoint_size) {
+    //  Called by Sensor Network Interface to register another CoAP server, after registering the transport.
+    assert(server_endpoint_size >= sizeof(struct esp8266_server));  //  Server Endpoint too small
+    int rc = esp8266_register_server((struct esp8266_server *) server_endpoint, host, port);
+    return rc;
+}
+
 /////////////////////////////////////////////////////////
 //  ESP8266 Driver Interface based on https://os.mbed.com/teams/ESP8266/code/esp8266-driver/file/6946b0b9e323/ESP8266Interface.cpp/
 
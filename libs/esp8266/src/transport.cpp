@@ -17,10 +17,13 @@ static void oc_shutdown(void);
 //  static void oc_event(struct os_event *ev);
 
 static const char *network_device;     //  Name of the ESP8266 device that will be used for transmitting CoAP messages e.g. "esp8266_0" 
-static struct esp8266_server *server;  //  CoAP Server host and port.  We only support 1 server.
-static void *socket;                   //  Reusable UDP socket connection to the CoAP server.  Never closed.
+static struct esp8266_server *servers[ESP8266_SOCKET_COUNT];  //  CoAP Server host and port for each socket.  First server is registered by esp8266_register_transport().
+static void *sockets[ESP8266_SOCKET_COUNT];  //  Reusable UDP socket connection to each CoAP server.  Never closed.
+static uint8_t server_count;           //  Number of CoAP servers registered.
 static uint8_t transport_id = -1;      //  Will contain the Transport ID allocated by Mynewt OIC.
 
+static int open_server_socket(struct esp8266 *dev, struct esp8266_server *server0);
+
 //  Definition of ESP8266 driver as a transport for CoAP.  Only 1 ESP8266 driver instance supported.
 static const struct oc_transport transport = {
     0,               //  uint8_t ot_flags;
@@ -57,18 +60,12 @@ int esp8266_register_transport(const char *network_device0, struct esp8266_serve
         rc = esp8266_connect(dev, NULL, NULL);  
         assert(rc == 0);
 
-        //  Allocate a new UDP socket for the CoAP server.  The socket will be always connected to the server and cannot be changed or closed.
-        rc = esp8266_socket_open(dev, &socket, NSAPI_UDP);
-        assert(rc == 0);
-
-        //  Connect the socket to the UDP address and port.  Command looks like: AT+CIPSTART=0,"UDP","coap.thethings.io",5683
-        //  The CoAP UDP message will be transmitted at the next call to oc_tx_ucast().
-        rc = esp8266_socket_connect(dev, socket, server0->endpoint.host, server0->endpoint.port);
+        //  Open the UDP socket for the CoAP server.
+        rc = open_server_socket(dev, server0);
         assert(rc == 0);
 
         //  ESP8266 registered.  Remember the details.
         network_device = network_device0;
-        server = server0;
 
         //  Close the ESP8266 device when we are done.
         os_dev_close((struct os_dev *) dev);
@@ -77,6 +74,48 @@ int esp8266_register_transport(const char *network_device0, struct esp8266_serve
     return 0;
 }
 
+int esp8266_register_server(struct esp8266_server *server0, const char *host, uint16_t port) {
+    //  Register another CoAP server for the ESP8266 transport, e.g. a local historian that receives a copy of each
+    //  message.  Must be called after esp8266_register_transport().  Each server uses one of the ESP8266_SOCKET_COUNT
+    //  sockets.  Return 0 if successful.
+    assert(server0);  assert(host);  assert(network_device);  //  Transport must be registered first.
+    if (server_count >= ESP8266_SOCKET_COUNT) { return -1; }  //  No more sockets.
+    int rc;
+
+    {   //  Lock the ESP8266 driver for exclusive use.  Find the ESP8266 device by name.
+        struct esp8266 *dev = (struct esp8266 *) os_dev_open(network_device, OS_TIMEOUT_NEVER, NULL);
+        assert(dev != NULL);
+
+        //  Init the server endpoint and open the UDP socket for the CoAP server.
+        rc = init_esp8266_server(server0, host, port);
+        assert(rc == 0);
+        rc = open_server_socket(dev, server0);
+
+        //  Close the ESP8266 device when we are done.
+        os_dev_close((struct os_dev *) dev);
+        //  Unlock the ESP8266 driver for exclusive use.
+    }
+    return rc;
+}
+
+static int open_server_socket(struct esp8266 *dev, struct esp8266_server *server0) {
+    //  Open a UDP socket for the CoAP server and remember the server.  The socket will be always connected to the
+    //  server and cannot be changed or closed.  Return 0 if successful.
+    void *socket = NULL;
+    assert(server_count < ESP8266_SOCKET_COUNT);
+    int rc = esp8266_socket_open(dev, &socket, NSAPI_UDP);
+    if (rc != 0) { return rc; }
+
+    //  Connect the socket to the UDP address and port.  Command looks like: AT+CIPSTART=0,"UDP","coap.thethings.io",5683
+    //  The CoAP UDP message will be transmitted at the next call to oc_tx_ucast().
+    rc = esp8266_socket_connect(dev, socket, server0->endpoint.host, server0->endpoint.port);
+    if (rc != 0) { esp8266_socket_close(dev, socket);  return rc; }
+    servers[server_count] = server0;
+    sockets[server_count] = socket;
+    server_count++;
+    return 0;
+}
+
 int init_esp8266_server(struct esp8266_server *server, const char *host, uint16_t port) {
     //  Init the server endpoint before use.  Returns 0.
     int rc = init_esp8266_endpoint(&server->endpoint, host, port);  assert(rc == 0);
@@ -107,9 +146,16 @@ static void oc_tx_ucast(struct os_mbuf *m) {
     struct esp8266_endpoint *endpoint = (struct esp8266_endpoint *) OC_MBUF_ENDPOINT(m);
 
     assert(endpoint);  assert(endpoint->host);  assert(endpoint->port);  //  Host and endpoint should be in the endpoint.
-    assert(server);  assert(endpoint->host == server->endpoint.host);  assert(endpoint->port == server->endpoint.port);  //  We only support 1 server connection. Must match the message endpoint.
-    assert(network_device);  assert(socket);
-    int rc;
+    assert(network_device);  assert(server_count > 0);
+    int rc, i;
+
+    //  Find the socket connected to the server in the message endpoint.
+    void *socket = NULL;
+    for (i = 0; i < server_count; i++) {
+        if (endpoint->host == servers[i]->endpoint.host && endpoint->port == servers[i]->endpoint.port) { socket = sockets[i];  break; }
+    }
+    assert(socket);  //  Server not registered.
+    if (!socket) { os_mbuf_free_chain(m);  return; }
 
     {   //  Lock the ESP8266 driver for exclusive use.  Find the ESP8266 device by name.
         struct esp8266 *dev = (struct esp8266 *) os_dev_open(network_device, OS_TIMEOUT_NEVER, NULL);  //  ESP8266_DEVICE is "esp8266_0"
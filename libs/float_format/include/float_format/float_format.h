@@ -0,0 +1,22 @@
+//  Format floats as decimal strings with integer arithmetic, without printf.
+#ifndef __FLOAT_FORMAT_H__
+#define __FLOAT_FORMAT_H__
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {  //  Expose the types and functions below to C functions.
+#endif
+
+#define FLOAT_FORMAT_MAX_DECIMALS 4   //  Max number of decimal places
+#define FLOAT_FORMAT_SIZE         17  //  Size of the output buffer: Sign, 10 integer digits, decimal point, 4 decimal places and terminating null
+
+//  Format the float f into buf with the number of decimal places (0 to FLOAT_FORMAT_MAX_DECIMALS), rounding half up
+//  i.e. away from zero.  buf must have FLOAT_FORMAT_SIZE bytes.  Return the number of chars written, excluding the
+//  terminating null.  Return -1 if f is not a number or too large for 32-bit integers.
+int float_format(float f, int decimals, char *buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  //  __FLOAT_FORMAT_H__
@@ -0,0 +1,82 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+//  Format floats as decimal strings without printf and without floating-point multiplies.  The integer part and
+//  the fraction are converted to digits with integer arithmetic.  The fraction is scaled exactly from its mantissa
+//  and exponent, so the last decimal place is rounded from the exact remainder: 0.005f is really 0.00499999989,
+//  so it becomes "0.00".  A single float multiply could round the scaled fraction up to the tie first.
+#include <os/mynewt.h>
+#include "float_format/float_format.h"
+
+//  10 to the power of the decimal places.
+static const uint16_t scales[FLOAT_FORMAT_MAX_DECIMALS + 1] = { 1, 10, 100, 1000, 10000 };
+
+static uint32_t scale_fraction(float frac, int decimals);
+
+int float_format(float f, int decimals, char *buf) {
+    //  Format the float f into buf with the number of decimal places (0 to FLOAT_FORMAT_MAX_DECIMALS), rounding half up
+    //  i.e. away from zero.  buf must have FLOAT_FORMAT_SIZE bytes.  Return the number of chars written, excluding the
+    //  terminating null.  Return -1 if f is not a number or too large for 32-bit integers.
+    assert(buf);  assert(decimals >= 0 && decimals <= FLOAT_FORMAT_MAX_DECIMALS);
+    bool neg = (f < 0.0f);                        //  True if f is negative
+    float f_abs = neg ? -f : f;                   //  Absolute value of f
+    if (!(f_abs < 4294967296.0f)) { buf[0] = 0; return -1; }  //  Not a number, infinity or too large.
+
+    uint32_t i = (uint32_t) f_abs;                //  Integer part, truncated
+    float frac = f_abs - (float) i;               //  Fraction part, always exact
+    uint32_t scale = scales[decimals];
+    uint32_t d = scale_fraction(frac, decimals);  //  Decimal part, rounded half up
+    if (d >= scale) { d -= scale; i++; }          //  Carry into the integer part e.g. 9.996 becomes 10.00
+
+    //  Write the sign.  Don't write "-0.00" for negative numbers that round to 0.
+    int len = 0;
+    if (neg && (i > 0 || d > 0)) { buf[len++] = '-'; }
+
+    //  Write the integer part in reverse, then flip it.
+    int start = len;
+    do { buf[len++] = '0' + (i % 10);  i /= 10; } while (i > 0);
+    int end = len - 1;
+    while (start < end) { char c = buf[start];  buf[start++] = buf[end];  buf[end--] = c; }
+
+    //  Write the decimal part with leading zeros.
+    if (decimals > 0) {
+        buf[len++] = '.';
+        int k;
+        for (k = len + decimals - 1; k >= len; k--) { buf[k] = '0' + (d % 10);  d /= 10; }
+        len += decimals;
+    }
+    buf[len] = 0;
+    return len;
+}
+
+static uint32_t scale_fraction(float frac, int decimals) {
+    //  Return the fraction (0 <= frac < 1) times 10 to the power of decimals, rounded half up.  The float is
+    //  mantissa * 2^-shift exactly, so we compute (2 * mantissa * 10^decimals + 2^shift) / 2^(shift + 1)
+    //  with 64-bit integers.  Nothing is lost, since the mantissa has 24 bits and 10^4 has 14 bits.
+    union { float f; uint32_t u; } bits;
+    bits.f = frac;
+    uint32_t exponent = (bits.u >> 23) & 0xff;
+    uint32_t mantissa = bits.u & 0x7fffff;
+    if (exponent > 0) { mantissa |= 0x800000; }  //  Implicit leading 1, except for denormals.
+    int shift = (exponent > 0) ? 150 - (int) exponent : 149;  //  frac < 1, so shift >= 24
+    //  If shift > 40, frac is below 2^-17, so the scaled fraction is below 10^4 / 2^17, which is less than a half.
+    if (mantissa == 0 || shift > 40) { return 0; }
+    uint64_t scaled = 2 * (uint64_t) mantissa * scales[decimals] + ((uint64_t) 1 << shift);
+    return (uint32_t) (scaled >> (shift + 1));
+}
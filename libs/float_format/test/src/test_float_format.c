@@ -0,0 +1,95 @@
+//  TODO: Use unit test convention
+//  Tests for the float formatter.  Run on the native BSP (targets/unittest) or on the Blue Pill.
+#include <stdio.h>
+#include <math.h>
+#include <os/os.h>
+#include <console/console.h>
+#include <float_format/float_format.h>
+
+void test_float_format(void);
+void test_float_format_bench(void);
+
+#define BENCH_FLOATS 100  //  Number of floats formatted by the benchmark.
+
+//  Expected results.  Halfway values that can't be represented exactly as floats are rounded by their actual value.
+static const struct {
+    float f;              //  Float to be formatted
+    int decimals;         //  Number of decimal places
+    const char *expected; //  Expected string, or NULL if float_format() should fail
+} cases[] = {
+    { 0.0f,          2, "0.00" },
+    { 12.34f,        2, "12.34" },
+    { -12.34f,       2, "-12.34" },
+    { 0.89f,         2, "0.89" },
+    { -0.89f,        2, "-0.89" },      //  Sign between -1 and 0
+    { 0.125f,        2, "0.13" },       //  Round half up
+    { -0.125f,       2, "-0.13" },      //  Round half away from zero
+    { 0.124f,        2, "0.12" },
+    { 0.005f,        2, "0.00" },       //  Near tie: 0.00499999989
+    { -0.005f,       2, "0.00" },
+    { 0.015f,        2, "0.01" },       //  Near tie: 0.0149999997
+    { 1.005f,        2, "1.00" },       //  Near tie: 1.00499999523
+    { 2.675f,        2, "2.67" },       //  Near tie: 2.67499995232
+    { 0.045f,        2, "0.05" },       //  Near tie above: 0.0450000018
+    { 0.00005f,      4, "0.0000" },     //  Near tie: 0.0000499999987
+    { 0.00000001f,   4, "0.0000" },     //  Tiny fraction
+    { 9.996f,        2, "10.00" },      //  Carry into integer part
+    { -9.996f,       2, "-10.00" },
+    { -0.001f,       2, "0.00" },       //  No "-0.00"
+    { 2.5f,          0, "3" },
+    { 2.4f,          0, "2" },
+    { -0.4f,         0, "0" },
+    { 0.05f,         1, "0.1" },
+    { 28.5f,         1, "28.5" },
+    { 3.14159f,      4, "3.1416" },
+    { 0.0001f,       4, "0.0001" },
+    { 1.99996f,      4, "2.0000" },
+    { 123456.0f,     3, "123456.000" },
+    { 4294967040.0f, 0, "4294967040" }, //  Largest float below 2^32
+    { 4294967296.0f, 2, NULL },         //  Too large
+    { -INFINITY,     2, NULL },
+    { NAN,           2, NULL },
+};
+
+void test_float_format(void) {
+    //  Check that every float in the table is formatted as expected.
+    char buf[FLOAT_FORMAT_SIZE];
+    int i;
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        int len = float_format(cases[i].f, cases[i].decimals, buf);
+        const char *expected = cases[i].expected;
+        console_printf("%s=%s\n", expected ? expected : "(fail)", len < 0 ? "(fail)" : buf);
+        if (expected == NULL) { assert(len < 0);  continue; }
+        assert(len == strlen(expected));
+        assert(strcmp(buf, expected) == 0);
+    }
+    console_flush();
+}
+
+static int sprintf_float(float f, char *buf) {
+    //  Previous formatter used by the JSON encoder and console_printfloat(): split_float() and sprintf(), 2 decimal places.
+    bool neg = (f < 0.0f);
+    float f_abs = neg ? -f : f;
+    int i = (int) f_abs;
+    int d = ((int) (100.0f * f_abs)) % 100;
+    return sprintf(buf, "%s%d.%02d", neg ? "-" : "", i, d);
+}
+
+void test_float_format_bench(void) {
+    //  Report the CPU time for formatting a float with 2 decimal places, with sprintf() versus float_format().
+    //  CPU time is measured in os_cputime ticks, which are CPU cycles when OS_CPUTIME_FREQ is set to the CPU clock.
+    static char buf[FLOAT_FORMAT_SIZE * 2];
+    uint32_t start, with_sprintf, with_format;
+    int i;
+    start = os_cputime_get32();
+    for (i = 0; i < BENCH_FLOATS; i++) { sprintf_float(-12.34f + i * 0.57f, buf); }
+    with_sprintf = os_cputime_get32() - start;
+
+    start = os_cputime_get32();
+    for (i = 0; i < BENCH_FLOATS; i++) { float_format(-12.34f + i * 0.57f, 2, buf); }
+    with_format = os_cputime_get32() - start;
+
+    console_printf("float: sprintf %u ticks, float_format %u ticks\n",
+        (unsigned) (with_sprintf / BENCH_FLOATS), (unsigned) (with_format / BENCH_FLOATS));
+    console_flush();
+}
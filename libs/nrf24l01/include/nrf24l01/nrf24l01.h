@@ -90,6 +90,13 @@ int nrf24l01_send(struct nrf24l01 *dev, uint8_t *buf, uint8_t size);
 //  Receive data from the pipe.
 int nrf24l01_receive(struct nrf24l01 *dev, int pipe, uint8_t *buf, uint8_t size);
 
+//  Set the address for transmitting.  Return 0 if successful.
+int nrf24l01_set_tx_address(struct nrf24l01 *dev, unsigned long long address);
+
+//  For Sensor Node: Listen on pipe 1 with the address for up to timeout_ms and receive the data.  Restore the
+//  pipe 1 address and transmit mode after.  Return the number of bytes received, or 0 if none.
+int nrf24l01_receive_wait(struct nrf24l01 *dev, unsigned long long address, uint8_t *buf, uint8_t size, uint32_t timeout_ms);
+
 //  Return the pipe number that has received data.  -1 if no data received.
 int nrf24l01_readable_pipe(struct nrf24l01 *dev);
 
@@ -114,6 +121,13 @@ int nrf24l01_flush_rx(struct nrf24l01 *dev);
 //  Flush the transmit and receive buffers.  Return 0 if successful.
 int nrf24l01_flush_txrx(struct nrf24l01 *dev);
 
+#if MYNEWT_VAL(SENSOR_NETWORK_RELAY)  //  If Sensor Nodes may relay frames...
+struct sensor_network_relay_stats;
+
+//  For Relay Node: Copy the relay statistics into stats.  Return 0 if successful.
+int nrf24l01_relay_stats(struct sensor_network_relay_stats *stats);
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_RELAY)
+
 #ifdef __cplusplus
 }
 #endif
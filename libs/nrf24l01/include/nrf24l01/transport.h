@@ -5,6 +5,10 @@
 #define __NRF24L01_TRANSPORT_H__
 
 #include <oic/port/oc_connectivity.h>
+#include <sensor_network/sensor_network.h>
+
+//  Largest CoAP Payload that fits into a frame, before the sequence number, node ID and hop count at the end.
+#define NRF24L01_MAX_PAYLOAD (MYNEWT_VAL(NRF24L01_TX_SIZE) - SENSOR_NETWORK_FRAME_TRAILER)
 
 #ifdef __cplusplus
 extern "C" {  //  Expose the types and functions below to C functions.
@@ -36,6 +40,11 @@ int init_nrf24l01_endpoint(struct nrf24l01_endpoint *endpoint, const char *host,
 //  Init the server endpoint before use.  Returns 0.
 int init_nrf24l01_server(struct nrf24l01_server *server, const char *host, uint16_t port);        
 
+//  Copy the CoAP Payload of the mbuf chain (CoAP Header and Payload) into frame, which has NRF24L01_TX_SIZE bytes,
+//  followed by the node ID (if sent in-frame) and the sequence number.  Return NRF24L01_TX_SIZE, or 0 if there is
+//  no payload or the payload is longer than NRF24L01_MAX_PAYLOAD.
+int nrf24l01_compose_frame(struct os_mbuf *mbuf, uint8_t seq, uint8_t *frame);
+
 #ifdef __cplusplus
 }
 #endif
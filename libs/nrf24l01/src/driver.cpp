@@ -23,6 +23,11 @@ static nRF24L01P controller;    //  The single controller instance.  TODO: Suppo
 static bool first_open = true;  //  True if this is the first time opening the driver.
 static unsigned long long sensor_node_address = 0;  //  Address of this node, if this is a Sensor Node.
 static struct os_event nrf24l01_event;  //  Event that will be forwarded to the Event Queue when a receive interrupt is triggered.
+#if MYNEWT_VAL(SENSOR_NETWORK_RELAY)  //  If Sensor Nodes may relay frames...
+static struct sensor_network_relay relay;  //  Forwarding state of this Relay Node
+static struct os_callout relay_callout;    //  Polls the pipes every SENSOR_NETWORK_RELAY_POLL milliseconds
+static void relay_poll(struct os_event *ev);
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_RELAY)
 
 //  Definition of nRF24L01 Sensor Network Interface
 static const struct sensor_network_interface network_iface = {
@@ -30,6 +35,10 @@ static const struct sensor_network_interface network_iface = {
     NRF24L01_DEVICE,                 //  const char *network_device; Network device name.  Must be a static string.
     sizeof(struct nrf24l01_server),  //  uint8_t server_endpoint_size; Server Endpoint size
     register_transport,              //  int (*register_transport_func)(const char *network_device0, void *server_endpoint, const char *host, uint16_t port, uint8_t server_endpoint_size);  //  Register transport function
+    NULL,                            //  int (*register_server_func)(...);  Collector has only 1 server.
+    0,                               //  int encoding; Default encoding for CoAP Collector
+    NRF24L01_MAX_PAYLOAD,  //  uint16_t mtu; Largest payload in a frame, see nrf24l01_compose_frame()
+    MYNEWT_VAL(NRF24L01_COST),       //  uint8_t cost; Cost of sending a message
 };
 
 /////////////////////////////////////////////////////////
@@ -68,8 +77,8 @@ static int nrf24l01_open(struct os_dev *dev0, uint32_t timeout, void *arg) {
     //  Power up after setting config.
     drv(dev)->powerUp();
     //  Start listening or transmitting.
-    if (is_collector_node()) {
-        //  For Collector Node: Start listening.
+    if (is_collector_node() || is_relay_node()) {
+        //  For Collector Node and Relay Node: Start listening.
         drv(dev)->setReceiveMode(); 
     } else {
         //  For Sensor Node: Start transmitting.
@@ -140,6 +149,16 @@ int nrf24l01_init(struct os_dev *dev0, void *arg) {
     rc = sensor_network_register_interface(&network_iface);
     assert(rc == 0);
 
+#if MYNEWT_VAL(SENSOR_NETWORK_RELAY)  //  If Sensor Nodes may relay frames...
+    //  For Relay Node: Start polling the pipes for frames to be forwarded.
+    if (is_relay_node()) {
+        sensor_network_relay_init(&relay, sensor_network_node.id);
+        os_callout_init(&relay_callout, os_eventq_dflt_get(), relay_poll, NULL);
+        rc = os_callout_reset(&relay_callout, os_time_ms_to_ticks32(MYNEWT_VAL(SENSOR_NETWORK_RELAY_POLL)));
+        assert(rc == 0);
+    }
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_RELAY)
+
     return (OS_OK);
 err:
     return rc;
@@ -179,11 +198,16 @@ int nrf24l01_default_cfg(struct nrf24l01_cfg *cfg) {
         cfg->irq_pin            = MYNEWT_VAL(NRF24L01_IRQ_PIN); //  e.g. MCU_GPIO_PORTA(15) means Collector Node gets rx interrupts on PA15
         cfg->tx_address         = get_collector_node_address(); //  Collector Node address
         cfg->rx_addresses       = get_sensor_node_addresses();  //  Listen to all Sensor Nodes
-        cfg->rx_addresses_len   = SENSOR_NETWORK_SIZE;    //  Number of Sensor Nodes to listen
+        cfg->rx_addresses_len   = SENSOR_NETWORK_PIPES;   //  Number of pipes to listen.  Sensor Nodes 6 onwards share the pipes.
+    } else if (is_relay_node()) {                         //  If this is a Relay Node...
+        cfg->irq_pin            = MCU_GPIO_PIN_NONE;      //  Disable rx interrupts.  We poll the pipes.
+        cfg->tx_address         = get_sensor_node_address();    //  Sensor Node address, which is the address of its pipe
+        cfg->rx_addresses       = get_sensor_node_addresses();  //  Listen to all Sensor Nodes, like the Collector Node
+        cfg->rx_addresses_len   = SENSOR_NETWORK_PIPES;
     } else {                                              //  If this is a Sensor Node...
         sensor_node_address = get_sensor_node_address();
         cfg->irq_pin            = MCU_GPIO_PIN_NONE;      //  Disable rx interrupts for Sensor Nodes
-        cfg->tx_address         = sensor_node_address;    //  Sensor Node address
+        cfg->tx_address         = sensor_node_address;    //  Sensor Node address, which is the address of its pipe
         cfg->rx_addresses       = &sensor_node_address;   //  Listen to itself only. For handling acknowledgements in future
         cfg->rx_addresses_len   = 1;
     }
@@ -233,6 +257,33 @@ int nrf24l01_receive(struct nrf24l01 *dev, int pipe, uint8_t *buf, uint8_t size)
     return rc;
 }
 
+int nrf24l01_set_tx_address(struct nrf24l01 *dev, unsigned long long address) {
+    //  Set the address for transmitting.  Return 0 if successful.
+    assert(dev);  assert(address);
+    dev->cfg.tx_address = address;
+    drv(dev)->setTxAddress(address);
+    return 0;
+}
+
+int nrf24l01_receive_wait(struct nrf24l01 *dev, unsigned long long address, uint8_t *buf, uint8_t size, uint32_t timeout_ms) {
+    //  For Sensor Node: Listen on pipe 1 with the address for up to timeout_ms and receive the data.  Restore the
+    //  pipe 1 address and transmit mode after.  Return the number of bytes received, or 0 if none.
+    assert(dev);  assert(address);  assert(buf);  assert(size > 0);
+    int rc = 0;
+    drv(dev)->setRxAddress(address, DEFAULT_NRF24L01P_ADDRESS_WIDTH, NRF24L01P_PIPE_P1);
+    drv(dev)->setReceiveMode();
+    drv(dev)->enable();  //  Set CE Pin to high to start listening.
+    os_time_t end = os_time_get() + os_time_ms_to_ticks32(timeout_ms);
+    while (OS_TIME_TICK_LT(os_time_get(), end)) {
+        if (drv(dev)->readablePipe() == NRF24L01P_PIPE_P1) { rc = drv(dev)->read(NRF24L01P_PIPE_P1, (char *) buf, size);  break; }
+        os_time_delay(1);
+    }
+    //  Restore the pipe 1 address and transmit mode.
+    if (dev->cfg.rx_addresses_len > 0) { drv(dev)->setRxAddress(dev->cfg.rx_addresses[0], DEFAULT_NRF24L01P_ADDRESS_WIDTH, NRF24L01P_PIPE_P1); }
+    drv(dev)->setTransmitMode();
+    return (rc > 0) ? rc : 0;
+}
+
 int nrf24l01_readable_pipe(struct nrf24l01 *dev) {
     //  Return the pipe number that has received data.  -1 if no data received.
     assert(dev);
@@ -264,6 +315,40 @@ static void nrf24l01_irq_handler(void *arg) {
 	os_eventq_put(os_eventq_dflt_get(), &nrf24l01_event);  //  This triggers the callback function.
 }
 
+#if MYNEWT_VAL(SENSOR_NETWORK_RELAY)  //  If Sensor Nodes may relay frames...
+static void relay_poll(struct os_event *ev) {
+    //  For Relay Node: Queue the frames heard on the pipes, then forward them toward the Collector Node from our pipe.
+    uint8_t frame[MYNEWT_VAL(NRF24L01_TX_SIZE)];
+    {   //  Lock the nRF24L01 driver for exclusive use.
+        struct nrf24l01 *dev = (struct nrf24l01 *) os_dev_open(NRF24L01_DEVICE, OS_TIMEOUT_NEVER, NULL);
+        assert(dev != NULL);
+        for (int i = 0; i < NRL24L01_MAX_RX_PIPES * 2; i++) {
+            //  For safety, stop after 10 frames.  The rest will be received at the next poll.
+            int pipe = nrf24l01_readable_pipe(dev);
+            if (pipe <= 0) { break; }
+            int size = nrf24l01_receive(dev, pipe, frame, sizeof(frame));
+            sensor_network_relay_receive(&relay, frame, size);
+        }
+        int size;
+        while ((size = sensor_network_relay_next(&relay, frame, sizeof(frame))) > 0) { nrf24l01_send(dev, frame, size); }
+        os_dev_close((struct os_dev *) dev);
+    }   //  Unlock the nRF24L01 driver for exclusive use.
+    int rc = os_callout_reset(&relay_callout, os_time_ms_to_ticks32(MYNEWT_VAL(SENSOR_NETWORK_RELAY_POLL)));
+    assert(rc == 0);
+}
+
+int nrf24l01_relay_stats(struct sensor_network_relay_stats *stats) {
+    //  For Relay Node: Copy the relay statistics into stats.  Return 0 if successful.
+    assert(stats);
+    if (!is_relay_node()) { return SYS_EINVAL; }
+    os_sr_t sr;
+    OS_ENTER_CRITICAL(sr);
+    memcpy(stats, &relay.stats, sizeof(struct sensor_network_relay_stats));
+    OS_EXIT_CRITICAL(sr);
+    return 0;
+}
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_RELAY)
+
 static void default_callback(struct os_event *ev) {
     //  Default receive callback that does nothing.
     console_printf("%sno callback\n", _nrf);
@@ -8,6 +8,10 @@
 #include "nrf24l01/transport.h"
 #include "util.h"
 
+#if MYNEWT_VAL(SENSOR_NETWORK_JOIN) && MYNEWT_VAL(NRF24L01_TX_SIZE) < SENSOR_NETWORK_JOIN_SIZE
+#error SENSOR_NETWORK_JOIN requires NRF24L01_TX_SIZE of at least 11
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_JOIN) && MYNEWT_VAL(NRF24L01_TX_SIZE) < SENSOR_NETWORK_JOIN_SIZE
+
 static void oc_tx_ucast(struct os_mbuf *m);
 static uint8_t oc_ep_size(const struct oc_endpoint *oe);
 static int oc_ep_has_conn(const struct oc_endpoint *);
@@ -86,48 +90,109 @@ int init_nrf24l01_endpoint(struct nrf24l01_endpoint *endpoint, const char *host,
 ///////////////////////////////////////////////////////////////////////////////
 //  OIC Callback Functions
 
+static int coap_payload_offset(struct os_mbuf *m) {
+    //  Return the offset of the CoAP Payload in the mbuf chain, after the CoAP Header and payload marker.
+    //  The header and payload may be in the same mbuf or in different mbufs.  Return -1 if there is no payload.
+    uint8_t b;
+    int len = OS_MBUF_PKTLEN(m);
+    if (os_mbuf_copydata(m, 0, 1, &b)) { return -1; }
+    int offset = 4 + (b & 0x0f);  //  Skip the fixed header and token.
+    while (offset < len) {
+        if (os_mbuf_copydata(m, offset++, 1, &b)) { return -1; }
+        if (b == 0xff) { return offset; }  //  Found the payload marker.
+        //  Skip the option.  Delta and length are 4-bit nibbles, extended by 1 byte (13) or 2 bytes (14).
+        int delta = b >> 4, size = b & 0x0f;
+        uint8_t ext[2];
+        if (delta == 13) { offset += 1; } else if (delta == 14) { offset += 2; }
+        if (size == 13 || size == 14) {
+            if (os_mbuf_copydata(m, offset, size - 12, ext)) { return -1; }
+            size = (size == 13) ? ext[0] + 13 : ((ext[0] << 8) | ext[1]) + 269;
+            offset += (b & 0x0f) - 12;
+        }
+        offset += size;
+    }
+    return -1;
+}
+
 static int nrf24l01_tx_mbuf(struct nrf24l01 *dev, struct os_mbuf *mbuf) {
     //  Transmit the mbuf chain: CoAP Payload only, not the CoAP Header.  Return the number of bytes transmitted.
-    //  First mbuf is CoAP Header, skip it.  Transmit the second mbuf with the CoAP Payload.
-    int rc = 0;
-    struct os_mbuf *m = mbuf;
-    int mbuf_num = 0;
-    while (m) {  //  For each mbuf in the list...
-        const char *data = OS_MBUF_DATA(m, const char *);  //  Fetch the data.
-        int size = m->om_len;  //  Fetch the size.
-        console_printf("%s%s len %02d: ", _nrf, (mbuf_num == 0 ? "header" : "payload"), size);
-        console_dump((const uint8_t *) data, size); console_printf("\n");
-        if (mbuf_num == 1) {  //  If this is the second mbuf, i.e. the CoAP Payload, not the CoAP Header...
-            //  Transmit the mbuf.
-            assert(size > 0);
-            ////assert(size <= MYNEWT_VAL(NRF24L01_TX_SIZE));  //  mbuf too big to transmit
-            if (size <= 0 || size > MYNEWT_VAL(NRF24L01_TX_SIZE)) { rc = 0; break; }  //  Too small or too big, quit.
-
-            //  Zero the buffer.  Copy into the buffer.
-            memset(nrf24l01_tx_buffer, 0, MYNEWT_VAL(NRF24L01_TX_SIZE));
-            memcpy(nrf24l01_tx_buffer, data, size);
-
-            //  Set the tx counter in last byte.
-            static uint8_t tx_count = 0;  nrf24l01_tx_buffer[MYNEWT_VAL(NRF24L01_TX_SIZE) - 1] = tx_count++;
-
-            //  On Sensor Node: Transmit the data to Collector Node.
-            rc = nrf24l01_send(dev, nrf24l01_tx_buffer, MYNEWT_VAL(NRF24L01_TX_SIZE));
-            assert(rc != -1);
-            break;
-        }
-        mbuf_num++;
-        m = m->om_next.sle_next;   //  Fetch next mbuf in the list.
+    static uint8_t tx_count = 0;
+    int rc = nrf24l01_compose_frame(mbuf, tx_count, nrf24l01_tx_buffer);
+    if (rc > 0) {
+        //  On Sensor Node: Transmit the data to Collector Node.
+        tx_count++;
+        rc = nrf24l01_send(dev, nrf24l01_tx_buffer, MYNEWT_VAL(NRF24L01_TX_SIZE));
+        assert(rc != -1);
     }
     console_flush();
     return rc;
 }
 
-/* mbuf should contain:
+int nrf24l01_compose_frame(struct os_mbuf *mbuf, uint8_t seq, uint8_t *frame) {
+    //  Copy the CoAP Payload of the mbuf chain (CoAP Header and Payload) into frame, which has NRF24L01_TX_SIZE bytes,
+    //  followed by the node ID (if sent in-frame) and the sequence number.  Return NRF24L01_TX_SIZE, or 0 if there is
+    //  no payload or the payload is longer than NRF24L01_MAX_PAYLOAD.
+    //  We parse the CoAP Header to find the payload, so the payload may start in any mbuf of the chain.
+    assert(mbuf);  assert(frame);
+    int offset = coap_payload_offset(mbuf);
+    int size = OS_MBUF_PKTLEN(mbuf) - offset;
+    console_printf("%sheader len %02d, payload len %02d: ", _nrf, offset, size);
+    //  The payload must end before the trailer, else the node ID or hop count would overwrite its last bytes.
+    if (offset <= 0 || size <= 0 || size > NRF24L01_MAX_PAYLOAD) { console_printf("\n");  return 0; }  //  No payload, too small or too big, quit.
+
+    //  Zero the buffer.  Copy the payload into the buffer.
+    memset(frame, 0, MYNEWT_VAL(NRF24L01_TX_SIZE));
+    int rc = os_mbuf_copydata(mbuf, offset, size, frame);  assert(rc == 0);
+    console_dump(frame, size); console_printf("\n");
+
+    //  Set the tx counter in last byte.
+    frame[MYNEWT_VAL(NRF24L01_TX_SIZE) - 1] = seq;
+#if SENSOR_NETWORK_FRAME_NODE_ID  //  If the node ID is sent in-frame...
+    //  Set the node ID in the byte before, so that the Collector Node can identify this node.
+    frame[MYNEWT_VAL(NRF24L01_TX_SIZE) - 2] = sensor_network_node.id;
+#endif  //  SENSOR_NETWORK_FRAME_NODE_ID
+    return MYNEWT_VAL(NRF24L01_TX_SIZE);
+}
+
+#if MYNEWT_VAL(SENSOR_NETWORK_JOIN)  //  If Sensor Nodes may join over the air...
+static struct nrf24l01 *join_dev;  //  nRF24L01 device that is joining.  Locked by oc_tx_ucast().
+
+static int join_send(unsigned long long address, const uint8_t *frame, int size) {
+    //  Send the Join Request to the Collector Node.  Return 0 if successful.
+    assert(join_dev);  assert(size <= MYNEWT_VAL(NRF24L01_TX_SIZE));
+    uint8_t buf[MYNEWT_VAL(NRF24L01_TX_SIZE)];
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, frame, size);
+    int rc = nrf24l01_set_tx_address(join_dev, address);  assert(rc == 0);
+    rc = nrf24l01_send(join_dev, buf, sizeof(buf));
+    return (rc == (int) sizeof(buf)) ? 0 : -1;
+}
+
+static int join_receive(unsigned long long address, uint8_t *frame, int size, uint32_t timeout_ms) {
+    //  Wait for the reply from the Collector Node.  Return the frame size, or 0 if none.
+    assert(join_dev);  assert(size >= MYNEWT_VAL(NRF24L01_TX_SIZE));
+    return nrf24l01_receive_wait(join_dev, address, frame, MYNEWT_VAL(NRF24L01_TX_SIZE), timeout_ms);
+}
+
+static const struct sensor_network_join_radio join_radio = { join_send, join_receive };
+
+static int join_network(struct nrf24l01 *dev) {
+    //  Join the Collector Node and transmit to the address of the assigned pipe from now on.  Return 0 if joined.
+    join_dev = dev;
+    int rc = sensor_network_join(get_hardware_id(), &join_radio, &sensor_network_node);
+    join_dev = NULL;
+    int rc2 = nrf24l01_set_tx_address(dev, sensor_network_node.address);  assert(rc2 == 0);
+    if (rc == 0) { console_printf("%sjoined as node #%d\n", _nrf, sensor_network_node.index + 1); }
+    return rc;
+}
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_JOIN)
+
+/* mbuf should contain the header followed by the payload, in one or more mbufs:
 Header:  58 02 00 01 00 00 16 4a 27 2a e2 39 b2 76 32 06 74 68 69 6e 67 73 0d 1e 49 56 52 69 42 43 63 52 36 48 50 70 5f 43 63 5a 49 46 66 4f 5a 46 78 7a 5f 69 7a 6e 69 35 78 63 5f 4b 4f 2d 6b 67 53 41 32 59 38 11 3c 51 3c ff 
 Payload: bf 61 74 19 06 be ff  */
 
 static void oc_tx_ucast(struct os_mbuf *m) {
-    //  Transmit the chain of mbufs to the network.  First mbuf is CoAP header, remaining mbufs contain the CoAP payload.
+    //  Transmit the chain of mbufs to the network.  The chain contains the CoAP header followed by the CoAP payload.
 
     //  Find the endpoint header.  Should be the end of the packet header of the first packet.
     assert(m);  assert(OS_MBUF_USRHDR_LEN(m) >= sizeof(struct nrf24l01_endpoint));
@@ -143,6 +208,16 @@ static void oc_tx_ucast(struct os_mbuf *m) {
         assert(dev != NULL);
         console_printf("%stx mbuf\n", _nrf);
 
+#if MYNEWT_VAL(SENSOR_NETWORK_JOIN)  //  If Sensor Nodes may join over the air...
+        //  If this Sensor Node has not joined, join now.  Drop the message if the Collector Node doesn't reply.
+        if (sensor_network_node.index < 0 && join_network(dev) != 0) {
+            console_printf("%sjoin failed\n", _nrf);
+            os_dev_close((struct os_dev *) dev);
+            rc = os_mbuf_free_chain(m);  assert(rc == 0);
+            return;
+        }
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_JOIN)
+
         //  Transmit the CoAP Payload only, not the CoAP Header.
         rc = nrf24l01_tx_mbuf(dev, m);  
         assert(rc > 0);
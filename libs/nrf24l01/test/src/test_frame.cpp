@@ -0,0 +1,58 @@
+//  TODO: Use unit test convention
+//  Tests for the nRF24L01 frame layout.  Run on the native BSP (targets/unittest), also with SENSOR_NETWORK_NODES
+//  above 5 and with SENSOR_NETWORK_RELAY, which add the node ID and hop count to the frame trailer.  A CBOR payload
+//  of exactly NRF24L01_MAX_PAYLOAD bytes must reach the Collector Node intact, including the final 0xff break.
+#include <assert.h>
+#include <string.h>
+#include <os/os.h>
+#include <console/console.h>
+#include <sensor_network/sensor_network.h>
+#include "nrf24l01/nrf24l01.h"
+#include "nrf24l01/transport.h"
+
+extern "C" void test_frame(void);
+
+static struct os_mbuf *coap_message(int payload_size, uint8_t *payload) {
+    //  Return a CoAP message with a CBOR payload of payload_size bytes: {"t": "aaa..."}.  Copy the payload into payload.
+    static const uint8_t header[] = { 0x50, 0x02, 0x00, 0x01, 0xff };  //  NON POST, no token, no options, payload marker
+    assert(payload_size >= 6);
+    int text_len = payload_size - 5;  //  bf 61 74 60+len ... ff
+    int i = 0;
+    payload[i++] = 0xbf;  payload[i++] = 0x61;  payload[i++] = 't';
+    if (text_len > 23) { text_len--;  payload[i++] = 0x78;  payload[i++] = text_len; }
+    else { payload[i++] = 0x60 + text_len; }
+    memset(&payload[i], 'a', text_len);  i += text_len;
+    payload[i++] = 0xff;  assert(i == payload_size);
+
+    struct os_mbuf *m = os_msys_get_pkthdr(0, 0);  assert(m);
+    int rc = os_mbuf_append(m, header, sizeof(header));  assert(rc == 0);
+    rc = os_mbuf_append(m, payload, payload_size);  assert(rc == 0);
+    return m;
+}
+
+void test_frame(void) {
+    //  Compose a frame with the largest payload, as a Sensor Node would, and check that the Collector Node gets the
+    //  payload intact after erasing the trailer.  A payload 1 byte longer must be rejected.
+    uint8_t payload[MYNEWT_VAL(NRF24L01_TX_SIZE) + 1], frame[MYNEWT_VAL(NRF24L01_TX_SIZE)];
+    uint8_t id = sensor_network_node.id;
+    sensor_network_node.id = (uint8_t) get_sensor_node_addresses()[0];  //  Send as Sensor Node 1.
+
+    struct os_mbuf *m = coap_message(NRF24L01_MAX_PAYLOAD, payload);
+    int rc = nrf24l01_compose_frame(m, 7, frame);
+    assert(rc == MYNEWT_VAL(NRF24L01_TX_SIZE));
+    assert(memcmp(frame, payload, NRF24L01_MAX_PAYLOAD) == 0);
+    assert(frame[NRF24L01_MAX_PAYLOAD - 1] == 0xff);  //  CBOR break not overwritten by the trailer.
+    os_mbuf_free_chain(m);
+
+    //  The Collector Node erases the node ID and hop count, but not the payload.
+    sensor_network_frame_node(1, frame, sizeof(frame));
+    assert(memcmp(frame, payload, NRF24L01_MAX_PAYLOAD) == 0);
+
+    m = coap_message(NRF24L01_MAX_PAYLOAD + 1, payload);
+    rc = nrf24l01_compose_frame(m, 8, frame);
+    assert(rc == 0);  //  Too big.
+    os_mbuf_free_chain(m);
+
+    sensor_network_node.id = id;
+    console_printf("frame max payload %d bytes ok\n", NRF24L01_MAX_PAYLOAD);  console_flush();
+}
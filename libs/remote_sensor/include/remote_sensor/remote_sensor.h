@@ -87,6 +87,12 @@ int remote_sensor_config(struct remote_sensor *remote_sensor, struct remote_sens
 //  Return the Sensor Type given the CBOR field name.  Return 0 if not found.
 sensor_type_t remote_sensor_lookup_type(const char *name);
 
+//  Return the Sensor Type given the CBOR integer key, used when REMOTE_SENSOR_INT_KEYS is enabled.  Return 0 if not found.
+sensor_type_t remote_sensor_lookup_type_by_key(unsigned key);
+
+//  Return the CBOR integer key given the CBOR field name, e.g. "t" returns 1 for Remote Sensor Type #1.  Return 0 if not found.
+unsigned remote_sensor_lookup_key(const char *name);
+
 //  Start the router that receives CBOR messages from Sensor Nodes
 //  and triggers the Remote Sensor for the field names in the CBOR message. 
 //  The router is started only for Collector Node.  Return 0 if successful.
@@ -38,7 +38,7 @@
 #define DEVICE_CREATE      remote_sensor_create  //  Device create function
 #define DEVICE_START       remote_sensor_start   //  Device start function, called after device creation
 #define DEVICE_ITF         itf_remote_sensor     //  Device interface
-#define DEVICE_COUNT       NRL24L01_MAX_RX_PIPES //  Number of instances
+#define DEVICE_COUNT       SENSOR_NETWORK_SIZE   //  Number of instances
 
 static struct DEVICE_DEV DEVICE_INSTANCE[DEVICE_COUNT];  //  Global instances of the device
 
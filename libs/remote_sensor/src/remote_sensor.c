@@ -94,6 +94,31 @@ sensor_type_t remote_sensor_lookup_type(const char *name) {
     return 0;
 }
 
+sensor_type_t remote_sensor_lookup_type_by_key(unsigned key) {
+    //  Return the Sensor Type given the CBOR integer key.  Return 0 if not found.
+    //  Sensor Types are normally configured without gaps, so Sensor Key n is at index n-1.  Else we search the list.
+    const unsigned count = sizeof(sensor_types) / sizeof(sensor_types[0]) - 1;  //  Exclude the terminator.
+    if (key > 0 && key <= count && sensor_types[key - 1].key == key) { return sensor_types[key - 1].type; }
+    const struct sensor_type_descriptor *st = sensor_types;
+    while (st->type) {
+        if (st->key == key) { return st->type; }
+        st++;
+    }
+    return 0;
+}
+
+unsigned remote_sensor_lookup_key(const char *name) {
+    //  Return the CBOR integer key given the CBOR field name.  Return 0 if not found.
+    assert(name);
+    const struct sensor_type_descriptor *st = sensor_types;
+    while (st->type) {
+        assert(st->name);
+        if (strcmp(name, st->name) == 0) { return st->key; }
+        st++;
+    }
+    return 0;
+}
+
 /////////////////////////////////////////////////////////
 //  Device Creation Functions
 
@@ -98,6 +98,7 @@ static void *save_temp_raw(sensor_data_union *data, oc_rep_t *r) {
 
 struct sensor_type_descriptor {  //  Describes a Sensor Type e.g. raw temperature sensor
     const char *name;  //  Sensor Name in CBOR Payload e.g. "t"
+    unsigned key;      //  Sensor Key in CBOR Payload when REMOTE_SENSOR_INT_KEYS is enabled, e.g. 1 for Remote Sensor Type #1
     int type;          //  Sensor Type e.g. SENSOR_TYPE_AMBIENT_TEMPERATURE_RAW
     int valtype;       //  Sensor Value Type e.g. SENSOR_VALUE_TYPE_INT32 (from Mynewt Sensor Framework)
     void *(*save_func)(union sensor_data_union *data, oc_rep_t *rep);  //  Save the sensor value from the oc_rep_t into data.
@@ -107,10 +108,11 @@ struct sensor_type_descriptor {  //  Describes a Sensor Type e.g. raw temperatur
 //  Supported Sensor Types: List of Sensor Types that Remote Sensor supports
 
 //  For temp_raw, the macro generates:
-//  { "t", SENSOR_TYPE_AMBIENT_TEMPERATURE_RAW, SENSOR_VALUE_TYPE_INT32, save_temp_raw }
-#define _SENSOR_TYPE_DESC(_name, _field, _type_upper2, _stype) \
+//  { "t", 1, SENSOR_TYPE_AMBIENT_TEMPERATURE_RAW, SENSOR_VALUE_TYPE_INT32, save_temp_raw }
+#define _SENSOR_TYPE_DESC(_name, _field, _key, _type_upper2, _stype) \
     { \
         _field, \
+        _key, \
         _SENSOR_TYPE(_stype), \
         _SENSOR_VALUE_TYPE(_type_upper2), \
         _SAVE(_name) \
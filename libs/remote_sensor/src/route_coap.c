@@ -21,6 +21,7 @@
 
 #define CBOR_IMPLEMENTATION  //  Define the TinyCBOR functions here.
 #include <tinycbor/cbor.h>
+#include <tinycbor/cbor_buf_reader.h>
 #include <assert.h>
 #include <os/os.h>
 #include <sensor/sensor.h>
@@ -34,8 +35,12 @@
 static void receive_callback(struct os_event *ev);
 static int process_coap_message(const char *name, uint8_t *data, uint8_t size0);
 static int decode_coap_payload(uint8_t *data, uint8_t size, oc_rep_t **out_rep);
+static int process_int_keys(const char *name, uint8_t *data, uint8_t size);
 
 static uint8_t rxData[MYNEWT_VAL(NRF24L01_TX_SIZE)];  //  Buffer for received data
+#if MYNEWT_VAL(SENSOR_NETWORK_JOIN)  //  If Sensor Nodes may join over the air...
+static uint8_t joinReply[MYNEWT_VAL(NRF24L01_TX_SIZE)];  //  Buffer for Join Accept and Join Reject
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_JOIN)
 static const char *_nrf = "NRF ";                     //  Prefix for log messages
 
 int remote_sensor_start(void) {
@@ -86,8 +91,20 @@ static void receive_callback(struct os_event *ev) {
                 //  Read the data into the receive buffer
                 rxDataCnt = nrf24l01_receive(dev, pipe, rxData, MYNEWT_VAL(NRF24L01_TX_SIZE));
                 assert(rxDataCnt > 0 && rxDataCnt <= MYNEWT_VAL(NRF24L01_TX_SIZE));
-                //  Get the rx (sender) address for the pipe.
-                name = sensor_node_names[pipe - 1];
+#if MYNEWT_VAL(SENSOR_NETWORK_JOIN)  //  If Sensor Nodes may join over the air...
+                if (sensor_network_is_join_frame(rxData, rxDataCnt)) {
+                    //  Reply to the Join Request at the join address, then restore the Collector Node address.
+                    if (sensor_network_join_process(rxData, rxDataCnt, joinReply) > 0) {
+                        int rc = nrf24l01_set_tx_address(dev, MYNEWT_VAL(SENSOR_NETWORK_JOIN_ADDRESS));  assert(rc == 0);
+                        nrf24l01_send(dev, joinReply, MYNEWT_VAL(NRF24L01_TX_SIZE));
+                        rc = nrf24l01_set_tx_address(dev, get_collector_node_address());  assert(rc == 0);
+                    }
+                    rxDataCnt = 0;  //  Not Sensor Data.
+                }
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_JOIN)
+                //  Get the rx (sender) address for the pipe, or for the node ID in the frame if the pipe is shared.
+                int node = (rxDataCnt > 0) ? sensor_network_frame_node(pipe, rxData, rxDataCnt) : -1;
+                if (node >= 0) { name = sensor_node_names[node]; }
             }
             //  Close the nRF24L01 device when we are done.
             os_dev_close((struct os_dev *) dev);
@@ -96,12 +113,13 @@ static void receive_callback(struct os_event *ev) {
         //  If no data available, quit.
         if (pipe <= 0) { break; }
 
-        //  Process the received data.
-        if (rxDataCnt > 0) { 
+        //  Process the received data.  Drop frames from unknown Sensor Nodes.
+        if (rxDataCnt > 0 && !name) { console_printf("%srx unknown node\n", _nrf); }
+        else if (rxDataCnt > 0) { 
             //  Display the receive buffer contents
             console_printf("%srx ", _nrf); console_dump((const uint8_t *) rxData, rxDataCnt); console_printf("\n"); 
             int rc = process_coap_message(name, rxData, rxDataCnt);  //  Process the incoming message and trigger the Remote Sensor.
-            assert(rc == 0);
+            if (rc) { console_printf("%srx malformed %d\n", _nrf, rc); }  //  Drop the malformed frame.
         }
     }
 }
@@ -118,6 +136,9 @@ static int process_coap_message(const char *name, uint8_t *data, uint8_t size0)
     data[size - 1] = 0;  //  Erase sequence number.
     while (size > 0 && data[size - 1] == 0) { size--; }  //  Discard trailing zeroes.
 
+#if MYNEWT_VAL(REMOTE_SENSOR_INT_KEYS)  //  If the payload contains {key1: val1, key2: val2, ...} with integer keys...
+    return process_int_keys(name, data, size);
+#else  //  If the payload contains {field1: val1, field2: val2, ...} with field names...
     //  Decode CoAP Payload (CBOR).
     oc_rep_t *rep = NULL;
     int rc = decode_coap_payload(data, size, &rep);
@@ -144,6 +165,71 @@ static int process_coap_message(const char *name, uint8_t *data, uint8_t size0)
     //  Free the decoded representation.
     oc_free_rep(first_rep);
     return 0;
+#endif  //  MYNEWT_VAL(REMOTE_SENSOR_INT_KEYS)
+}
+
+static int process_int_keys(const char *name, uint8_t *data, uint8_t size) {
+    //  Process the CoAP payload in "data" with integer keys: {key1: val1, key2: val2, ...} in CBOR format.
+    //  The key is the Remote Sensor Type number, so we look up the Sensor Type by array index.
+    //  The payload is decoded in place without allocating mbufs or oc_rep_t.  Keys and values that this node doesn't
+    //  know, e.g. from a Sensor Node with newer firmware, are skipped.  Return 0 if successful, or SYS_EINVAL if the
+    //  payload is malformed.
+    struct cbor_buf_reader reader;
+    CborParser parser;
+    CborValue root, it;
+    cbor_buf_reader_init(&reader, data, size);
+    CborError err = cbor_parser_init(&reader.r, 0, &parser, &root);
+    if (err || !cbor_value_is_map(&root)) { return SYS_EINVAL; }
+    err = cbor_value_enter_container(&root, &it);
+
+    //  Fetch the Remote Sensor by name.  "name" looks like "b3b4b5b6f1", the Sensor Node Address.
+    struct sensor *remote_sensor = sensor_mgr_find_next_bydevname(name, NULL);
+    assert(remote_sensor);  //  Sensor not found
+
+    //  For each key and value in the payload...
+    while (err == CborNoError && !cbor_value_at_end(&it)) {
+        //  Convert the key to sensor type, e.g. 1 -> SENSOR_TYPE_AMBIENT_TEMPERATURE_RAW
+        uint64_t key = 0;
+        if (!cbor_value_is_unsigned_integer(&it)) { return SYS_EINVAL; }
+        err |= cbor_value_get_uint64(&it, &key);
+        err |= cbor_value_advance_fixed(&it);
+        if (err) { break; }
+        sensor_type_t type = remote_sensor_lookup_type_by_key(key);
+        if (!type) {
+            //  Unknown key: Skip the value.
+            console_printf("%srx unknown key %u\n", _nrf, (unsigned) key);
+            err = cbor_value_advance(&it);
+            continue;
+        }
+
+        //  Convert the value to oc_rep_t, which is expected by the Remote Sensor.
+        oc_rep_t rep;
+        memset(&rep, 0, sizeof(rep));
+        if (cbor_value_is_integer(&it)) {
+            rep.type = INT;
+            err |= cbor_value_get_int64(&it, &rep.value_int);
+        } else if (cbor_value_is_double(&it)) {
+            rep.type = DOUBLE;
+            err |= cbor_value_get_double(&it, &rep.value_double);
+        } else if (cbor_value_is_float(&it)) {
+            float f = 0;
+            rep.type = DOUBLE;
+            err |= cbor_value_get_float(&it, &f);
+            rep.value_double = f;
+        } else {
+            //  Unknown value type: Skip the value.
+            console_printf("%srx unknown value for key %u\n", _nrf, (unsigned) key);
+            err = cbor_value_advance(&it);
+            continue;
+        }
+        err |= cbor_value_advance_fixed(&it);
+        if (err) { break; }
+
+        //  Send the read request to Remote Sensor.  This causes the sensor to be read and Listener Function to be called.
+        int rc = sensor_read(remote_sensor, type, NULL, &rep, 0);
+        assert(rc == 0);
+    }
+    return (err == CborNoError) ? 0 : SYS_EINVAL;
 }
 
 static int decode_coap_payload(uint8_t *data, uint8_t size, oc_rep_t **out_rep) {
@@ -33,12 +33,13 @@ static const struct sensor_type_descriptor sensor_types[] = {
 
 /////////////////////////////////////////////////////////
 //  Remote Sensor Type #1: Sensor Type Descriptor
-//  For temp_raw: { "t", SENSOR_TYPE_AMBIENT_TEMPERATURE_RAW, SENSOR_VALUE_TYPE_INT32, save_temp_raw }
+//  For temp_raw: { "t", 1, SENSOR_TYPE_AMBIENT_TEMPERATURE_RAW, SENSOR_VALUE_TYPE_INT32, save_temp_raw }
 
 #ifdef MYNEWT_VAL_REMOTE_SENSOR_TYPE_1__FIELD  //  If Remote Sensor Type #1 is configured...
     _SENSOR_TYPE_DESC(
         MYNEWT_VAL_CHOICE(REMOTE_SENSOR_TYPE_1, NAME), 
         MYNEWT_VAL_CHOICE(REMOTE_SENSOR_TYPE_1, FIELD), 
+        1,
         MYNEWT_VAL_CHOICE(REMOTE_SENSOR_TYPE_1, TYPE_UPPER2), 
         MYNEWT_VAL_CHOICE(REMOTE_SENSOR_TYPE_1, SENSOR_TYPE)
     ),
@@ -46,12 +47,13 @@ static const struct sensor_type_descriptor sensor_types[] = {
 
 /////////////////////////////////////////////////////////
 //  Remote Sensor Type #2: Sensor Type Descriptor
-//  For temp: { "tf", SENSOR_TYPE_AMBIENT_TEMPERATURE, SENSOR_VALUE_TYPE_FLOAT, save_temp },
+//  For temp: { "tf", 2, SENSOR_TYPE_AMBIENT_TEMPERATURE, SENSOR_VALUE_TYPE_FLOAT, save_temp },
 
 #ifdef MYNEWT_VAL_REMOTE_SENSOR_TYPE_2__FIELD  //  If Remote Sensor Type #2 is configured...
     _SENSOR_TYPE_DESC(
         MYNEWT_VAL_CHOICE(REMOTE_SENSOR_TYPE_2, NAME), 
         MYNEWT_VAL_CHOICE(REMOTE_SENSOR_TYPE_2, FIELD), 
+        2,
         MYNEWT_VAL_CHOICE(REMOTE_SENSOR_TYPE_2, TYPE_UPPER2), 
         MYNEWT_VAL_CHOICE(REMOTE_SENSOR_TYPE_2, SENSOR_TYPE)
     ),
@@ -59,12 +61,13 @@ static const struct sensor_type_descriptor sensor_types[] = {
 
 /////////////////////////////////////////////////////////
 //  Remote Sensor Type #3: Sensor Type Descriptor
-//  For press: { "p", SENSOR_TYPE_PRESSURE, SENSOR_VALUE_TYPE_FLOAT, save_press },
+//  For press: { "p", 3, SENSOR_TYPE_PRESSURE, SENSOR_VALUE_TYPE_FLOAT, save_press },
 
 #ifdef MYNEWT_VAL_REMOTE_SENSOR_TYPE_3__FIELD  //  If Remote Sensor Type #3 is configured...
     _SENSOR_TYPE_DESC(
         MYNEWT_VAL_CHOICE(REMOTE_SENSOR_TYPE_3, NAME), 
         MYNEWT_VAL_CHOICE(REMOTE_SENSOR_TYPE_3, FIELD), 
+        3,
         MYNEWT_VAL_CHOICE(REMOTE_SENSOR_TYPE_3, TYPE_UPPER2), 
         MYNEWT_VAL_CHOICE(REMOTE_SENSOR_TYPE_3, SENSOR_TYPE)
     ),
@@ -72,12 +75,13 @@ static const struct sensor_type_descriptor sensor_types[] = {
 
 /////////////////////////////////////////////////////////
 //  Remote Sensor Type #4: Sensor Type Descriptor
-//  For humid: { "h", SENSOR_TYPE_RELATIVE_HUMIDITY, SENSOR_VALUE_TYPE_FLOAT, save_humid },
+//  For humid: { "h", 4, SENSOR_TYPE_RELATIVE_HUMIDITY, SENSOR_VALUE_TYPE_FLOAT, save_humid },
 
 #ifdef MYNEWT_VAL_REMOTE_SENSOR_TYPE_4__FIELD  //  If Remote Sensor Type #4 is configured...
     _SENSOR_TYPE_DESC(
         MYNEWT_VAL_CHOICE(REMOTE_SENSOR_TYPE_4, NAME), 
         MYNEWT_VAL_CHOICE(REMOTE_SENSOR_TYPE_4, FIELD), 
+        4,
         MYNEWT_VAL_CHOICE(REMOTE_SENSOR_TYPE_4, TYPE_UPPER2), 
         MYNEWT_VAL_CHOICE(REMOTE_SENSOR_TYPE_4, SENSOR_TYPE)
     ),
@@ -90,7 +94,7 @@ static const struct sensor_type_descriptor sensor_types[] = {
     #error _SENSOR_TYPE_DESC() not defined for Remote Sensor Type 5
 #endif  //  MYNEWT_VAL_REMOTE_SENSOR_TYPE_5__FIELD
 
-    { NULL, 0, 0, NULL }  //  Ends with 0
+    { NULL, 0, 0, 0, NULL }  //  Ends with 0
 };
 
 #ifdef __cplusplus
@@ -22,6 +22,7 @@
 #if MYNEWT_VAL(CONSOLE_SEMIHOSTING)
 #include <os/os_mbuf.h>
 #include <ctype.h>
+#include <float_format/float_format.h>
 
 #include "console/console.h"
 #include "console_priv.h"
@@ -157,19 +158,12 @@ void console_printhex(uint8_t v) {
     console_buffer(buffer, strlen(buffer));
 }
 
-static void split_float(float f, bool *neg, int *i, int *d) {
-    //  Split the float f into 3 parts: neg is true if negative, the absolute integer part i, and the decimal part d, with 2 decimal places.
-    *neg = (f < 0.0f);                    //  True if f is negative
-    float f_abs = *neg ? -f : f;          //  Absolute value of f
-    *i = (int) f_abs;                     //  Integer part
-    *d = ((int) (100.0f * f_abs)) % 100;  //  Two decimal places
-}
-
 void console_printfloat(float f) {
     //  Write a float to the output buffer, with 2 decimal places.
-    bool neg; int i, d;
-    split_float(f, &neg, &i, &d);      //  Split the float into neg, integer and decimal parts to 2 decimal places
-    console_printf("%s%d.%02d", neg ? "-" : "", i, d);   //  Combine the sign, integer and decimal parts
+    char buf[FLOAT_FORMAT_SIZE];
+    int len = float_format(f, 2, buf);     //  Format the float without printf, rounded to 2 decimal places
+    if (len < 0) { console_buffer("?", 1);  return; }  //  Not a number or too large
+    console_buffer(buf, len);
 }
 
 void console_dump(const uint8_t *buffer, unsigned int len) {
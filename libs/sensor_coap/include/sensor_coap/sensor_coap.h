@@ -4,6 +4,15 @@
 #ifndef __SENSOR_COAP_H__
 #define __SENSOR_COAP_H__
 
+#include <os/mynewt.h>
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+#include <json/json.h>
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+#include <oic/oc_rep.h>             //  Import Mynewt's CBOR encoding functions.
+#include <tinycbor/cbor_mbuf_writer.h>
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+
 #ifdef __cplusplus
 extern "C" {  //  Expose the types and functions below to C functions.
 #endif
@@ -18,11 +27,98 @@ struct sensor_value {
     float       float_val;  //  For computed temp, contains the computed temp float value
 };
 
+///////////////////////////////////////////////////////////////////////////////
+//  Sensor CoAP Compose Context
+
+struct coap_packet;
+struct oc_server_handle;
+struct sensor_coap_header;
+struct sensor_coap_encoder;
+
+//  Payload layouts written by the CP_* macros and payload skeletons.  See sensor_coap_set_layout().
+#define SENSOR_COAP_LAYOUT_ITEMS 0  //  {"values": [{"key": "device","value": "0102..."},{"key": "t","value": 1715}]}
+#define SENSOR_COAP_LAYOUT_FLAT  1  //  {"device": "0102...","t": 1715}
+
+//  Transmit priorities for the messages.  See sensor_coap_set_priority().
+#define SENSOR_COAP_PRIORITY_ALERT  0  //  Alerts: Sent before all other messages.
+#define SENSOR_COAP_PRIORITY_NORMAL 1  //  Default e.g. single sensor readings.
+#define SENSOR_COAP_PRIORITY_BULK   2  //  Bulk messages e.g. batches: Sent after all other messages.
+#define SENSOR_COAP_PRIORITIES      3  //  Number of priorities.
+
+//  Function that transmits a serialised CoAP message, instead of coap_send_message().  Must free the mbuf chain.
+//  See sensor_coap_set_send_func().
+typedef void sensor_coap_send_func(struct os_mbuf *m, uint8_t priority);
+
+#define SENSOR_COAP_CBOR_DEPTH 3  //  Max nesting of CBOR maps and arrays in a payload: root object, array, array item.
+
+//  Another destination for a copy of the payload.  See sensor_coap_add_destination().
+struct sensor_coap_destination {
+    struct oc_server_handle *server;          //  Destination server.
+    const struct sensor_coap_header *header;  //  Cached header template for the server, URI and content format.
+};
+
+//  A compose context holds the mbufs, CoAP request and encoder state for one CoAP message
+//  being composed.  We keep a small pool of contexts (SENSOR_COAP_CONTEXTS in syscfg.yml) so that
+//  multiple tasks may compose messages at the same time.  Each task may hold only 1 context at a time.
+struct sensor_coap_context {
+    struct os_task *owner;         //  Task that is composing the message.  NULL if the context is free.
+    int content_format;            //  CoAP Payload encoding format: APPLICATION_JSON, APPLICATION_CBOR, APPLICATION_SENML_JSON or APPLICATION_SENML_CBOR
+    struct os_mbuf *message;       //  Contains the CoAP headers.  With a header template, also contains the payload after the reserved header space.
+    struct os_mbuf *payload;       //  Contains the CoAP payload body.  Same as message if there is a header template.
+    struct coap_packet *request;   //  CoAP request.  Allocated by sensor_coap.c.  Used only if header is NULL.
+    const char *uri;               //  Destination URI.  Must point to a static string.
+    const struct sensor_coap_header *header;  //  Cached header template for the destination, or NULL to serialise the request.
+    uint16_t mid;                  //  CoAP Message ID.
+    uint8_t token_len;             //  CoAP token length.
+    uint8_t token[8];              //  CoAP token.  Generated locally, SENSOR_COAP_TOKEN_LEN bytes.
+    uint8_t priority;              //  Transmit priority: SENSOR_COAP_PRIORITY_ALERT, NORMAL or BULK.  See sensor_coap_set_priority().
+#if MYNEWT_VAL(SENSOR_COAP_FLAT)  //  If we are supporting the flat payload layout...
+    uint8_t layout;                //  Payload layout for the CP_* macros and skeletons: SENSOR_COAP_LAYOUT_ITEMS or SENSOR_COAP_LAYOUT_FLAT.
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FLAT)
+#if MYNEWT_VAL(SENSOR_COAP_COMPRESS)  //  If we are compressing payloads...
+    bool compress;                 //  True if the payload should be compressed.  See sensor_coap_set_compress().
+#endif  //  MYNEWT_VAL(SENSOR_COAP_COMPRESS)
+#if MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0  //  If we are sending each payload to multiple destinations...
+    struct sensor_coap_destination fanout[MYNEWT_VAL(SENSOR_COAP_FANOUT)];  //  Other destinations for copies of the payload.
+    uint8_t fanout_count;          //  Number of destinations in fanout.
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    struct json_encoder json_encoder;  //  JSON encoder that writes to the payload.
+    struct json_value json_value;      //  Custom JSON value being encoded.
+    char json_buf[MYNEWT_VAL(SENSOR_COAP_JSON_CHUNK)];  //  Staging buffer that coalesces the JSON tokens before appending to the payload.
+    uint16_t json_len;                 //  Number of bytes in json_buf.
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+    struct cbor_mbuf_writer cbor_writer;  //  CBOR writer that writes to the payload.
+    CborEncoder cbor_encoder;             //  CBOR root encoder.
+    CborError cbor_err;                   //  CBOR encoding errors.
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  For coexistence of CBOR and JSON encoding...
+    const struct sensor_coap_encoder *encoder;  //  Encoder for the content format: sensor_coap_json_encoder or sensor_coap_cbor_encoder.
+    CborEncoder cbor_stack[SENSOR_COAP_CBOR_DEPTH];  //  CBOR encoders for the open maps and arrays.  Used by sensor_coap_cbor_encoder.
+    uint8_t cbor_depth;                   //  Number of open maps and arrays in cbor_stack.
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 //  Sensor CoAP Functions
 
 #define COAP_PORT_UNSECURED (5683)  //  Port number for CoAP Unsecured
 
+//  SenML content formats (RFC 8428).  Not defined in oic/messaging/coap/constants.h.
+#define APPLICATION_SENML_JSON (110)  //  application/senml+json
+#define APPLICATION_SENML_CBOR (112)  //  application/senml+cbor
+
+//  True if the content format is written by the JSON encoder, the CBOR encoder or the SenML encoder.
+#define SENSOR_COAP_JSON_FORMAT(format)  ((format) == APPLICATION_JSON || (format) == APPLICATION_SENML_JSON)
+#define SENSOR_COAP_CBOR_FORMAT(format)  ((format) == APPLICATION_CBOR || (format) == APPLICATION_SENML_CBOR)
+#define SENSOR_COAP_SENML_FORMAT(format) ((format) == APPLICATION_SENML_JSON || (format) == APPLICATION_SENML_CBOR)
+
+//  Content format for a payload compressed with LZSS, e.g. 65050 for compressed JSON.  In the range 65000 to 65535
+//  reserved for experimental use (RFC 7252), so the server can tell the compressed payload and its original format.
+#define SENSOR_COAP_LZSS_BASE  (65000)
+#define SENSOR_COAP_LZSS_FORMAT(format) (SENSOR_COAP_LZSS_BASE + (format))
+
 struct oc_server_handle;
 
 //  Init the Sensor CoAP module. Called by sysinit() during startup, defined in pkg.yml.
@@ -31,52 +127,370 @@ void init_sensor_coap(void);
 //  Return true if the Sensor CoAP is ready for sending sensor data.
 bool sensor_coap_ready(void);
 
-//  Create a new sensor post request to send to CoAP server.  coap_content_format is 
-//  APPLICATION_JSON or APPLICATION_CBOR. If coap_content_format is 0, use the default format.
-bool init_sensor_post(struct oc_server_handle *server, const char *uri, int coap_content_format);
+//  Create a new sensor post request to send to CoAP server.  coap_content_format is APPLICATION_JSON,
+//  APPLICATION_CBOR, APPLICATION_SENML_JSON or APPLICATION_SENML_CBOR. If coap_content_format is 0, use the default format.
+//  Waits up to SENSOR_COAP_ACQUIRE_TIMEOUT milliseconds for a free compose context.  Returns the
+//  context assigned to the current task, or NULL if no context is free or the request could not be created.
+struct sensor_coap_context *init_sensor_post(struct oc_server_handle *server, const char *uri, int coap_content_format);
+
+#define SENSOR_COAP_NO_WAIT 0  //  Timeout for init_sensor_post_wait(): Fail right away if no compose context is free.
+
+//  Create a new sensor post request like init_sensor_post(), but wait at most timeout_ms milliseconds for a free
+//  compose context.  SENSOR_COAP_NO_WAIT fails right away, so high-priority tasks never block behind a slow send.
+//  Returns 0 and sets ctx to the context assigned to the current task if successful, SYS_EAGAIN if all contexts
+//  are still busy, or SYS_ENOMEM if the request could not be created.
+int init_sensor_post_wait(struct oc_server_handle *server, const char *uri, int coap_content_format,
+    uint32_t timeout_ms, struct sensor_coap_context **ctx);
+
+//  Set the transmit priority of the message: SENSOR_COAP_PRIORITY_ALERT, SENSOR_COAP_PRIORITY_NORMAL (default)
+//  or SENSOR_COAP_PRIORITY_BULK.  Used by the send function.  Call after init_sensor_post() and before
+//  do_sensor_post().  Return 0 if successful.
+int sensor_coap_set_priority(struct sensor_coap_context *ctx, uint8_t priority);
+
+//  Transmit the serialised CoAP messages with the function, e.g. to queue them for a transmit task, instead of
+//  coap_send_message().  NULL to restore coap_send_message().
+void sensor_coap_set_send_func(sensor_coap_send_func *func);
+
+#if MYNEWT_VAL(SENSOR_COAP_WAITERS) > 0  //  If tasks may be notified when a compose context is free...
+//  Put the event onto the event queue when a compose context is free: right away if a context is free now,
+//  else when the next context is released.  The event callback should call init_sensor_post_wait() with
+//  SENSOR_COAP_NO_WAIT, which may still return SYS_EAGAIN if another task took the context first.
+//  Returns 0 if successful, or SYS_ENOMEM if SENSOR_COAP_WAITERS events are already waiting.
+int sensor_coap_notify_free(struct os_eventq *evq, struct os_event *ev);
+#endif  //  MYNEWT_VAL(SENSOR_COAP_WAITERS) > 0
+
+#if MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0  //  If we are sending each payload to multiple destinations...
+//  Send a copy of the payload to another server and URI, with the same content format.  Call after
+//  init_sensor_post() and before do_sensor_post().  The payload is encoded once and copied for each destination.
+//  Return 0 if successful, or -1 if there are already SENSOR_COAP_FANOUT destinations or there is no header
+//  template for the destination.
+int sensor_coap_add_destination(struct sensor_coap_context *ctx, struct oc_server_handle *server, const char *uri);
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0
+
+#if MYNEWT_VAL(SENSOR_COAP_FLAT)  //  If we are supporting the flat payload layout...
+//  Set the payload layout written by the CP_* macros and payload skeletons: SENSOR_COAP_LAYOUT_ITEMS (default)
+//  or SENSOR_COAP_LAYOUT_FLAT.  Call after init_sensor_post() and before composing the payload.
+//  Return 0 if successful.
+int sensor_coap_set_layout(struct sensor_coap_context *ctx, uint8_t layout);
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FLAT)
+
+#if MYNEWT_VAL(SENSOR_COAP_COMPRESS)  //  If we are compressing payloads...
+//  If compress is true, compress the payload with LZSS when the message is sent, if the payload has at least
+//  SENSOR_COAP_COMPRESS_MIN bytes.  The message is sent with the content format SENSOR_COAP_LZSS_FORMAT(format).
+//  If the payload doesn't shrink, or there is no header template for the compressed format, the payload is sent
+//  uncompressed.  Call after init_sensor_post() and before do_sensor_post().
+void sensor_coap_set_compress(struct sensor_coap_context *ctx, bool compress);
+
+//  Init the LZSS compressor.  Called by init_sensor_coap().
+void sensor_coap_lzss_init(void);
+
+//  Compress the first len bytes of the mbuf chain src with LZSS and append to dst.  Uses a static window of
+//  SENSOR_COAP_LZSS_WINDOW bytes, shared by all tasks.  Return the compressed size, or -1 if out of mbufs or if
+//  the compressed size would not be smaller than len.
+int sensor_coap_lzss_compress(struct os_mbuf *src, int len, struct os_mbuf *dst);
+#endif  //  MYNEWT_VAL(SENSOR_COAP_COMPRESS)
+
+//  Send the message being composed to another server instead, e.g. through another network interface whose MTU
+//  fits the payload.  The encoded payload is kept and the request is serialised for the new server when sending.
+//  Copies for other destinations are dropped.  Call before do_sensor_post().  Return 0 if successful,
+//  or SYS_ENOMEM if out of mbufs.
+int sensor_coap_set_server(struct sensor_coap_context *ctx, struct oc_server_handle *server);
+
+//  Send the sensor post request to CoAP server and release the compose context.  Return false if the message was
+//  not sent, e.g. a Block1 payload without a header template.
+bool do_sensor_post(struct sensor_coap_context *ctx);
+
+//  Discard the sensor post request without sending, e.g. if the payload is too big for the network interface,
+//  and release the compose context.
+void sensor_coap_discard(struct sensor_coap_context *ctx);
+
+//  Return the compose context assigned to the current task by init_sensor_post().  Used by the rep_* macros.
+struct sensor_coap_context *sensor_coap_current(void);
+
+///////////////////////////////////////////////////////////////////////////////
+//  CoAP Header Templates: Serialise the CoAP options once per destination
+
+//  Cached header template.  Contains the serialised options for the destination server, URI and content format.
+struct sensor_coap_header {
+    const struct oc_server_handle *server;  //  Destination server.  NULL if the entry is unused.
+    const char *uri;                        //  Destination URI.  Must point to a static string.
+    int content_format;                     //  Content format and accept format: APPLICATION_JSON, APPLICATION_CBOR, ...
+    uint8_t options_len;                    //  Number of bytes in options.
+    uint8_t options[MYNEWT_VAL(SENSOR_COAP_HEADER_SIZE)];  //  Serialised options: Uri-Path, Content-Format, Accept.
+};
+
+//  Return the cached header template for the server, URI and content format.  Create the template if not found.
+//  Return NULL if the cache is full or the options don't fit into the template.
+const struct sensor_coap_header *sensor_coap_get_header(const struct oc_server_handle *server, const char *uri, int content_format);
+
+//  Serialise the options for the URI and content format into a header template owned by the caller, without caching,
+//  e.g. for sending Block1 blocks when the cache is full.  Return 0 if successful, or -1 if the options don't fit.
+int sensor_coap_build_header(struct sensor_coap_header *header, const char *uri, int content_format);
+
+//  Return the size of the CoAP header written by sensor_coap_write_header(): Fixed header, token,
+//  template options and payload marker.
+int sensor_coap_header_size(const struct sensor_coap_header *header, uint8_t token_len);
+
+//  Prepend the CoAP header for a NON message to the payload in the mbuf: Fixed header with the Message ID and token,
+//  the template options and the payload marker.  The header is written in place into the leading space of the mbuf,
+//  if the space was reserved.  Return the head of the mbuf chain, or NULL if out of mbufs (the chain is freed).
+struct os_mbuf *sensor_coap_write_header(const struct sensor_coap_header *header, uint8_t code, uint16_t mid,
+    const uint8_t *token, uint8_t token_len, struct os_mbuf *m);
+
+#define SENSOR_COAP_BLOCK1_OPTION_SIZE 4  //  Max size of the Block1 option: Option byte and 3 value bytes.
+
+//  Same as sensor_coap_write_header(), plus a Block1 option (RFC 7959) for block number num of the payload.
+//  more is true if more blocks will follow.  szx is the block size exponent: block size is 2^(szx + 4).
+//  Return the head of the mbuf chain, or NULL if out of mbufs (the chain is freed).
+struct os_mbuf *sensor_coap_write_block1_header(const struct sensor_coap_header *header, uint8_t code, uint16_t mid,
+    const uint8_t *token, uint8_t token_len, uint32_t num, bool more, uint8_t szx, struct os_mbuf *m);
+
+#if MYNEWT_VAL(SENSOR_COAP_BLOCK1)  //  If we are sending large payloads as Block1 blocks...
+//  Set the block size exponent for Block1 transfers: block size is 2^(szx + 4), from 16 to 1024 bytes.
+//  Payloads larger than the block size are sent in blocks.  Default is SENSOR_COAP_BLOCK1_SZX.  Return 0 if successful.
+int sensor_coap_set_block1_szx(uint8_t szx);
+#endif  //  MYNEWT_VAL(SENSOR_COAP_BLOCK1)
+
+///////////////////////////////////////////////////////////////////////////////
+//  Sensor CoAP Batching: Collect multiple sensor values into a single CoAP message
+
+//  A batched reading: the sensor value plus the node that produced it.
+struct sensor_coap_reading {
+    struct sensor_value val;  //  Sensor value.  The key must point to a static string.
+    const char *node;         //  Sensor name or Sensor Node Address, like "b3b4b5b6f1".  Must point to a static string.
+    os_time_t time;           //  When the reading was added to the batch, in OS ticks.  For SenML record times.
+};
+
+struct sensor_coap_batch;
+
+//  Called to compose and post the batched readings, usually with CP_BATCH_ITEMS.  Return 0 if successful,
+//  or SYS_EAGAIN to keep the readings and retry later, e.g. if no compose context is free.
+typedef int sensor_coap_batch_func(struct sensor_coap_batch *batch, void *arg);
+
+//  Batch of readings.  The batch is flushed when the estimated payload size reaches max_bytes,
+//  when SENSOR_COAP_BATCH_COUNT readings have been collected, when readings from node_target nodes
+//  have been collected, or when the oldest reading has waited max_latency ticks.
+struct sensor_coap_batch {
+    struct sensor_coap_reading readings[MYNEWT_VAL(SENSOR_COAP_BATCH_COUNT)];  //  Readings collected.
+    uint8_t  count;            //  Number of readings collected.
+    uint16_t bytes;            //  Estimated JSON payload size, including reserved_bytes.
+    uint16_t reserved_bytes;   //  Payload bytes reserved for the root and fixed items like the device ID.
+    uint16_t max_bytes;        //  Flush before the estimated payload size exceeds this.
+    bool     senml;            //  True if the payload size is estimated for CP_SENML_BATCH instead of CP_BATCH_ITEMS.
+    uint16_t senml_prefix;     //  For SenML: Length of the base name prefix, e.g. the device ID.
+    bool     flat;             //  True if the payload size is estimated for the flat layout.  See sensor_coap_batch_use_flat().
+    bool     group_nodes;      //  True if the readings are grouped by node.  See sensor_coap_batch_group_nodes().
+    uint8_t  nodes;            //  If grouping by node: Number of different nodes in the batch.
+    uint8_t  node_target;      //  If grouping by node: Flush when readings from this number of nodes have been collected.  0 if none.
+    os_time_t max_latency;     //  Flush when the oldest reading has waited this number of ticks.
+    struct os_callout callout; //  Timer for flushing by latency.
+    struct os_mutex lock;      //  Prevents concurrent updates to the batch.
+    sensor_coap_batch_func *flush_func;  //  Function to compose and post the readings.
+    void *flush_arg;           //  Argument for flush_func.
+};
+
+//  Init the batch.  max_bytes is the max JSON payload size, e.g. ESP8266_TX_BUFFER_SIZE less the CoAP header.
+//  reserved_bytes is the size of the payload root and fixed items, e.g. sensor_coap_batch_item_size("device", device_id).
+//  max_latency_ms is the max milliseconds that a reading may wait.  flush_func will be called with flush_arg 
+//  to compose and post the readings.  Return 0 if successful.
+int sensor_coap_batch_init(struct sensor_coap_batch *batch, uint16_t max_bytes, uint16_t reserved_bytes, 
+    uint32_t max_latency_ms, sensor_coap_batch_func *flush_func, void *flush_arg);
+
+//  Add the sensor value to the batch.  The batch will be flushed if it's full.  Return 0 if successful,
+//  or SYS_EAGAIN if the reading was dropped because the batch is full and its flush is waiting to be retried.
+int sensor_coap_batch_add(struct sensor_coap_batch *batch, const struct sensor_value *val, const char *node);
+
+//  Compose and post the batched readings now.  Return 0 if successful or if the batch is empty, or SYS_EAGAIN
+//  if the readings are kept for a retry.
+int sensor_coap_batch_flush(struct sensor_coap_batch *batch);
+
+//  Return the estimated JSON size of an item with a string value: {"key": "<key>","value": "<value>"},
+int sensor_coap_batch_item_size(const char *key, const char *value);
+
+//  Return the estimated JSON size of a key/value pair with a string value in the flat layout: "<key>": "<value>",
+int sensor_coap_batch_pair_size(const char *key, const char *value);
+
+#if MYNEWT_VAL(SENSOR_COAP_FLAT)  //  If we are supporting the flat payload layout...
+//  Estimate the payload size according to the flat layout, for payloads composed with SENSOR_COAP_LAYOUT_FLAT.
+//  reserved_bytes replaces the reserved_bytes passed to sensor_coap_batch_init(), e.g.
+//  sensor_coap_batch_pair_size("device", device_id).  Call before adding readings.  Return 0 if successful.
+int sensor_coap_batch_use_flat(struct sensor_coap_batch *batch, uint16_t reserved_bytes);
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FLAT)
+
+//  Keep the readings grouped by node, so that each node is written once per payload, and flush as soon as
+//  readings from node_count different nodes have been collected, e.g. from every Sensor Node on the Collector Node.
+//  If node_count is 0, don't flush by the number of nodes.  Call before adding readings.  Return 0 if successful.
+int sensor_coap_batch_group_nodes(struct sensor_coap_batch *batch, uint8_t node_count);
+
+#if MYNEWT_VAL(SENSOR_COAP_SENML)  //  If we are composing SenML payloads...
+//  Estimate the payload size according to the SenML JSON layout written by CP_SENML_BATCH, instead of
+//  CP_BATCH_ITEMS.  base_prefix is the longest base name prefix, e.g. the device ID.  The reserved_bytes
+//  passed to sensor_coap_batch_init() are replaced by the pack root and base time.  Call before adding readings.
+//  Return 0 if successful.
+int sensor_coap_batch_use_senml(struct sensor_coap_batch *batch, const char *base_prefix);
+#endif  //  MYNEWT_VAL(SENSOR_COAP_SENML)
+
+///////////////////////////////////////////////////////////////////////////////
+//  Sensor CoAP Payload Skeletons: Precomputed payloads with value slots, for payloads with a fixed shape
+
+//  Type of the value slot in a skeleton item.
+#define SENSOR_COAP_SLOT_TEXT  1  //  Text string value
+#define SENSOR_COAP_SLOT_INT   2  //  Integer value
+#define SENSOR_COAP_SLOT_UINT  3  //  Unsigned integer value
+#define SENSOR_COAP_SLOT_FLOAT 4  //  Float value
+
+//  An item in the "values" array of the skeleton: {"key": <key>, "value": <slot>}
+struct sensor_coap_skeleton_item {
+    const char *key;  //  Item key.  If NULL, the key is a text string slot before the value slot.
+    uint8_t type;     //  Type of the value slot: SENSOR_COAP_SLOT_TEXT, INT, UINT or FLOAT.
+};
+
+//  Constant bytes of a skeleton in one encoding.  Segment i ends at ends[i] and is followed by slot i.
+//  The last segment is not followed by a slot.
+struct sensor_coap_skeleton_layout {
+    uint8_t ends[MYNEWT_VAL(SENSOR_COAP_SKELETON_SLOTS) + 1];  //  End offset of each segment in bytes.
+    uint8_t bytes[MYNEWT_VAL(SENSOR_COAP_SKELETON_SIZE)];      //  Constant segments, back to back.
+};
+
+//  Payload skeleton: {"values": [ <items> ]}, or { <items> } for the flat layout.  Defined with SENSOR_COAP_SKELETON().
+//  The constant bytes are rendered once, on first use, in the same layouts as the CP_* macros.
+struct sensor_coap_skeleton {
+    const struct sensor_coap_skeleton_item *items;  //  Items in the "values" array.
+    uint8_t count;                                  //  Number of items.
+    uint8_t slots;                                  //  Number of value slots.  Set when rendered.
+    bool ready;                                     //  True if the layouts have been rendered.
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    struct sensor_coap_skeleton_layout json;        //  Constant bytes in JSON.
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+    struct sensor_coap_skeleton_layout cbor;        //  Constant bytes in CBOR.
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+#if MYNEWT_VAL(SENSOR_COAP_FLAT)  //  If we are supporting the flat payload layout...
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    struct sensor_coap_skeleton_layout json_flat;   //  Constant bytes in JSON, flat layout.
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+    struct sensor_coap_skeleton_layout cbor_flat;   //  Constant bytes in CBOR, flat layout.
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FLAT)
+};
+
+//  Value to be filled into a slot, according to the slot type.
+struct sensor_coap_slot {
+    union {
+        const char *text_val;  //  For SENSOR_COAP_SLOT_TEXT
+        int64_t     int_val;   //  For SENSOR_COAP_SLOT_INT
+        uint64_t    uint_val;  //  For SENSOR_COAP_SLOT_UINT
+        float       float_val; //  For SENSOR_COAP_SLOT_FLOAT
+    };
+};
+
+//  Define a static payload skeleton named name0 with the items, e.g.
+//    SENSOR_COAP_SKELETON(server_skeleton, CP_SKELETON_STR("device"), CP_SKELETON_FLOAT(NULL));
+#define SENSOR_COAP_SKELETON(name0, ...) \
+    static const struct sensor_coap_skeleton_item name0##_items[] = { __VA_ARGS__ }; \
+    static struct sensor_coap_skeleton name0 = { name0##_items, sizeof(name0##_items) / sizeof(name0##_items[0]), 0, false }
+
+//  Skeleton items with a value slot.  If key0 is NULL, the key is filled from a text string slot.
+#define CP_SKELETON_STR(  key0) { key0, SENSOR_COAP_SLOT_TEXT  }
+#define CP_SKELETON_INT(  key0) { key0, SENSOR_COAP_SLOT_INT   }
+#define CP_SKELETON_UINT( key0) { key0, SENSOR_COAP_SLOT_UINT  }
+#define CP_SKELETON_FLOAT(key0) { key0, SENSOR_COAP_SLOT_FLOAT }
+
+//  Write the payload into the compose context by copying the skeleton's constant bytes and filling the slots
+//  with the values, in the encoding and layout of the context.  The output is identical to the CP_* macros.
+//  slots contains one value per slot, in payload order.  Return 0 if successful.
+int sensor_coap_write_skeleton(struct sensor_coap_context *ctx, struct sensor_coap_skeleton *skeleton,
+    const struct sensor_coap_slot *slots);
+
+//  Write the skeleton's items as the constant payload prefix, then append the batched readings to the "values"
+//  array, adding a "node" item whenever the node changes.  The output is identical to CP_ROOT and
+//  CP_ARRAY(root, values, ...) with the skeleton's CP_ITEM_* items followed by CP_BATCH_ITEMS.
+//  The skeleton must have at least 1 item.  Return 0 if successful.
+int sensor_coap_write_skeleton_batch(struct sensor_coap_context *ctx, struct sensor_coap_skeleton *skeleton,
+    const struct sensor_coap_slot *slots, const struct sensor_coap_batch *batch);
+
+///////////////////////////////////////////////////////////////////////////////
+//  Sensor CoAP SenML: Payloads as SenML packs (RFC 8428) with base name and base time
+
+#if MYNEWT_VAL(SENSOR_COAP_SENML)  //  If we are composing SenML payloads...
+
+#define SENSOR_COAP_SENML_NAME_SIZE 48  //  Max size of the base name, including the terminating null: 32-char device ID, node and separators.
+
+//  A SenML pack being composed with the CP_SENML_* macros: an array of records like {"n": "t", "v": 1715, "t": 5}.
+//  The base name (bn) and base time (bt) are written into the next record only when they change, so readings
+//  from the same node share the name prefix and the timestamp.
+struct sensor_coap_senml {
+    struct sensor_coap_context *ctx;  //  Compose context that contains the payload.
+    int32_t base_time;                //  Base time (bt) in seconds.  The record times are relative to it.
+    bool base_time_pending;           //  True if the base time has not been written.
+    char base_name[SENSOR_COAP_SENML_NAME_SIZE];  //  Base name to be written into the next record.  Empty if unchanged.
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+    CborEncoder array;                //  Root array of records, for SenML CBOR.
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+};
+
+//  Start the SenML pack in the compose context, whose content format must be APPLICATION_SENML_JSON or
+//  APPLICATION_SENML_CBOR.  base_time is the base time in seconds.  Since the devices have no clock, times are
+//  relative to now: a negative base time means seconds in the past.  Return 0 if successful.
+int sensor_coap_senml_start(struct sensor_coap_senml *senml, struct sensor_coap_context *ctx, int32_t base_time);
+
+//  Set the base name for the following records to "<prefix>:<name>:", or "<name>:" if prefix is NULL.
+//  The base name is written into the next record.
+void sensor_coap_senml_set_base_name(struct sensor_coap_senml *senml, const char *prefix, const char *name);
+
+//  Append a record with the name, value and time in seconds relative to the base time.  Time 0 is not written.
+void sensor_coap_senml_add_int(  struct sensor_coap_senml *senml, const char *name, int32_t value, int32_t time);
+void sensor_coap_senml_add_float(struct sensor_coap_senml *senml, const char *name, float value, int32_t time);
+void sensor_coap_senml_add_str(  struct sensor_coap_senml *senml, const char *name, const char *value, int32_t time);
 
-//  Send the sensor post request to CoAP server.
-bool do_sensor_post(void);
+//  End the SenML pack.  Return 0 if successful.
+int sensor_coap_senml_end(struct sensor_coap_senml *senml);
+
+//  Convert the OS ticks to SenML time in whole seconds.
+int32_t sensor_coap_senml_seconds(os_time_t ticks);
+
+#endif  //  MYNEWT_VAL(SENSOR_COAP_SENML)
 
 ///////////////////////////////////////////////////////////////////////////////
 //  JSON Common Encoding Macros
 
 #if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
-#include <json/json.h>
 #define COAP_CONTENT_FORMAT APPLICATION_JSON   //  Specify JSON content type and accept type in the CoAP header.
 #define JSON_VALUE_TYPE_EXT_FLOAT (6)          //  For custom encoding of floats.
 
-extern struct json_encoder coap_json_encoder;  //  Note: We don't support concurrent encoding of JSON messages.
-extern struct json_value coap_json_value;      //  Custom JSON value being encoded.
-
-void json_rep_new(struct os_mbuf *m);   //  Prepare to write a new JSON CoAP payload into the mbuf.
-void json_rep_reset(void);              //  Close the current JSON CoAP payload.  Erase the JSON encoder.
-int json_rep_finalize(void);            //  Finalise the payload and return the payload size.
+int json_write_mbuf(void *buf, char *data, int len);  //  JSON writer for the compose context buf.  Stages the data and appends to the payload in chunks.
+int json_flush_mbuf(struct sensor_coap_context *ctx);  //  Append the staged JSON data to the payload.
+void json_rep_new(struct sensor_coap_context *ctx, struct os_mbuf *m);  //  Prepare to write a new JSON CoAP payload into the mbuf.
+void json_rep_reset(struct sensor_coap_context *ctx);     //  Close the current JSON CoAP payload.  Erase the JSON encoder.
+int json_rep_finalize(struct sensor_coap_context *ctx);   //  Finalise the payload and return the payload size.
 int json_encode_object_entry_ext(struct json_encoder *encoder, char *key, struct json_value *val);  //  Custom encoder for floats.
 
 //  Start the JSON representation.  Assume top level is object.
 //  --> {
-void json_rep_start_root_object(void);
+void json_rep_start_root_object(struct sensor_coap_context *ctx);
 
 //  End the JSON representation.  Assume top level is object.
 //  {... --> {...}
-void json_rep_end_root_object(void);
+void json_rep_end_root_object(struct sensor_coap_context *ctx);
+
+//  The json_rep_* macros below write to the compose context coap_ctx, which is declared by rep_start_root_object().
 
 //  Assume we are writing an object now.  Write the key name and start a child array.
 //  {a:b --> {a:b, key:[
-#define json_rep_set_array(object, key) { json_encode_array_name(&coap_json_encoder, #key); json_encode_array_start(&coap_json_encoder); }
+#define json_rep_set_array(object, key) { json_encode_array_name(&coap_ctx->json_encoder, #key); json_encode_array_start(&coap_ctx->json_encoder); }
 
 //  End the child array and resume writing the parent object.
 //  {a:b, key:[... --> {a:b, key:[...]
-#define json_rep_close_array(object, key) json_encode_array_finish(&coap_json_encoder)
+#define json_rep_close_array(object, key) json_encode_array_finish(&coap_ctx->json_encoder)
 
 //  Assume we have called set_array.  Start an array item, assumed to be an object.
 //  [... --> [...,
-#define json_rep_object_array_start_item(key) { json_encode_object_start(&coap_json_encoder); }
+#define json_rep_object_array_start_item(key) { json_encode_object_start(&coap_ctx->json_encoder); }
 
 //  End an array item, assumed to be an object.
 //  [... --> [...,
-#define json_rep_object_array_end_item(key) { json_encode_object_finish(&coap_json_encoder); }   
+#define json_rep_object_array_end_item(key) { json_encode_object_finish(&coap_ctx->json_encoder); }   
 
 //  Define a float JSON value.
 #define JSON_VALUE_EXT_FLOAT(__jv, __v)       \
@@ -84,21 +498,60 @@ void json_rep_end_root_object(void);
 (__jv)->jv_val.fl = (float) __v;
 
 //  Encode a value into JSON: int, unsigned int, float, text, ...
-#define json_rep_set_int(        object, key, value) { JSON_VALUE_INT      (&coap_json_value, value);          json_encode_object_entry    (&coap_json_encoder, #key, &coap_json_value); }
-#define json_rep_set_uint(       object, key, value) { JSON_VALUE_UINT     (&coap_json_value, value);          json_encode_object_entry    (&coap_json_encoder, #key, &coap_json_value); }
-#define json_rep_set_float(      object, key, value) { JSON_VALUE_EXT_FLOAT(&coap_json_value, value);          json_encode_object_entry_ext(&coap_json_encoder, #key, &coap_json_value); }
-#define json_rep_set_text_string(object, key, value) { JSON_VALUE_STRING   (&coap_json_value, (char *) value); json_encode_object_entry    (&coap_json_encoder, #key, &coap_json_value); }
+#define json_rep_set_int(        object, key, value) { JSON_VALUE_INT      (&coap_ctx->json_value, value);          json_encode_object_entry    (&coap_ctx->json_encoder, #key, &coap_ctx->json_value); }
+#define json_rep_set_uint(       object, key, value) { JSON_VALUE_UINT     (&coap_ctx->json_value, value);          json_encode_object_entry    (&coap_ctx->json_encoder, #key, &coap_ctx->json_value); }
+#define json_rep_set_float(      object, key, value) { JSON_VALUE_EXT_FLOAT(&coap_ctx->json_value, value);          json_encode_object_entry_ext(&coap_ctx->json_encoder, #key, &coap_ctx->json_value); }
+#define json_rep_set_text_string(object, key, value) { JSON_VALUE_STRING   (&coap_ctx->json_value, (char *) value); json_encode_object_entry    (&coap_ctx->json_encoder, #key, &coap_ctx->json_value); }
+
+//  Same as above, except that the key is not stringified.
+#define json_rep_set_int_k(        object, key, value) { JSON_VALUE_INT      (&coap_ctx->json_value, value);          json_encode_object_entry    (&coap_ctx->json_encoder, (char *) key, &coap_ctx->json_value); }
+#define json_rep_set_uint_k(       object, key, value) { JSON_VALUE_UINT     (&coap_ctx->json_value, value);          json_encode_object_entry    (&coap_ctx->json_encoder, (char *) key, &coap_ctx->json_value); }
+#define json_rep_set_float_k(      object, key, value) { JSON_VALUE_EXT_FLOAT(&coap_ctx->json_value, value);          json_encode_object_entry_ext(&coap_ctx->json_encoder, (char *) key, &coap_ctx->json_value); }
+#define json_rep_set_text_string_k(object, key, value) { JSON_VALUE_STRING   (&coap_ctx->json_value, (char *) value); json_encode_object_entry    (&coap_ctx->json_encoder, (char *) key, &coap_ctx->json_value); }
 
 #endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
 
+///////////////////////////////////////////////////////////////////////////////
+//  CBOR Common Encoding Macros
+
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+
+void cbor_rep_new(struct sensor_coap_context *ctx, struct os_mbuf *m);  //  Prepare to write a new CBOR CoAP payload into the mbuf.
+int cbor_rep_finalize(struct sensor_coap_context *ctx);  //  Finalise the payload and return the payload size, or -1 if failed.
+
+//  Start the CBOR representation with the root encoder of the current compose context.  Assume top level is object.
+//  Declares coap_ctx, plus root_map and g_err that shadow the Mynewt globals, so that the oc_rep_* macros
+//  write to this context only.  --> {
+#define cbor_rep_start_root_object() \
+    struct sensor_coap_context *coap_ctx = sensor_coap_current(); \
+    CborError g_err = CborNoError; \
+    CborEncoder root_map; \
+    g_err |= cbor_encoder_create_map(&coap_ctx->cbor_encoder, &root_map, CborIndefiniteLength)
+
+//  End the CBOR representation and save the errors into the compose context.  {... --> {...}
+#define cbor_rep_end_root_object() \
+    g_err |= cbor_encoder_close_container(&coap_ctx->cbor_encoder, &root_map); \
+    coap_ctx->cbor_err |= g_err
+
+//  Set the integer value in the CBOR object, with an unsigned integer key instead of a text string key.
+//  Integer keys 0 to 23 are encoded in 1 byte, for compact messages to the Collector Node.
+#define oc_rep_set_int_ukey(object, key, value)                                  \
+  do {                                                                         \
+    g_err |= cbor_encode_uint(&object##_map, key);                             \
+    g_err |= cbor_encode_int(&object##_map, value);                            \
+  } while (0)
+
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+
 ///////////////////////////////////////////////////////////////////////////////
 //  JSON-Only Encoding Macros
 
 #if MYNEWT_VAL(COAP_JSON_ENCODING) && !MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in JSON only...
 
 //  Alias the generic rep* macros as json_rep*
-#define rep_start_root_object() json_rep_start_root_object()
-#define rep_end_root_object()   json_rep_end_root_object()
+#define rep_start_root_object() struct sensor_coap_context *coap_ctx = sensor_coap_current(); \
+                                json_rep_start_root_object(coap_ctx)
+#define rep_end_root_object()   json_rep_end_root_object(coap_ctx)
 
 #define rep_set_array(  object, key) json_rep_set_array(  object, key)
 #define rep_close_array(object, key) json_rep_close_array(object, key)
@@ -111,18 +564,22 @@ void json_rep_end_root_object(void);
 #define rep_set_float(      object, key, value) json_rep_set_float(      object, key, value)
 #define rep_set_text_string(object, key, value) json_rep_set_text_string(object, key, value)
 
+#define rep_set_int_k(        object, key, value) json_rep_set_int_k(        object, key, value)
+#define rep_set_uint_k(       object, key, value) json_rep_set_uint_k(       object, key, value)
+#define rep_set_float_k(      object, key, value) json_rep_set_float_k(      object, key, value)
+#define rep_set_text_string_k(object, key, value) json_rep_set_text_string_k(object, key, value)
+
 #endif  //  MYNEWT_VAL(COAP_JSON_ENCODING) && !MYNEWT_VAL(COAP_CBOR_ENCODING)
 
 ///////////////////////////////////////////////////////////////////////////////
 //  CBOR-Only Encoding Macros
 
 #if MYNEWT_VAL(COAP_CBOR_ENCODING) && !MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in CBOR only...
-#include <oic/oc_rep.h>             //  Use the default Mynewt encoding in CBOR.
 
 #define COAP_CONTENT_FORMAT APPLICATION_CBOR  //  Specify CBOR content type and accept type in the CoAP header.
 
-#define rep_start_root_object()                 oc_rep_start_root_object()
-#define rep_end_root_object()                   oc_rep_end_root_object()
+#define rep_start_root_object()                 cbor_rep_start_root_object()
+#define rep_end_root_object()                   cbor_rep_end_root_object()
 
 #define rep_set_array(object, key)              oc_rep_set_array(object, key)
 #define rep_close_array(object, key)            oc_rep_close_array(object, key)
@@ -135,6 +592,8 @@ void json_rep_end_root_object(void);
 #define rep_set_float(      object, key, value) oc_rep_set_double(     object, key, value)
 #define rep_set_text_string(object, key, value) oc_rep_set_text_string(object, key, value)
 
+#define rep_set_int_ukey(   object, key, value) oc_rep_set_int_ukey(   object, key, value)
+
 #endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING) && !MYNEWT_VAL(COAP_JSON_ENCODING)
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -145,74 +604,59 @@ void json_rep_end_root_object(void);
 //  JSON or CBOR encoding will be selected by the Sensor Network, which depends on whether we're sending
 //  to CoAP Server (JSON) or Collector Node (CBOR)
 
-#include <oic/oc_rep.h>        //  Import Mynewt's CBOR encoding functions.
 #include <oic/messaging/coap/constants.h>  //  For APPLICATION_JSON
 
 #undef COAP_CONTENT_FORMAT     //  Must manually specify CoAP Payload encoding format
-extern int oc_content_format;  //  CoAP Payload encoding format: APPLICATION_JSON or APPLICATION_CBOR
-#define JSON_ENC (oc_content_format == APPLICATION_JSON)  //  True if encoding format is JSON
-
-//  From repos\apache-mynewt-core\net\oic\include\oic\oc_rep.h
-//  Changed "#key" to "key" so that the key won't be stringified.
-
-#define oc_rep_set_int_k(object, key, value)                                     \
-  do {                                                                         \
-    g_err |= cbor_encode_text_string(&object##_map, key, strlen(key));       \
-    g_err |= cbor_encode_int(&object##_map, value);                            \
-  } while (0)
-
-#define oc_rep_set_uint_k(object, key, value)                                    \
-  do {                                                                         \
-    g_err |= cbor_encode_text_string(&object##_map, key, strlen(key));       \
-    g_err |= cbor_encode_uint(&object##_map, value);                           \
-  } while (0)
-
-#define oc_rep_set_float_k(object, key, value)                                    \
-  do {                                                                         \
-    g_err |= cbor_encode_text_string(&object##_map, key, strlen(key));       \
-    g_err |= cbor_encode_float(&object##_map, value);                           \
-  } while (0)
-
-#define oc_rep_set_text_string_k(object, key, value)                             \
-  do {                                                                         \
-    g_err |= cbor_encode_text_string(&object##_map, key, strlen(key));       \
-    g_err |= cbor_encode_text_string(&object##_map, value, strlen(value));     \
-  } while (0)
-
-#define rep_start_root_object()                 oc_rep_start_root_object(); \
-                                                  if (JSON_ENC) { json_rep_start_root_object(); }
+#define JSON_ENC SENSOR_COAP_JSON_FORMAT(coap_ctx->content_format)  //  True if encoding format is JSON
+
+//  Encoder interface for the rep_* macros.  init_sensor_post() selects the encoder for the content format,
+//  so each message is encoded once: in JSON for the CoAP Server, or in CBOR for the Collector Node.
+//  Keys are text strings.  The functions record any errors in the compose context.
+struct sensor_coap_encoder {
+    void (*start_root_object)(struct sensor_coap_context *ctx);  //  --> {
+    void (*end_root_object)  (struct sensor_coap_context *ctx);  //  {... --> {...}
+    void (*set_array)        (struct sensor_coap_context *ctx, const char *key);  //  {a:b --> {a:b, key:[
+    void (*close_array)      (struct sensor_coap_context *ctx);  //  {a:b, key:[... --> {a:b, key:[...]
+    void (*start_item)       (struct sensor_coap_context *ctx);  //  [... --> [...,{
+    void (*end_item)         (struct sensor_coap_context *ctx);  //  [...,{... --> [...,{...}
+    void (*set_int)          (struct sensor_coap_context *ctx, const char *key, int64_t value);
+    void (*set_uint)         (struct sensor_coap_context *ctx, const char *key, uint64_t value);
+    void (*set_float)        (struct sensor_coap_context *ctx, const char *key, float value);
+    void (*set_text_string)  (struct sensor_coap_context *ctx, const char *key, const char *value);
+};
 
-#define rep_end_root_object()                     if (JSON_ENC) { json_rep_end_root_object(); } \
-                                                oc_rep_end_root_object();
+extern const struct sensor_coap_encoder sensor_coap_json_encoder;  //  Encodes the payload in JSON.
+extern const struct sensor_coap_encoder sensor_coap_cbor_encoder;  //  Encodes the payload in CBOR.
 
-#define rep_set_array(object, key)              oc_rep_set_array(object, key); \
-                                                  if (JSON_ENC) { json_rep_set_array(object, key); }
+//  Set the integer value in the current CBOR object, with an unsigned integer key.  For CBOR only.
+void cbor_rep_set_int_ukey(struct sensor_coap_context *ctx, unsigned key, int64_t value);
 
-#define rep_close_array(object, key)              if (JSON_ENC) { json_rep_close_array(object, key); } \
-                                                oc_rep_close_array(object, key);
+//  The rep_* macros call the encoder selected in the compose context coap_ctx, which is declared by rep_start_root_object().
+//  The object and array names are not used, since the encoder tracks the open maps and arrays.
 
-#define rep_object_array_start_item(key)        oc_rep_object_array_start_item(key); \
-                                                  if (JSON_ENC) { json_rep_object_array_start_item(key); }
+#define rep_start_root_object() struct sensor_coap_context *coap_ctx = sensor_coap_current(); \
+                                coap_ctx->encoder->start_root_object(coap_ctx)
+#define rep_end_root_object()   coap_ctx->encoder->end_root_object(coap_ctx)
 
-#define rep_object_array_end_item(key)            if (JSON_ENC) { json_rep_object_array_end_item(key); } \
-                                                oc_rep_object_array_end_item(key);
+#define rep_set_array(  object, key) coap_ctx->encoder->set_array(coap_ctx, #key)
+#define rep_close_array(object, key) coap_ctx->encoder->close_array(coap_ctx)
 
-//  oc_rep_set_int(object, key, value)
-//  -> cbor_encode_text_string(&object##_map, #key, strlen(#key));
-//     cbor_encode_int(&object##_map, value);      
-//  oc_rep_set_key(parent, key)
-//  -> cbor_encode_text_string(&parent, key, strlen(key))
+#define rep_object_array_start_item(key) coap_ctx->encoder->start_item(coap_ctx)
+#define rep_object_array_end_item(key)   coap_ctx->encoder->end_item(coap_ctx)
 
-#define rep_set_int(object, key, value)    { if (JSON_ENC) { json_rep_set_int(object, key, value); } else { oc_rep_set_int(object, key, value); } }
-#define rep_set_uint(object, key, value)   { if (JSON_ENC) { json_rep_set_uint(object, key, value); } else { oc_rep_set_uint(object, key, value); } }
-#define rep_set_float(object, key, value)  { if (JSON_ENC) { json_rep_set_float(object, key, value); } else { oc_rep_set_double(object, key, value); } }
-#define rep_set_text_string(object, key, value)  { if (JSON_ENC) { json_rep_set_text_string(object, key, value); } else { oc_rep_set_text_string(object, key, value); } }
+#define rep_set_int(        object, key, value) coap_ctx->encoder->set_int(        coap_ctx, #key, value)
+#define rep_set_uint(       object, key, value) coap_ctx->encoder->set_uint(       coap_ctx, #key, value)
+#define rep_set_float(      object, key, value) coap_ctx->encoder->set_float(      coap_ctx, #key, value)
+#define rep_set_text_string(object, key, value) coap_ctx->encoder->set_text_string(coap_ctx, #key, value)
 
 //  Same as above, except that the key is not stringified.
-#define rep_set_int_k(object, key, value)    { if (JSON_ENC) { json_rep_set_int(object, key, value); } else { oc_rep_set_int_k(object, key, value); } }
-#define rep_set_uint_k(object, key, value)   { if (JSON_ENC) { json_rep_set_uint(object, key, value); } else { oc_rep_set_uint_k(object, key, value); } }
-#define rep_set_float_k(object, key, value)  { if (JSON_ENC) { json_rep_set_float(object, key, value); } else { oc_rep_set_double_k(object, key, value); } }
-#define rep_set_text_string_k(object, key, value)  { if (JSON_ENC) { json_rep_set_text_string(object, key, value); } else { oc_rep_set_text_string_k(object, key, value); } }
+#define rep_set_int_k(        object, key, value) coap_ctx->encoder->set_int(        coap_ctx, key, value)
+#define rep_set_uint_k(       object, key, value) coap_ctx->encoder->set_uint(       coap_ctx, key, value)
+#define rep_set_float_k(      object, key, value) coap_ctx->encoder->set_float(      coap_ctx, key, value)
+#define rep_set_text_string_k(object, key, value) coap_ctx->encoder->set_text_string(coap_ctx, key, value)
+
+//  Set the integer value with an unsigned integer key.  For CBOR only, since JSON keys must be strings.
+#define rep_set_int_ukey(object, key, value) { assert(!JSON_ENC); cbor_rep_set_int_ukey(coap_ctx, key, value); }
 
 #endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING) && MYNEWT_VAL(COAP_JSON_ENCODING)
 
@@ -220,6 +664,15 @@ extern int oc_content_format;  //  CoAP Payload encoding format: APPLICATION_JSO
 //  CP Macros for composing CoAP Payloads in JSON and CBOR
 //  The format defined here is used by thethings.io for receiving sensor data
 
+//  Layout policy: With the flat layout, CP_ARRAY doesn't open an array and each CP_ITEM_* item is written as a
+//  key/value pair of the enclosing object.  CP_LAYOUT(items0, flat0) runs items0 for the "values" items layout
+//  and flat0 for the flat layout.  items0 may declare variables, for the oc_rep_* macros.
+#if MYNEWT_VAL(SENSOR_COAP_FLAT)  //  If we are supporting the flat payload layout...
+#define CP_LAYOUT(items0, flat0) if (coap_ctx->layout == SENSOR_COAP_LAYOUT_FLAT) { flat0; } else { items0; }
+#else
+#define CP_LAYOUT(items0, flat0) items0
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FLAT)
+
 //  Compose the payload root.
 #define CP_ROOT(children0) { \
     rep_start_root_object();  \
@@ -227,12 +680,33 @@ extern int oc_content_format;  //  CoAP Payload encoding format: APPLICATION_JSO
     rep_end_root_object(); \
 }
 
+//  Compose the payload from the payload skeleton, filling the slots with the values in slots0.
+//  Same output as CP_ROOT and CP_ARRAY(root, values, ...) with the equivalent CP_ITEM_* macros.
+#define CP_SKELETON(skeleton0, slots0) { \
+    int skeleton_rc = sensor_coap_write_skeleton(sensor_coap_current(), &(skeleton0), slots0); \
+    assert(skeleton_rc == 0); \
+}
+
+//  Compose the payload from the payload skeleton as the constant prefix, followed by the batched readings.
+//  Same output as CP_ROOT and CP_ARRAY(root, values, ...) with the equivalent CP_ITEM_* macros and CP_BATCH_ITEMS.
+#define CP_SKELETON_BATCH(skeleton0, slots0, batch0) { \
+    int skeleton_rc = sensor_coap_write_skeleton_batch(sensor_coap_current(), &(skeleton0), slots0, batch0); \
+    assert(skeleton_rc == 0); \
+}
+
 //  Given an object parent and an integer Sensor Value val, set the val's key/value in the object.
 #define CP_SET_INT_VAL(parent0, val0) { \
     assert(val0->val_type == SENSOR_VALUE_TYPE_INT32); \
     rep_set_int_k(parent0, val0->key, val0->int_val); \
 }
 
+//  Given an object parent, an unsigned integer key and an integer Sensor Value val, set the key and val's value
+//  in the object.  For CBOR only, since JSON keys must be strings.
+#define CP_SET_INT_VAL_UKEY(parent0, key0, val0) { \
+    assert(val0->val_type == SENSOR_VALUE_TYPE_INT32); \
+    rep_set_int_ukey(parent0, key0, val0->int_val); \
+}
+
 //  Given an object parent and a float Sensor Value val, set the val's key/value in the object.
 #define CP_SET_FLOAT_VAL(parent0, val0) { \
     assert(val0->val_type == SENSOR_VALUE_TYPE_FLOAT); \
@@ -272,10 +746,11 @@ extern int oc_content_format;  //  CoAP Payload encoding format: APPLICATION_JSO
 }
 
 //  Compose an array under "object", named as "key".  Add "children" as array elements.
+//  With the flat layout, add "children" to "object" instead.
 #define CP_ARRAY(object0, key0, children0) { \
-    rep_set_array(object0, key0);  \
+    CP_LAYOUT(rep_set_array(object0, key0), );  \
     { children0; } \
-    rep_close_array(object0, key0); \
+    CP_LAYOUT(rep_close_array(object0, key0), ); \
 }
 
 //  Append an array item under the array named "array".  Add "children" as the item key and value.
@@ -288,40 +763,123 @@ extern int oc_content_format;  //  CoAP Payload encoding format: APPLICATION_JSO
 
 //  Append a (key + int value) item to the array named "array":
 //    { <array>: [ ..., {"key": <key0>, "value": <value0>} ], ... }
+//  Flat layout:  { ..., <key0>: <value0>, ... }
 #define CP_ITEM_INT(array0, key0, value0) { \
-    CP_ITEM(array0, { \
+    CP_LAYOUT(CP_ITEM(array0, { \
         rep_set_text_string(array0, key, key0); \
         rep_set_int(        array0, value, value0); \
-    }) \
+    }), rep_set_int_k(array0, key0, value0)); \
 }
 
 //  Append a (key + unsigned int value) item to the array named "array":
 //    { <array>: [ ..., {"key": <key0>, "value": <value0>} ], ... }
+//  Flat layout:  { ..., <key0>: <value0>, ... }
 #define CP_ITEM_UINT(array0, key0, value0) { \
-    CP_ITEM(array0, { \
+    CP_LAYOUT(CP_ITEM(array0, { \
         rep_set_text_string(array0, key, key0); \
         rep_set_uint(       array0, value, value0); \
-    }) \
+    }), rep_set_uint_k(array0, key0, value0)); \
 }
 
 //  Append a (key + float value) item to the array named "array":
 //    { <array>: [ ..., {"key": <key0>, "value": <value0>} ], ... }
+//  Flat layout:  { ..., <key0>: <value0>, ... }
 #define CP_ITEM_FLOAT(array0, key0, value0) { \
-    CP_ITEM(array0, { \
+    CP_LAYOUT(CP_ITEM(array0, { \
         rep_set_text_string(array0, key, key0); \
         rep_set_float(      array0, value, value0); \
-    }) \
+    }), rep_set_float_k(array0, key0, value0)); \
 }
 
 //  Append a (key + string value) item to the array named "array":
 //    { <array>: [ ..., {"key": <key0>, "value": <value0>} ], ... }
+//  Flat layout:  { ..., <key0>: <value0>, ... }
 #define CP_ITEM_STR(array0, key0, value0) { \
-    CP_ITEM(array0, { \
+    CP_LAYOUT(CP_ITEM(array0, { \
         rep_set_text_string(array0, key, key0); \
         rep_set_text_string(array0, value, value0); \
-    }) \
+    }), rep_set_text_string_k(array0, key0, value0)); \
 }
 
+//  Append the batched readings to the array named "array", adding a "node" item whenever the node changes.
+//  item_macro is CP_ITEM_INT_VAL, CP_ITEM_FLOAT_VAL or CP_ITEM_VAL, depending on the sensor value types.
+//    { <array>: [ ..., {"key": "node", "value": <node>}, {"key": <key>, "value": <value>}, ... ], ... }
+//  Flat layout:  { ..., "node": <node>, <key>: <value>, ... }.  Keys repeat when a node has multiple readings for the same key.
+#define CP_BATCH_ITEMS(array0, batch0, item_macro) { \
+    const char *batch_node = NULL; \
+    int batch_index; \
+    for (batch_index = 0; batch_index < (batch0)->count; batch_index++) { \
+        struct sensor_coap_reading *batch_reading = &(batch0)->readings[batch_index]; \
+        if (batch_reading->node && (batch_node == NULL || strcmp(batch_node, batch_reading->node) != 0)) { \
+            batch_node = batch_reading->node; \
+            CP_ITEM_STR(array0, "node", batch_node); \
+        } \
+        struct sensor_value *batch_val = &batch_reading->val; \
+        item_macro(array0, batch_val); \
+    } \
+}
+
+#if MYNEWT_VAL(SENSOR_COAP_SENML)  //  If we are composing SenML payloads...
+
+///////////////////////////////////////////////////////////////////////////////
+//  SenML Macros for composing CoAP Payloads in SenML JSON and CBOR (RFC 8428)
+//  Use these instead of the CP macros when the content format is APPLICATION_SENML_JSON or APPLICATION_SENML_CBOR.
+
+//  Compose the payload as a SenML pack.  base_time0 is the base time in seconds, relative to now.
+//    [ <children> ]
+#define CP_SENML_ROOT(base_time0, children0) { \
+    struct sensor_coap_senml senml; \
+    sensor_coap_senml_start(&senml, sensor_coap_current(), base_time0); \
+    { children0; } \
+    sensor_coap_senml_end(&senml); \
+}
+
+//  Set the base name for the following records to "<prefix0>:<name0>:".  Written into the next record.
+#define CP_SENML_BASE_NAME(prefix0, name0) sensor_coap_senml_set_base_name(&senml, prefix0, name0)
+
+//  Append a record with the name, value and time relative to the base time:
+//    [ ..., {"n": <name0>, "v": <value0>, "t": <time0>} ]
+#define CP_SENML_INT(  name0, value0, time0) sensor_coap_senml_add_int(  &senml, name0, value0, time0)
+#define CP_SENML_FLOAT(name0, value0, time0) sensor_coap_senml_add_float(&senml, name0, value0, time0)
+#define CP_SENML_STR(  name0, value0, time0) sensor_coap_senml_add_str(  &senml, name0, value0, time0)
+
+//  Append a record with the Sensor Value's key and value (integer).
+#define CP_SENML_INT_VAL(val0, time0) { \
+    assert(val0->val_type == SENSOR_VALUE_TYPE_INT32); \
+    CP_SENML_INT(val0->key, val0->int_val, time0); \
+}
+
+//  Append a record with the Sensor Value's key and value (float).
+#define CP_SENML_FLOAT_VAL(val0, time0) { \
+    assert(val0->val_type == SENSOR_VALUE_TYPE_FLOAT); \
+    CP_SENML_FLOAT(val0->key, val0->float_val, time0); \
+}
+
+//  Compose the payload as a SenML pack with the batched readings.  The base time is the time of the first reading
+//  and each record time is relative to it.  The base name "<prefix0>:<node>:" is set whenever the node changes.
+//  record_macro is CP_SENML_INT_VAL or CP_SENML_FLOAT_VAL, depending on the sensor value types.
+//    [{"bn": "<prefix>:<node>:", "bt": -25, "n": <key>, "v": <value>}, {"n": <key>, "v": <value>, "t": 5}, ... ]
+#define CP_SENML_BATCH(prefix0, batch0, record_macro) { \
+    struct sensor_coap_batch *senml_batch = (batch0); \
+    assert(senml_batch->count > 0); \
+    os_time_t senml_start = senml_batch->readings[0].time; \
+    CP_SENML_ROOT(-sensor_coap_senml_seconds(os_time_get() - senml_start), { \
+        const char *batch_node = NULL; \
+        int batch_index; \
+        for (batch_index = 0; batch_index < senml_batch->count; batch_index++) { \
+            struct sensor_coap_reading *batch_reading = &senml_batch->readings[batch_index]; \
+            if (batch_reading->node && (batch_node == NULL || strcmp(batch_node, batch_reading->node) != 0)) { \
+                batch_node = batch_reading->node; \
+                CP_SENML_BASE_NAME(prefix0, batch_node); \
+            } \
+            struct sensor_value *batch_val = &batch_reading->val; \
+            record_macro(batch_val, sensor_coap_senml_seconds(batch_reading->time - senml_start)); \
+        } \
+    }); \
+}
+
+#endif  //  MYNEWT_VAL(SENSOR_COAP_SENML)
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,257 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+//  Collect multiple sensor values into a single CoAP message.  Over WiFi, each message costs an AT+CIPSEND
+//  handshake with the ESP8266, so we send fewer and larger messages.  The batch is flushed when the payload
+//  is nearly full, when the batch is full, or when the oldest reading has waited too long.  On the Collector Node,
+//  the readings may be grouped by Sensor Node so that each node is written once, and the batch is flushed as soon
+//  as all nodes have reported.  The payload size is estimated according to the JSON layout, which is larger than CBOR.
+#include <os/mynewt.h>
+#include <sensor/sensor.h>  //  For SENSOR_VALUE_TYPE_INT32
+#include <console/console.h>
+#include "sensor_coap/sensor_coap.h"
+
+//  Estimated JSON sizes, according to the JSON encoder output: {"values": [{"key": "t","value": 1234},...]}
+#define ROOT_BYTES  (sizeof("{\"values\": []}") - 1)             //  Payload root and "values" array
+#define ITEM_BYTES  (sizeof("{\"key\": \"\",\"value\": },") - 1)  //  Item without key and value, including comma
+#define FLOAT_BYTES (MYNEWT_VAL(SENSOR_COAP_JSON_DECIMALS) + 2)     //  Sign, decimal point and decimal places
+
+//  Estimated SenML JSON sizes, according to CP_SENML_BATCH: [{"bn": "<prefix>:<node>:","bt": -25,"n": "t","v": 1715},...]
+#define SENML_ROOT_BYTES  (sizeof("[]") - 1)                     //  Pack root
+#define SENML_BT_BYTES    (sizeof("\"bt\": -,") - 1)              //  Base time without digits
+#define SENML_ITEM_BYTES  (sizeof("{\"n\": \"\",\"v\": ,\"t\": },") - 1)  //  Record without name, value and time digits
+#define SENML_BN_BYTES    (sizeof("\"bn\": \"::\",") - 1)          //  Base name without prefix and node
+
+//  Estimated flat JSON sizes, according to the flat layout: {"device": "<device>","t": 1234,...}
+#define FLAT_ROOT_BYTES   (sizeof("{}") - 1)                     //  Payload root
+#define FLAT_PAIR_BYTES   (sizeof("\"\": ,") - 1)                  //  Key/value pair without key and value, including comma
+
+static int flush_batch(struct sensor_coap_batch *batch);
+static int find_node(struct sensor_coap_batch *batch, const char *node);
+static int reading_size(struct sensor_coap_batch *batch, const struct sensor_value *val, const char *node);
+static int int_size(unsigned int i);
+static unsigned int batch_seconds(struct sensor_coap_batch *batch);
+static void batch_timeout(struct os_event *ev);
+
+int sensor_coap_batch_init(struct sensor_coap_batch *batch, uint16_t max_bytes, uint16_t reserved_bytes,
+    uint32_t max_latency_ms, sensor_coap_batch_func *flush_func, void *flush_arg) {
+    //  Init the batch.  Return 0 if successful.
+    assert(batch);  assert(flush_func);  assert(max_bytes > ROOT_BYTES + reserved_bytes);
+    memset(batch, 0, sizeof(struct sensor_coap_batch));
+    batch->reserved_bytes = ROOT_BYTES + reserved_bytes;
+    batch->bytes = batch->reserved_bytes;
+    batch->max_bytes = max_bytes;
+    batch->max_latency = os_time_ms_to_ticks32(max_latency_ms);
+    batch->flush_func = flush_func;
+    batch->flush_arg = flush_arg;
+    os_callout_init(&batch->callout, os_eventq_dflt_get(), batch_timeout, batch);
+    int rc = os_mutex_init(&batch->lock);  assert(rc == 0);
+    return rc;
+}
+
+#if MYNEWT_VAL(SENSOR_COAP_SENML)  //  If we are composing SenML payloads...
+
+int sensor_coap_batch_use_senml(struct sensor_coap_batch *batch, const char *base_prefix) {
+    //  Estimate the payload size according to the SenML JSON layout written by CP_SENML_BATCH.  The base name
+    //  prefix is repeated whenever the node changes, so it's counted with the node instead of being reserved.
+    //  Return 0 if successful.
+    assert(batch);  assert(base_prefix);  assert(batch->count == 0);  //  Must be called before adding readings.
+    if (batch->count > 0) { return -1; }
+    batch->senml = true;
+    batch->senml_prefix = strlen(base_prefix);
+    batch->reserved_bytes = SENML_ROOT_BYTES + SENML_BT_BYTES + int_size(batch_seconds(batch));
+    batch->bytes = batch->reserved_bytes;
+    assert(batch->max_bytes > batch->reserved_bytes);
+    return 0;
+}
+
+#endif  //  MYNEWT_VAL(SENSOR_COAP_SENML)
+
+#if MYNEWT_VAL(SENSOR_COAP_FLAT)  //  If we are supporting the flat payload layout...
+
+int sensor_coap_batch_use_flat(struct sensor_coap_batch *batch, uint16_t reserved_bytes) {
+    //  Estimate the payload size according to the flat layout.  reserved_bytes is the size of the fixed pairs,
+    //  e.g. sensor_coap_batch_pair_size("device", device_id).  Return 0 if successful.
+    assert(batch);  assert(batch->count == 0);  //  Must be called before adding readings.
+    if (batch->count > 0) { return -1; }
+    batch->flat = true;
+    batch->reserved_bytes = FLAT_ROOT_BYTES + reserved_bytes;
+    batch->bytes = batch->reserved_bytes;
+    assert(batch->max_bytes > batch->reserved_bytes);
+    return 0;
+}
+
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FLAT)
+
+int sensor_coap_batch_group_nodes(struct sensor_coap_batch *batch, uint8_t node_count) {
+    //  Keep the readings grouped by node, so that each node is written once per payload, and flush as soon as
+    //  readings from node_count different nodes have been collected.  If node_count is 0, don't flush by the
+    //  number of nodes.  Must be called before adding readings.  Return 0 if successful.
+    assert(batch);  assert(batch->count == 0);  assert(node_count <= MYNEWT_VAL(SENSOR_COAP_BATCH_COUNT));
+    if (batch->count > 0) { return -1; }
+    batch->group_nodes = true;
+    batch->node_target = node_count;
+    return 0;
+}
+
+int sensor_coap_batch_add(struct sensor_coap_batch *batch, const struct sensor_value *val, const char *node) {
+    //  Add the sensor value to the batch.  The batch will be flushed if it's full.  Return 0 if successful.
+    assert(batch);  assert(val);  assert(val->key);
+    int rc = 0;
+    os_error_t err = os_mutex_pend(&batch->lock, OS_TIMEOUT_NEVER);  assert(err == OS_OK);
+
+    //  If the reading doesn't fit into the payload, flush the batch first.
+    int size = reading_size(batch, val, node);
+    if (batch->count > 0 && (batch->bytes + size > batch->max_bytes || batch->count >= MYNEWT_VAL(SENSOR_COAP_BATCH_COUNT))) {
+        rc = flush_batch(batch);
+        size = reading_size(batch, val, node);  //  Node item is needed again after flushing.
+    }
+    if (batch->count > 0 && (batch->bytes + size > batch->max_bytes || batch->count >= MYNEWT_VAL(SENSOR_COAP_BATCH_COUNT))) {
+        //  The flush will be retried, so the batch is still full.  Drop the reading.
+        assert(rc == SYS_EAGAIN);
+        err = os_mutex_release(&batch->lock);  assert(err == OS_OK);
+        return rc;
+    }
+    assert(batch->bytes + size <= batch->max_bytes);  //  Reading is too big for the payload.
+    if (rc == SYS_EAGAIN) { rc = 0; }  //  The reading fits, so it's not dropped.
+
+    //  Add the reading.  If grouping by node, insert after the last reading from the same node.
+    //  The first reading stays in front, so it's still the oldest.  Start the latency timer for the first reading.
+    int index = batch->count;
+    if (batch->group_nodes && node) {
+        int last = find_node(batch, node);
+        if (last < 0) { batch->nodes++; }  //  First reading from the node.
+        else {
+            index = last + 1;
+            memmove(&batch->readings[index + 1], &batch->readings[index], (batch->count - index) * sizeof(batch->readings[0]));
+        }
+    }
+    batch->count++;
+    struct sensor_coap_reading *reading = &batch->readings[index];
+    reading->val = *val;
+    reading->node = node;
+    reading->time = os_time_get();
+    batch->bytes += size;
+    if (batch->count == 1) { os_callout_reset(&batch->callout, batch->max_latency); }
+
+    //  If the batch is full or all nodes have reported, flush the batch.
+    if (batch->count >= MYNEWT_VAL(SENSOR_COAP_BATCH_COUNT) ||
+        (batch->node_target > 0 && batch->nodes >= batch->node_target)) {
+        int rc2 = flush_batch(batch);
+        if (rc == 0 && rc2 != SYS_EAGAIN) { rc = rc2; }  //  If SYS_EAGAIN, the reading is kept for the retry.
+    }
+    err = os_mutex_release(&batch->lock);  assert(err == OS_OK);
+    return rc;
+}
+
+int sensor_coap_batch_flush(struct sensor_coap_batch *batch) {
+    //  Compose and post the batched readings now.  Return 0 if successful or if the batch is empty.
+    assert(batch);
+    os_error_t err = os_mutex_pend(&batch->lock, OS_TIMEOUT_NEVER);  assert(err == OS_OK);
+    int rc = flush_batch(batch);
+    err = os_mutex_release(&batch->lock);  assert(err == OS_OK);
+    return rc;
+}
+
+int sensor_coap_batch_item_size(const char *key, const char *value) {
+    //  Return the estimated JSON size of an item with a string value: {"key": "<key>","value": "<value>"},
+    assert(key);  assert(value);
+    return ITEM_BYTES + strlen(key) + strlen(value) + 2;
+}
+
+int sensor_coap_batch_pair_size(const char *key, const char *value) {
+    //  Return the estimated JSON size of a key/value pair with a string value in the flat layout: "<key>": "<value>",
+    assert(key);  assert(value);
+    return FLAT_PAIR_BYTES + strlen(key) + strlen(value) + 2;
+}
+
+static int flush_batch(struct sensor_coap_batch *batch) {
+    //  Call the flush function to compose and post the readings.  The batch must be locked.
+    //  If the flush function returns SYS_EAGAIN, e.g. no compose context is free, the readings are kept and the
+    //  flush is retried after SENSOR_COAP_BATCH_RETRY milliseconds.  If the flush function fails otherwise,
+    //  the readings are dropped.
+    if (batch->count == 0) { return 0; }
+    os_callout_stop(&batch->callout);
+    int rc = batch->flush_func(batch, batch->flush_arg);
+    if (rc == SYS_EAGAIN) {
+        os_callout_reset(&batch->callout, os_time_ms_to_ticks32(MYNEWT_VAL(SENSOR_COAP_BATCH_RETRY)));
+        return rc;
+    }
+    if (rc) { console_printf("NET batch dropped %d\n", batch->count); }
+    batch->count = 0;
+    batch->nodes = 0;
+    batch->bytes = batch->reserved_bytes;
+    return rc;
+}
+
+static int find_node(struct sensor_coap_batch *batch, const char *node) {
+    //  Return the index of the last reading from the node, or -1 if none.
+    int i;
+    for (i = batch->count - 1; i >= 0; i--) {
+        const char *n = batch->readings[i].node;
+        if (n && (n == node || strcmp(n, node) == 0)) { return i; }
+    }
+    return -1;
+}
+
+static int reading_size(struct sensor_coap_batch *batch, const struct sensor_value *val, const char *node) {
+    //  Return the estimated JSON size of the reading, including the "node" item or SenML base name if the node has changed.
+    int size = batch->senml ?
+        SENML_ITEM_BYTES + strlen(val->key) + int_size(batch_seconds(batch)) :  //  SenML record with relative time
+        (batch->flat ? FLAT_PAIR_BYTES : ITEM_BYTES) + strlen(val->key);
+    switch (val->val_type) {
+        case SENSOR_VALUE_TYPE_INT32: size += int_size(val->int_val); break;
+        case SENSOR_VALUE_TYPE_FLOAT: {
+            float f = (val->float_val < 0) ? -val->float_val : val->float_val;
+            size += int_size((unsigned int) f + 1) + FLOAT_BYTES;  //  Rounding may carry into the integer part.
+            break;
+        }
+        default: assert(0);  //  Unknown type
+    }
+    //  When grouping by node, the node is written only before its first reading.
+    const char *prev_node = (batch->count > 0) ? batch->readings[batch->count - 1].node : NULL;
+    bool new_node = node && (batch->group_nodes ?
+        (find_node(batch, node) < 0) :
+        (prev_node == NULL || strcmp(prev_node, node) != 0));
+    if (new_node) {
+        size += batch->senml ?
+            SENML_BN_BYTES + batch->senml_prefix + strlen(node) :  //  SenML base name "<prefix>:<node>:"
+            (batch->flat ? sensor_coap_batch_pair_size("node", node) : sensor_coap_batch_item_size("node", node));
+    }
+    return size;
+}
+
+static int int_size(unsigned int i) {
+    //  Return the number of decimal digits in i.
+    int size = 1;
+    while (i >= 10) { i /= 10; size++; }
+    return size;
+}
+
+static unsigned int batch_seconds(struct sensor_coap_batch *batch) {
+    //  Return the max age of a reading in seconds, for estimating the SenML times.  Rounded up.
+    return (os_time_ticks_to_ms32(batch->max_latency) + 999) / 1000;
+}
+
+static void batch_timeout(struct os_event *ev) {
+    //  Flush the batch when the oldest reading has waited max_latency ticks.  Called by the Event Queue.
+    struct sensor_coap_batch *batch = (struct sensor_coap_batch *) ev->ev_arg;
+    assert(batch);
+    sensor_coap_batch_flush(batch);
+}
@@ -0,0 +1,176 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+//  Cached CoAP header templates.  The URI, accept format and content format never change between posts to the
+//  same destination, so we serialise the CoAP options once per destination and copy them into every message.
+//  Only the Message ID and token change for each message.  CoAP message format (RFC 7252):
+//    Ver | T | TKL (1 byte), Code (1 byte), Message ID (2 bytes), Token (TKL bytes), Options, 0xFF, Payload
+#include <os/mynewt.h>
+#include <oic/messaging/coap/coap.h>
+#include "sensor_coap/sensor_coap.h"
+
+#define COAP_VERSION 1  //  CoAP version number
+
+static struct sensor_coap_header headers[MYNEWT_VAL(SENSOR_COAP_HEADER_CACHE)];  //  Cached header templates.  Entries are never evicted.
+
+static struct os_mbuf *write_header(const struct sensor_coap_header *header, uint8_t code, uint16_t mid,
+    const uint8_t *token, uint8_t token_len, const uint8_t *extra, uint8_t extra_len, struct os_mbuf *m);
+static int put_option(struct sensor_coap_header *header, uint16_t *prev_number, uint16_t number, const uint8_t *value, uint16_t len);
+static int put_uint_option(struct sensor_coap_header *header, uint16_t *prev_number, uint16_t number, uint32_t value);
+
+const struct sensor_coap_header *sensor_coap_get_header(const struct oc_server_handle *server, const char *uri, int content_format) {
+    //  Return the cached header template for the server, URI and content format.  Create the template if not found.
+    //  Return NULL if the cache is full or the options don't fit into the template.
+    assert(server);  assert(uri);  assert(content_format);
+    const struct sensor_coap_header *result = NULL;
+    os_sr_t sr;
+    OS_ENTER_CRITICAL(sr);
+    int i;
+    for (i = 0; i < MYNEWT_VAL(SENSOR_COAP_HEADER_CACHE); i++) {
+        struct sensor_coap_header *header = &headers[i];
+        if (header->server == NULL) {
+            //  Not found.  Create the template in the unused entry.
+            if (sensor_coap_build_header(header, uri, content_format) == 0) {
+                header->server = server;
+                result = header;
+            }
+            break;
+        }
+        if (header->server == server && header->content_format == content_format &&
+            (header->uri == uri || strcmp(header->uri, uri) == 0)) {
+            result = header;  //  Found the template.
+            break;
+        }
+    }
+    OS_EXIT_CRITICAL(sr);
+    return result;
+}
+
+int sensor_coap_header_size(const struct sensor_coap_header *header, uint8_t token_len) {
+    //  Return the size of the CoAP header written by sensor_coap_write_header(): Fixed header, token,
+    //  template options and payload marker.
+    assert(header);
+    return 4 + token_len + header->options_len + 1;
+}
+
+struct os_mbuf *sensor_coap_write_header(const struct sensor_coap_header *header, uint8_t code, uint16_t mid,
+    const uint8_t *token, uint8_t token_len, struct os_mbuf *m) {
+    //  Prepend the CoAP header for a NON message to the payload in the mbuf: Fixed header with the Message ID and token,
+    //  the template options and the payload marker.  The header is written in place into the leading space of the mbuf,
+    //  if the space was reserved.  Return the head of the mbuf chain, or NULL if out of mbufs (the chain is freed).
+    return write_header(header, code, mid, token, token_len, NULL, 0, m);
+}
+
+struct os_mbuf *sensor_coap_write_block1_header(const struct sensor_coap_header *header, uint8_t code, uint16_t mid,
+    const uint8_t *token, uint8_t token_len, uint32_t num, bool more, uint8_t szx, struct os_mbuf *m) {
+    //  Same as sensor_coap_write_header(), plus a Block1 option (RFC 7959) for block number num of the payload.
+    //  more is true if more blocks will follow.  szx is the block size exponent: block size is 2^(szx + 4).
+    //  Return the head of the mbuf chain, or NULL if out of mbufs (the chain is freed).
+    assert(szx <= 6);  assert(num < (1ul << 20));
+    uint8_t option[SENSOR_COAP_BLOCK1_OPTION_SIZE];
+    uint32_t value = (num << 4) | ((more ? 1 : 0) << 3) | szx;  //  NUM, M and SZX fields.
+    uint8_t len = (value > 0xffff) ? 3 : (value > 0xff) ? 2 : (value > 0) ? 1 : 0;  //  Fewest bytes, big endian.
+    int i;
+    //  The template options end with Accept, so the Block1 option delta fits into the option byte.
+    option[0] = ((COAP_OPTION_BLOCK1 - COAP_OPTION_ACCEPT) << 4) | len;
+    for (i = 0; i < len; i++) { option[1 + i] = (uint8_t) (value >> (8 * (len - 1 - i))); }
+    return write_header(header, code, mid, token, token_len, option, 1 + len, m);
+}
+
+static struct os_mbuf *write_header(const struct sensor_coap_header *header, uint8_t code, uint16_t mid,
+    const uint8_t *token, uint8_t token_len, const uint8_t *extra, uint8_t extra_len, struct os_mbuf *m) {
+    //  Prepend the fixed header, token, template options, extra options and payload marker to the payload.
+    //  extra contains serialised options that follow the template options.
+    assert(header);  assert(m);  assert(token_len <= COAP_TOKEN_LEN);
+    int size = sensor_coap_header_size(header, token_len) + extra_len;
+    m = os_mbuf_prepend_pullup(m, size);  //  Header must be contiguous in the first mbuf.
+    if (!m) { return NULL; }
+    uint8_t *buf = OS_MBUF_DATA(m, uint8_t *);
+    buf[0] = (COAP_VERSION << COAP_HEADER_VERSION_POSITION) |
+        (COAP_TYPE_NON << COAP_HEADER_TYPE_POSITION) | token_len;
+    buf[1] = code;
+    buf[2] = (uint8_t) (mid >> 8);
+    buf[3] = (uint8_t) mid;
+    if (token_len > 0) { memcpy(&buf[4], token, token_len); }
+    memcpy(&buf[4 + token_len], header->options, header->options_len);
+    if (extra_len > 0) { memcpy(&buf[4 + token_len + header->options_len], extra, extra_len); }
+    buf[size - 1] = COAP_PAYLOAD_MARKER;
+    return m;
+}
+
+int sensor_coap_build_header(struct sensor_coap_header *header, const char *uri, int content_format) {
+    //  Serialise the options into the header template, in increasing option number:
+    //  Uri-Path (11) for each path segment, Content-Format (12), Accept (17).  The template is not cached and
+    //  the server is not set.  Return 0 if successful, or -1 if the options don't fit into the template.
+    //  Accept must be the last option, since sensor_coap_write_block1_header() appends Block1 (27) after it.
+    assert(header);  assert(uri);  assert(content_format);
+    uint16_t prev_number = 0;
+    header->uri = uri;
+    header->content_format = content_format;
+    header->options_len = 0;
+
+    //  Split the URI into path segments, skipping the slashes.
+    const char *segment = uri;
+    while (*segment) {
+        if (*segment == '/') { segment++; continue; }
+        const char *end = strchr(segment, '/');
+        uint16_t len = end ? (end - segment) : strlen(segment);
+        if (put_option(header, &prev_number, COAP_OPTION_URI_PATH, (const uint8_t *) segment, len)) { return -1; }
+        segment += len;
+    }
+    if (put_uint_option(header, &prev_number, COAP_OPTION_CONTENT_FORMAT, content_format)) { return -1; }
+    if (put_uint_option(header, &prev_number, COAP_OPTION_ACCEPT, content_format)) { return -1; }
+    return 0;
+}
+
+static int put_option(struct sensor_coap_header *header, uint16_t *prev_number, uint16_t number, const uint8_t *value, uint16_t len) {
+    //  Append the option to the template, encoded as the delta from the previous option number.  Return 0 if successful.
+    uint8_t buf[5];
+    int size = 1;
+    uint16_t delta = number - *prev_number;
+    uint8_t delta_nibble, len_nibble;
+    //  Delta and length are encoded as 4-bit nibbles, extended by 1 byte (13 to 268) or 2 bytes (269 onwards).
+    if (delta < 13)       { delta_nibble = delta; }
+    else if (delta < 269) { delta_nibble = 13; buf[size++] = delta - 13; }
+    else                  { delta_nibble = 14; buf[size++] = (delta - 269) >> 8; buf[size++] = (delta - 269); }
+    if (len < 13)         { len_nibble = len; }
+    else if (len < 269)   { len_nibble = 13; buf[size++] = len - 13; }
+    else                  { len_nibble = 14; buf[size++] = (len - 269) >> 8; buf[size++] = (len - 269); }
+    buf[0] = (delta_nibble << 4) | len_nibble;
+
+    if (header->options_len + size + len > sizeof(header->options)) { return -1; }  //  Too long for the template.
+    memcpy(&header->options[header->options_len], buf, size);
+    memcpy(&header->options[header->options_len + size], value, len);
+    header->options_len += size + len;
+    *prev_number = number;
+    return 0;
+}
+
+static int put_uint_option(struct sensor_coap_header *header, uint16_t *prev_number, uint16_t number, uint32_t value) {
+    //  Append the unsigned integer option to the template, in the fewest bytes (big endian).  Return 0 if successful.
+    uint8_t buf[4];
+    uint16_t len = 0;
+    int shift;
+    for (shift = 24; shift >= 0; shift -= 8) {
+        uint8_t b = (uint8_t) (value >> shift);
+        if (len == 0 && b == 0) { continue; }  //  Skip leading zeros.
+        buf[len++] = b;
+    }
+    return put_option(header, prev_number, number, buf, len);
+}
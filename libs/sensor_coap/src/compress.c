@@ -0,0 +1,119 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+//  LZSS compression for batched payloads.  A batch of readings repeats the same keys and punctuation, like
+//  {"key": "t","value": 1715},{"key": "t","value": 1716}, so a small sliding window finds most of the repeats.
+//  The compressor reads the payload mbuf chain through a static window buffer, so the RAM used is fixed
+//  (SENSOR_COAP_LZSS_WINDOW plus 2 x LZSS_MAX_MATCH bytes) no matter how large the payload.  Format:
+//    Flag byte, followed by up to 8 tokens.  Bit i of the flag byte (LSB first) describes token i:
+//    0: Literal byte.
+//    1: Match of 2 bytes: distance - 1 (1 byte), length - LZSS_MIN_MATCH (1 byte).  Copy length bytes
+//       from distance bytes back in the output.  The match may overlap the bytes being copied.
+#include <os/mynewt.h>
+#include "sensor_coap/sensor_coap.h"
+
+#if MYNEWT_VAL(SENSOR_COAP_COMPRESS)  //  If we are compressing payloads...
+
+#if MYNEWT_VAL(SENSOR_COAP_LZSS_WINDOW) < 16 || MYNEWT_VAL(SENSOR_COAP_LZSS_WINDOW) > 256
+#error SENSOR_COAP_LZSS_WINDOW must be 16 to 256
+#endif  //  MYNEWT_VAL(SENSOR_COAP_LZSS_WINDOW) < 16 || MYNEWT_VAL(SENSOR_COAP_LZSS_WINDOW) > 256
+
+#define LZSS_WINDOW    MYNEWT_VAL(SENSOR_COAP_LZSS_WINDOW)  //  Max match distance.  Encoded in 1 byte.
+#define LZSS_MIN_MATCH 3   //  Shorter matches are written as literals, since a match takes 2 bytes.
+#define LZSS_MAX_MATCH 66  //  Longest match that we search for.  The format allows up to LZSS_MIN_MATCH + 255.
+#define LZSS_GROUP     (1 + 8 * 2)  //  Flag byte and 8 tokens of up to 2 bytes.
+
+static uint8_t window[LZSS_WINDOW + 2 * LZSS_MAX_MATCH];  //  Recent input for matching, plus the lookahead.
+static struct os_mutex window_lock;  //  Only 1 task may use the window at a time.
+
+static int find_match(int pos, int avail, int *distance);
+
+void sensor_coap_lzss_init(void) {
+    //  Init the compressor.  Called by init_sensor_coap().
+    os_error_t rc = os_mutex_init(&window_lock);  assert(rc == OS_OK);
+}
+
+int sensor_coap_lzss_compress(struct os_mbuf *src, int len, struct os_mbuf *dst) {
+    //  Compress the first len bytes of the mbuf chain src and append to dst.  Return the compressed size, or -1
+    //  if out of mbufs or if the compressed size would not be smaller than len.  dst may contain partial output
+    //  if failed.
+    assert(src);  assert(dst);  assert(len > 0);
+    uint8_t group[LZSS_GROUP];  //  Flag byte and tokens being collected.
+    int group_len = 1, tokens = 0, size = 0, rc = 0;
+    int read = 0;    //  Number of bytes read from src into the window.
+    int filled = 0;  //  Number of bytes in the window.
+    int pos = 0;     //  Position of the next byte to be compressed in the window.
+    int done = 0;    //  Number of bytes compressed before the window start.
+    group[0] = 0;
+    os_error_t err = os_mutex_pend(&window_lock, OS_TIMEOUT_NEVER);  assert(err == OS_OK);
+    while (done + pos < len) {
+        if (filled - pos < LZSS_MAX_MATCH && read < len) {
+            //  Lookahead is running out.  Slide the window to keep only LZSS_WINDOW bytes before pos, then refill.
+            if (pos > LZSS_WINDOW) {
+                int shift = pos - LZSS_WINDOW;
+                memmove(window, &window[shift], filled - shift);
+                filled -= shift;  pos -= shift;  done += shift;
+            }
+            int n = len - read;
+            if (n > (int) sizeof(window) - filled) { n = sizeof(window) - filled; }
+            if (os_mbuf_copydata(src, read, n, &window[filled])) { rc = -1;  break; }  //  src is too short.
+            read += n;  filled += n;
+        }
+        //  Write the longest match as a token, or a literal if none.
+        int avail = filled - pos;
+        if (avail > LZSS_MAX_MATCH) { avail = LZSS_MAX_MATCH; }
+        int distance = 0;
+        int match = find_match(pos, avail, &distance);
+        if (match >= LZSS_MIN_MATCH) {
+            group[0] |= 1 << tokens;
+            group[group_len++] = distance - 1;
+            group[group_len++] = match - LZSS_MIN_MATCH;
+            pos += match;
+        } else {
+            group[group_len++] = window[pos++];
+        }
+        if (++tokens == 8 || done + pos >= len) {
+            //  Append the flag byte and tokens.  Stop if the output is no smaller than the input.
+            size += group_len;
+            if (size >= len) { rc = -1;  break; }
+            if (os_mbuf_append(dst, group, group_len)) { rc = -1;  break; }
+            group[0] = 0;  group_len = 1;  tokens = 0;
+        }
+    }
+    err = os_mutex_release(&window_lock);  assert(err == OS_OK);
+    return rc ? -1 : size;
+}
+
+static int find_match(int pos, int avail, int *distance) {
+    //  Return the length of the longest match for the bytes at pos, searching up to LZSS_WINDOW bytes back.
+    //  The match may run past pos, up to avail bytes.  Set distance to the distance of the match.
+    int best = 0, start = (pos > LZSS_WINDOW) ? pos - LZSS_WINDOW : 0, i;
+    for (i = pos - 1; i >= start; i--) {
+        if (window[i] != window[pos] || window[i + best] != window[pos + best]) { continue; }  //  Can't be longer.
+        int n = 1;
+        while (n < avail && window[i + n] == window[pos + n]) { n++; }
+        if (n > best) {
+            best = n;  *distance = pos - i;
+            if (n == avail) { break; }  //  Can't be longer.
+        }
+    }
+    return best;
+}
+
+#endif  //  MYNEWT_VAL(SENSOR_COAP_COMPRESS)
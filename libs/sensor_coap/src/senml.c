@@ -0,0 +1,222 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+//  SenML encoder (RFC 8428) for the CP_SENML_* macros.  A SenML pack is an array of records.  The base name (bn)
+//  and base time (bt) are written only into the record where they change, so a time series from one node carries
+//  just the short sensor key, the value and the relative time in each record:
+//    [{"bn": "<device>:b3b4b5b6f1:","bt": -25,"n": "t","v": 1715},{"n": "t","v": 1716,"t": 10}]
+//  SenML JSON is written with the JSON encoder.  SenML CBOR uses the integer labels from RFC 8428 and
+//  definite-length record maps, since the number of fields is known before writing each record.
+#include <os/mynewt.h>
+#include <oic/messaging/coap/constants.h>  //  For APPLICATION_JSON, APPLICATION_CBOR
+#include "sensor_coap/sensor_coap.h"
+
+#if MYNEWT_VAL(SENSOR_COAP_SENML)  //  If we are composing SenML payloads...
+
+//  SenML CBOR labels (RFC 8428 Table 4)
+#define SENML_LABEL_BASE_NAME  -2  //  bn
+#define SENML_LABEL_BASE_TIME  -3  //  bt
+#define SENML_LABEL_NAME        0  //  n
+#define SENML_LABEL_VALUE       2  //  v
+#define SENML_LABEL_STRING      3  //  vs
+#define SENML_LABEL_TIME        6  //  t
+
+//  Record value to be written: one of int, float or string.
+struct record_value {
+    uint8_t type;  //  SENSOR_COAP_SLOT_INT, SENSOR_COAP_SLOT_FLOAT or SENSOR_COAP_SLOT_TEXT
+    struct sensor_coap_slot slot;
+};
+
+static void add_record(struct sensor_coap_senml *senml, const char *name, const struct record_value *value, int32_t time);
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+static void json_record(struct sensor_coap_senml *senml, const char *name, const struct record_value *value, int32_t time);
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+static void cbor_record(struct sensor_coap_senml *senml, const char *name, const struct record_value *value, int32_t time);
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+
+int sensor_coap_senml_start(struct sensor_coap_senml *senml, struct sensor_coap_context *ctx, int32_t base_time) {
+    //  Start the SenML pack in the compose context.  base_time is the base time in seconds, relative to now.
+    //  --> [
+    assert(senml);  assert(ctx);  assert(ctx->payload);
+    memset(senml, 0, sizeof(struct sensor_coap_senml));
+    senml->ctx = ctx;
+    senml->base_time = base_time;
+    senml->base_time_pending = (base_time != 0);  //  Base time 0 means now, which is the default.
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    if (ctx->content_format == APPLICATION_SENML_JSON) { return json_encode_array_start(&ctx->json_encoder); }
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+    if (ctx->content_format == APPLICATION_SENML_CBOR) {
+        ctx->cbor_err |= cbor_encoder_create_array(&ctx->cbor_encoder, &senml->array, CborIndefiniteLength);
+        return (ctx->cbor_err == CborNoError) ? 0 : -1;
+    }
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+    assert(0);  //  Content format is not SenML.
+    return -1;
+}
+
+void sensor_coap_senml_set_base_name(struct sensor_coap_senml *senml, const char *prefix, const char *name) {
+    //  Set the base name for the following records to "<prefix>:<name>:", or "<name>:" if prefix is NULL.
+    //  The base name is written into the next record.
+    assert(senml);  assert(name);
+    char *s = senml->base_name;
+    int prefix_len = prefix ? strlen(prefix) : 0;
+    int name_len = strlen(name);
+    int size = (prefix ? prefix_len + 1 : 0) + name_len + 2;  //  Separators and terminating null.
+    assert(size <= SENSOR_COAP_SENML_NAME_SIZE);  //  Base name too long.
+    if (size > SENSOR_COAP_SENML_NAME_SIZE) { return; }  //  Keep the previous base name.
+    if (prefix) { memcpy(s, prefix, prefix_len);  s += prefix_len;  *s++ = ':'; }
+    memcpy(s, name, name_len);  s += name_len;
+    *s++ = ':';
+    *s = 0;
+}
+
+void sensor_coap_senml_add_int(struct sensor_coap_senml *senml, const char *name, int32_t value, int32_t time) {
+    //  Append a record with the name, integer value and relative time.
+    struct record_value v;
+    v.type = SENSOR_COAP_SLOT_INT;
+    v.slot.int_val = value;
+    add_record(senml, name, &v, time);
+}
+
+void sensor_coap_senml_add_float(struct sensor_coap_senml *senml, const char *name, float value, int32_t time) {
+    //  Append a record with the name, float value and relative time.
+    struct record_value v;
+    v.type = SENSOR_COAP_SLOT_FLOAT;
+    v.slot.float_val = value;
+    add_record(senml, name, &v, time);
+}
+
+void sensor_coap_senml_add_str(struct sensor_coap_senml *senml, const char *name, const char *value, int32_t time) {
+    //  Append a record with the name, string value and relative time.
+    assert(value);
+    struct record_value v;
+    v.type = SENSOR_COAP_SLOT_TEXT;
+    v.slot.text_val = value;
+    add_record(senml, name, &v, time);
+}
+
+int sensor_coap_senml_end(struct sensor_coap_senml *senml) {
+    //  End the SenML pack.  Return 0 if successful.
+    //  [... --> [...]
+    assert(senml);  assert(senml->ctx);
+    struct sensor_coap_context *ctx = senml->ctx;
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    if (ctx->content_format == APPLICATION_SENML_JSON) { return json_encode_array_finish(&ctx->json_encoder); }
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+    if (ctx->content_format == APPLICATION_SENML_CBOR) {
+        ctx->cbor_err |= cbor_encoder_close_container(&ctx->cbor_encoder, &senml->array);
+        return (ctx->cbor_err == CborNoError) ? 0 : -1;
+    }
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+    assert(0);  //  Content format is not SenML.
+    return -1;
+}
+
+int32_t sensor_coap_senml_seconds(os_time_t ticks) {
+    //  Convert the OS ticks to SenML time in whole seconds.
+    return (int32_t) (os_time_ticks_to_ms32(ticks) / 1000);
+}
+
+static void add_record(struct sensor_coap_senml *senml, const char *name, const struct record_value *value, int32_t time) {
+    //  Append a record in the content format of the pack, with the pending base name and base time.
+    assert(senml);  assert(senml->ctx);  assert(name);
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    if (senml->ctx->content_format == APPLICATION_SENML_JSON) { json_record(senml, name, value, time); }
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+    if (senml->ctx->content_format == APPLICATION_SENML_CBOR) { cbor_record(senml, name, value, time); }
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+    //  Base name and base time apply to all following records.
+    senml->base_name[0] = 0;
+    senml->base_time_pending = false;
+}
+
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+
+static void json_record(struct sensor_coap_senml *senml, const char *name, const struct record_value *value, int32_t time) {
+    //  [... --> [...,{"bn": <base name>,"bt": <base time>,"n": <name>,"v": <value>,"t": <time>}
+    struct sensor_coap_context *ctx = senml->ctx;
+    struct json_encoder *encoder = &ctx->json_encoder;
+    struct json_value *jv = &ctx->json_value;
+    json_encode_object_start(encoder);
+    if (senml->base_name[0]) { JSON_VALUE_STRING(jv, senml->base_name);  json_encode_object_entry(encoder, "bn", jv); }
+    if (senml->base_time_pending) { JSON_VALUE_INT(jv, senml->base_time);  json_encode_object_entry(encoder, "bt", jv); }
+    JSON_VALUE_STRING(jv, (char *) name);
+    json_encode_object_entry(encoder, "n", jv);
+    switch (value->type) {
+        case SENSOR_COAP_SLOT_INT:   JSON_VALUE_INT(jv, value->slot.int_val);  json_encode_object_entry(encoder, "v", jv);  break;
+        case SENSOR_COAP_SLOT_FLOAT: JSON_VALUE_EXT_FLOAT(jv, value->slot.float_val);  json_encode_object_entry_ext(encoder, "v", jv);  break;
+        case SENSOR_COAP_SLOT_TEXT:  JSON_VALUE_STRING(jv, (char *) value->slot.text_val);  json_encode_object_entry(encoder, "vs", jv);  break;
+        default: assert(0);  //  Unknown value type.
+    }
+    if (time != 0) { JSON_VALUE_INT(jv, time);  json_encode_object_entry(encoder, "t", jv); }
+    json_encode_object_finish(encoder);
+}
+
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+
+static void cbor_record(struct sensor_coap_senml *senml, const char *name, const struct record_value *value, int32_t time) {
+    //  [... --> [..., {-2: <base name>, -3: <base time>, 0: <name>, 2: <value>, 6: <time>}
+    //  Floats are encoded as single precision, which is enough for sensor values and 4 bytes shorter than double.
+    struct sensor_coap_context *ctx = senml->ctx;
+    CborEncoder record;
+    CborError err = CborNoError;
+    size_t fields = 2 + (senml->base_name[0] ? 1 : 0) + (senml->base_time_pending ? 1 : 0) + (time != 0 ? 1 : 0);
+    err |= cbor_encoder_create_map(&senml->array, &record, fields);
+    if (senml->base_name[0]) {
+        err |= cbor_encode_int(&record, SENML_LABEL_BASE_NAME);
+        err |= cbor_encode_text_string(&record, senml->base_name, strlen(senml->base_name));
+    }
+    if (senml->base_time_pending) {
+        err |= cbor_encode_int(&record, SENML_LABEL_BASE_TIME);
+        err |= cbor_encode_int(&record, senml->base_time);
+    }
+    err |= cbor_encode_int(&record, SENML_LABEL_NAME);
+    err |= cbor_encode_text_string(&record, name, strlen(name));
+    switch (value->type) {
+        case SENSOR_COAP_SLOT_INT:
+            err |= cbor_encode_int(&record, SENML_LABEL_VALUE);
+            err |= cbor_encode_int(&record, value->slot.int_val);
+            break;
+        case SENSOR_COAP_SLOT_FLOAT:
+            err |= cbor_encode_int(&record, SENML_LABEL_VALUE);
+            err |= cbor_encode_float(&record, value->slot.float_val);
+            break;
+        case SENSOR_COAP_SLOT_TEXT:
+            err |= cbor_encode_int(&record, SENML_LABEL_STRING);
+            err |= cbor_encode_text_string(&record, value->slot.text_val, strlen(value->slot.text_val));
+            break;
+        default: assert(0);  //  Unknown value type.
+    }
+    if (time != 0) {
+        err |= cbor_encode_int(&record, SENML_LABEL_TIME);
+        err |= cbor_encode_int(&record, time);
+    }
+    err |= cbor_encoder_close_container(&senml->array, &record);
+    ctx->cbor_err |= err;
+}
+
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+
+#endif  //  MYNEWT_VAL(SENSOR_COAP_SENML)
@@ -22,31 +22,73 @@
 #include <oic/port/mynewt/config.h>
 #include <oic/messaging/coap/coap.h>
 #include <oic/oc_buffer.h>
-#include <oic/oc_client_state.h>
+#include <oic/port/oc_random.h>
 #include <console/console.h>
+#include <float_format/float_format.h>
 #include "sensor_coap/sensor_coap.h"
-#if MYNEWT_VAL(COAP_CBOR_ENCODING) && MYNEWT_VAL(COAP_JSON_ENCODING)  //  For coexistence of CBOR and JSON encoding...
-#include "tinycbor/cbor_cnt_writer.h"
-static struct CborCntWriter cnt_writer;  //  Set a dummy writer so that CBOR encoder will not crash when JSON encoding is selected
-#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING) && MYNEWT_VAL(COAP_JSON_ENCODING)
 
-#define OC_CLIENT_CB_TIMEOUT_SECS COAP_RESPONSE_TIMEOUT
+#define SENSOR_COAP_CONTEXTS MYNEWT_VAL(SENSOR_COAP_CONTEXTS)  //  Number of CoAP messages that may be composed at the same time.
+#define SENSOR_COAP_TOKEN_LEN MYNEWT_VAL(SENSOR_COAP_TOKEN_LEN)  //  Size of the locally generated CoAP token.
 
-static struct os_mbuf *oc_c_message;  //  Contains the CoAP headers.
-static struct os_mbuf *oc_c_rsp;      //  Contains the CoAP payload body.
-static coap_packet_t oc_c_request[1]; //  CoAP request.
-static struct os_sem oc_sem;          //  Because the CoAP JSON / CBOR buffers are shared, use this semaphore to prevent two CoAP requests from being composed at the same time.
+static struct sensor_coap_context coap_contexts[SENSOR_COAP_CONTEXTS];  //  Pool of compose contexts.
+static coap_packet_t coap_requests[SENSOR_COAP_CONTEXTS];  //  CoAP request for each compose context.
+static struct os_sem coap_context_sem;     //  Counts the free compose contexts.  Tasks will wait on this semaphore when all contexts are busy.
 static bool oc_sensor_coap_ready = false;  //  True if the Sensor CoAP is ready for sending sensor data.
-int oc_content_format = 0;            //  CoAP Payload encoding format: APPLICATION_JSON or APPLICATION_CBOR
-
+static uint32_t next_token;                //  Token for the next message.  Incremented for each message.
+static sensor_coap_send_func *send_func = NULL;  //  Transmits the messages, or NULL for coap_send_message().
+
+static struct sensor_coap_context *find_context(struct os_task *task);
+static void release_context(struct sensor_coap_context *ctx);
+#if MYNEWT_VAL(SENSOR_COAP_WAITERS) > 0  //  If tasks may be notified when a compose context is free...
+static struct {
+    struct os_eventq *evq;  //  Event queue for the event.
+    struct os_event *ev;    //  Event to be put onto the queue when a compose context is free.
+} coap_waiters[MYNEWT_VAL(SENSOR_COAP_WAITERS)];  //  Events waiting for a free compose context, oldest first.
+static int coap_waiter_count = 0;  //  Number of events waiting.
+static void notify_waiter(void);
+#endif  //  MYNEWT_VAL(SENSOR_COAP_WAITERS) > 0
+
+#if SENSOR_COAP_TOKEN_LEN > 4
+#error SENSOR_COAP_TOKEN_LEN must be 0 to 4
+#endif  //  SENSOR_COAP_TOKEN_LEN > 4
+#if MYNEWT_VAL(SENSOR_COAP_FLAT) && !MYNEWT_VAL(COAP_JSON_ENCODING)
+#error SENSOR_COAP_FLAT requires COAP_JSON_ENCODING, since the CBOR-only oc_rep_* macros write to named maps and arrays
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FLAT) && !MYNEWT_VAL(COAP_JSON_ENCODING)
+static void prepare_request_header(struct sensor_coap_context *ctx);
+static void new_message_id(struct sensor_coap_context *ctx);
+static uint16_t next_mid(void);
+static void send_message(struct sensor_coap_context *ctx, struct os_mbuf *m);
+static void send_payload(struct sensor_coap_context *ctx, const struct sensor_coap_header *header, uint16_t mid,
+    struct os_mbuf *m, int payload_len);
+#if MYNEWT_VAL(SENSOR_COAP_BLOCK1)  //  If we are sending large payloads as Block1 blocks...
+static uint8_t block1_szx = MYNEWT_VAL(SENSOR_COAP_BLOCK1_SZX);  //  Block size exponent: block size is 2^(szx + 4).
+static void send_blocks(struct sensor_coap_context *ctx, const struct sensor_coap_header *header, uint16_t mid,
+    struct os_mbuf *payload, int payload_len);
+static void send_uncached_blocks(struct sensor_coap_context *ctx, int payload_len);
+#endif  //  MYNEWT_VAL(SENSOR_COAP_BLOCK1)
+#if MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0  //  If we are sending each payload to multiple destinations...
+static void send_fanout(struct sensor_coap_context *ctx, int payload_len);
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0
+#if MYNEWT_VAL(SENSOR_COAP_COMPRESS)  //  If we are compressing payloads...
+static int compress_payload(struct sensor_coap_context *ctx, int payload_len);
+#endif  //  MYNEWT_VAL(SENSOR_COAP_COMPRESS)
 
 ///////////////////////////////////////////////////////////////////////////////
 //  CoAP Functions
 
 void init_sensor_coap(void) {
     //  Init the Sensor CoAP module. Called by sysinit() during startup, defined in pkg.yml.
-    os_error_t rc = os_sem_init(&oc_sem, 1);  //  Init to 1 token, so only 1 caller will be allowed.
+    int i;
+    for (i = 0; i < SENSOR_COAP_CONTEXTS; i++) {
+        memset(&coap_contexts[i], 0, sizeof(coap_contexts[i]));
+        coap_contexts[i].request = &coap_requests[i];
+    }
+    os_error_t rc = os_sem_init(&coap_context_sem, SENSOR_COAP_CONTEXTS);  //  Init to 1 token per context.
     assert(rc == OS_OK);
+    next_token = oc_random_rand();  //  Start from a random token so that tokens don't repeat after restarting.
+#if MYNEWT_VAL(SENSOR_COAP_COMPRESS)  //  If we are compressing payloads...
+    sensor_coap_lzss_init();
+#endif  //  MYNEWT_VAL(SENSOR_COAP_COMPRESS)
     oc_sensor_coap_ready = true;
 }
 
@@ -55,213 +97,668 @@ bool sensor_coap_ready(void) {
     return oc_sensor_coap_ready;
 }
 
-static void handle_coap_response(oc_client_response_t *data) {
-    //  Handle CoAP response.
-    console_printf("handle_coap\n");
-}
-
 static bool
-dispatch_coap_request(void)
+dispatch_coap_request(struct sensor_coap_context *ctx)
 {
     //  Serialise the CoAP request and payload into the final mbuf format for transmitting.
     //  Forward the serialised mbuf to the background transmit task for transmitting.
     bool ret = false;
-    assert(oc_content_format);
+    assert(ctx);  assert(ctx->content_format);
+    coap_packet_t *request = ctx->request;
     int response_length = 
 #if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON..
-        (oc_content_format == APPLICATION_JSON) ? json_rep_finalize() :
+        SENSOR_COAP_JSON_FORMAT(ctx->content_format) ? json_rep_finalize(ctx) :
 #endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
 #if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR..
-        (oc_content_format == APPLICATION_CBOR) ? oc_rep_finalize() :
+        SENSOR_COAP_CBOR_FORMAT(ctx->content_format) ? cbor_rep_finalize(ctx) :
 #endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
         0;  //  Unknown CoAP content format.
 
-    if (response_length) {
-        oc_c_request->payload_m = oc_c_rsp;
-        oc_c_request->payload_len = response_length;
-        coap_set_header_content_format(oc_c_request, oc_content_format);  //  Either JSON or CBOR.
-    } else {
-        os_mbuf_free_chain(oc_c_rsp);
-    }
-    oc_c_rsp = NULL;
+#if MYNEWT_VAL(SENSOR_COAP_COMPRESS)  //  If we are compressing payloads...
+    //  Compress the encoded payload once, before it's copied to the other destinations.
+    if (ctx->message && response_length > 0) { response_length = compress_payload(ctx, response_length); }
+#endif  //  MYNEWT_VAL(SENSOR_COAP_COMPRESS)
+
+#if MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0  //  If we are sending each payload to multiple destinations...
+    //  Copy the encoded payload to the other destinations before the payload is sent and freed.
+    if (ctx->message && response_length > 0) { send_fanout(ctx, response_length); }
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0
+
+    if (ctx->message && ctx->header) {
+        //  The payload was encoded into the message after the space reserved for the header.  Prepend the header
+        //  in place by copying the cached header template.  Only the Message ID and token are patched.
+        if (response_length > 0) {
+            send_payload(ctx, ctx->header, ctx->mid, ctx->message, response_length);
+        } else {
+            os_mbuf_free_chain(ctx->message);
+        }
+        ctx->payload = NULL;
+#if MYNEWT_VAL(SENSOR_COAP_BLOCK1)  //  If we are sending large payloads as Block1 blocks...
+    } else if (ctx->message && response_length > (16 << block1_szx)) {
+        //  No header template, e.g. the header cache is full, but the payload is too big for one message.
+        send_uncached_blocks(ctx, response_length);
+        ctx->payload = NULL;
+#endif  //  MYNEWT_VAL(SENSOR_COAP_BLOCK1)
+    } else if (ctx->message) {
+        //  No header template.  Serialise the CoAP request and append the payload chain.
+        if (response_length > 0) {
+            request->payload_m = ctx->payload;
+            request->payload_len = response_length;
+            coap_set_header_content_format(request, ctx->content_format);  //  JSON, CBOR or SenML.
+        } else {
+            os_mbuf_free_chain(ctx->payload);
+        }
+        ctx->payload = NULL;
 
-    if (oc_c_message) {
-        if (!coap_serialize_message(oc_c_request, oc_c_message)) {
-            coap_send_message(oc_c_message, 0);
+        if (!coap_serialize_message(request, ctx->message)) {
+            send_message(ctx, ctx->message);
         } else {
-            os_mbuf_free_chain(oc_c_message);
+            os_mbuf_free_chain(ctx->message);
         }
+    }
 
-        //  Deallocate the client callback for the message ID.  We won't be processing the response from server.  
+    if (ctx->message) {
+        //  No client callback was allocated for the NON message, so there is nothing to deallocate.
         //  TODO: Handle errors from server.
-        oc_ri_remove_client_cb_by_mid(oc_c_request->mid);
-
-        oc_c_message = NULL;
+        ctx->message = NULL;
         ret = true;
     }
-    os_error_t rc = os_sem_release(&oc_sem);  //  Request completed.  Release the semaphore for another request.
-    assert(rc == OS_OK);
+    release_context(ctx);  //  Request completed.  Release the context for another request.
     return ret;
 }
 
-static bool
-prepare_coap_request(oc_client_cb_t *cb, oc_string_t *query)
+static void send_payload(struct sensor_coap_context *ctx, const struct sensor_coap_header *header, uint16_t mid,
+    struct os_mbuf *m, int payload_len) {
+    //  Prepend the header to the payload in the mbuf and send it with the Message ID, or send the payload as
+    //  Block1 blocks if it's larger than the block size.  The mbuf is freed.
+#if MYNEWT_VAL(SENSOR_COAP_BLOCK1)  //  If we are sending large payloads as Block1 blocks...
+    if (payload_len > (16 << block1_szx)) { send_blocks(ctx, header, mid, m, payload_len);  return; }
+#endif  //  MYNEWT_VAL(SENSOR_COAP_BLOCK1)
+    m = sensor_coap_write_header(header, COAP_POST, mid, ctx->token, ctx->token_len, m);
+    if (m) { send_message(ctx, m); }  //  If out of mbufs, the message has been freed.
+}
+
+static void send_message(struct sensor_coap_context *ctx, struct os_mbuf *m) {
+    //  Transmit the serialised message with the send function, or forward to the OIC Background Task.
+    if (send_func) { send_func(m, ctx->priority); }
+    else { coap_send_message(m, 0); }
+}
+
+void sensor_coap_set_send_func(sensor_coap_send_func *func) {
+    //  Transmit the serialised CoAP messages with the function, e.g. to queue them for a transmit task, instead of
+    //  coap_send_message().  NULL to restore coap_send_message().
+    send_func = func;
+}
+
+#if MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0  //  If we are sending each payload to multiple destinations...
+
+int sensor_coap_add_destination(struct sensor_coap_context *ctx, struct oc_server_handle *server, const char *uri) {
+    //  Send a copy of the payload to another server and URI, with the same content format.  Call after
+    //  init_sensor_post() and before do_sensor_post().  Return 0 if successful, or -1 if there are already
+    //  SENSOR_COAP_FANOUT destinations or there is no header template for the destination.
+    assert(ctx);  assert(ctx->owner == os_sched_get_current_task());  assert(server);  assert(uri);
+    if (ctx->fanout_count >= MYNEWT_VAL(SENSOR_COAP_FANOUT)) { return -1; }
+    const struct sensor_coap_header *header = sensor_coap_get_header(server, uri, ctx->content_format);
+    if (!header) { return -1; }  //  Copies are sent only with a header template.
+    struct sensor_coap_destination *dest = &ctx->fanout[ctx->fanout_count++];
+    dest->server = server;
+    dest->header = header;
+    return 0;
+}
+
+static void send_fanout(struct sensor_coap_context *ctx, int payload_len) {
+    //  Send a copy of the encoded payload to each destination added by sensor_coap_add_destination(), each with
+    //  its own header and Message ID.  The payload is encoded only once: each copy costs an mbuf copy of the
+    //  payload bytes, not another encoding.  Mynewt mbufs can't be shared between chains, so the bytes are copied.
+    int i;
+    for (i = 0; i < ctx->fanout_count; i++) {
+        const struct sensor_coap_destination *dest = &ctx->fanout[i];
+        struct os_mbuf *m = oc_allocate_mbuf(&dest->server->endpoint);
+        if (!m) { break; }  //  Out of mbufs.
+        int headroom = sensor_coap_header_size(dest->header, ctx->token_len);
+        if (OS_MBUF_TRAILINGSPACE(m) > headroom) { m->om_data += headroom; }
+        if (os_mbuf_appendfrom(m, ctx->payload, 0, payload_len)) { os_mbuf_free_chain(m);  break; }
+        send_payload(ctx, dest->header, next_mid(), m, payload_len);
+    }
+    ctx->fanout_count = 0;
+}
+
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0
+
+#if MYNEWT_VAL(SENSOR_COAP_COMPRESS)  //  If we are compressing payloads...
+
+void sensor_coap_set_compress(struct sensor_coap_context *ctx, bool compress) {
+    //  If compress is true, compress the payload with LZSS when the message is sent.
+    assert(ctx);  assert(ctx->owner == os_sched_get_current_task());
+    ctx->compress = compress;
+}
+
+static int compress_payload(struct sensor_coap_context *ctx, int payload_len) {
+    //  Replace the payload by the LZSS compressed payload and switch to the compressed content format, including the
+    //  header templates of the other destinations.  Return the new payload size.  If the payload is too small,
+    //  doesn't shrink or there are no header templates for the compressed format, keep the payload unchanged.
+    if (!ctx->compress || payload_len < MYNEWT_VAL(SENSOR_COAP_COMPRESS_MIN)) { return payload_len; }
+    int format = SENSOR_COAP_LZSS_FORMAT(ctx->content_format);
+
+    //  Look up the header templates for the compressed format before changing anything.
+    const struct sensor_coap_header *header = NULL;
+    if (ctx->header) {
+        header = sensor_coap_get_header(ctx->header->server, ctx->uri, format);
+        if (!header) { return payload_len; }  //  Header cache is full.
+    }
+#if MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0  //  If we are sending each payload to multiple destinations...
+    const struct sensor_coap_header *fanout_headers[MYNEWT_VAL(SENSOR_COAP_FANOUT)];
+    int i;
+    for (i = 0; i < ctx->fanout_count; i++) {
+        const struct sensor_coap_header *dest = ctx->fanout[i].header;
+        fanout_headers[i] = sensor_coap_get_header(dest->server, dest->uri, format);
+        if (!fanout_headers[i]) { return payload_len; }  //  Header cache is full.
+    }
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0
+
+    //  Compress into a new mbuf chain.  With a header template, the new chain becomes the message, so it needs
+    //  the same user header (the endpoint) and leading space for the header.
+    struct os_mbuf *m = ctx->header ?
+        os_msys_get_pkthdr(0, OS_MBUF_USRHDR_LEN(ctx->message)) :
+        os_msys_get_pkthdr(0, 0);
+    if (!m) { return payload_len; }  //  Out of mbufs.
+    if (ctx->header) {
+        memcpy(OS_MBUF_USRHDR(m), OS_MBUF_USRHDR(ctx->message), OS_MBUF_USRHDR_LEN(ctx->message));
+        int headroom = sensor_coap_header_size(header, ctx->token_len);
+        if (OS_MBUF_TRAILINGSPACE(m) > headroom) { m->om_data += headroom; }
+    }
+    int len = sensor_coap_lzss_compress(ctx->payload, payload_len, m);
+    if (len < 0) { os_mbuf_free_chain(m);  return payload_len; }  //  Doesn't shrink or out of mbufs.
+
+    //  Replace the payload.
+    os_mbuf_free_chain(ctx->payload);
+    ctx->payload = m;
+    if (ctx->header) { ctx->message = m;  ctx->header = header; }
+#if MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0  //  If we are sending each payload to multiple destinations...
+    for (i = 0; i < ctx->fanout_count; i++) { ctx->fanout[i].header = fanout_headers[i]; }
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0
+    ctx->content_format = format;
+    return len;
+}
+
+#endif  //  MYNEWT_VAL(SENSOR_COAP_COMPRESS)
+
+#if MYNEWT_VAL(SENSOR_COAP_BLOCK1)  //  If we are sending large payloads as Block1 blocks...
+
+int sensor_coap_set_block1_szx(uint8_t szx) {
+    //  Set the block size exponent for Block1 transfers: block size is 2^(szx + 4), from 16 to 1024 bytes.
+    //  Return 0 if successful.
+    assert(szx <= 6);
+    if (szx > 6) { return -1; }
+    block1_szx = szx;
+    return 0;
+}
+
+static void send_blocks(struct sensor_coap_context *ctx, const struct sensor_coap_header *header, uint16_t mid,
+    struct os_mbuf *payload, int payload_len) {
+    //  Send the payload in the message as RFC 7959 Block1 blocks, each in its own NON message with a new Message ID.
+    //  The first block uses the Message ID mid.  Each block is copied into a new mbuf chain and the copied mbufs of
+    //  the payload are freed right away, so the blocks don't need any more mbufs than the payload plus one block.
+    //  The message is freed.
+    uint8_t szx = block1_szx;
+    int block_size = 16 << szx;
+    int headroom = sensor_coap_header_size(header, ctx->token_len) + SENSOR_COAP_BLOCK1_OPTION_SIZE;
+    uint32_t num;
+    for (num = 0; num * block_size < payload_len; num++) {
+        int len = payload_len - num * block_size;
+        bool more = (len > block_size);
+        if (more) { len = block_size; }
+
+        //  Copy the block into a new message for the same endpoint, after reserving space for the header.
+        struct os_mbuf *m = oc_allocate_mbuf(OC_MBUF_ENDPOINT(payload));
+        if (!m) { break; }
+        if (OS_MBUF_TRAILINGSPACE(m) > headroom) { m->om_data += headroom; }
+        if (os_mbuf_appendfrom(m, payload, 0, len)) { os_mbuf_free_chain(m);  break; }
+
+        //  Trim the block from the payload and free the emptied mbufs.  The first mbuf holds the endpoint.
+        os_mbuf_adj(payload, len);
+        struct os_mbuf *next;
+        while ((next = SLIST_NEXT(payload, om_next)) != NULL && next->om_len == 0) {
+            SLIST_NEXT(payload, om_next) = SLIST_NEXT(next, om_next);
+            os_mbuf_free(next);
+        }
+
+        m = sensor_coap_write_block1_header(header, COAP_POST, mid, ctx->token, ctx->token_len, num, more, szx, m);
+        if (!m) { break; }  //  Out of mbufs.  The block has been freed.
+        send_message(ctx, m);
+        mid = next_mid();
+    }
+    os_mbuf_free_chain(payload);
+}
+
+static void send_uncached_blocks(struct sensor_coap_context *ctx, int payload_len) {
+    //  Send the payload as Block1 blocks when the destination has no cached header template.  Build the template
+    //  on the stack and move the payload chain behind the endpoint in the message, like a payload encoded with a
+    //  template.  If the options don't fit into a template, drop the message and set it to NULL so that the post
+    //  fails, since the payload is too big to send whole.  The message and payload are freed.
+    struct sensor_coap_header header;
+    if (sensor_coap_build_header(&header, ctx->uri, ctx->content_format) != 0) {
+        console_printf("COAP no header for block1 %s, dropped %d bytes\n", ctx->uri, payload_len);
+        os_mbuf_free_chain(ctx->payload);
+        os_mbuf_free_chain(ctx->message);
+        ctx->payload = NULL;
+        ctx->message = NULL;
+        return;
+    }
+    os_mbuf_concat(ctx->message, ctx->payload);  //  The message is empty, since the request was not serialised.
+    send_blocks(ctx, &header, ctx->mid, ctx->message, payload_len);
+}
+
+#endif  //  MYNEWT_VAL(SENSOR_COAP_BLOCK1)
+
+static void
+prepare_request_header(struct sensor_coap_context *ctx)
 {
-    //  Prepare a new CoAP request for transmitting sensor data.
+    //  Set the CoAP request headers, for serialising the CoAP request without a header template.
     coap_message_type_t type = COAP_TYPE_NON;
+    coap_packet_t *request = ctx->request;
+    coap_init_message(request, type, COAP_POST, ctx->mid);
+    coap_set_header_accept(request, ctx->content_format);  //  JSON, CBOR or SenML.
+    coap_set_token(request, ctx->token, ctx->token_len);
+    coap_set_header_uri_path(request, ctx->uri);
+}
 
-    oc_c_rsp = os_msys_get_pkthdr(0, 0);
-    if (!oc_c_rsp) {
+static void new_message_id(struct sensor_coap_context *ctx) {
+    //  Generate the Message ID and token for a new NON message locally, without allocating a client callback
+    //  with oc_ri_alloc_client_cb().  We don't process the responses, so the client callback and its
+    //  timeout callout were removed right after sending anyway.  The token is the big endian counter.
+    os_sr_t sr;
+    ctx->mid = next_mid();
+    OS_ENTER_CRITICAL(sr);  //  Tokens may be requested by multiple tasks.
+    uint32_t token = next_token++;
+    OS_EXIT_CRITICAL(sr);
+    ctx->token_len = SENSOR_COAP_TOKEN_LEN;
+    int i;
+    for (i = 0; i < SENSOR_COAP_TOKEN_LEN; i++) { ctx->token[i] = (uint8_t) (token >> (8 * (SENSOR_COAP_TOKEN_LEN - 1 - i))); }
+}
+
+static uint16_t next_mid(void) {
+    //  Return the next CoAP Message ID.  Message IDs may be requested by multiple tasks.
+    os_sr_t sr;
+    OS_ENTER_CRITICAL(sr);
+    uint16_t mid = coap_get_mid();
+    OS_EXIT_CRITICAL(sr);
+    return mid;
+}
+
+static bool
+prepare_coap_request(struct sensor_coap_context *ctx, struct oc_server_handle *server, const char *uri)
+{
+    //  Prepare a new NON CoAP request for transmitting sensor data.  If we have a cached header template for the
+    //  destination, we skip the CoAP request headers and copy the template when sending.
+    new_message_id(ctx);
+    ctx->uri = uri;
+#if MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0  //  If we are sending each payload to multiple destinations...
+    ctx->fanout_count = 0;
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0
+    ctx->header = sensor_coap_get_header(server, uri, ctx->content_format);  //  Look up the header template for the destination.
+
+    ctx->message = oc_allocate_mbuf(&server->endpoint);
+    if (!ctx->message) {
         return false;
     }
-    oc_c_message = oc_allocate_mbuf(&cb->server.endpoint);
-    if (!oc_c_message) {
-        goto free_rsp;
+    if (ctx->header) {
+        //  Encode the payload directly into the message, after reserving space for the header.
+        //  The header will be prepended in place, so the message needs only 1 mbuf chain.  If the mbuf is too small
+        //  to reserve the space, os_mbuf_prepend_pullup() will allocate another mbuf for the header.
+        int headroom = sensor_coap_header_size(ctx->header, ctx->token_len);
+        if (OS_MBUF_TRAILINGSPACE(ctx->message) > headroom) { ctx->message->om_data += headroom; }
+        ctx->payload = ctx->message;
+    } else {
+        //  Without a header template, coap_serialize_message() will write the header and append the payload chain.
+        ctx->payload = os_msys_get_pkthdr(0, 0);
+        if (!ctx->payload) {
+            goto free_msg;
+        }
     }
     
-    if (oc_content_format == APPLICATION_JSON) { 
+    //  SenML JSON and SenML CBOR are written by the JSON and CBOR encoders, through the CP_SENML_* macros.
+    assert(MYNEWT_VAL(SENSOR_COAP_SENML) || !SENSOR_COAP_SENML_FORMAT(ctx->content_format));  //  SenML not enabled.
+    if (SENSOR_COAP_JSON_FORMAT(ctx->content_format)) { 
 #if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON..
-        json_rep_new(oc_c_rsp); 
+        json_rep_new(ctx, ctx->payload); 
 #endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
     }
-    else if (oc_content_format == APPLICATION_CBOR) { 
+    else if (SENSOR_COAP_CBOR_FORMAT(ctx->content_format)) { 
 #if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR..
-        oc_rep_new(oc_c_rsp); 
+        cbor_rep_new(ctx, ctx->payload); 
 #endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
     }
     else { assert(0); }  //  Unknown CoAP content format.
 
-    coap_init_message(oc_c_request, type, cb->method, cb->mid);
-    coap_set_header_accept(oc_c_request, oc_content_format);  //  Either JSON or CBOR.
-    coap_set_token(oc_c_request, cb->token, cb->token_len);
-    coap_set_header_uri_path(oc_c_request, oc_string(cb->uri));
-    if (cb->observe_seq != -1) {
-        coap_set_header_observe(oc_c_request, cb->observe_seq);
-    }
-    if (query && oc_string_len(*query)) {
-        coap_set_header_uri_query(oc_c_request, oc_string(*query));
-    }
-    if (cb->observe_seq == -1 && cb->qos == LOW_QOS) {
-        os_callout_reset(&cb->callout,
-          OC_CLIENT_CB_TIMEOUT_SECS * OS_TICKS_PER_SEC);
-    }
-
+    if (!ctx->header) { prepare_request_header(ctx); }
     return true;
-free_rsp:
-    os_mbuf_free_chain(oc_c_rsp);
-    oc_c_rsp = NULL;
+free_msg:
+    os_mbuf_free_chain(ctx->message);
+    ctx->message = NULL;
     return false;
 }
 
-bool
+struct sensor_coap_context *
 init_sensor_post(struct oc_server_handle *server, const char *uri, int coap_content_format)
 {
-    //  Create a new sensor post request to send to CoAP server.
-    assert(oc_sensor_coap_ready);  assert(server);  assert(uri);
+    //  Create a new sensor post request to send to CoAP server.  Return the compose context,
+    //  or NULL if no context is free after SENSOR_COAP_ACQUIRE_TIMEOUT milliseconds.
+    struct sensor_coap_context *ctx = NULL;
+    int rc = init_sensor_post_wait(server, uri, coap_content_format, MYNEWT_VAL(SENSOR_COAP_ACQUIRE_TIMEOUT), &ctx);
+    return (rc == 0) ? ctx : NULL;
+}
+
+int
+init_sensor_post_wait(struct oc_server_handle *server, const char *uri, int coap_content_format,
+    uint32_t timeout_ms, struct sensor_coap_context **ctx_out)
+{
+    //  Create a new sensor post request to send to CoAP server, waiting at most timeout_ms milliseconds for a
+    //  free compose context.  SENSOR_COAP_NO_WAIT fails right away.  Return 0 and set ctx_out if successful,
+    //  SYS_EAGAIN if all contexts are still busy, or SYS_ENOMEM if out of mbufs.
+    assert(oc_sensor_coap_ready);  assert(server);  assert(uri);  assert(ctx_out);
+    *ctx_out = NULL;
 #ifdef COAP_CONTENT_FORMAT
     //  If content format is not specified, select the default.
     if (coap_content_format == 0) { coap_content_format = COAP_CONTENT_FORMAT; }
 #endif  //  COAP_CONTENT_FORMAT
     assert(coap_content_format != 0);  //  CoAP Content Format not specified
 
-    //  Lock the semaphore for preparing the CoAP request.
-    os_error_t rc = os_sem_pend(&oc_sem, OS_TIMEOUT_NEVER);  //  Allow only 1 task to be creating a sensor request at any time.
+    //  Wait for a free compose context.  Other tasks may be composing their requests with the other contexts.
+    struct os_task *task = os_sched_get_current_task();
+    assert(find_context(task) == NULL);  //  Task is already composing a request.  Call do_sensor_post() first.
+    os_error_t rc = os_sem_pend(&coap_context_sem, os_time_ms_to_ticks32(timeout_ms));
+    if (rc == OS_TIMEOUT) { return SYS_EAGAIN; }  //  All contexts are busy.
     assert(rc == OS_OK);
 
-    oc_content_format = coap_content_format;
-    oc_qos_t qos = LOW_QOS;  //  Default to low QoS, no transactions.
-    oc_response_handler_t handler = handle_coap_response;
-    oc_client_cb_t *cb;
-    bool status = false;
+    //  Assign a free context to the task.
+    struct sensor_coap_context *ctx = NULL;
+    os_sr_t sr;
+    OS_ENTER_CRITICAL(sr);
+    int i;
+    for (i = 0; i < SENSOR_COAP_CONTEXTS; i++) {
+        if (coap_contexts[i].owner == NULL) {
+            ctx = &coap_contexts[i];
+            ctx->owner = task;
+            break;
+        }
+    }
+    OS_EXIT_CRITICAL(sr);
+    assert(ctx);  //  Semaphore count should match the free contexts.
+
+    ctx->content_format = coap_content_format;
+    ctx->priority = SENSOR_COAP_PRIORITY_NORMAL;  //  Caller may change with sensor_coap_set_priority().
+#if MYNEWT_VAL(SENSOR_COAP_FLAT)  //  If we are supporting the flat payload layout...
+    ctx->layout = SENSOR_COAP_LAYOUT_ITEMS;  //  Default layout.  Caller may change with sensor_coap_set_layout().
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FLAT)
+#if MYNEWT_VAL(SENSOR_COAP_COMPRESS)  //  If we are compressing payloads...
+    ctx->compress = false;  //  Caller may enable with sensor_coap_set_compress().
+#endif  //  MYNEWT_VAL(SENSOR_COAP_COMPRESS)
+    if (!prepare_coap_request(ctx, server, uri)) {
+        release_context(ctx);  //  Failed.  Release the context.
+        return SYS_ENOMEM;
+    }
+    *ctx_out = ctx;
+    return 0;
+}
 
-    cb = oc_ri_alloc_client_cb(uri, server, OC_POST, handler, qos);
-    if (!cb) {
-        rc = os_sem_release(&oc_sem);  //  Failed.  Release the semaphore.
-        assert(rc == OS_OK);
-        return false;
+#if MYNEWT_VAL(SENSOR_COAP_WAITERS) > 0  //  If tasks may be notified when a compose context is free...
+
+int sensor_coap_notify_free(struct os_eventq *evq, struct os_event *ev) {
+    //  Put the event onto the event queue when a compose context is free: right away if a context is free now,
+    //  else when the next context is released.  The event callback should call init_sensor_post_wait() with
+    //  SENSOR_COAP_NO_WAIT, which may still return SYS_EAGAIN if another task took the context first.
+    //  Return 0 if successful, or SYS_ENOMEM if SENSOR_COAP_WAITERS events are already waiting.
+    assert(oc_sensor_coap_ready);  assert(evq);  assert(ev);  assert(ev->ev_cb);
+    int rc = 0, i;
+    bool notify_now = false;
+    os_sr_t sr;
+    OS_ENTER_CRITICAL(sr);
+    if (os_sem_get_count(&coap_context_sem) > 0) {
+        notify_now = true;
+    } else {
+        //  Append to the waiting events, unless already waiting.
+        for (i = 0; i < coap_waiter_count; i++) {
+            if (coap_waiters[i].ev == ev) { break; }
+        }
+        if (i == coap_waiter_count) {
+            if (coap_waiter_count < MYNEWT_VAL(SENSOR_COAP_WAITERS)) {
+                coap_waiters[coap_waiter_count].evq = evq;
+                coap_waiters[coap_waiter_count].ev = ev;
+                coap_waiter_count++;
+            } else { rc = SYS_ENOMEM; }
+        }
     }
-    status = prepare_coap_request(cb, NULL);
-    return status;
+    OS_EXIT_CRITICAL(sr);
+    if (notify_now) { os_eventq_put(evq, ev); }
+    return rc;
+}
+
+static void notify_waiter(void) {
+    //  A compose context has been released.  Notify the event that has waited longest.
+    struct os_eventq *evq = NULL;
+    struct os_event *ev = NULL;
+    os_sr_t sr;
+    OS_ENTER_CRITICAL(sr);
+    if (coap_waiter_count > 0) {
+        evq = coap_waiters[0].evq;
+        ev = coap_waiters[0].ev;
+        coap_waiter_count--;
+        memmove(&coap_waiters[0], &coap_waiters[1], coap_waiter_count * sizeof(coap_waiters[0]));
+    }
+    OS_EXIT_CRITICAL(sr);
+    if (ev) { os_eventq_put(evq, ev); }
+}
+
+#endif  //  MYNEWT_VAL(SENSOR_COAP_WAITERS) > 0
+
+int sensor_coap_set_priority(struct sensor_coap_context *ctx, uint8_t priority) {
+    //  Set the transmit priority of the message: SENSOR_COAP_PRIORITY_ALERT, SENSOR_COAP_PRIORITY_NORMAL (default)
+    //  or SENSOR_COAP_PRIORITY_BULK.  Return 0 if successful.
+    assert(ctx);  assert(ctx->owner == os_sched_get_current_task());  assert(priority < SENSOR_COAP_PRIORITIES);
+    if (priority >= SENSOR_COAP_PRIORITIES) { return -1; }
+    ctx->priority = priority;
+    return 0;
+}
+
+#if MYNEWT_VAL(SENSOR_COAP_FLAT)  //  If we are supporting the flat payload layout...
+
+int sensor_coap_set_layout(struct sensor_coap_context *ctx, uint8_t layout) {
+    //  Set the payload layout written by the CP_* macros and payload skeletons: SENSOR_COAP_LAYOUT_ITEMS
+    //  or SENSOR_COAP_LAYOUT_FLAT.  SenML payloads are not affected.  Return 0 if successful.
+    assert(ctx);  assert(ctx->owner == os_sched_get_current_task());
+    assert(layout == SENSOR_COAP_LAYOUT_ITEMS || layout == SENSOR_COAP_LAYOUT_FLAT);
+    if (layout != SENSOR_COAP_LAYOUT_ITEMS && layout != SENSOR_COAP_LAYOUT_FLAT) { return -1; }
+    ctx->layout = layout;
+    return 0;
+}
+
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FLAT)
+
+int sensor_coap_set_server(struct sensor_coap_context *ctx, struct oc_server_handle *server) {
+    //  Send the message being composed to another server, e.g. through another network interface whose MTU fits
+    //  the payload.  The encoded payload is kept.  Return 0 if successful, or SYS_ENOMEM if out of mbufs.
+    assert(ctx);  assert(ctx->owner == os_sched_get_current_task());  assert(server);  assert(ctx->message);
+    struct os_mbuf *m = oc_allocate_mbuf(&server->endpoint);  //  The endpoint is stored in the mbuf user header.
+    if (!m) { return SYS_ENOMEM; }
+    if (ctx->header) {
+        //  The payload was encoded into the message after the space reserved for the old header.  Keep the mbuf
+        //  as the payload chain, since the encoder still writes to it, and serialise the request for the new server.
+        ctx->header = NULL;
+        prepare_request_header(ctx);
+    } else {
+        os_mbuf_free_chain(ctx->message);  //  Message is empty, since the request is serialised when sending.
+    }
+    ctx->message = m;
+#if MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0  //  If we are sending each payload to multiple destinations...
+    ctx->fanout_count = 0;  //  The copies were meant for the old server.
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0
+    return 0;
 }
 
 bool
-do_sensor_post(void)
+do_sensor_post(struct sensor_coap_context *ctx)
 {
     //  Send the sensor post request to CoAP server.
-    return dispatch_coap_request();
+    assert(ctx);  assert(ctx->owner == os_sched_get_current_task());
+    return dispatch_coap_request(ctx);
+}
+
+void sensor_coap_discard(struct sensor_coap_context *ctx) {
+    //  Discard the sensor post request without sending, e.g. if the payload is too big for the network interface,
+    //  and release the compose context.
+    assert(ctx);  assert(ctx->owner == os_sched_get_current_task());
+    if (ctx->payload && ctx->payload != ctx->message) { os_mbuf_free_chain(ctx->payload); }
+    if (ctx->message) { os_mbuf_free_chain(ctx->message); }
+    ctx->payload = NULL;
+    ctx->message = NULL;
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    ctx->json_len = 0;  //  Drop the JSON tokens not flushed to the payload.
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+    release_context(ctx);
+}
+
+struct sensor_coap_context *sensor_coap_current(void) {
+    //  Return the compose context assigned to the current task by init_sensor_post().
+    struct sensor_coap_context *ctx = find_context(os_sched_get_current_task());
+    assert(ctx);  //  Missing call to init_sensor_post().
+    return ctx;
+}
+
+static struct sensor_coap_context *find_context(struct os_task *task) {
+    //  Return the compose context assigned to the task, or NULL if none.
+    int i;
+    for (i = 0; i < SENSOR_COAP_CONTEXTS; i++) {
+        if (coap_contexts[i].owner == task) { return &coap_contexts[i]; }
+    }
+    return NULL;
+}
+
+static void release_context(struct sensor_coap_context *ctx) {
+    //  Return the compose context to the pool and wake up the next task waiting for a context.
+    assert(ctx);  assert(ctx->owner);
+    ctx->content_format = 0;
+    ctx->owner = NULL;
+    os_error_t rc = os_sem_release(&coap_context_sem);
+    assert(rc == OS_OK);
+#if MYNEWT_VAL(SENSOR_COAP_WAITERS) > 0  //  If tasks may be notified when a compose context is free...
+    notify_waiter();
+#endif  //  MYNEWT_VAL(SENSOR_COAP_WAITERS) > 0
 }
 
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+
+///////////////////////////////////////////////////////////////////////////////
+//  CBOR Encoding Functions
+
+void cbor_rep_new(struct sensor_coap_context *ctx, struct os_mbuf *m) {
+    //  Prepare to write a new CBOR CoAP payload into the mbuf, with the context's own encoder.
+    assert(ctx);  assert(m);
+    ctx->cbor_err = CborNoError;
+    cbor_mbuf_writer_init(&ctx->cbor_writer, m);
+    cbor_encoder_init(&ctx->cbor_encoder, &ctx->cbor_writer.enc, 0);
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  For coexistence of CBOR and JSON encoding...
+    ctx->encoder = &sensor_coap_cbor_encoder;  //  The rep_* macros will encode in CBOR only.
+    ctx->cbor_depth = 0;
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+}
+
+int cbor_rep_finalize(struct sensor_coap_context *ctx) {
+    //  Finalise the payload and return the payload size, or -1 if encoding failed.
+    assert(ctx);  assert(ctx->payload);
+    if (ctx->cbor_err != CborNoError) { return -1; }
+    return OS_MBUF_PKTLEN(ctx->payload);
+}
+
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+
 #if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
 
 ///////////////////////////////////////////////////////////////////////////////
 //  JSON Encoding Functions
 
-struct json_encoder coap_json_encoder;  //  Note: We don't support concurrent encoding of JSON messages.
-struct json_value coap_json_value;
-static struct os_mbuf *coap_json_mbuf;  //  The mbuf that contains the outgoing CoAP payload.
-
 int json_write_mbuf(void *buf, char *data, int len) {
-    //  Write the JSON to the mbuf for the outgoing CoAP message.
-    if (oc_content_format != APPLICATION_JSON) { return 0; }  //  Exit if we are encoding CBOR, not JSON.
-    assert(coap_json_mbuf);
+    //  Write the JSON to the mbuf for the outgoing CoAP message.  buf is the compose context.
+    //  The JSON encoder writes tiny tokens like "," and "\": ", so we stage the data and
+    //  append to the mbuf in chunks of SENSOR_COAP_JSON_CHUNK bytes.
+    struct sensor_coap_context *ctx = (struct sensor_coap_context *) buf;
+    assert(ctx);  assert(ctx->payload);
     assert(data);
     //  console_printf("json "); console_buffer(data, len); console_printf("\n");  ////
-    int rc = os_mbuf_append(coap_json_mbuf, data, len);  assert(rc == 0);
+    if (ctx->json_len + len > sizeof(ctx->json_buf)) {
+        //  Staging buffer is full.  Append the staged data to the mbuf.
+        if (json_flush_mbuf(ctx)) { return -1; }
+        if (len > (int) sizeof(ctx->json_buf)) {
+            //  Data is too big for the staging buffer.  Append directly.
+            int rc = os_mbuf_append(ctx->payload, data, len);  assert(rc == 0);
+            if (rc) { return -1; }
+            return 0;
+        }
+    }
+    memcpy(ctx->json_buf + ctx->json_len, data, len);
+    ctx->json_len += len;
+    return 0;
+}
+
+int json_flush_mbuf(struct sensor_coap_context *ctx) {
+    //  Append the staged JSON data to the mbuf.  Return 0 if successful.
+    assert(ctx);  assert(ctx->payload);
+    if (ctx->json_len == 0) { return 0; }
+    int rc = os_mbuf_append(ctx->payload, ctx->json_buf, ctx->json_len);  assert(rc == 0);
+    ctx->json_len = 0;
     if (rc) { return -1; }
     return 0;
 }
 
-void json_rep_new(struct os_mbuf *m) {
+void json_rep_new(struct sensor_coap_context *ctx, struct os_mbuf *m) {
     //  Prepare to write a new JSON CoAP payload into the mbuf.
-    assert(m);
-    json_rep_reset();  //  Erase the JSON encoder.
-    coap_json_mbuf = m;
-
-#if MYNEWT_VAL(COAP_CBOR_ENCODING) && MYNEWT_VAL(COAP_JSON_ENCODING)  //  For coexistence of CBOR and JSON encoding...
-    //  Set a dummy writer so that CBOR encoder will not crash when JSON encoding is selected.
-    cbor_cnt_writer_init(&cnt_writer);
-    cbor_encoder_init(&g_encoder, &cnt_writer.enc, 0);
-#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING) && MYNEWT_VAL(COAP_JSON_ENCODING)
+    assert(ctx);  assert(m);
+    json_rep_reset(ctx);  //  Erase the JSON encoder.
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  For coexistence of CBOR and JSON encoding...
+    ctx->encoder = &sensor_coap_json_encoder;  //  The rep_* macros will encode in JSON only.
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
 }
 
-void json_rep_reset(void) {
+void json_rep_reset(struct sensor_coap_context *ctx) {
     //  Close the current JSON CoAP payload.  Erase the JSON encoder.
-    coap_json_mbuf = NULL;
-    memset(&coap_json_encoder, 0, sizeof(coap_json_encoder));  //  Erase the encoder.
-    coap_json_encoder.je_write = json_write_mbuf;
+    assert(ctx);
+    memset(&ctx->json_encoder, 0, sizeof(ctx->json_encoder));  //  Erase the encoder.
+    ctx->json_encoder.je_write = json_write_mbuf;
+    ctx->json_encoder.je_arg = ctx;
+    ctx->json_len = 0;
 }
 
-int json_rep_finalize(void) {
+int json_rep_finalize(struct sensor_coap_context *ctx) {
     //  Finalise the payload and return the payload size.
-    assert(coap_json_mbuf);
-    int size = OS_MBUF_PKTLEN(coap_json_mbuf);
-#define DUMP_COAP
+    assert(ctx);  assert(ctx->payload);
+    int rc = json_flush_mbuf(ctx);  //  Append the remaining staged data.
+    int size = rc ? 0 : OS_MBUF_PKTLEN(ctx->payload);
+//  #define DUMP_COAP  //  Uncomment to dump the JSON payload to the console.
 #ifdef DUMP_COAP
-    console_printf("NET payload size %d\n", size); struct os_mbuf *m = coap_json_mbuf;
+    console_printf("NET payload size %d\n", size); struct os_mbuf *m = ctx->payload;
     while (m) {
-        console_buffer((const char *) (m->om_databuf + m->om_pkthdr_len), m->om_len);
+        console_buffer((const char *) m->om_data, m->om_len);  //  Skip the space reserved for the header.
         m = m->om_next.sle_next;
     } console_printf("\n");
 #endif  //  DUMP_COAP
 
-    json_rep_reset();
+    json_rep_reset(ctx);
     return size;
 }
 
-void json_rep_start_root_object(void) {
+void json_rep_start_root_object(struct sensor_coap_context *ctx) {
     //  Start the JSON representation.  Assume top level is object.
     //  --> {
-    int rc = json_encode_object_start(&coap_json_encoder);  assert(rc == 0);
+    int rc = json_encode_object_start(&ctx->json_encoder);  assert(rc == 0);
 }
 
-void json_rep_end_root_object(void) {
+void json_rep_end_root_object(struct sensor_coap_context *ctx) {
     //  End the JSON representation.  Assume top level is object.
     //  {... --> {...}
-    int rc = json_encode_object_finish(&coap_json_encoder);  assert(rc == 0);
+    int rc = json_encode_object_finish(&ctx->json_encoder);  assert(rc == 0);
 }
 
 static int json_encode_value_ext(struct json_encoder *encoder, struct json_value *jv);
-static void split_float(float f, bool *neg, int *i, int *d);
 
 int
 json_encode_object_entry_ext(struct json_encoder *encoder, char *key,
@@ -301,17 +798,9 @@ json_encode_value_ext(struct json_encoder *encoder, struct json_value *jv)
 
     switch (jv->jv_type) {
         case JSON_VALUE_TYPE_EXT_FLOAT: {
-            //  Encode the float with 2 decimal places.
-            bool neg; int i, d;
-            float f = jv->jv_val.fl;
-            split_float(f, &neg, &i, &d);  //  Split the float into neg, integer and decimal parts (two decimal places)
-            len = sprintf(
-                encoder->je_encode_buf,
-                "%s%d.%02d",
-                neg ? "-" : "",  //  Sign
-                i, //  Integer part
-                d  //  2 decimal places
-            );
+            //  Encode the float with SENSOR_COAP_JSON_DECIMALS decimal places.  JSON doesn't support NaN and infinity, so we encode them as null.
+            len = float_format(jv->jv_val.fl, MYNEWT_VAL(SENSOR_COAP_JSON_DECIMALS), encoder->je_encode_buf);
+            if (len < 0) { encoder->je_write(encoder->je_arg, "null", sizeof("null")-1);  break; }
             encoder->je_write(encoder->je_arg, encoder->je_encode_buf, len);
             break;
         }
@@ -326,12 +815,141 @@ err:
     return (rc);
 }
 
-static void split_float(float f, bool *neg, int *i, int *d) {
-    //  Split the float f into 3 parts: neg is true if negative, the absolute integer part i, and the decimal part d, with 2 decimal places.
-    *neg = (f < 0.0f);                    //  True if f is negative
-    float f_abs = *neg ? -f : f;          //  Absolute value of f
-    *i = (int) f_abs;                     //  Integer part
-    *d = ((int) (100.0f * f_abs)) % 100;  //  Two decimal places
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+
+#if MYNEWT_VAL(COAP_CBOR_ENCODING) && MYNEWT_VAL(COAP_JSON_ENCODING)  //  For coexistence of CBOR and JSON encoding...
+
+///////////////////////////////////////////////////////////////////////////////
+//  JSON Encoder Interface: Called by the rep_* macros when the content format is JSON
+
+static void json_start_root_object(struct sensor_coap_context *ctx) { json_rep_start_root_object(ctx); }
+static void json_end_root_object(struct sensor_coap_context *ctx)   { json_rep_end_root_object(ctx); }
+
+static void json_set_array(struct sensor_coap_context *ctx, const char *key) {
+    //  {a:b --> {a:b, key:[
+    json_encode_array_name(&ctx->json_encoder, (char *) key);
+    json_encode_array_start(&ctx->json_encoder);
 }
 
-#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+static void json_close_array(struct sensor_coap_context *ctx) { json_encode_array_finish(&ctx->json_encoder); }
+static void json_start_item(struct sensor_coap_context *ctx)  { json_encode_object_start(&ctx->json_encoder); }
+static void json_end_item(struct sensor_coap_context *ctx)    { json_encode_object_finish(&ctx->json_encoder); }
+
+static void json_set_int(struct sensor_coap_context *ctx, const char *key, int64_t value) {
+    JSON_VALUE_INT(&ctx->json_value, value);
+    json_encode_object_entry(&ctx->json_encoder, (char *) key, &ctx->json_value);
+}
+
+static void json_set_uint(struct sensor_coap_context *ctx, const char *key, uint64_t value) {
+    JSON_VALUE_UINT(&ctx->json_value, value);
+    json_encode_object_entry(&ctx->json_encoder, (char *) key, &ctx->json_value);
+}
+
+static void json_set_float(struct sensor_coap_context *ctx, const char *key, float value) {
+    JSON_VALUE_EXT_FLOAT(&ctx->json_value, value);
+    json_encode_object_entry_ext(&ctx->json_encoder, (char *) key, &ctx->json_value);
+}
+
+static void json_set_text_string(struct sensor_coap_context *ctx, const char *key, const char *value) {
+    JSON_VALUE_STRING(&ctx->json_value, (char *) value);
+    json_encode_object_entry(&ctx->json_encoder, (char *) key, &ctx->json_value);
+}
+
+const struct sensor_coap_encoder sensor_coap_json_encoder = {
+    .start_root_object = json_start_root_object,
+    .end_root_object   = json_end_root_object,
+    .set_array         = json_set_array,
+    .close_array       = json_close_array,
+    .start_item        = json_start_item,
+    .end_item          = json_end_item,
+    .set_int           = json_set_int,
+    .set_uint          = json_set_uint,
+    .set_float         = json_set_float,
+    .set_text_string   = json_set_text_string,
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//  CBOR Encoder Interface: Called by the rep_* macros when the content format is CBOR.
+//  The open maps and arrays are kept in cbor_stack, in place of the local encoders declared by the oc_rep_* macros.
+//  Maps and arrays have indefinite length, same as the oc_rep_* macros.
+
+static CborEncoder *cbor_current(struct sensor_coap_context *ctx) {
+    //  Return the encoder for the innermost open map or array, or the root encoder if none.
+    return (ctx->cbor_depth == 0) ? &ctx->cbor_encoder : &ctx->cbor_stack[ctx->cbor_depth - 1];
+}
+
+static void cbor_open(struct sensor_coap_context *ctx, bool is_map) {
+    //  Open a map or array inside the current map or array.
+    assert(ctx->cbor_depth < SENSOR_COAP_CBOR_DEPTH);  //  Too many nested maps and arrays.
+    if (ctx->cbor_depth >= SENSOR_COAP_CBOR_DEPTH) { ctx->cbor_err |= CborErrorInternalError; return; }
+    CborEncoder *parent = cbor_current(ctx);
+    CborEncoder *child = &ctx->cbor_stack[ctx->cbor_depth++];
+    ctx->cbor_err |= is_map ?
+        cbor_encoder_create_map(parent, child, CborIndefiniteLength) :
+        cbor_encoder_create_array(parent, child, CborIndefiniteLength);
+}
+
+static void cbor_close(struct sensor_coap_context *ctx) {
+    //  Close the current map or array and resume writing the parent.
+    assert(ctx->cbor_depth > 0);
+    if (ctx->cbor_depth == 0) { ctx->cbor_err |= CborErrorInternalError; return; }
+    CborEncoder *child = &ctx->cbor_stack[--ctx->cbor_depth];
+    ctx->cbor_err |= cbor_encoder_close_container(cbor_current(ctx), child);
+}
+
+static void cbor_set_key(struct sensor_coap_context *ctx, const char *key) {
+    //  Write the text string key into the current map.
+    assert(key);
+    ctx->cbor_err |= cbor_encode_text_string(cbor_current(ctx), key, strlen(key));
+}
+
+static void cbor_start_root_object(struct sensor_coap_context *ctx) { cbor_open(ctx, true); }
+static void cbor_end_root_object(struct sensor_coap_context *ctx)   { cbor_close(ctx); }
+static void cbor_set_array(struct sensor_coap_context *ctx, const char *key) { cbor_set_key(ctx, key); cbor_open(ctx, false); }
+static void cbor_close_array(struct sensor_coap_context *ctx) { cbor_close(ctx); }
+static void cbor_start_item(struct sensor_coap_context *ctx)  { cbor_open(ctx, true); }
+static void cbor_end_item(struct sensor_coap_context *ctx)    { cbor_close(ctx); }
+
+static void cbor_set_int(struct sensor_coap_context *ctx, const char *key, int64_t value) {
+    cbor_set_key(ctx, key);
+    ctx->cbor_err |= cbor_encode_int(cbor_current(ctx), value);
+}
+
+static void cbor_set_uint(struct sensor_coap_context *ctx, const char *key, uint64_t value) {
+    cbor_set_key(ctx, key);
+    ctx->cbor_err |= cbor_encode_uint(cbor_current(ctx), value);
+}
+
+static void cbor_set_float(struct sensor_coap_context *ctx, const char *key, float value) {
+    //  Encoded as double, same as oc_rep_set_double.
+    cbor_set_key(ctx, key);
+    ctx->cbor_err |= cbor_encode_double(cbor_current(ctx), value);
+}
+
+static void cbor_set_text_string(struct sensor_coap_context *ctx, const char *key, const char *value) {
+    assert(value);
+    cbor_set_key(ctx, key);
+    ctx->cbor_err |= cbor_encode_text_string(cbor_current(ctx), value, strlen(value));
+}
+
+void cbor_rep_set_int_ukey(struct sensor_coap_context *ctx, unsigned key, int64_t value) {
+    //  Set the integer value in the current CBOR object, with an unsigned integer key.  For CBOR only.
+    assert(ctx);  assert(ctx->encoder == &sensor_coap_cbor_encoder);
+    ctx->cbor_err |= cbor_encode_uint(cbor_current(ctx), key);
+    ctx->cbor_err |= cbor_encode_int(cbor_current(ctx), value);
+}
+
+const struct sensor_coap_encoder sensor_coap_cbor_encoder = {
+    .start_root_object = cbor_start_root_object,
+    .end_root_object   = cbor_end_root_object,
+    .set_array         = cbor_set_array,
+    .close_array       = cbor_close_array,
+    .start_item        = cbor_start_item,
+    .end_item          = cbor_end_item,
+    .set_int           = cbor_set_int,
+    .set_uint          = cbor_set_uint,
+    .set_float         = cbor_set_float,
+    .set_text_string   = cbor_set_text_string,
+};
+
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING) && MYNEWT_VAL(COAP_JSON_ENCODING)
@@ -0,0 +1,454 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+//  Payload skeletons for payloads with a fixed shape, like {"values": [{"key": "device","value": ...}, ...]}.
+//  The constant bytes (root, array, keys and punctuation) are rendered once per skeleton, in JSON and CBOR,
+//  in the same layout as the CP_* macros.  With SENSOR_COAP_FLAT, the flat layout {"device": ...} is rendered too.  Composing a message becomes copying the constant segments and
+//  filling the value slots in between, without running the JSON or CBOR encoder.  For batches, the skeleton is the
+//  constant payload prefix, e.g. the "device" item, and the batched readings are appended after it.
+#include <os/mynewt.h>
+#include <oic/messaging/coap/constants.h>  //  For APPLICATION_JSON, APPLICATION_CBOR
+#include <sensor/sensor.h>  //  For SENSOR_VALUE_TYPE_INT32
+#include <float_format/float_format.h>
+#include "sensor_coap/sensor_coap.h"
+
+#if MYNEWT_VAL(SENSOR_COAP_SKELETON_SIZE) > 255
+#error SENSOR_COAP_SKELETON_SIZE must not exceed 255
+#endif  //  MYNEWT_VAL(SENSOR_COAP_SKELETON_SIZE) > 255
+
+#define CBOR_MAJOR_UINT   0     //  CBOR major types
+#define CBOR_MAJOR_NINT   1
+#define CBOR_MAJOR_TEXT   3
+#define CBOR_MAP_START    0xbf  //  Map with indefinite length
+#define CBOR_ARRAY_START  0x9f  //  Array with indefinite length
+#define CBOR_BREAK        0xff  //  End of indefinite length map or array
+#define CBOR_DOUBLE       0xfb  //  Double-precision float
+#define CLOSE_BYTES       2     //  Closing bytes of the "values" array and the root: "]}" in JSON, 2 breaks in CBOR
+#define FLAT_CLOSE_BYTES  1     //  Closing bytes of the root in the flat layout: "}" in JSON, 1 break in CBOR
+
+typedef int write_func(void *arg, char *data, int len);  //  Same signature as json_write_mbuf().
+
+//  Rendering state for a skeleton layout.
+struct render {
+    struct sensor_coap_skeleton_layout *layout;
+    int len;   //  Number of bytes rendered.
+    int seg;   //  Current segment.
+    int err;   //  Non-zero if the layout overflowed.
+};
+
+static int render_skeleton(struct sensor_coap_skeleton *skeleton);
+static int write_skeleton(struct sensor_coap_context *ctx, struct sensor_coap_skeleton *skeleton,
+    const struct sensor_coap_slot *slots, bool open);
+static const struct sensor_coap_skeleton_layout *select_layout(struct sensor_coap_context *ctx,
+    struct sensor_coap_skeleton *skeleton);
+static int fill_slots(struct sensor_coap_context *ctx, struct sensor_coap_skeleton *skeleton,
+    const struct sensor_coap_skeleton_layout *layout, const struct sensor_coap_slot *slots, bool open);
+static int write_item(struct sensor_coap_context *ctx, bool json, const char *key, uint8_t type,
+    const struct sensor_coap_slot *value);
+static bool is_flat(const struct sensor_coap_context *ctx);
+static int render_write(void *arg, char *data, int len);
+static void render_slot(struct render *r);
+static int write_payload(void *arg, char *data, int len);
+static int json_text(write_func *write, void *arg, const char *text);
+static int json_value(write_func *write, void *arg, uint8_t type, const struct sensor_coap_slot *slot);
+static int cbor_text(write_func *write, void *arg, const char *text);
+static int cbor_value(write_func *write, void *arg, uint8_t type, const struct sensor_coap_slot *slot);
+static int cbor_head(uint8_t *buf, uint8_t major, uint64_t value);
+
+int sensor_coap_write_skeleton(struct sensor_coap_context *ctx, struct sensor_coap_skeleton *skeleton,
+    const struct sensor_coap_slot *slots) {
+    //  Write the payload into the compose context by copying the skeleton's constant bytes and filling the slots
+    //  with the values, in the encoding and layout of the context.  The output is identical to the CP_* macros.
+    //  slots contains one value per slot, in payload order.  Return 0 if successful.
+    return write_skeleton(ctx, skeleton, slots, false);
+}
+
+int sensor_coap_write_skeleton_batch(struct sensor_coap_context *ctx, struct sensor_coap_skeleton *skeleton,
+    const struct sensor_coap_slot *slots, const struct sensor_coap_batch *batch) {
+    //  Write the skeleton's items as the constant payload prefix, then append the batched readings to the "values"
+    //  array, adding a "node" item whenever the node changes.  The output is identical to CP_ROOT and
+    //  CP_ARRAY(root, values, ...) with the skeleton's CP_ITEM_* items followed by CP_BATCH_ITEMS.
+    //  With the flat layout, the readings are appended to the root as key/value pairs.  Return 0 if successful.
+    assert(batch);  assert(skeleton->count > 0);  //  Items are appended after the skeleton items.
+    int rc = write_skeleton(ctx, skeleton, slots, true);
+    if (rc) { return rc; }
+    bool json = (ctx->content_format == APPLICATION_JSON);
+    const char *node = NULL;
+    int i;
+    for (i = 0; i < batch->count; i++) {
+        const struct sensor_coap_reading *reading = &batch->readings[i];
+        struct sensor_coap_slot slot;
+        if (reading->node && (node == NULL || strcmp(node, reading->node) != 0)) {
+            node = reading->node;
+            slot.text_val = node;
+            rc |= write_item(ctx, json, "node", SENSOR_COAP_SLOT_TEXT, &slot);
+        }
+        const struct sensor_value *val = &reading->val;
+        switch (val->val_type) {
+            case SENSOR_VALUE_TYPE_INT32: slot.int_val = val->int_val;  rc |= write_item(ctx, json, val->key, SENSOR_COAP_SLOT_INT, &slot);  break;
+            case SENSOR_VALUE_TYPE_FLOAT: slot.float_val = val->float_val;  rc |= write_item(ctx, json, val->key, SENSOR_COAP_SLOT_FLOAT, &slot);  break;
+            default: assert(0);  rc = -1;  //  Unknown type
+        }
+    }
+    //  Close the "values" array and the root, or only the root for the flat layout.
+    static char brk[] = { CBOR_BREAK, CBOR_BREAK };
+    int close = is_flat(ctx) ? FLAT_CLOSE_BYTES : CLOSE_BYTES;
+    rc |= json ? write_payload(ctx, (close == CLOSE_BYTES) ? "]}" : "}", close) : write_payload(ctx, brk, close);
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+    if (rc && !json) { ctx->cbor_err |= CborErrorOutOfMemory; }  //  cbor_rep_finalize() will fail the message.
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+    return rc ? -1 : 0;
+}
+
+static int write_skeleton(struct sensor_coap_context *ctx, struct sensor_coap_skeleton *skeleton,
+    const struct sensor_coap_slot *slots, bool open) {
+    //  Write the skeleton in the encoding of the context.  If open is true, the "values" array and the root
+    //  are left open for more items.  Return 0 if successful.
+    assert(ctx);  assert(ctx->payload);  assert(skeleton);  assert(slots);
+    if (!skeleton->ready) {
+        //  Render the constant bytes on first use.  Other tasks may be rendering the same skeleton.
+        int rc;
+        os_sr_t sr;
+        OS_ENTER_CRITICAL(sr);
+        rc = skeleton->ready ? 0 : render_skeleton(skeleton);
+        OS_EXIT_CRITICAL(sr);
+        assert(rc == 0);  //  Skeleton is too big.  Increase SENSOR_COAP_SKELETON_SIZE or SENSOR_COAP_SKELETON_SLOTS.
+        if (rc) { return -1; }
+    }
+    const struct sensor_coap_skeleton_layout *layout = select_layout(ctx, skeleton);
+    assert(layout);  //  Unknown content format.
+    if (!layout) { return -1; }
+    return fill_slots(ctx, skeleton, layout, slots, open);
+}
+
+static const struct sensor_coap_skeleton_layout *select_layout(struct sensor_coap_context *ctx,
+    struct sensor_coap_skeleton *skeleton) {
+    //  Return the rendered constant bytes for the encoding and layout of the context, or NULL if unknown.
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    if (ctx->content_format == APPLICATION_JSON) {
+#if MYNEWT_VAL(SENSOR_COAP_FLAT)  //  If we are supporting the flat payload layout...
+        if (is_flat(ctx)) { return &skeleton->json_flat; }
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FLAT)
+        return &skeleton->json;
+    }
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+    if (ctx->content_format == APPLICATION_CBOR) {
+#if MYNEWT_VAL(SENSOR_COAP_FLAT)  //  If we are supporting the flat payload layout...
+        if (is_flat(ctx)) { return &skeleton->cbor_flat; }
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FLAT)
+        return &skeleton->cbor;
+    }
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+    return NULL;
+}
+
+static int fill_slots(struct sensor_coap_context *ctx, struct sensor_coap_skeleton *skeleton,
+    const struct sensor_coap_skeleton_layout *layout, const struct sensor_coap_slot *slots, bool open) {
+    //  Copy each constant segment followed by its slot value.  If open is true, the closing bytes of the
+    //  "values" array and the root (or only the root for the flat layout) are not copied.  Return 0 if successful.
+    bool json = (ctx->content_format == APPLICATION_JSON);
+    int seg = 0, start = 0, rc = 0, i;
+    for (i = 0; i < skeleton->count; i++) {
+        const struct sensor_coap_skeleton_item *item = &skeleton->items[i];
+        int pass;
+        for (pass = (item->key ? 1 : 0); pass < 2; pass++) {
+            //  Pass 0 fills the key slot, pass 1 fills the value slot.
+            uint8_t type = (pass == 0) ? SENSOR_COAP_SLOT_TEXT : item->type;
+            rc |= write_payload(ctx, (char *) &layout->bytes[start], layout->ends[seg] - start);
+            rc |= json ?
+                json_value(write_payload, ctx, type, &slots[seg]) :
+                cbor_value(write_payload, ctx, type, &slots[seg]);
+            start = layout->ends[seg++];
+        }
+    }
+    assert(seg == skeleton->slots);
+    //  The last segment ends with "]}" in JSON, or 2 CBOR break bytes.  For the flat layout: "}" or 1 break byte.
+    int close = is_flat(ctx) ? FLAT_CLOSE_BYTES : CLOSE_BYTES;
+    rc |= write_payload(ctx, (char *) &layout->bytes[start], layout->ends[seg] - start - (open ? close : 0));
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+    if (rc && !json) { ctx->cbor_err |= CborErrorOutOfMemory; }  //  cbor_rep_finalize() will fail the message.
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+    return rc ? -1 : 0;
+}
+
+static int write_item(struct sensor_coap_context *ctx, bool json, const char *key, uint8_t type,
+    const struct sensor_coap_slot *value) {
+    //  Append the item {"key": <key>,"value": <value>} to the open "values" array, after the skeleton items.
+    //  For the flat layout, append <key>: <value> to the open root instead.
+    //  Same output as CP_ITEM_STR, CP_ITEM_INT and CP_ITEM_FLOAT.  Return 0 if successful.
+    int rc = 0;
+    if (is_flat(ctx)) {
+        if (json) {
+            rc |= write_payload(ctx, ",", 1);
+            rc |= json_text(write_payload, ctx, key);
+            rc |= write_payload(ctx, ": ", 2);
+            rc |= json_value(write_payload, ctx, type, value);
+        } else {
+            rc |= cbor_text(write_payload, ctx, key);
+            rc |= cbor_value(write_payload, ctx, type, value);
+        }
+    } else if (json) {
+        rc |= write_payload(ctx, ",{\"key\": ", 9);
+        rc |= json_text(write_payload, ctx, key);
+        rc |= write_payload(ctx, ",\"value\": ", 10);
+        rc |= json_value(write_payload, ctx, type, value);
+        rc |= write_payload(ctx, "}", 1);
+    } else {
+        static char key_bytes[] = { CBOR_MAP_START, CBOR_MAJOR_TEXT << 5 | 3, 'k', 'e', 'y' };
+        static char value_bytes[] = { CBOR_MAJOR_TEXT << 5 | 5, 'v', 'a', 'l', 'u', 'e' };
+        static char brk[] = { CBOR_BREAK };
+        rc |= write_payload(ctx, key_bytes, sizeof(key_bytes));
+        rc |= cbor_text(write_payload, ctx, key);
+        rc |= write_payload(ctx, value_bytes, sizeof(value_bytes));
+        rc |= cbor_value(write_payload, ctx, type, value);
+        rc |= write_payload(ctx, brk, sizeof(brk));
+    }
+    return rc;
+}
+
+static bool is_flat(const struct sensor_coap_context *ctx) {
+    //  Return true if the context uses the flat layout.
+#if MYNEWT_VAL(SENSOR_COAP_FLAT)  //  If we are supporting the flat payload layout...
+    return ctx->layout == SENSOR_COAP_LAYOUT_FLAT;
+#else
+    return false;
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FLAT)
+}
+
+static int write_payload(void *arg, char *data, int len) {
+    //  Write to the payload of the compose context arg: JSON is staged, CBOR is appended to the mbuf.
+    struct sensor_coap_context *ctx = (struct sensor_coap_context *) arg;
+    if (len == 0) { return 0; }
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    if (ctx->content_format == APPLICATION_JSON) { return json_write_mbuf(ctx, data, len); }
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+    return os_mbuf_append(ctx->payload, data, len) ? -1 : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  Render Skeleton
+
+static int render_skeleton(struct sensor_coap_skeleton *skeleton) {
+    //  Render the constant bytes of the skeleton in each encoding, split at the value slots.  Return 0 if successful.
+    struct render r;
+    int rc = 0, i;
+    skeleton->slots = 0;
+    for (i = 0; i < skeleton->count; i++) { skeleton->slots += skeleton->items[i].key ? 1 : 2; }
+    if (skeleton->slots > MYNEWT_VAL(SENSOR_COAP_SKELETON_SLOTS)) { return -1; }
+
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    //  Same as the JSON encoder: {"values": [{"key": "device","value": <slot>},{"key": <slot>,"value": <slot>}]}
+    memset(&r, 0, sizeof(r));  r.layout = &skeleton->json;
+    render_write(&r, "{\"values\": [", 12);
+    for (i = 0; i < skeleton->count; i++) {
+        const struct sensor_coap_skeleton_item *item = &skeleton->items[i];
+        if (i > 0) { render_write(&r, ",", 1); }
+        render_write(&r, "{\"key\": ", 8);
+        if (item->key) { json_text(render_write, &r, item->key); }
+        else { render_slot(&r); }
+        render_write(&r, ",\"value\": ", 10);
+        render_slot(&r);
+        render_write(&r, "}", 1);
+    }
+    render_write(&r, "]}", 2);
+    r.layout->ends[r.seg] = r.len;
+    rc |= r.err;
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+    //  Same as the CBOR encoder: Indefinite length root map, "values" array and item maps.
+    static char root[] = { CBOR_MAP_START, CBOR_MAJOR_TEXT << 5 | 6, 'v', 'a', 'l', 'u', 'e', 's', CBOR_ARRAY_START };
+    static char key[] = { CBOR_MAP_START, CBOR_MAJOR_TEXT << 5 | 3, 'k', 'e', 'y' };
+    static char value[] = { CBOR_MAJOR_TEXT << 5 | 5, 'v', 'a', 'l', 'u', 'e' };
+    static char brk[] = { CBOR_BREAK };
+    memset(&r, 0, sizeof(r));  r.layout = &skeleton->cbor;
+    render_write(&r, root, sizeof(root));
+    for (i = 0; i < skeleton->count; i++) {
+        const struct sensor_coap_skeleton_item *item = &skeleton->items[i];
+        render_write(&r, key, sizeof(key));
+        if (item->key) { cbor_text(render_write, &r, item->key); }
+        else { render_slot(&r); }
+        render_write(&r, value, sizeof(value));
+        render_slot(&r);
+        render_write(&r, brk, sizeof(brk));  //  End of item
+    }
+    render_write(&r, brk, sizeof(brk));  //  End of "values" array
+    render_write(&r, brk, sizeof(brk));  //  End of root
+    r.layout->ends[r.seg] = r.len;
+    rc |= r.err;
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+
+#if MYNEWT_VAL(SENSOR_COAP_FLAT)  //  If we are supporting the flat payload layout...
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    //  Same as the JSON encoder with the flat layout: {"device": <slot>,<slot>: <slot>}
+    memset(&r, 0, sizeof(r));  r.layout = &skeleton->json_flat;
+    render_write(&r, "{", 1);
+    for (i = 0; i < skeleton->count; i++) {
+        const struct sensor_coap_skeleton_item *item = &skeleton->items[i];
+        if (i > 0) { render_write(&r, ",", 1); }
+        if (item->key) { json_text(render_write, &r, item->key); }
+        else { render_slot(&r); }
+        render_write(&r, ": ", 2);
+        render_slot(&r);
+    }
+    render_write(&r, "}", 1);
+    r.layout->ends[r.seg] = r.len;
+    rc |= r.err;
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+    //  Same as the CBOR encoder with the flat layout: Indefinite length root map with the keys and values.
+    static char map[] = { CBOR_MAP_START };
+    memset(&r, 0, sizeof(r));  r.layout = &skeleton->cbor_flat;
+    render_write(&r, map, sizeof(map));
+    for (i = 0; i < skeleton->count; i++) {
+        const struct sensor_coap_skeleton_item *item = &skeleton->items[i];
+        if (item->key) { cbor_text(render_write, &r, item->key); }
+        else { render_slot(&r); }
+        render_slot(&r);
+    }
+    render_write(&r, brk, sizeof(brk));  //  End of root
+    r.layout->ends[r.seg] = r.len;
+    rc |= r.err;
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FLAT)
+
+    if (rc == 0) { skeleton->ready = true; }
+    return rc;
+}
+
+static int render_write(void *arg, char *data, int len) {
+    //  Append constant bytes to the current segment of the layout.  Return 0 if successful.
+    struct render *r = (struct render *) arg;
+    if (r->len + len > (int) sizeof(r->layout->bytes)) { r->err = -1; return -1; }
+    memcpy(&r->layout->bytes[r->len], data, len);
+    r->len += len;
+    return 0;
+}
+
+static void render_slot(struct render *r) {
+    //  End the current segment.  The next slot value will be filled here.
+    r->layout->ends[r->seg++] = r->len;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//  Encode Slot Values
+
+static int json_text(write_func *write, void *arg, const char *text) {
+    //  Write the JSON string with the same escaping as the JSON encoder.  Return 0 if successful.
+    assert(text);
+    int rc = write(arg, "\"", 1);
+    const char *run = text;
+    for (;; text++) {
+        char esc;
+        switch (*text) {
+            case '"': case '/': case '\\': esc = *text; break;
+            case '\t': esc = 't'; break;
+            case '\r': esc = 'r'; break;
+            case '\n': esc = 'n'; break;
+            case '\f': esc = 'f'; break;
+            case '\b': esc = 'b'; break;
+            case 0: rc |= write(arg, (char *) run, text - run);  rc |= write(arg, "\"", 1);  return rc;
+            default: continue;
+        }
+        //  Write the characters before the escaped character, then the escape sequence.
+        char buf[2] = { '\\', esc };
+        rc |= write(arg, (char *) run, text - run);
+        rc |= write(arg, buf, 2);
+        run = text + 1;
+    }
+}
+
+static int json_value(write_func *write, void *arg, uint8_t type, const struct sensor_coap_slot *slot) {
+    //  Write the slot value in JSON, same as the JSON encoder.  Return 0 if successful.
+    char buf[FLOAT_FORMAT_SIZE > 21 ? FLOAT_FORMAT_SIZE : 21];  //  Longest int64 is 20 digits and sign.
+    int len;
+    switch (type) {
+        case SENSOR_COAP_SLOT_TEXT: return json_text(write, arg, slot->text_val);
+        case SENSOR_COAP_SLOT_FLOAT:
+            //  Floats are formatted with SENSOR_COAP_JSON_DECIMALS decimal places.  NaN and infinity are encoded as null.
+            len = float_format(slot->float_val, MYNEWT_VAL(SENSOR_COAP_JSON_DECIMALS), buf);
+            if (len < 0) { return write(arg, "null", 4); }
+            return write(arg, buf, len);
+        case SENSOR_COAP_SLOT_INT:
+        case SENSOR_COAP_SLOT_UINT: {
+            //  Format the decimal digits from the end of buf.
+            bool negative = (type == SENSOR_COAP_SLOT_INT && slot->int_val < 0);
+            uint64_t u = (type == SENSOR_COAP_SLOT_UINT) ? slot->uint_val :
+                negative ? -(uint64_t) slot->int_val : (uint64_t) slot->int_val;
+            char *p = buf + sizeof(buf);
+            do { *--p = '0' + (u % 10);  u /= 10; } while (u);
+            if (negative) { *--p = '-'; }
+            return write(arg, p, buf + sizeof(buf) - p);
+        }
+        default: assert(0);  return -1;  //  Unknown slot type.
+    }
+}
+
+static int cbor_text(write_func *write, void *arg, const char *text) {
+    //  Write the CBOR text string, same as cbor_encode_text_string().  Return 0 if successful.
+    assert(text);
+    uint8_t head[9];
+    int len = strlen(text);
+    int rc = write(arg, (char *) head, cbor_head(head, CBOR_MAJOR_TEXT, len));
+    rc |= write(arg, (char *) text, len);
+    return rc;
+}
+
+static int cbor_value(write_func *write, void *arg, uint8_t type, const struct sensor_coap_slot *slot) {
+    //  Write the slot value in CBOR, same as the CBOR encoder.  Return 0 if successful.
+    uint8_t buf[9];
+    int len;
+    switch (type) {
+        case SENSOR_COAP_SLOT_TEXT: return cbor_text(write, arg, slot->text_val);
+        case SENSOR_COAP_SLOT_INT:
+            //  Negative integers are encoded as -1 - value, same as cbor_encode_int().
+            len = (slot->int_val < 0) ?
+                cbor_head(buf, CBOR_MAJOR_NINT, ~(uint64_t) slot->int_val) :
+                cbor_head(buf, CBOR_MAJOR_UINT, slot->int_val);
+            break;
+        case SENSOR_COAP_SLOT_UINT: len = cbor_head(buf, CBOR_MAJOR_UINT, slot->uint_val); break;
+        case SENSOR_COAP_SLOT_FLOAT: {
+            //  Floats are encoded as doubles, same as rep_set_float.  Big endian.
+            union { double d; uint64_t u; } v;
+            v.d = slot->float_val;
+            buf[0] = CBOR_DOUBLE;
+            int i;
+            for (i = 0; i < 8; i++) { buf[1 + i] = (uint8_t) (v.u >> (56 - 8 * i)); }
+            len = 9;
+            break;
+        }
+        default: assert(0);  return -1;  //  Unknown slot type.
+    }
+    return write(arg, (char *) buf, len);
+}
+
+static int cbor_head(uint8_t *buf, uint8_t major, uint64_t value) {
+    //  Write the CBOR initial byte and argument in the fewest bytes.  Return the number of bytes.
+    int size, i;
+    major <<= 5;
+    if (value < 24)               { buf[0] = major | value;  return 1; }
+    else if (value <= 0xff)       { buf[0] = major | 24;  size = 1; }
+    else if (value <= 0xffff)     { buf[0] = major | 25;  size = 2; }
+    else if (value <= 0xffffffff) { buf[0] = major | 26;  size = 4; }
+    else                          { buf[0] = major | 27;  size = 8; }
+    for (i = 0; i < size; i++) { buf[1 + i] = (uint8_t) (value >> (8 * (size - 1 - i))); }
+    return 1 + size;
+}
@@ -0,0 +1,1298 @@
+//  TODO: Use unit test convention
+//  Tests for the Sensor CoAP module.  Run on the native BSP (targets/unittest), which doesn't need any
+//  network hardware: CoAP messages are sent to a stand-in transport that simulates the link.
+#include <os/os.h>
+#include <console/console.h>
+#include <oic/port/oc_connectivity.h>
+#include <oic/messaging/coap/coap.h>
+#include <sensor/sensor.h>
+#include <sensor_coap/sensor_coap.h>
+
+void test_sensor_coap_pool(void);
+void test_sensor_coap_batch(void);
+void test_sensor_coap_batch_nodes(void);
+void test_sensor_coap_json_bench(void);
+void test_sensor_coap_header_bench(void);
+void test_sensor_coap_mbuf_watermark(void);
+void test_sensor_coap_non(void);
+void test_sensor_coap_encoder(void);
+void test_sensor_coap_skeleton(void);
+void test_sensor_coap_skeleton_batch(void);
+void test_sensor_coap_block1(void);
+void test_sensor_coap_block1_uncached(void);
+void test_sensor_coap_senml(void);
+void test_sensor_coap_fanout(void);
+void test_sensor_coap_flat(void);
+void test_sensor_coap_compress(void);
+void test_sensor_coap_try_post(void);
+
+#define TEST_PRODUCERS       3    //  Number of tasks composing messages at the same time.
+#define TEST_MESSAGES       20    //  Number of messages sent by each producer.
+#define TEST_COMPOSE_TICKS  10    //  Simulated time to collect the sensor values for each message e.g. remote sensor reads.
+#define TEST_LINK_TICKS      5    //  Simulated time to transmit each message e.g. AT+CIPSEND handshake for ESP8266.
+#define TEST_TX_TIMEOUT    (2 * TEST_PRODUCERS * TEST_MESSAGES * (TEST_COMPOSE_TICKS + TEST_LINK_TICKS))  //  Ticks to wait for the messages to be transmitted.
+#define TEST_STACK_SIZE    256    //  Stack size for each producer task.
+#define BENCH_ITEMS         10    //  Number of CP_ITEM_FLOAT items in each benchmark message.
+#define BENCH_MESSAGES      20    //  Number of benchmark messages.
+#define BENCH_HEADERS      100    //  Number of CoAP headers serialised by the benchmark.
+#define BENCH_URI  "v2/things/IVRiBCcR6HPp_CcZIFfOZFxz_izni5xc_KO-kgSA2Y8"  //  Typical thethings.io URI.
+#define LONG_URI   BENCH_URI "/" BENCH_URI  //  URI too long for the header template, so the request is serialised with 2 mbuf chains.
+
+//  Stand-in Server Endpoint, same layout as esp8266_server.
+struct test_server {
+    struct oc_ep_hdr ep;  //  OIC network endpoint.  Don't change, must be first field.
+    uint8_t id;           //  0 for the main server, 1 for the mirror server.
+};
+
+static uint8_t test_ep_size(const struct oc_endpoint *oe);
+static void test_tx_ucast(struct os_mbuf *m);
+static void test_send(struct os_mbuf *m, uint8_t priority);
+
+static const struct oc_transport test_transport = {
+    0,              //  uint8_t ot_flags;
+    test_ep_size,   //  uint8_t (*ot_ep_size)(const struct oc_endpoint *);
+    NULL,           //  int (*ot_ep_has_conn)(const struct oc_endpoint *);
+    test_tx_ucast,  //  void (*ot_tx_ucast)(struct os_mbuf *);
+    NULL,           //  void (*ot_tx_mcast)(struct os_mbuf *);
+    NULL,           //  enum oc_resource_properties *ot_get_trans_security)(const struct oc_endpoint *);
+    NULL,           //  char *(*ot_ep_str)(char *ptr, int maxlen, const struct oc_endpoint *);
+    NULL,           //  int (*ot_init)(void);
+    NULL,           //  void (*ot_shutdown)(void);
+};
+
+static struct test_server server;
+static struct os_mutex link_mutex;   //  Only 1 message may be on the simulated link at any time.
+static struct os_sem serial_sem;     //  For the baseline: allow only 1 producer to compose at any time, like the single global oc_sem.
+static struct os_sem start_sem;      //  Released once per producer to start a run.
+static struct os_sem done_sem;       //  Released by each producer when its run is done.
+static bool serialise;               //  True if we are measuring the baseline.
+static const char *producer_uri = "/test";  //  URI for the producers.
+static uint16_t min_free;            //  Lowest number of free mbufs seen during the run.
+static int tx_count;                 //  Number of messages transmitted.
+static int sent_count;               //  Number of messages handed to the OIC layer for transmitting.
+static void (*server_receive)(struct os_mbuf *m);  //  If set, the stand-in CoAP Server receives each message.
+#if MYNEWT_VAL(SENSOR_COAP_FLAT)  //  If we are supporting the flat payload layout...
+static uint8_t payload_layout = SENSOR_COAP_LAYOUT_ITEMS;  //  Layout of the payloads composed by compose_payload() and compose_batch().
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FLAT)
+
+static struct os_task producer_tasks[TEST_PRODUCERS];
+static os_stack_t producer_stacks[TEST_PRODUCERS][TEST_STACK_SIZE];
+
+static void producer_func(void *arg) {
+    //  For each run: wait for the start signal, then compose and send TEST_MESSAGES messages.
+    int id = (int) arg;
+    for (;;) {
+        os_error_t rc = os_sem_pend(&start_sem, OS_TIMEOUT_NEVER);  assert(rc == OS_OK);
+        int i;
+        for (i = 0; i < TEST_MESSAGES; i++) {
+            if (serialise) { rc = os_sem_pend(&serial_sem, OS_TIMEOUT_NEVER);  assert(rc == OS_OK); }
+
+            struct sensor_coap_context *ctx = init_sensor_post((struct oc_server_handle *) &server, producer_uri, APPLICATION_JSON);
+            assert(ctx);
+            CP_ROOT({
+                CP_ARRAY(root, values, {
+                    CP_ITEM_INT(values, "producer", id);
+                    os_time_delay(TEST_COMPOSE_TICKS);  //  Wait for the sensor value.
+                    CP_ITEM_INT(values, "t", i);
+                });
+            });
+            bool status = do_sensor_post(ctx);  assert(status);
+
+            if (serialise) { rc = os_sem_release(&serial_sem);  assert(rc == OS_OK); }
+        }
+        rc = os_sem_release(&done_sem);  assert(rc == OS_OK);
+    }
+}
+
+static bool wait_tx(void) {
+    //  Wait until the stand-in transport has transmitted every message handed to the OIC layer, or TEST_TX_TIMEOUT
+    //  ticks have passed.  The OIC layer transmits from the default event queue, so run its events here in case
+    //  this task is the one that processes the queue.  Return true if all messages were transmitted.
+    os_time_t start = os_time_get();
+    while (tx_count < sent_count) {
+        if (os_time_get() - start > TEST_TX_TIMEOUT) { return false; }
+        struct os_event *ev = os_eventq_get_no_wait(os_eventq_dflt_get());
+        if (ev) { ev->ev_cb(ev); }
+        else { os_time_delay(1); }
+    }
+    return true;
+}
+
+static uint32_t run_producers(bool serialise0) {
+    //  Run TEST_PRODUCERS producers until all messages are transmitted.  Return the messages delivered per second.
+    int i;
+    bool done = wait_tx();  assert(done);  //  Don't count the messages left by the previous test.
+    serialise = serialise0;
+    tx_count = 0;
+    sent_count = 0;
+    os_time_t start = os_time_get();
+    for (i = 0; i < TEST_PRODUCERS; i++) {
+        os_error_t rc = os_sem_release(&start_sem);  assert(rc == OS_OK);
+    }
+    for (i = 0; i < TEST_PRODUCERS; i++) {
+        os_error_t rc = os_sem_pend(&done_sem, OS_TIMEOUT_NEVER);  assert(rc == OS_OK);
+    }
+    done = wait_tx();  //  The last messages may still be queued for the link.
+    os_time_t elapsed = os_time_get() - start;
+    assert(done);  assert(tx_count == TEST_PRODUCERS * TEST_MESSAGES);
+    if (elapsed == 0) { elapsed = 1; }
+    return (uint32_t) tx_count * OS_TICKS_PER_SEC / elapsed;
+}
+
+static void test_setup(void) {
+    //  Register the stand-in transport.  Called once by each test.
+    static bool done = false;
+    if (done) { return; }
+    assert(sensor_coap_ready());
+    int8_t transport_id = oc_transport_register(&test_transport);  assert(transport_id >= 0);
+    server.ep.oe_type = transport_id;
+    server.ep.oe_flags = 0;
+    sensor_coap_set_send_func(test_send);  //  Count the messages sent, so that wait_tx() knows when the link is done.
+    int rc = os_mutex_init(&link_mutex);  assert(rc == OS_OK);
+    done = true;
+}
+
+void test_sensor_coap_pool(void) {
+    //  Compare the messages delivered per second for 3 producers: composing one at a time (baseline, like the
+    //  single global message buffer) versus composing in parallel with the pool of compose contexts.  The clock
+    //  stops when the last message has been transmitted, so the link time is included.
+    //  Should be called by a task with lower priority than the producers.
+    int rc, i;
+    test_setup();
+    rc = os_sem_init(&serial_sem, 1);  assert(rc == OS_OK);
+    rc = os_sem_init(&start_sem, 0);  assert(rc == OS_OK);
+    rc = os_sem_init(&done_sem, 0);  assert(rc == OS_OK);
+    for (i = 0; i < TEST_PRODUCERS; i++) {
+        rc = os_task_init(&producer_tasks[i], "producer", producer_func, (void *) i,
+            10 + i, OS_WAIT_FOREVER, producer_stacks[i], TEST_STACK_SIZE);
+        assert(rc == 0);
+    }
+
+    uint32_t serial_rate = run_producers(true);
+    console_printf("serialised: %u delivered msgs/sec\n", (unsigned) serial_rate);
+    uint32_t pooled_rate = run_producers(false);
+    console_printf("pooled (%d contexts): %u delivered msgs/sec\n", MYNEWT_VAL(SENSOR_COAP_CONTEXTS), (unsigned) pooled_rate);
+
+    //  With 2 or more contexts, the producers compose in parallel, so the link is the bottleneck instead of
+    //  composing.  TEST_COMPOSE_TICKS is longer than TEST_LINK_TICKS, so the pooled rate is higher.
+    if (MYNEWT_VAL(SENSOR_COAP_CONTEXTS) > 1) { assert(pooled_rate > serial_rate); }
+    console_flush();
+}
+
+static int batch_flushes;    //  Number of times the batch was flushed.
+static int batch_readings;   //  Number of readings flushed.
+
+static bool batch_busy;      //  True if the flush function should fail as if no compose context is free.
+
+static int test_flush(struct sensor_coap_batch *batch, void *arg) {
+    //  Compose the batch like send_coap.c and check that the JSON payload fits the byte budget.
+    const char *device_id = (const char *) arg;
+    if (batch_busy) { return SYS_EAGAIN; }
+    struct sensor_coap_context *ctx = init_sensor_post((struct oc_server_handle *) &server, "/test", APPLICATION_JSON);
+    assert(ctx);
+    CP_ROOT({
+        CP_ARRAY(root, values, {
+            CP_ITEM_STR(values, "device", device_id);
+            CP_BATCH_ITEMS(values, batch, CP_ITEM_INT_VAL);
+        });
+    });
+    json_flush_mbuf(ctx);  //  Append the staged JSON data before checking the size.
+    int size = OS_MBUF_PKTLEN(ctx->payload);
+    console_printf("batch %d readings, %d bytes\n", batch->count, size);
+    assert(size <= batch->max_bytes);
+    bool status = do_sensor_post(ctx);  assert(status);
+    batch_flushes++;
+    batch_readings += batch->count;
+    return 0;
+}
+
+void test_sensor_coap_batch(void) {
+    //  Add readings from 2 nodes to a batch and check that the batch is flushed by size and by count.
+    static struct sensor_coap_batch batch;
+    static const char *device_id = "0102030405060708090a0b0c0d0e0f10";
+    static const char *nodes[] = { "b3b4b5b6f1", "b3b4b5b6f2" };
+    int rc, i;
+    test_setup();
+
+    //  Flush by size: 200 bytes fits the device ID and a few readings.
+    rc = sensor_coap_batch_init(&batch, 200, sensor_coap_batch_item_size("device", device_id),
+        60000, test_flush, (void *) device_id);
+    assert(rc == 0);
+    batch_flushes = 0;  batch_readings = 0;
+    for (i = 0; i < 10; i++) {
+        struct sensor_value val = { "t", SENSOR_VALUE_TYPE_INT32, 1700 + i, 0 };
+        rc = sensor_coap_batch_add(&batch, &val, nodes[i % 2]);  assert(rc == 0);
+    }
+    rc = sensor_coap_batch_flush(&batch);  assert(rc == 0);
+    assert(batch_readings == 10);
+    assert(batch_flushes > 1);  //  Too many readings for 1 message.
+
+    //  Flush by count: the payload is big enough, so the batch is flushed every SENSOR_COAP_BATCH_COUNT readings.
+    rc = sensor_coap_batch_init(&batch, 1000, sensor_coap_batch_item_size("device", device_id),
+        60000, test_flush, (void *) device_id);
+    assert(rc == 0);
+    batch_flushes = 0;  batch_readings = 0;
+    for (i = 0; i < MYNEWT_VAL(SENSOR_COAP_BATCH_COUNT); i++) {
+        struct sensor_value val = { "t", SENSOR_VALUE_TYPE_INT32, 1700 + i, 0 };
+        rc = sensor_coap_batch_add(&batch, &val, nodes[0]);  assert(rc == 0);
+    }
+    assert(batch_flushes == 1);  assert(batch_readings == MYNEWT_VAL(SENSOR_COAP_BATCH_COUNT));
+
+    //  Busy: the readings are kept while the flush function returns SYS_EAGAIN, and new readings are dropped
+    //  while the batch is full.  The kept readings are sent by the next flush.
+    batch_flushes = 0;  batch_readings = 0;  batch_busy = true;
+    for (i = 0; i <= MYNEWT_VAL(SENSOR_COAP_BATCH_COUNT); i++) {
+        struct sensor_value val = { "t", SENSOR_VALUE_TYPE_INT32, 1700 + i, 0 };
+        rc = sensor_coap_batch_add(&batch, &val, nodes[0]);
+        assert(rc == ((i < MYNEWT_VAL(SENSOR_COAP_BATCH_COUNT)) ? 0 : SYS_EAGAIN));
+    }
+    assert(batch.count == MYNEWT_VAL(SENSOR_COAP_BATCH_COUNT));
+    rc = sensor_coap_batch_flush(&batch);  assert(rc == SYS_EAGAIN);
+    batch_busy = false;
+    rc = sensor_coap_batch_flush(&batch);  assert(rc == 0);
+    assert(batch_flushes == 1);  assert(batch_readings == MYNEWT_VAL(SENSOR_COAP_BATCH_COUNT));
+    assert(batch.count == 0);
+    console_flush();
+}
+
+static int grouped_flush(struct sensor_coap_batch *batch, void *arg) {
+    //  Check that the readings from each node are contiguous, then compose the batch like test_flush().
+    int i, j;
+    for (i = 1; i < batch->count; i++) {
+        if (strcmp(batch->readings[i].node, batch->readings[i - 1].node) == 0) { continue; }
+        for (j = 0; j < i - 1; j++) { assert(strcmp(batch->readings[j].node, batch->readings[i].node) != 0); }
+    }
+    for (i = 1; i < batch->count; i++) { assert(batch->readings[i].time >= batch->readings[0].time); }  //  First reading is the oldest.
+    return test_flush(batch, arg);
+}
+
+void test_sensor_coap_batch_nodes(void) {
+    //  Collector Node: readings forwarded by 5 Sensor Nodes are merged into 1 message per cycle when grouped
+    //  by node, versus flushing by count.  Readings from the same node must be contiguous.
+    static struct sensor_coap_batch batch;
+    static const char *device_id = "0102030405060708090a0b0c0d0e0f10";
+    static const char *nodes[] = { "b3b4b5b6f1", "b3b4b5b6cd", "b3b4b5b6a3", "b3b4b5b60f", "b3b4b5b605" };
+    static const int order[] = { 0, 1, 0, 2, 1, 3, 4 };  //  Node 0 and 1 report twice before node 4 reports.
+    int rc, i;
+    test_setup();
+
+    //  Without grouping: flushed by count, and the node items are repeated whenever the node changes.
+    rc = sensor_coap_batch_init(&batch, 1000, sensor_coap_batch_item_size("device", device_id),
+        60000, test_flush, (void *) device_id);
+    assert(rc == 0);
+    batch_flushes = 0;  batch_readings = 0;
+    for (i = 0; i < 2 * 5; i++) {
+        struct sensor_value val = { "t", SENSOR_VALUE_TYPE_INT32, 1700 + i, 0 };
+        rc = sensor_coap_batch_add(&batch, &val, nodes[i % 5]);  assert(rc == 0);
+    }
+    rc = sensor_coap_batch_flush(&batch);  assert(rc == 0);
+    int ungrouped_flushes = batch_flushes;
+
+    //  With grouping: flushed once per cycle of 5 nodes.
+    rc = sensor_coap_batch_init(&batch, 1000, sensor_coap_batch_item_size("device", device_id),
+        60000, grouped_flush, (void *) device_id);
+    assert(rc == 0);
+    rc = sensor_coap_batch_group_nodes(&batch, 5);  assert(rc == 0);
+    batch_flushes = 0;  batch_readings = 0;
+    for (i = 0; i < 2 * 5; i++) {
+        struct sensor_value val = { "t", SENSOR_VALUE_TYPE_INT32, 1700 + i, 0 };
+        rc = sensor_coap_batch_add(&batch, &val, nodes[i % 5]);  assert(rc == 0);
+    }
+    assert(batch_flushes == 2);  assert(batch_readings == 2 * 5);
+    console_printf("batch 5 nodes x 2 cycles: ungrouped %d msgs, grouped %d msgs\n", ungrouped_flushes, batch_flushes);
+
+    //  Nodes reporting more than once are kept together.  Flushed when the fifth node reports.
+    batch_flushes = 0;  batch_readings = 0;
+    for (i = 0; i < (int) (sizeof(order) / sizeof(order[0])); i++) {
+        struct sensor_value val = { "t", SENSOR_VALUE_TYPE_INT32, 1700 + i, 0 };
+        rc = sensor_coap_batch_add(&batch, &val, nodes[order[i]]);  assert(rc == 0);
+    }
+    assert(batch_flushes == 1);  assert(batch_readings == (int) (sizeof(order) / sizeof(order[0])));
+    console_flush();
+}
+
+static int direct_write(void *buf, char *data, int len) {
+    //  Previous JSON writer for comparison: Append every JSON token to the mbuf.
+    struct sensor_coap_context *ctx = (struct sensor_coap_context *) buf;
+    return os_mbuf_append(ctx->payload, data, len) ? -1 : 0;
+}
+
+static uint32_t bench_float_items(bool direct) {
+    //  Return the average CPU time ticks for encoding a CP_ITEM_FLOAT.  If direct is true, use the previous JSON writer.
+    uint32_t total = 0;
+    int m, i;
+    for (m = 0; m < BENCH_MESSAGES; m++) {
+        struct sensor_coap_context *ctx = init_sensor_post((struct oc_server_handle *) &server, "/test", APPLICATION_JSON);
+        assert(ctx);
+        if (direct) { ctx->json_encoder.je_write = direct_write; }
+        uint32_t start = os_cputime_get32();
+        CP_ROOT({
+            CP_ARRAY(root, values, {
+                for (i = 0; i < BENCH_ITEMS; i++) {
+                    CP_ITEM_FLOAT(values, "tmp", 28.5f + i);
+                }
+            });
+        });
+        json_flush_mbuf(ctx);
+        total += os_cputime_get32() - start;
+        bool status = do_sensor_post(ctx);  assert(status);
+    }
+    return total / (BENCH_MESSAGES * BENCH_ITEMS);
+}
+
+void test_sensor_coap_json_bench(void) {
+    //  Report the CPU time per encoded CP_ITEM_FLOAT, before (one os_mbuf_append per JSON token) and after
+    //  (staging writer).  CPU time is measured in os_cputime ticks, which are CPU cycles when
+    //  OS_CPUTIME_FREQ is set to the CPU clock.
+    test_setup();
+    uint32_t direct = bench_float_items(true);
+    uint32_t staged = bench_float_items(false);
+    console_printf("CP_ITEM_FLOAT: direct append %u ticks, staged %u ticks\n", (unsigned) direct, (unsigned) staged);
+    console_flush();
+}
+
+void test_sensor_coap_header_bench(void) {
+    //  Compare the CPU time for serialising the CoAP header with coap_serialize_message() versus copying
+    //  the cached header template.  Both headers must be identical.
+    static coap_packet_t request[1];
+    static uint8_t serialised[128], copied[128];
+    static const uint8_t token[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    uint8_t payload = '{';
+    uint32_t serialise_ticks = 0, template_ticks = 0;
+    int i, rc, len = 0;
+    test_setup();
+    const struct sensor_coap_header *header = sensor_coap_get_header((struct oc_server_handle *) &server, BENCH_URI, APPLICATION_JSON);
+    assert(header);
+
+    for (i = 0; i < BENCH_HEADERS; i++) {
+        //  Serialise the header with a 1-byte payload.
+        struct os_mbuf *m = os_msys_get_pkthdr(0, 0);  assert(m);
+        struct os_mbuf *p = os_msys_get_pkthdr(0, 0);  assert(p);
+        rc = os_mbuf_append(p, &payload, 1);  assert(rc == 0);
+        uint32_t start = os_cputime_get32();
+        coap_init_message(request, COAP_TYPE_NON, COAP_POST, i);
+        coap_set_header_accept(request, APPLICATION_JSON);
+        coap_set_token(request, token, sizeof(token));
+        coap_set_header_uri_path(request, BENCH_URI);
+        request->payload_m = p;
+        request->payload_len = 1;
+        coap_set_header_content_format(request, APPLICATION_JSON);
+        rc = coap_serialize_message(request, m);  assert(rc == 0);
+        serialise_ticks += os_cputime_get32() - start;
+        len = OS_MBUF_PKTLEN(m);  assert(len <= (int) sizeof(serialised));
+        rc = os_mbuf_copydata(m, 0, len, serialised);  assert(rc == 0);
+        os_mbuf_free_chain(m);
+
+        //  Copy the header template in front of the same payload, into the reserved header space.
+        p = os_msys_get_pkthdr(0, 0);  assert(p);
+        p->om_data += sensor_coap_header_size(header, sizeof(token));
+        rc = os_mbuf_append(p, &payload, 1);  assert(rc == 0);
+        start = os_cputime_get32();
+        m = sensor_coap_write_header(header, COAP_POST, i, token, sizeof(token), p);  assert(m == p);
+        template_ticks += os_cputime_get32() - start;
+        assert(OS_MBUF_PKTLEN(m) == len);
+        rc = os_mbuf_copydata(m, 0, len, copied);  assert(rc == 0);
+        assert(memcmp(serialised, copied, len) == 0);  //  Headers must be identical.
+        os_mbuf_free_chain(m);
+    }
+    console_printf("CoAP header: serialise %u ticks, template %u ticks\n",
+        (unsigned) (serialise_ticks / BENCH_HEADERS), (unsigned) (template_ticks / BENCH_HEADERS));
+    console_flush();
+}
+
+static uint16_t count_message_mbufs(const char *uri) {
+    //  Return the number of mbufs allocated for composing a message to the URI.
+    uint16_t before = os_msys_num_free();
+    struct sensor_coap_context *ctx = init_sensor_post((struct oc_server_handle *) &server, uri, APPLICATION_JSON);
+    assert(ctx);
+    CP_ROOT({
+        CP_ARRAY(root, values, {
+            CP_ITEM_INT(values, "t", 1234);
+        });
+    });
+    json_flush_mbuf(ctx);
+    uint16_t used = before - os_msys_num_free();
+    bool status = do_sensor_post(ctx);  assert(status);
+    return used;
+}
+
+void test_sensor_coap_mbuf_watermark(void) {
+    //  Report the mbufs per message and the lowest number of free mbufs while 3 producers send messages
+    //  continuously: serialised with 2 mbuf chains (before) versus a single chain with the header prepended
+    //  in place (after).  The long URI doesn't fit into a header template, so it's serialised the old way.
+    //  Must be called after test_sensor_coap_pool(), which starts the producers.
+    test_setup();
+    uint16_t before_mbufs = count_message_mbufs(LONG_URI);
+    uint16_t after_mbufs  = count_message_mbufs("/test");
+    console_printf("mbufs per message: before %u, after %u\n", before_mbufs, after_mbufs);
+
+    producer_uri = LONG_URI;
+    min_free = os_msys_num_free();
+    run_producers(false);
+    uint16_t before_free = min_free;
+
+    producer_uri = "/test";
+    min_free = os_msys_num_free();
+    run_producers(false);
+    uint16_t after_free = min_free;
+    console_printf("free mbufs low watermark (of %u): before %u, after %u\n",
+        (unsigned) os_msys_count(), (unsigned) before_free, (unsigned) after_free);
+
+    assert(after_mbufs < before_mbufs);
+    assert(after_free >= before_free);
+    console_flush();
+}
+
+#define NON_MESSAGES 4  //  Number of NON messages sent to each URI.
+
+static uint16_t non_mids[NON_MESSAGES];    //  Message IDs received.
+static uint32_t non_tokens[NON_MESSAGES];  //  Tokens received.
+static int non_count;                      //  Number of messages received.
+
+static void non_server_receive(struct os_mbuf *m) {
+    //  Check the fixed CoAP header: NON message with a locally generated token.  Record the Message ID and token.
+    uint8_t buf[4 + COAP_TOKEN_LEN];
+    int len = OS_MBUF_PKTLEN(m), i;
+    if (len > (int) sizeof(buf)) { len = sizeof(buf); }
+    int rc = os_mbuf_copydata(m, 0, len, buf);  assert(rc == 0);
+    assert(((buf[0] >> COAP_HEADER_TYPE_POSITION) & 3) == COAP_TYPE_NON);
+    assert((buf[0] & 0x0f) == MYNEWT_VAL(SENSOR_COAP_TOKEN_LEN));
+    assert(buf[1] == COAP_POST);
+    assert(non_count < NON_MESSAGES);
+    non_mids[non_count] = (buf[2] << 8) | buf[3];
+    non_tokens[non_count] = 0;
+    for (i = 0; i < MYNEWT_VAL(SENSOR_COAP_TOKEN_LEN); i++) { non_tokens[non_count] = (non_tokens[non_count] << 8) | buf[4 + i]; }
+    non_count++;
+}
+
+static void check_non(const char *name, const char *uri) {
+    //  Send NON_MESSAGES messages to the URI.  The Message IDs and tokens must be unique.
+    int i, j;
+    uint32_t ticks = 0;
+    non_count = 0;
+    for (i = 0; i < NON_MESSAGES; i++) {
+        uint32_t start = os_cputime_get32();
+        struct sensor_coap_context *ctx = init_sensor_post((struct oc_server_handle *) &server, uri, APPLICATION_JSON);
+        ticks += os_cputime_get32() - start;
+        assert(ctx);
+        CP_ROOT({
+            CP_ARRAY(root, values, {
+                CP_ITEM_INT(values, "t", i);
+            });
+        });
+        bool status = do_sensor_post(ctx);  assert(status);
+    }
+    while (non_count < NON_MESSAGES) { os_time_delay(1); }  //  Wait for the last message.
+    for (i = 0; i < NON_MESSAGES; i++) {
+        for (j = i + 1; j < NON_MESSAGES; j++) {
+            assert(non_mids[i] != non_mids[j]);
+            assert(MYNEWT_VAL(SENSOR_COAP_TOKEN_LEN) == 0 || non_tokens[i] != non_tokens[j]);
+        }
+    }
+    console_printf("NON %s: init_sensor_post %u ticks\n", name,
+        (unsigned) (ticks / NON_MESSAGES));
+}
+
+void test_sensor_coap_non(void) {
+    //  Send NON messages with and without a cached header template.  Each message must get its own Message ID
+    //  and token, generated locally without a client callback.
+    test_setup();
+    server_receive = non_server_receive;
+    check_non("template", "/test");
+    check_non("serialised", LONG_URI);
+    server_receive = NULL;
+    console_flush();
+}
+
+static uint8_t test_ep_size(const struct oc_endpoint *oe) {
+    //  Return the size of the endpoint.
+    return sizeof(struct test_server);
+}
+
+static void test_send(struct os_mbuf *m, uint8_t priority) {
+    //  Count the message and forward to the OIC Background Task, which calls test_tx_ucast() later.
+    os_sr_t sr;
+    OS_ENTER_CRITICAL(sr);  //  Producers send at the same time.
+    sent_count++;
+    OS_EXIT_CRITICAL(sr);
+    coap_send_message(m, 0);
+}
+
+static void test_tx_ucast(struct os_mbuf *m) {
+    //  Simulate the transmission of the message, then free the chain of mbufs.
+    assert(m);
+    os_error_t rc = os_mutex_pend(&link_mutex, OS_TIMEOUT_NEVER);  assert(rc == OS_OK);
+    uint16_t free = os_msys_num_free();  //  Messages are queued while the link is busy.
+    if (free < min_free) { min_free = free; }
+    os_time_delay(TEST_LINK_TICKS);
+    if (server_receive) { server_receive(m); }
+    tx_count++;
+    rc = os_mutex_release(&link_mutex);  assert(rc == OS_OK);
+    os_mbuf_free_chain(m);
+}
+
+#if MYNEWT_VAL(COAP_CBOR_ENCODING) && MYNEWT_VAL(COAP_JSON_ENCODING)  //  For coexistence of CBOR and JSON encoding...
+
+static void check_encoding(int content_format, const uint8_t *expected, int len) {
+    //  Compose the same payload as count_message_mbufs() in the content format and check that the payload is
+    //  encoded exactly once, in the selected format only.
+    struct sensor_coap_context *ctx = init_sensor_post((struct oc_server_handle *) &server, "/test", content_format);
+    assert(ctx);
+    CP_ROOT({
+        CP_ARRAY(root, values, {
+            CP_ITEM_INT(values, "t", 1234);
+        });
+    });
+    if (content_format == APPLICATION_JSON) { json_flush_mbuf(ctx); }
+    else { assert(ctx->cbor_err == CborNoError);  assert(ctx->cbor_depth == 0); }
+
+    uint8_t buf[64];
+    assert(OS_MBUF_PKTLEN(ctx->payload) == len);
+    int rc = os_mbuf_copydata(ctx->payload, 0, len, buf);  assert(rc == 0);
+    assert(memcmp(buf, expected, len) == 0);
+    bool status = do_sensor_post(ctx);  assert(status);
+}
+
+void test_sensor_coap_encoder(void) {
+    //  With JSON and CBOR coexistence, the rep_* macros call the encoder selected for the content format.
+    //  Check the JSON and CBOR payloads byte by byte.
+    static const char json[] = "{\"values\": [{\"key\": \"t\",\"value\": 1234}]}";
+    static const uint8_t cbor[] = {
+        0xbf,                                            //  Root map (indefinite length)
+        0x66, 'v', 'a', 'l', 'u', 'e', 's', 0x9f,        //  "values": Array (indefinite length)
+        0xbf, 0x63, 'k', 'e', 'y', 0x61, 't',            //  Item map, "key": "t"
+        0x65, 'v', 'a', 'l', 'u', 'e', 0x19, 0x04, 0xd2, //  "value": 1234
+        0xff, 0xff, 0xff,                                //  End of item, array and root
+    };
+    test_setup();
+    check_encoding(APPLICATION_JSON, (const uint8_t *) json, sizeof(json) - 1);
+    check_encoding(APPLICATION_CBOR, cbor, sizeof(cbor));
+    console_printf("encoder: JSON %d bytes, CBOR %d bytes\n", (int) sizeof(json) - 1, (int) sizeof(cbor));
+    console_flush();
+}
+
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING) && MYNEWT_VAL(COAP_JSON_ENCODING)
+
+SENSOR_COAP_SKELETON(test_skeleton,
+    CP_SKELETON_STR("device"),
+    CP_SKELETON_STR("node"),
+    CP_SKELETON_FLOAT(NULL),
+    CP_SKELETON_INT(NULL)
+);
+
+static int compose_payload(int content_format, bool skeleton, const struct sensor_value *tmp, uint8_t *buf, int size) {
+    //  Compose the payload with the CP macros or with test_skeleton.  Copy the payload into buf and return the size.
+    struct sensor_coap_context *ctx = init_sensor_post((struct oc_server_handle *) &server, "/test", content_format);
+    assert(ctx);
+#if MYNEWT_VAL(SENSOR_COAP_FLAT)  //  If we are supporting the flat payload layout...
+    int layout_rc = sensor_coap_set_layout(ctx, payload_layout);  assert(layout_rc == 0);
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FLAT)
+    if (skeleton) {
+        struct sensor_coap_slot slots[6];
+        slots[0].text_val = "0102030405060708090a0b0c0d0e0f10";
+        slots[1].text_val = "b3b4b5b6\"f1";  //  Escaped in JSON.
+        slots[2].text_val = tmp->key;
+        slots[3].float_val = tmp->float_val;
+        slots[4].text_val = "t";
+        slots[5].int_val = -1234;
+        CP_SKELETON(test_skeleton, slots);
+    } else {
+        CP_ROOT({
+            CP_ARRAY(root, values, {
+                CP_ITEM_STR(values, "device", "0102030405060708090a0b0c0d0e0f10");
+                CP_ITEM_STR(values, "node", "b3b4b5b6\"f1");
+                CP_ITEM_FLOAT_VAL(values, tmp);
+                CP_ITEM_INT(values, "t", -1234);
+            });
+        });
+    }
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    if (content_format == APPLICATION_JSON) { json_flush_mbuf(ctx); }
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+    int len = OS_MBUF_PKTLEN(ctx->payload);  assert(len <= size);
+    int rc = os_mbuf_copydata(ctx->payload, 0, len, buf);  assert(rc == 0);
+    bool status = do_sensor_post(ctx);  assert(status);
+    return len;
+}
+
+static void check_skeleton(int content_format) {
+    //  The skeleton payload must be identical to the CP macros payload.  Report the CPU time for each.
+    struct sensor_value tmp = { "tmp", SENSOR_VALUE_TYPE_FLOAT, 0, 28.7f };
+    uint8_t expected[128], actual[128];
+    uint32_t start = os_cputime_get32();
+    int expected_len = compose_payload(content_format, false, &tmp, expected, sizeof(expected));
+    uint32_t cp_ticks = os_cputime_get32() - start;
+    compose_payload(content_format, true, &tmp, actual, sizeof(actual));  //  First use renders the skeleton.
+    start = os_cputime_get32();
+    int actual_len = compose_payload(content_format, true, &tmp, actual, sizeof(actual));
+    uint32_t skeleton_ticks = os_cputime_get32() - start;
+    assert(actual_len == expected_len);
+    assert(memcmp(actual, expected, expected_len) == 0);
+    console_printf("skeleton %s: %d bytes, CP macros %u ticks, skeleton %u ticks\n",
+        (content_format == APPLICATION_JSON) ? "JSON" : "CBOR", expected_len,
+        (unsigned) cp_ticks, (unsigned) skeleton_ticks);
+}
+
+void test_sensor_coap_skeleton(void) {
+    //  Compose the same payload with the CP macros and with a payload skeleton, in each encoding.
+    test_setup();
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    check_skeleton(APPLICATION_JSON);
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+    check_skeleton(APPLICATION_CBOR);
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+    console_flush();
+}
+
+SENSOR_COAP_SKELETON(test_prefix,
+    CP_SKELETON_STR("device")
+);
+
+static int compose_batch(int content_format, bool skeleton, struct sensor_coap_batch *batch, uint8_t *buf, int size,
+    uint32_t *ticks, int *mbufs) {
+    //  Compose the batch with the CP macros or with test_prefix as the constant prefix.  Copy the payload into buf
+    //  and return the size.  Return the CPU time and the number of mbufs used by the payload.
+    struct sensor_coap_context *ctx = init_sensor_post((struct oc_server_handle *) &server, "/test", content_format);
+    assert(ctx);
+#if MYNEWT_VAL(SENSOR_COAP_FLAT)  //  If we are supporting the flat payload layout...
+    int layout_rc = sensor_coap_set_layout(ctx, payload_layout);  assert(layout_rc == 0);
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FLAT)
+    uint16_t free = os_msys_num_free();
+    uint32_t start = os_cputime_get32();
+    if (skeleton) {
+        struct sensor_coap_slot slots[1];
+        slots[0].text_val = "0102030405060708090a0b0c0d0e0f10";
+        CP_SKELETON_BATCH(test_prefix, slots, batch);
+    } else {
+        CP_ROOT({
+            CP_ARRAY(root, values, {
+                CP_ITEM_STR(values, "device", "0102030405060708090a0b0c0d0e0f10");
+                CP_BATCH_ITEMS(values, batch, CP_ITEM_VAL);
+            });
+        });
+    }
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    if (content_format == APPLICATION_JSON) { json_flush_mbuf(ctx); }
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+    *ticks = os_cputime_get32() - start;
+    *mbufs = free - os_msys_num_free();
+    int len = OS_MBUF_PKTLEN(ctx->payload);  assert(len <= size);
+    int rc = os_mbuf_copydata(ctx->payload, 0, len, buf);  assert(rc == 0);
+    bool status = do_sensor_post(ctx);  assert(status);
+    return len;
+}
+
+static void check_skeleton_batch(int content_format, struct sensor_coap_batch *batch) {
+    //  The batch payload with the constant prefix must be identical to the CP macros payload.
+    uint8_t expected[400], actual[400];
+    uint32_t cp_ticks, skeleton_ticks;
+    int cp_mbufs, skeleton_mbufs;
+    int expected_len = compose_batch(content_format, false, batch, expected, sizeof(expected), &cp_ticks, &cp_mbufs);
+    compose_batch(content_format, true, batch, actual, sizeof(actual), &skeleton_ticks, &skeleton_mbufs);  //  First use renders the prefix.
+    int actual_len = compose_batch(content_format, true, batch, actual, sizeof(actual), &skeleton_ticks, &skeleton_mbufs);
+    assert(actual_len == expected_len);
+    assert(memcmp(actual, expected, expected_len) == 0);
+    console_printf("skeleton batch %s: %d bytes, CP macros %u ticks %d mbufs, prefix %u ticks %d mbufs\n",
+        (content_format == APPLICATION_JSON) ? "JSON" : "CBOR", expected_len,
+        (unsigned) cp_ticks, cp_mbufs, (unsigned) skeleton_ticks, skeleton_mbufs);
+}
+
+void test_sensor_coap_skeleton_batch(void) {
+    //  Compose a batch of int and float readings from 2 nodes with the CP macros and with the constant prefix.
+    static struct sensor_coap_batch batch;
+    int i;
+    test_setup();
+    memset(&batch, 0, sizeof(batch));
+    for (i = 0; i < MYNEWT_VAL(SENSOR_COAP_BATCH_COUNT); i++) {
+        struct sensor_coap_reading *reading = &batch.readings[batch.count++];
+        struct sensor_value val = { "t", SENSOR_VALUE_TYPE_INT32, 1715 + i, 0 };
+        struct sensor_value tmp = { "tmp", SENSOR_VALUE_TYPE_FLOAT, 0, 28.7f + i };
+        reading->val = (i % 2) ? tmp : val;
+        reading->node = (i < MYNEWT_VAL(SENSOR_COAP_BATCH_COUNT) / 2) ? "b3b4b5b6f1" : "b3b4b5b6f2";
+    }
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    check_skeleton_batch(APPLICATION_JSON, &batch);
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+    check_skeleton_batch(APPLICATION_CBOR, &batch);
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+    console_flush();
+}
+
+#if MYNEWT_VAL(SENSOR_COAP_FLAT)  //  If we are supporting the flat payload layout...
+
+void test_sensor_coap_flat(void) {
+    //  Compose the same payload in the "values" items layout and in the flat layout, with the CP macros.
+    //  The flat JSON payload is checked byte by byte.  Then check that the payload skeletons write the same
+    //  flat payloads as the CP macros, in each encoding.
+    static const char expected[] =
+        "{\"device\": \"0102030405060708090a0b0c0d0e0f10\",\"node\": \"b3b4b5b6\\\"f1\",\"tmp\": 28.70,\"t\": -1234}";
+    struct sensor_value tmp = { "tmp", SENSOR_VALUE_TYPE_FLOAT, 0, 28.7f };
+    uint8_t items[128], flat[128];
+    test_setup();
+    payload_layout = SENSOR_COAP_LAYOUT_ITEMS;
+    int items_len = compose_payload(APPLICATION_JSON, false, &tmp, items, sizeof(items));
+    payload_layout = SENSOR_COAP_LAYOUT_FLAT;
+    int flat_len = compose_payload(APPLICATION_JSON, false, &tmp, flat, sizeof(flat));
+    assert(flat_len == sizeof(expected) - 1);
+    assert(memcmp(flat, expected, flat_len) == 0);
+    assert(flat_len < items_len);
+    console_printf("flat JSON: %d bytes, items %d bytes, %d%% smaller\n",
+        flat_len, items_len, 100 * (items_len - flat_len) / items_len);
+
+    //  Payload skeletons and batches must follow the layout.
+    check_skeleton(APPLICATION_JSON);
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+    check_skeleton(APPLICATION_CBOR);
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+    test_sensor_coap_skeleton_batch();
+    payload_layout = SENSOR_COAP_LAYOUT_ITEMS;
+    console_flush();
+}
+
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FLAT)
+
+#if MYNEWT_VAL(SENSOR_COAP_BLOCK1)  //  If we are sending large payloads as Block1 blocks...
+
+#define BLOCK_ITEMS  36   //  Number of CP_ITEM_INT items in the large payload, about 1 KB in JSON.
+#define BLOCK_MAX  1100   //  Max size of the reassembled payload.
+
+//  Stand-in CoAP Server that reassembles the Block1 blocks received through the stand-in transport.
+static uint8_t block_payload[BLOCK_MAX];  //  Reassembled payload.
+static int block_len;                     //  Number of bytes reassembled.
+static uint32_t block_next;               //  Next expected block number.
+static int block_msgs;                    //  Number of messages received.
+static bool block_done;                   //  True if the last block has been received.
+static uint8_t block_szx;                 //  Expected block size exponent.
+
+static void block_server_receive(struct os_mbuf *m) {
+    //  Parse the CoAP header and the Block1 option, then append the block payload in block order.
+    uint8_t buf[4 + COAP_TOKEN_LEN + MYNEWT_VAL(SENSOR_COAP_HEADER_SIZE) + SENSOR_COAP_BLOCK1_OPTION_SIZE + 1];
+    int len = OS_MBUF_PKTLEN(m), off, number = 0;
+    bool has_block1 = false;
+    uint32_t block1 = 0;
+    if (len > (int) sizeof(buf)) { len = sizeof(buf); }
+    int rc = os_mbuf_copydata(m, 0, len, buf);  assert(rc == 0);
+    off = 4 + (buf[0] & 0x0f);  //  Skip the fixed header and token.
+    while (off < len && buf[off] != 0xff) {
+        //  Parse the option delta and length, with extended values.
+        int delta = buf[off] >> 4, opt_len = buf[off] & 0x0f, i;
+        off++;
+        if (delta == 13) { delta = 13 + buf[off++]; } else if (delta == 14) { delta = 269 + (buf[off] << 8) + buf[off + 1];  off += 2; }
+        if (opt_len == 13) { opt_len = 13 + buf[off++]; } else if (opt_len == 14) { opt_len = 269 + (buf[off] << 8) + buf[off + 1];  off += 2; }
+        number += delta;
+        if (number == COAP_OPTION_BLOCK1) {
+            has_block1 = true;
+            for (i = 0; i < opt_len; i++) { block1 = (block1 << 8) | buf[off + i]; }
+        }
+        off += opt_len;
+    }
+    assert(off < len);  //  Missing payload marker.
+    off++;
+    int payload_len = OS_MBUF_PKTLEN(m) - off;
+    block_msgs++;
+    if (!has_block1) {
+        //  Payload was sent in a single message.
+        assert(block_len + payload_len <= BLOCK_MAX);
+        rc = os_mbuf_copydata(m, off, payload_len, &block_payload[block_len]);  assert(rc == 0);
+        block_len += payload_len;  block_done = true;
+        return;
+    }
+    uint32_t num = block1 >> 4;
+    bool more = (block1 >> 3) & 1;
+    uint8_t szx = block1 & 7;
+    assert(szx == block_szx);  assert(num == block_next);  assert(!block_done);
+    assert(more ? (payload_len == (16 << szx)) : (payload_len <= (16 << szx)));  //  Only the last block may be short.
+    assert(num * (16 << szx) == (uint32_t) block_len);
+    assert(block_len + payload_len <= BLOCK_MAX);
+    rc = os_mbuf_copydata(m, off, payload_len, &block_payload[block_len]);  assert(rc == 0);
+    block_len += payload_len;
+    block_next++;
+    if (!more) { block_done = true; }
+}
+
+static int compose_large_payload(uint8_t szx, const char *uri, uint8_t *expected, int size, bool *status) {
+    //  Send a large payload with the block size exponent to the URI.  Copy the payload into expected and return the
+    //  size.  Set status to the result of do_sensor_post().
+    int rc = sensor_coap_set_block1_szx(szx);  assert(rc == 0);
+    block_len = 0;  block_next = 0;  block_msgs = 0;  block_done = false;  block_szx = szx;
+    struct sensor_coap_context *ctx = init_sensor_post((struct oc_server_handle *) &server, uri, APPLICATION_JSON);
+    assert(ctx);
+    int i;
+    CP_ROOT({
+        CP_ARRAY(root, values, {
+            for (i = 0; i < BLOCK_ITEMS; i++) { CP_ITEM_INT(values, "t", 1000 + i); }
+        });
+    });
+    json_flush_mbuf(ctx);
+    int len = OS_MBUF_PKTLEN(ctx->payload);  assert(len <= size);
+    rc = os_mbuf_copydata(ctx->payload, 0, len, expected);  assert(rc == 0);
+    *status = do_sensor_post(ctx);
+    return len;
+}
+
+void test_sensor_coap_block1(void) {
+    //  Send a payload of about 1 KB at each block size.  The stand-in CoAP Server must reassemble the identical
+    //  payload.  Report the messages and the throughput, with TEST_LINK_TICKS per message on the simulated link.
+    static uint8_t expected[BLOCK_MAX];
+    uint8_t szx;
+    test_setup();
+    server_receive = block_server_receive;
+    for (szx = 2; szx <= 6; szx++) {
+        uint16_t free = os_msys_num_free();
+        os_time_t start = os_time_get();
+        bool status;
+        int len = compose_large_payload(szx, "/test", expected, sizeof(expected), &status);  assert(status);
+        while (!block_done) { os_time_delay(1); }  //  Wait for the last block.
+        os_time_t elapsed = os_time_get() - start;
+        if (elapsed == 0) { elapsed = 1; }
+        assert(block_len == len);
+        assert(memcmp(block_payload, expected, len) == 0);
+        console_printf("block1 SZX %d (%d bytes): %d bytes in %d msgs, %u bytes/sec\n", szx, 16 << szx, len, block_msgs,
+            (unsigned) ((uint32_t) len * OS_TICKS_PER_SEC / elapsed));
+        while (os_msys_num_free() < free) { os_time_delay(1); }  //  Wait for the transport to free the blocks.
+    }
+    server_receive = NULL;
+    int rc = sensor_coap_set_block1_szx(MYNEWT_VAL(SENSOR_COAP_BLOCK1_SZX));  assert(rc == 0);
+    console_flush();
+}
+
+void test_sensor_coap_block1_uncached(void) {
+    //  Fill the header cache, then send a large payload to a URI without a header template.  The payload must
+    //  still be sent in blocks.  A URI too long for a template must fail the post instead of sending the payload
+    //  whole.  Run after the other tests, since the header cache is never cleared.
+    static uint8_t expected[BLOCK_MAX];
+    static const char *fill_uris[] = { "/fill0", "/fill1", "/fill2", "/fill3", "/fill4", "/fill5", "/fill6", "/fill7" };
+    static char long_uri[MYNEWT_VAL(SENSOR_COAP_HEADER_SIZE) + 2];
+    uint8_t szx = 4;
+    int i;
+    test_setup();
+    for (i = 0; i < (int) (sizeof(fill_uris) / sizeof(fill_uris[0])); i++) {
+        if (!sensor_coap_get_header((struct oc_server_handle *) &server, fill_uris[i], APPLICATION_JSON)) { break; }
+    }
+    assert(!sensor_coap_get_header((struct oc_server_handle *) &server, "/uncached", APPLICATION_JSON));  //  Cache is full.
+
+    server_receive = block_server_receive;
+    uint16_t free = os_msys_num_free();
+    bool status;
+    int len = compose_large_payload(szx, "/uncached", expected, sizeof(expected), &status);  assert(status);
+    while (!block_done) { os_time_delay(1); }  //  Wait for the last block.
+    assert(block_len == len);  assert(block_msgs > 1);
+    assert(memcmp(block_payload, expected, len) == 0);
+    console_printf("block1 uncached: %d bytes in %d msgs\n", len, block_msgs);
+    while (os_msys_num_free() < free) { os_time_delay(1); }  //  Wait for the transport to free the blocks.
+
+    //  No template fits the URI: Nothing is sent and no mbufs are leaked.
+    long_uri[0] = '/';
+    memset(&long_uri[1], 'u', sizeof(long_uri) - 2);
+    compose_large_payload(szx, long_uri, expected, sizeof(expected), &status);  assert(!status);
+    os_time_delay(OS_TICKS_PER_SEC / 10);
+    assert(block_msgs == 0);  assert(os_msys_num_free() == free);
+
+    server_receive = NULL;
+    int rc = sensor_coap_set_block1_szx(MYNEWT_VAL(SENSOR_COAP_BLOCK1_SZX));  assert(rc == 0);
+    console_flush();
+}
+
+#endif  //  MYNEWT_VAL(SENSOR_COAP_BLOCK1)
+
+#if MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0  //  If we are sending each payload to multiple destinations...
+
+#define FANOUT_MAX 64  //  Max size of the payload received by each server.
+
+static struct test_server mirror;             //  Stand-in mirror server, e.g. a local historian.
+static uint8_t fanout_payloads[2][FANOUT_MAX];  //  Payload received by the main server and the mirror server.
+static int fanout_lens[2];                    //  Size of the payload received by each server.
+static uint16_t fanout_mids[2];               //  Message ID received by each server.
+static int fanout_count;                      //  Number of messages received.
+
+static void fanout_server_receive(struct os_mbuf *m) {
+    //  Skip the CoAP header and record the payload and Message ID for the server in the message endpoint.
+    uint8_t buf[4 + COAP_TOKEN_LEN + MYNEWT_VAL(SENSOR_COAP_HEADER_SIZE) + 1];
+    const struct test_server *ep = (const struct test_server *) OC_MBUF_ENDPOINT(m);
+    int len = OS_MBUF_PKTLEN(m), off;
+    assert(ep->id < 2);
+    if (len > (int) sizeof(buf)) { len = sizeof(buf); }
+    int rc = os_mbuf_copydata(m, 0, len, buf);  assert(rc == 0);
+    for (off = 4 + (buf[0] & 0x0f); off < len && buf[off] != 0xff; off++) {}  //  Options contain no 0xff bytes.
+    assert(off < len);  //  Missing payload marker.
+    off++;
+    fanout_lens[ep->id] = OS_MBUF_PKTLEN(m) - off;  assert(fanout_lens[ep->id] <= FANOUT_MAX);
+    rc = os_mbuf_copydata(m, off, fanout_lens[ep->id], fanout_payloads[ep->id]);  assert(rc == 0);
+    fanout_mids[ep->id] = (buf[2] << 8) | buf[3];
+    fanout_count++;
+}
+
+void test_sensor_coap_fanout(void) {
+    //  Send a payload to the main server and a copy to the mirror server.  Both servers must receive the same
+    //  payload in separate messages.  Needs 2 free header templates in SENSOR_COAP_HEADER_CACHE.
+    test_setup();
+    mirror.ep = server.ep;
+    server.id = 0;  mirror.id = 1;
+    server_receive = fanout_server_receive;
+    fanout_count = 0;
+    struct sensor_coap_context *ctx = init_sensor_post((struct oc_server_handle *) &server, "/test", APPLICATION_JSON);
+    assert(ctx);
+    int rc = sensor_coap_add_destination(ctx, (struct oc_server_handle *) &mirror, "/mirror");  assert(rc == 0);
+    CP_ROOT({
+        CP_ARRAY(root, values, {
+            CP_ITEM_INT(values, "t", 1715);
+        });
+    });
+    bool status = do_sensor_post(ctx);  assert(status);
+    while (fanout_count < 2) { os_time_delay(1); }  //  Wait for both messages.
+    assert(fanout_lens[0] > 0);  assert(fanout_lens[0] == fanout_lens[1]);
+    assert(memcmp(fanout_payloads[0], fanout_payloads[1], fanout_lens[0]) == 0);
+    assert(fanout_mids[0] != fanout_mids[1]);
+    server_receive = NULL;
+    console_printf("fanout: %d bytes to 2 servers\n", fanout_lens[0]);
+    console_flush();
+}
+
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0
+
+#if MYNEWT_VAL(SENSOR_COAP_SENML)  //  If we are composing SenML payloads...
+
+static void check_senml(int content_format, const uint8_t *expected, int len) {
+    //  Compose a SenML pack with base name changes, relative times and a string value.  Check the payload byte by byte.
+    struct sensor_coap_context *ctx = init_sensor_post((struct oc_server_handle *) &server, "/test", content_format);
+    assert(ctx);
+    CP_SENML_ROOT(-25, {
+        CP_SENML_BASE_NAME("q83v_w", "b3b4b5b6f1");
+        CP_SENML_INT("t", 1715, 0);
+        CP_SENML_INT("t", 1716, 10);
+        CP_SENML_BASE_NAME(NULL, "b3b4b5b6f2");
+        CP_SENML_STR("s", "ok", 12);
+    });
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    if (content_format == APPLICATION_SENML_JSON) { json_flush_mbuf(ctx); }
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+    if (content_format == APPLICATION_SENML_CBOR) { assert(ctx->cbor_err == CborNoError); }
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+
+    uint8_t buf[160];
+    assert(OS_MBUF_PKTLEN(ctx->payload) == len);
+    int rc = os_mbuf_copydata(ctx->payload, 0, len, buf);  assert(rc == 0);
+    assert(memcmp(buf, expected, len) == 0);
+    bool status = do_sensor_post(ctx);  assert(status);
+}
+
+static int senml_flush_len;  //  Payload size of the last SenML batch flushed.
+
+static int test_senml_flush(struct sensor_coap_batch *batch, void *arg) {
+    //  Compose the batched readings as a SenML JSON pack.  The estimated size must not be less than the payload size.
+    struct sensor_coap_context *ctx = init_sensor_post((struct oc_server_handle *) &server, "/test", APPLICATION_SENML_JSON);
+    assert(ctx);
+    CP_SENML_BATCH("0102030405060708090a0b0c0d0e0f10", batch, CP_SENML_INT_VAL);
+    json_flush_mbuf(ctx);
+    senml_flush_len = OS_MBUF_PKTLEN(ctx->payload);
+    assert(senml_flush_len <= batch->bytes);
+    bool status = do_sensor_post(ctx);  assert(status);
+    return 0;
+}
+
+void test_sensor_coap_senml(void) {
+    //  Check the SenML JSON and CBOR packs, then compare the SenML batch with the thethings.io batch.
+    static const char json[] =
+        "[{\"bn\": \"q83v_w:b3b4b5b6f1:\",\"bt\": -25,\"n\": \"t\",\"v\": 1715},"
+        "{\"n\": \"t\",\"v\": 1716,\"t\": 10},"
+        "{\"bn\": \"b3b4b5b6f2:\",\"n\": \"s\",\"vs\": \"ok\",\"t\": 12}]";
+    static const uint8_t cbor[] = {
+        0x9f,                                            //  Pack (indefinite length)
+        0xa4, 0x21, 0x72, 'q', '8', '3', 'v', '_', 'w', ':',  //  Record with 4 fields, bn (-2): "q83v_w:b3b4b5b6f1:"
+        'b', '3', 'b', '4', 'b', '5', 'b', '6', 'f', '1', ':',
+        0x22, 0x38, 0x18,                                //  bt (-3): -25
+        0x00, 0x61, 't', 0x02, 0x19, 0x06, 0xb3,         //  n (0): "t", v (2): 1715
+        0xa3, 0x00, 0x61, 't', 0x02, 0x19, 0x06, 0xb4,   //  Record with 3 fields, n: "t", v: 1716
+        0x06, 0x0a,                                      //  t (6): 10
+        0xa4, 0x21, 0x6b, 'b', '3', 'b', '4', 'b', '5',  //  Record with 4 fields, bn: "b3b4b5b6f2:"
+        'b', '6', 'f', '2', ':',
+        0x00, 0x61, 's', 0x03, 0x62, 'o', 'k',           //  n: "s", vs (3): "ok"
+        0x06, 0x0c,                                      //  t: 12
+        0xff,                                            //  End of pack
+    };
+    test_setup();
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    check_senml(APPLICATION_SENML_JSON, (const uint8_t *) json, sizeof(json) - 1);
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+#if MYNEWT_VAL(COAP_CBOR_ENCODING)  //  If we are encoding the CoAP payload in CBOR...
+    check_senml(APPLICATION_SENML_CBOR, cbor, sizeof(cbor));
+#endif  //  MYNEWT_VAL(COAP_CBOR_ENCODING)
+    console_printf("senml: JSON %d bytes, CBOR %d bytes\n", (int) sizeof(json) - 1, (int) sizeof(cbor));
+
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    //  Batch a time series from one node, with the SenML size estimates.
+    static struct sensor_coap_batch batch;
+    struct sensor_value val = { "t", SENSOR_VALUE_TYPE_INT32, 1715, 0 };
+    int rc = sensor_coap_batch_init(&batch, 1000, 0, 60000, test_senml_flush, NULL);  assert(rc == 0);
+    rc = sensor_coap_batch_use_senml(&batch, "0102030405060708090a0b0c0d0e0f10");  assert(rc == 0);
+    int i;
+    for (i = 0; i < MYNEWT_VAL(SENSOR_COAP_BATCH_COUNT); i++) {
+        val.int_val++;
+        rc = sensor_coap_batch_add(&batch, &val, "b3b4b5b6f1");  assert(rc == 0);
+        os_time_delay(OS_TICKS_PER_SEC);
+    }
+    assert(senml_flush_len > 0);  //  Batch should have been flushed when full.
+    console_printf("senml: batch of %d readings in %d bytes\n", MYNEWT_VAL(SENSOR_COAP_BATCH_COUNT), senml_flush_len);
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+    console_flush();
+}
+
+#endif  //  MYNEWT_VAL(SENSOR_COAP_SENML)
+
+#if MYNEWT_VAL(SENSOR_COAP_COMPRESS)  //  If we are compressing payloads...
+
+#define COMPRESS_MAX 600  //  Max size of the uncompressed payloads.
+
+static uint8_t compress_received[COMPRESS_MAX];  //  Payload received by the stand-in CoAP Server, decompressed.
+static int compress_len;                        //  Size of the decompressed payload.
+static int compress_wire_len;                   //  Size of the payload on the wire.
+static unsigned compress_format;                //  Content format received.
+
+static int lzss_decode(const uint8_t *in, int len, uint8_t *out, int size) {
+    //  Decompress the LZSS payload, as the server would.  Return the decompressed size, or -1 if the payload is corrupt.
+    int i = 0, o = 0, bit;
+    while (i < len) {
+        uint8_t flags = in[i++];
+        for (bit = 0; bit < 8 && i < len; bit++) {
+            if (flags & (1 << bit)) {
+                //  Match: Copy byte by byte, since the match may overlap the bytes being copied.
+                if (i + 2 > len) { return -1; }
+                int distance = in[i] + 1, n = in[i + 1] + 3;
+                i += 2;
+                if (distance > o || o + n > size) { return -1; }
+                while (n-- > 0) { out[o] = out[o - distance];  o++; }
+            } else {
+                if (o >= size) { return -1; }
+                out[o++] = in[i++];
+            }
+        }
+    }
+    return o;
+}
+
+static int compress_buf(const uint8_t *buf, int len, uint8_t *out, int size, uint32_t *ticks) {
+    //  Compress the bytes with sensor_coap_lzss_compress() through a chain of mbufs.  Copy the compressed bytes into
+    //  out and return the compressed size, or -1 if the bytes don't shrink.  Return the CPU time in ticks.
+    struct os_mbuf *src = os_msys_get_pkthdr(0, 0);  assert(src);
+    struct os_mbuf *dst = os_msys_get_pkthdr(0, 0);  assert(dst);
+    int rc = os_mbuf_append(src, buf, len);  assert(rc == 0);
+    uint32_t start = os_cputime_get32();
+    int compressed_len = sensor_coap_lzss_compress(src, len, dst);
+    *ticks = os_cputime_get32() - start;
+    if (compressed_len >= 0) {
+        assert(compressed_len == OS_MBUF_PKTLEN(dst));  assert(compressed_len <= size);
+        rc = os_mbuf_copydata(dst, 0, compressed_len, out);  assert(rc == 0);
+    }
+    os_mbuf_free_chain(src);
+    os_mbuf_free_chain(dst);
+    return compressed_len;
+}
+
+static void check_round_trip(const char *name, const uint8_t *buf, int len, uint32_t encode_ticks) {
+    //  Compress and decompress the bytes.  The decompressed bytes must be identical.  Report the compression ratio
+    //  and the CPU time, compared with the time to encode the payload.
+    static uint8_t compressed[COMPRESS_MAX], decompressed[COMPRESS_MAX];
+    uint32_t ticks;
+    int compressed_len = compress_buf(buf, len, compressed, sizeof(compressed), &ticks);
+    assert(compressed_len > 0);  assert(compressed_len < len);
+    int decompressed_len = lzss_decode(compressed, compressed_len, decompressed, sizeof(decompressed));
+    assert(decompressed_len == len);
+    assert(memcmp(decompressed, buf, len) == 0);
+    console_printf("LZSS %s: %d -> %d bytes (%d%%), compress %u ticks, encode %u ticks\n", name, len, compressed_len,
+        100 * compressed_len / len, (unsigned) ticks, (unsigned) encode_ticks);
+}
+
+static void compress_server_receive(struct os_mbuf *m) {
+    //  Parse the CoAP header for the content format, then decompress the payload if compressed.
+    uint8_t buf[4 + COAP_TOKEN_LEN + 160];  //  Fits the options for LONG_URI.
+    uint8_t wire[COMPRESS_MAX];
+    int len = OS_MBUF_PKTLEN(m), off, number = 0;
+    if (len > (int) sizeof(buf)) { len = sizeof(buf); }
+    int rc = os_mbuf_copydata(m, 0, len, buf);  assert(rc == 0);
+    off = 4 + (buf[0] & 0x0f);  //  Skip the fixed header and token.
+    compress_format = 0;
+    while (off < len && buf[off] != 0xff) {
+        //  Parse the option delta and length, with extended values.
+        int delta = buf[off] >> 4, opt_len = buf[off] & 0x0f, i;
+        off++;
+        if (delta == 13) { delta = 13 + buf[off++]; } else if (delta == 14) { delta = 269 + (buf[off] << 8) + buf[off + 1];  off += 2; }
+        if (opt_len == 13) { opt_len = 13 + buf[off++]; } else if (opt_len == 14) { opt_len = 269 + (buf[off] << 8) + buf[off + 1];  off += 2; }
+        number += delta;
+        if (number == COAP_OPTION_CONTENT_FORMAT) {
+            for (i = 0; i < opt_len; i++) { compress_format = (compress_format << 8) | buf[off + i]; }
+        }
+        off += opt_len;
+    }
+    assert(off < len);  //  Missing payload marker.
+    off++;
+    compress_wire_len = OS_MBUF_PKTLEN(m) - off;  assert(compress_wire_len <= COMPRESS_MAX);
+    rc = os_mbuf_copydata(m, off, compress_wire_len, wire);  assert(rc == 0);
+    if (compress_format == SENSOR_COAP_LZSS_FORMAT(APPLICATION_JSON)) {
+        compress_len = lzss_decode(wire, compress_wire_len, compress_received, sizeof(compress_received));
+    } else {
+        memcpy(compress_received, wire, compress_wire_len);
+        compress_len = compress_wire_len;
+    }
+}
+
+void test_sensor_coap_compress(void) {
+    //  Compress batch payloads of increasing size and check the round trips with the decoder.  Report the
+    //  compression ratio against the CPU time to compress and to encode.  Then send a compressed payload through
+    //  the stand-in transport: the server must receive the compressed content format and decompress the payload.
+    static struct sensor_coap_batch batch;
+    static uint8_t buf[COMPRESS_MAX], expected[COMPRESS_MAX];
+    uint32_t encode_ticks, ticks;
+    int mbufs, count, i, len;
+    test_setup();
+
+    //  Batches of int and float readings from 2 nodes, in JSON.
+    for (count = 2; count <= MYNEWT_VAL(SENSOR_COAP_BATCH_COUNT); count *= 2) {
+        char name[24];
+        memset(&batch, 0, sizeof(batch));
+        for (i = 0; i < count; i++) {
+            struct sensor_coap_reading *reading = &batch.readings[batch.count++];
+            struct sensor_value val = { "t", SENSOR_VALUE_TYPE_INT32, 1715 + i, 0 };
+            struct sensor_value tmp = { "tmp", SENSOR_VALUE_TYPE_FLOAT, 0, 28.7f + i };
+            reading->val = (i % 2) ? tmp : val;
+            reading->node = (i < count / 2) ? "b3b4b5b6f1" : "b3b4b5b6f2";
+        }
+        len = compose_batch(APPLICATION_JSON, false, &batch, buf, sizeof(buf), &encode_ticks, &mbufs);
+        sprintf(name, "batch of %d", count);
+        check_round_trip(name, buf, len, encode_ticks);
+    }
+
+    //  Long runs are encoded as overlapping matches.  Random bytes don't shrink, so they are not compressed.
+    memset(buf, 'a', 200);
+    check_round_trip("run of 200", buf, 200, 0);
+    for (i = 0; i < 200; i++) { buf[i] = (uint8_t) (i * 167 + (i >> 3) * 13); }
+    assert(compress_buf(buf, 200, expected, sizeof(expected), &ticks) < 0);
+
+    //  Send a compressed payload.  Without a header template, the request is serialised with the compressed format.
+    server_receive = compress_server_receive;
+    compress_len = -1;
+    struct sensor_coap_context *ctx = init_sensor_post((struct oc_server_handle *) &server, LONG_URI, APPLICATION_JSON);
+    assert(ctx);
+    sensor_coap_set_compress(ctx, true);
+    CP_ROOT({
+        CP_ARRAY(root, values, {
+            for (i = 0; i < 16; i++) { CP_ITEM_INT(values, "t", 1700 + i); }
+        });
+    });
+    json_flush_mbuf(ctx);
+    len = OS_MBUF_PKTLEN(ctx->payload);  assert(len <= (int) sizeof(expected));
+    int rc = os_mbuf_copydata(ctx->payload, 0, len, expected);  assert(rc == 0);
+    bool status = do_sensor_post(ctx);  assert(status);
+    while (compress_len < 0) { os_time_delay(1); }  //  Wait for the message.
+    assert(compress_format == SENSOR_COAP_LZSS_FORMAT(APPLICATION_JSON));
+    assert(compress_len == len);
+    assert(memcmp(compress_received, expected, len) == 0);
+    console_printf("LZSS sent: %d -> %d bytes, content format %u\n", len, compress_wire_len, compress_format);
+    server_receive = NULL;
+    console_flush();
+}
+
+#endif  //  MYNEWT_VAL(SENSOR_COAP_COMPRESS)
+
+static struct os_task hold_tasks[MYNEWT_VAL(SENSOR_COAP_CONTEXTS)];
+static os_stack_t hold_stacks[MYNEWT_VAL(SENSOR_COAP_CONTEXTS)][TEST_STACK_SIZE];
+static struct os_sem hold_start_sem;    //  Released to make a holder take a compose context.
+static struct os_sem hold_ready_sem;    //  Released by a holder when it has taken a compose context.
+static struct os_sem hold_release_sem;  //  Released to make a holder send its message and free the context.
+
+static void hold_func(void *arg) {
+    //  Take a compose context and hold it, like a task waiting for a slow ESP8266 send, until told to post.
+    for (;;) {
+        os_error_t rc = os_sem_pend(&hold_start_sem, OS_TIMEOUT_NEVER);  assert(rc == OS_OK);
+        struct sensor_coap_context *ctx = init_sensor_post((struct oc_server_handle *) &server, "/test", APPLICATION_JSON);
+        assert(ctx);
+        rc = os_sem_release(&hold_ready_sem);  assert(rc == OS_OK);
+        rc = os_sem_pend(&hold_release_sem, OS_TIMEOUT_NEVER);  assert(rc == OS_OK);
+        CP_ROOT({
+            CP_ARRAY(root, values, {
+                CP_ITEM_INT(values, "t", 1715);
+            });
+        });
+        bool status = do_sensor_post(ctx);  assert(status);
+    }
+}
+
+#if MYNEWT_VAL(SENSOR_COAP_WAITERS) > 0  //  If tasks may be notified when a compose context is free...
+static void free_event_cb(struct os_event *ev) {}  //  Not called: the test takes the event from the queue.
+#endif  //  MYNEWT_VAL(SENSOR_COAP_WAITERS) > 0
+
+void test_sensor_coap_try_post(void) {
+    //  While other tasks hold all compose contexts, init_sensor_post_wait() must fail with SYS_EAGAIN right away
+    //  with SENSOR_COAP_NO_WAIT, and after the timeout otherwise.  sensor_coap_notify_free() must put the event
+    //  when a context is released, and the context can then be taken without waiting.
+    //  Should be called by a task with lower priority than the holders.
+    static bool started = false;
+    struct sensor_coap_context *ctx = NULL;
+    int rc, i;
+    test_setup();
+    if (!started) {
+        rc = os_sem_init(&hold_start_sem, 0);  assert(rc == OS_OK);
+        rc = os_sem_init(&hold_ready_sem, 0);  assert(rc == OS_OK);
+        rc = os_sem_init(&hold_release_sem, 0);  assert(rc == OS_OK);
+        for (i = 0; i < MYNEWT_VAL(SENSOR_COAP_CONTEXTS); i++) {
+            rc = os_task_init(&hold_tasks[i], "holder", hold_func, NULL,
+                20 + i, OS_WAIT_FOREVER, hold_stacks[i], TEST_STACK_SIZE);
+            assert(rc == 0);
+        }
+        started = true;
+    }
+
+    //  Take all compose contexts.
+    for (i = 0; i < MYNEWT_VAL(SENSOR_COAP_CONTEXTS); i++) {
+        rc = os_sem_release(&hold_start_sem);  assert(rc == OS_OK);
+        rc = os_sem_pend(&hold_ready_sem, OS_TIMEOUT_NEVER);  assert(rc == OS_OK);
+    }
+
+    //  Try-acquire returns right away.  Bounded wait returns after the timeout.
+    os_time_t start = os_time_get();
+    rc = init_sensor_post_wait((struct oc_server_handle *) &server, "/test", APPLICATION_JSON, SENSOR_COAP_NO_WAIT, &ctx);
+    assert(rc == SYS_EAGAIN);  assert(ctx == NULL);
+    os_time_t try_ticks = os_time_get() - start;
+    assert(try_ticks == 0);
+    start = os_time_get();
+    rc = init_sensor_post_wait((struct oc_server_handle *) &server, "/test", APPLICATION_JSON, 50, &ctx);
+    assert(rc == SYS_EAGAIN);  assert(ctx == NULL);
+    os_time_t wait_ticks = os_time_get() - start;
+    assert(wait_ticks >= os_time_ms_to_ticks32(50));
+    console_printf("try post: %u ticks, wait 50 ms: %u ticks\n", (unsigned) try_ticks, (unsigned) wait_ticks);
+
+#if MYNEWT_VAL(SENSOR_COAP_WAITERS) > 0  //  If tasks may be notified when a compose context is free...
+    //  Ask to be notified.  The event is put onto the queue when a holder releases its context.
+    static struct os_eventq test_evq;
+    static struct os_event free_ev;
+    os_eventq_init(&test_evq);
+    memset(&free_ev, 0, sizeof(free_ev));
+    free_ev.ev_cb = free_event_cb;
+    rc = sensor_coap_notify_free(&test_evq, &free_ev);  assert(rc == 0);
+    rc = sensor_coap_notify_free(&test_evq, &free_ev);  assert(rc == 0);  //  Already waiting, not added again.
+    assert(!free_ev.ev_queued);
+    rc = os_sem_release(&hold_release_sem);  assert(rc == OS_OK);  //  Holder runs now, since it has higher priority.
+    struct os_event *ev = os_eventq_get(&test_evq);
+    assert(ev == &free_ev);
+#else
+    rc = os_sem_release(&hold_release_sem);  assert(rc == OS_OK);  //  Holder runs now, since it has higher priority.
+#endif  //  MYNEWT_VAL(SENSOR_COAP_WAITERS) > 0
+
+    //  A context is free, so try-acquire succeeds without waiting.
+    rc = init_sensor_post_wait((struct oc_server_handle *) &server, "/test", APPLICATION_JSON, SENSOR_COAP_NO_WAIT, &ctx);
+    assert(rc == 0);  assert(ctx);  assert(ctx == sensor_coap_current());
+    CP_ROOT({
+        CP_ARRAY(root, values, {
+            CP_ITEM_INT(values, "t", 1716);
+        });
+    });
+    bool status = do_sensor_post(ctx);  assert(status);
+
+    //  Let the other holders send their messages.
+    for (i = 1; i < MYNEWT_VAL(SENSOR_COAP_CONTEXTS); i++) {
+        rc = os_sem_release(&hold_release_sem);  assert(rc == OS_OK);
+    }
+    console_flush();
+}
@@ -48,25 +48,67 @@ extern "C" {  //  Expose the types and functions below to C functions.
 /////////////////////////////////////////////////////////
 //  Network Interface Definitions
 
-//  Network Interface Types: Server Interface (ESP8266 + CoAP) and Collector Interface (nRF24L01 + CBOR)
-
-#define SERVER_INTERFACE_TYPE       0   //  Server Network Interface (ESP8266)
-#define COLLECTOR_INTERFACE_TYPE    1   //  Collector Network Interface (nRF24L01)
-#define MAX_INTERFACE_TYPES         2   //  Max network interfaces supported
+//  Network Interface Types: The destination classes, CoAP Server (e.g. ESP8266 + CoAP) and Collector Node
+//  (e.g. nRF24L01 + CBOR).  Each destination class has a route: The Network Interfaces that reach the destination,
+//  ordered by cost.  A message takes the cheapest available interface, so a second uplink like a backup modem only
+//  needs to register itself with a higher cost.
+
+#define SERVER_INTERFACE_TYPE       0   //  Destination class: CoAP Server (ESP8266)
+#define COLLECTOR_INTERFACE_TYPE    1   //  Destination class: Collector Node (nRF24L01)
+#define MAX_INTERFACE_TYPES         2   //  Number of destination classes
+#define MAX_NETWORK_INTERFACES      MYNEWT_VAL(SENSOR_NETWORK_INTERFACES)  //  Max network interfaces registered, for all destination classes
 #define MAX_ENDPOINT_SIZE           16  //  Max byte size of Server or Collector endpoint
-#define SENSOR_NETWORK_SIZE         5   //  5 Sensor Nodes in the Sensor Network (Pipes 1 to 5 for nRF24L01)
-
-//  Represents a Network Interface: ESP8266 or nRF24L01
+#define SENSOR_NETWORK_SIZE         MYNEWT_VAL(SENSOR_NETWORK_NODES)  //  Number of Sensor Nodes in the Sensor Network e.g. 5
+#define SENSOR_NETWORK_MAX_PIPES    5   //  nRF24L01 pipes 1 to 5 receive from the Sensor Nodes
+#define SENSOR_NETWORK_PIPES        (SENSOR_NETWORK_SIZE < SENSOR_NETWORK_MAX_PIPES ? SENSOR_NETWORK_SIZE : SENSOR_NETWORK_MAX_PIPES)  //  Pipes used
+#define SENSOR_NETWORK_SHARED_PIPES (SENSOR_NETWORK_SIZE > SENSOR_NETWORK_MAX_PIPES)  //  1 if Sensor Nodes share pipes
+
+//  Every nRF24L01 frame ends with the sequence number.  If the Sensor Nodes share pipes or frames are relayed, the
+//  byte before that is the node ID (last byte of the Sensor Node address), so that the Collector Node can identify
+//  the sender.  If frames are relayed, the byte before the node ID is the hop count.
+#define SENSOR_NETWORK_FRAME_NODE_ID (SENSOR_NETWORK_SHARED_PIPES || MYNEWT_VAL(SENSOR_NETWORK_RELAY))  //  1 if node ID in frame
+#define SENSOR_NETWORK_FRAME_TRAILER (1 + (SENSOR_NETWORK_FRAME_NODE_ID ? 1 : 0) + (MYNEWT_VAL(SENSOR_NETWORK_RELAY) ? 1 : 0))
+#define SENSOR_NETWORK_MAX_FRAME     32  //  Largest nRF24L01 frame
+
+#if SENSOR_NETWORK_SIZE < 1 || SENSOR_NETWORK_SIZE > 120
+#error SENSOR_NETWORK_NODES must be 1 to 120
+#endif  //  SENSOR_NETWORK_SIZE < 1 || SENSOR_NETWORK_SIZE > 120
+
+//  Represents a Network Interface: ESP8266, nRF24L01 or another driver that registers itself
 struct sensor_network_interface {
-    uint8_t iface_type;          //  Interface Type: Server or Collector
+    uint8_t iface_type;          //  Interface Type: Destination class, Server or Collector
     const char *network_device;  //  Network device name.  Must be a static string.
     uint8_t server_endpoint_size;       //  Endpoint size
     int (*register_transport_func)(const char *network_device, void *server_endpoint, const char *host, uint16_t port, uint8_t server_endpoint_size);  //  Register transport function
+    int (*register_server_func)(const char *network_device, void *server_endpoint, const char *host, uint16_t port, uint8_t server_endpoint_size);  //  Register another server after the transport.  NULL if not supported.
+    int encoding;                //  CoAP content format e.g. APPLICATION_CBOR, or 0 for the default of the destination class.
+    uint16_t mtu;                //  Largest CoAP payload in bytes, or 0 if no limit.
+    uint8_t cost;                //  Cost of sending a message e.g. airtime or tariff.  The cheapest available interface is used.
     uint8_t transport_registered;    //  For internal use: Set to non-zero if transport has been registered.
+    uint8_t unavailable;             //  For internal use: Set to non-zero if the interface is down or its transport failed to register.
 };
 
 struct sensor_value;
 
+//  Roles of a node in the Sensor Network.  See sensor_network_node.
+#define SENSOR_NETWORK_ROLE_UNKNOWN    0  //  Role not resolved yet.  sensor_network_init() has not been called.
+#define SENSOR_NETWORK_ROLE_STANDALONE 1  //  Standalone Node: Sends to the CoAP Server (ESP8266).
+#define SENSOR_NETWORK_ROLE_COLLECTOR  2  //  Collector Node: Receives from Sensor Nodes (nRF24L01), sends to the CoAP Server.
+#define SENSOR_NETWORK_ROLE_SENSOR     3  //  Sensor Node: Sends to the Collector Node (nRF24L01).
+
+//  Role, index, pipe and address of this node, resolved once from the Hardware ID by sensor_network_init().
+//  Read-only after that, so the role queries below are single loads.
+struct sensor_network_node {
+    uint8_t role;      //  SENSOR_NETWORK_ROLE_STANDALONE, COLLECTOR or SENSOR.
+    int8_t  index;     //  Sensor Node index 0 to SENSOR_NETWORK_SIZE - 1, or -1 if not a Sensor Node.
+    uint8_t pipe;      //  nRF24L01 pipe: 0 for the Collector Node, 1 to 5 for Sensor Nodes, 0 if not applicable.
+    uint8_t id;        //  Sensor Node ID sent in-frame if the pipes are shared: Last byte of the Sensor Node address.  Else 0.
+    unsigned long long address;  //  nRF24L01 transmit address of this node e.g. 0xB3B4B5B6f1, or 0 for a Standalone Node.
+                                 //  For a Sensor Node, this is the address of its pipe, which may be shared.
+};
+
+extern struct sensor_network_node sensor_network_node;  //  This node.  Set by sensor_network_init().
+
 /////////////////////////////////////////////////////////
 //  Register Network Interface for CoAP Transport (Server and Collector)
 
@@ -76,61 +118,119 @@ int register_server_transport(void);
 //  For Collector Node and Sensor Nodes: Register the nRF24L01 driver as the network transport for CoAP Collector.
 int register_collector_transport(void);
 
-//  Register the Network Interface as the network transport for CoAP Server or CoAP Collector.
+//  Register the transport of the cheapest available Network Interface for CoAP Server or CoAP Collector.  If the
+//  transport fails to register, the interface is marked unavailable and the next interface in the route is tried.
+//  Return 0 if successful.
 int sensor_network_register_transport(uint8_t iface_type);
 
+//  Register another CoAP Server e.g. a local historian.  Every CoAP Server message is also sent to this server,
+//  with the same URI.  The payload is encoded once and copied.  Up to SENSOR_COAP_FANOUT servers may be added.
+//  Return 0 if successful.
+int sensor_network_add_server(const char *host, uint16_t port);
+
 /////////////////////////////////////////////////////////
 //  Compose CoAP Messages
 
 //  Start composing the CoAP Server message with the sensor data in the payload.  This will 
-//  block other tasks from composing and posting CoAP messages (through a semaphore).
-//  We only have 1 memory buffer for composing CoAP messages so it needs to be locked.
+//  block other tasks from composing and posting CoAP messages (through a semaphore)
+//  only when all SENSOR_COAP_CONTEXTS compose contexts are busy.  Returns false if no context is free after the timeout.
 bool init_server_post(const char *uri);
 
 //  Start composing the CoAP Collector message with the sensor data in the payload.  This will 
-//  block other tasks from composing and posting CoAP messages (through a semaphore).
-//  We only have 1 memory buffer for composing CoAP messages so it needs to be locked.
+//  block other tasks from composing and posting CoAP messages (through a semaphore)
+//  only when all SENSOR_COAP_CONTEXTS compose contexts are busy.  Returns false if no context is free after the timeout.
 bool init_collector_post(void);
 
+//  Start composing the CoAP Server message only if a compose context is free right now.  Never blocks, so it's
+//  safe for high-priority sensor paths.  Returns 0 if successful, or SYS_EAGAIN if all compose contexts are busy
+//  or the transport has not been registered.
+int try_server_post(const char *uri);
+
+//  Start composing the CoAP Collector message only if a compose context is free right now.  Never blocks, so it's
+//  safe for high-priority sensor paths.  Returns 0 if successful, or SYS_EAGAIN if all compose contexts are busy
+//  or the transport has not been registered.
+int try_collector_post(void);
+
 //  Start composing the CoAP Server or Collector message with the sensor data in the payload.  This will 
-//  block other tasks from composing and posting CoAP messages (through a semaphore).
-//  We only have 1 memory buffer for composing CoAP messages so it needs to be locked.
+//  block other tasks from composing and posting CoAP messages (through a semaphore)
+//  only when all SENSOR_COAP_CONTEXTS compose contexts are busy.  Returns false if no context is free after the timeout.
 bool sensor_network_init_post(uint8_t iface_type, const char *uri);
 
+//  Start composing the CoAP Server or Collector message, waiting at most timeout_ms milliseconds for a free
+//  compose context.  SENSOR_COAP_NO_WAIT fails right away.  The transport is not registered here, since
+//  connecting to WiFi may block for seconds.  Returns 0 if successful, SYS_EAGAIN if all compose contexts are
+//  still busy or the transport has not been registered, or SYS_ENOMEM if out of mbufs.
+int sensor_network_init_post_wait(uint8_t iface_type, const char *uri, uint32_t timeout_ms);
+
 /////////////////////////////////////////////////////////
 //  Post CoAP Messages
 
 //  Post the CoAP Server message to the CoAP Background Task for transmission.  After posting the
 //  message to the background task, we release a semaphore that unblocks other requests
-//  to compose and post CoAP messages.
+//  to compose and post CoAP messages.  If the payload is too big for the MTU of the Network Interface, the message
+//  is sent through the next interface whose MTU fits.  Return false if no interface fits, in which case the message
+//  is discarded.
 bool do_server_post(void);
 
 //  Post the CoAP Collector message to the CoAP Background Task for transmission.  After posting the
 //  message to the background task, we release a semaphore that unblocks other requests
-//  to compose and post CoAP messages.
+//  to compose and post CoAP messages.  If the payload is too big for the MTU of the Network Interface, the message
+//  is sent through the next interface whose MTU fits.  Return false if no interface fits, in which case the message
+//  is discarded.
 bool do_collector_post(void);
 
 //  Post the CoAP Server or Collector message to the CoAP Background Task for transmission.  After posting the
 //  message to the background task, we release a semaphore that unblocks other requests
-//  to compose and post CoAP messages.
+//  to compose and post CoAP messages.  The Network Interface was chosen by the size of the previous payload, so if
+//  the payload is too big for its MTU, send the message through the cheapest registered interface with the same
+//  encoding whose MTU fits.  Return false and discard the message if no interface fits.
 bool sensor_network_do_post(uint8_t iface_type);
 
+/////////////////////////////////////////////////////////
+//  Transmit Task
+
+#define SENSOR_NETWORK_TX_PRIORITIES 3  //  Number of transmit queues, one per priority.  Same as SENSOR_COAP_PRIORITIES.
+
+//  Transmit queue statistics.  Indexed by priority: SENSOR_COAP_PRIORITY_ALERT, NORMAL and BULK.
+struct sensor_network_tx_stats {
+    uint16_t depth[SENSOR_NETWORK_TX_PRIORITIES];      //  Number of messages waiting.
+    uint16_t max_depth[SENSOR_NETWORK_TX_PRIORITIES];  //  Highest number of messages that have waited.
+    uint32_t sent[SENSOR_NETWORK_TX_PRIORITIES];       //  Number of messages transmitted.
+    uint32_t dropped[SENSOR_NETWORK_TX_PRIORITIES];    //  Number of messages dropped because the queue was full.
+};
+
+//  Start the Transmit Task and route the CoAP messages from sensor_coap to the transmit queues.
+//  Called by sensor_network_init().  Does nothing without TX_TASK.  Return 0 if successful.
+int sensor_network_start_tx(void);
+
+//  Queue the serialised CoAP message for the Transmit Task, which transmits the highest priority messages first.
+//  If the queue for the priority already has TX_QUEUE_DEPTH messages, the message is dropped.  The mbuf chain is
+//  always consumed.  Without TX_TASK, the message is forwarded to the CoAP Background Task.
+void sensor_network_tx(struct os_mbuf *m, uint8_t priority);
+
+//  Return true if the transmit queue for the priority has room for another message.  Producers should check
+//  before composing a message, and drop or defer their data if the radio is backed up.  Always true without TX_TASK.
+bool sensor_network_tx_ready(uint8_t priority);
+
+//  Copy the transmit queue statistics into stats.  All zero without TX_TASK.
+void sensor_network_tx_stats(struct sensor_network_tx_stats *stats);
+
 /////////////////////////////////////////////////////////
 //  Query Collector and Sensor Nodes
 
 //  Return true if this is the Collector Node.
 //  This is the Collector Node if the Hardware ID matches the Collector Node Hardware ID.
-bool is_collector_node(void);
+static inline bool is_collector_node(void) { return sensor_network_node.role == SENSOR_NETWORK_ROLE_COLLECTOR; }
 
 //  Return true if this is a Sensor Node.
 //  This is a Sensor Node if the Hardware ID matches one of the Sensor Node Hardware IDs.
-bool is_sensor_node(void);
+static inline bool is_sensor_node(void) { return sensor_network_node.role == SENSOR_NETWORK_ROLE_SENSOR; }
 
 //  Return true if this is a Standalone Node, i.e. not a Collector or Sensor Node.
-bool is_standalone_node(void);
+static inline bool is_standalone_node(void) { return sensor_network_node.role == SENSOR_NETWORK_ROLE_STANDALONE; }
 
 //  Return true if this node should send to a Collector Node instead of CoAP Server.  Which means this must be a Sensor Node.
-bool should_send_to_collector(struct sensor_value *val, const char *device_name);
+static inline bool should_send_to_collector(struct sensor_value *val, const char *device_name) { return is_sensor_node(); }
 
 /////////////////////////////////////////////////////////
 //  Sensor Network Addresses
@@ -141,27 +241,170 @@ const uint8_t *get_hardware_id(void);
 //  Get the randomly-generated Device ID that will be sent in every CoAP Server message.  Changes upon restart.
 const char *get_device_id(void);
 
+//  Return the Device ID or Device Token to be sent in the next CoAP Server message.  Call once per message.
+//  If DEVICE_TOKEN is enabled, the full Device ID is sent in the first DEVICE_TOKEN_ANNOUNCE messages of every
+//  DEVICE_TOKEN_RENEW messages, and the short Device Token in other messages.  Otherwise same as get_device_id().
+const char *get_device_token(void);
+
+//  Encode the first len bytes of the binary Device ID in base64url without padding, e.g. 0xab 0xcd 0xef 0xff
+//  becomes q83v_w.  token must have space for (len * 8 + 5) / 6 characters and a terminating null.
+//  Return the token length.
+int device_token_encode(const uint8_t *id, int len, char *token);
+
 //  Return the Collector Node address for this Sensor Network.
 unsigned long long get_collector_node_address(void);
 
-//  Return the Sensor Node address for this node, if this is a Sensor Node.
-unsigned long long get_sensor_node_address(void);
+//  Return the Sensor Node address for this node, if this is a Sensor Node.  Else 0.
+static inline unsigned long long get_sensor_node_address(void) { return is_sensor_node() ? sensor_network_node.address : 0; }
 
-//  Return the list of Sensor Node addresses for this Sensor Network.
+//  Return the list of SENSOR_NETWORK_SIZE Sensor Node addresses for this Sensor Network.  The first
+//  SENSOR_NETWORK_PIPES addresses are also the addresses of pipes 1 to 5.
 const unsigned long long *get_sensor_node_addresses(void);
 
 //  Return the list of Sensor Node names for this Sensor Network.
 const char **get_sensor_node_names(void);
 
+//  Return the index of the Sensor Node with the address, or -1 if not found.  Hashed, so the cost doesn't
+//  grow with the number of Sensor Nodes.
+int sensor_network_find_node(unsigned long long address);
+
+//  Return the index of the Sensor Node that transmitted the frame received on the pipe (1 to 5), or -1 if unknown
+//  or seen before.  The node ID and hop count in the frame, if any, are erased.
+int sensor_network_frame_node(int pipe, uint8_t *frame, int size);
+
+//  Return the configured Hardware ID of the Sensor Node at the index, or NULL if not configured or all zeroes.
+const uint8_t *get_sensor_node_hw_id(int index);
+
+//  Set the node as the Sensor Node at the index of the Sensor Node table.
+void sensor_network_set_node(int index, struct sensor_network_node *node);
+
+/////////////////////////////////////////////////////////
+//  Over-The-Air Join
+
+//  A Sensor Node whose Hardware ID is not configured joins the Sensor Network on first transmit: It sends a Join
+//  Request with the digest of its Hardware ID to pipe 1, and the Collector Node replies to SENSOR_NETWORK_JOIN_ADDRESS
+//  with the index of a free Sensor Node, which is stored persistently.  Join frames start with 0, unlike CBOR maps.
+#define SENSOR_NETWORK_JOIN_REQUEST   1   //  Sensor Node to Collector Node: [0, 1, digest (8 bytes)]
+#define SENSOR_NETWORK_JOIN_ACCEPT    2   //  Collector Node to Sensor Node: [0, 2, digest (8 bytes), index]
+#define SENSOR_NETWORK_JOIN_REJECT    3   //  Collector Node to Sensor Node: [0, 3, digest (8 bytes)].  No free index.
+#define SENSOR_NETWORK_DIGEST_LENGTH  8   //  Digest of the Hardware ID
+#define SENSOR_NETWORK_JOIN_SIZE      (2 + SENSOR_NETWORK_DIGEST_LENGTH + 1)  //  Longest join frame
+
+//  Radio used by sensor_network_join() to send and receive join frames, provided by the nRF24L01 driver, or by a
+//  stand-in for testing.  send() returns 0 if successful.  receive() waits up to timeout_ms for a frame sent to the
+//  address and returns the frame size, or 0 if none.
+struct sensor_network_join_radio {
+    int (*send)(unsigned long long address, const uint8_t *frame, int size);
+    int (*receive)(unsigned long long address, uint8_t *frame, int size, uint32_t timeout_ms);
+};
+
+/////////////////////////////////////////////////////////
+//  Multi-Hop Relay
+
+//  Relay Nodes are Sensor Nodes 1 to SENSOR_NETWORK_RELAY_NODES.  A Relay Node listens on the Sensor Node pipes like
+//  the Collector Node and forwards the frames that it hears toward the Collector Node, so Sensor Nodes out of range
+//  of the Collector Node are still heard.  Each forward increments the hop count in the frame, up to
+//  SENSOR_NETWORK_RELAY_MAX_HOPS.  Relay Nodes and the Collector Node drop frames that they have seen, by node ID and
+//  sequence number.
+
+//  Relay statistics
+struct sensor_network_relay_stats {
+    uint32_t forwarded;   //  Frames queued for forwarding
+    uint32_t duplicates;  //  Frames dropped because they have been seen
+    uint32_t expired;     //  Frames dropped because the hop count reached SENSOR_NETWORK_RELAY_MAX_HOPS
+    uint32_t dropped;     //  Frames dropped because the forwarding queue is full
+};
+
+#if MYNEWT_VAL(SENSOR_NETWORK_RELAY)  //  If Sensor Nodes may relay frames...
+
+//  State of a Relay Node: Recently seen frames and the forwarding queue.  The Collector Node uses only the seen frames.
+struct sensor_network_relay {
+    uint8_t  id;  //  Node ID of this Relay Node.  Its own frames are never forwarded.
+    uint16_t seen[MYNEWT_VAL(SENSOR_NETWORK_RELAY_SEEN)];  //  Recently seen frames: Node ID << 8 | sequence number
+    uint8_t  seen_next;   //  Next entry of seen to be replaced
+    uint8_t  seen_count;  //  Number of entries in seen
+    uint8_t  queue[MYNEWT_VAL(SENSOR_NETWORK_RELAY_QUEUE)][SENSOR_NETWORK_MAX_FRAME];  //  Frames waiting to be forwarded
+    uint8_t  queue_size[MYNEWT_VAL(SENSOR_NETWORK_RELAY_QUEUE)];  //  Size of each frame in queue
+    uint8_t  queue_head;   //  Oldest frame in queue
+    uint8_t  queue_count;  //  Number of frames in queue
+    struct sensor_network_relay_stats stats;
+};
+
+//  Return true if this node relays frames for other Sensor Nodes.
+static inline bool is_relay_node(void) {
+    return is_sensor_node() && sensor_network_node.index >= 0 && sensor_network_node.index < MYNEWT_VAL(SENSOR_NETWORK_RELAY_NODES);
+}
+
+//  Init the relay state for the node ID, or 0 for the Collector Node.
+void sensor_network_relay_init(struct sensor_network_relay *relay, uint8_t id);
+
+//  For Relay Node: Queue the Sensor Data frame that was heard, for forwarding with the hop count incremented.
+//  Return 0 if queued, SYS_EALREADY if seen before or sent by this node, SYS_ERANGE if the hop count is at the
+//  limit, SYS_ENOMEM if the queue is full, SYS_EINVAL if not a Sensor Data frame.
+int sensor_network_relay_receive(struct sensor_network_relay *relay, const uint8_t *frame, int size);
+
+//  For Relay Node: Copy the oldest queued frame into frame, which has size bytes, and remove it from the queue.
+//  Return the frame size, or 0 if the queue is empty.
+int sensor_network_relay_next(struct sensor_network_relay *relay, uint8_t *frame, int size);
+
+//  Return true if the frame from the node ID with the sequence number has been seen.  Else remember it and return false.
+bool sensor_network_relay_seen(struct sensor_network_relay *relay, uint8_t id, uint8_t seq);
+
+#else
+
+static inline bool is_relay_node(void) { return false; }
+
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_RELAY)
+
+#if MYNEWT_VAL(SENSOR_NETWORK_JOIN)  //  If Sensor Nodes may join over the air...
+
+//  Return true if the frame is a join frame instead of a Sensor Data frame.
+static inline bool sensor_network_is_join_frame(const uint8_t *frame, int size) { return size >= SENSOR_NETWORK_JOIN_SIZE && frame[0] == 0; }
+
+//  For Collector Node: Bind the configured Hardware IDs and register the storage of the joined nodes.  Called by
+//  sensor_network_init().  The app must call conf_load() after sysinit() to restore the nodes that joined before.
+//  Return 0 if successful.
+int sensor_network_join_init(void);
+
+//  For Collector Node: Process the Join Request in the frame.  Assign a free Sensor Node index, or the same index
+//  if the node has joined before, and store it persistently.  Write the Join Accept or Join Reject into reply,
+//  which must have SENSOR_NETWORK_JOIN_SIZE bytes.  Return the reply size, or 0 if the frame is not a Join Request.
+int sensor_network_join_process(const uint8_t *frame, int size, uint8_t *reply);
+
+//  For Sensor Node: Send Join Requests until the Collector Node replies, up to SENSOR_NETWORK_JOIN_RETRIES times.
+//  Set node to the Sensor Node index that was assigned.  Return 0 if joined, SYS_ENOMEM if the Collector Node has
+//  no free index, SYS_ETIMEOUT if no reply.
+int sensor_network_join(const uint8_t *hardware_id, const struct sensor_network_join_radio *radio, struct sensor_network_node *node);
+
+//  Return true if a Sensor Node is configured or has joined at the index.
+bool sensor_network_join_bound(int index);
+
+//  Compute the digest of the Hardware ID that identifies the Sensor Node in join frames.
+void sensor_network_digest(const uint8_t *hardware_id, uint8_t *digest);
+
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_JOIN)
+
 /////////////////////////////////////////////////////////
 //  Sensor Network Configuration
 
 //  Allocate Sensor Node address for this node.
 void sensor_network_init(void);
 
-//  Register the Network Interface (e.g. ESP8266, nRF24L01) for the Sensor Network.
+//  Register the Network Interface (e.g. ESP8266, nRF24L01) for the Sensor Network.  The interface is added to the
+//  route of its destination class, ordered by cost.  Return 0 if successful, SYS_EALREADY if the network device is
+//  already registered, SYS_ENOMEM if MAX_NETWORK_INTERFACES interfaces are registered.
 int sensor_network_register_interface(const struct sensor_network_interface *iface);
 
+//  Return the Network Interface that the next message of size bytes (0 if unknown) for the destination class would
+//  take: The cheapest available interface whose MTU fits the size, else the cheapest available interface.
+//  NULL if none.
+const struct sensor_network_interface *sensor_network_route(uint8_t iface_type, uint16_t size);
+
+//  Mark the Network Interface with the network device name as available or not, e.g. when the link goes down or
+//  comes back up.  Messages take the next interface in the route while it's unavailable.  Return 0 if successful,
+//  SYS_ENOENT if the network device is not registered.
+int sensor_network_set_available(const char *network_device, bool available);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,191 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+//  Over-The-Air Join for Sensor Nodes.  Without it, every Sensor Node Hardware ID must be compiled into the
+//  Collector Node.  With SENSOR_NETWORK_JOIN, a Sensor Node whose Hardware ID is not configured sends a Join Request
+//  with the digest of its Hardware ID, and the Collector Node binds the digest to a free index of the Sensor Node
+//  table.  The addresses in the table are allocated the same way on every node by sensor_network_init(), so the
+//  Join Accept only needs to carry the index.  The Collector Node stores the bindings with sys/config as
+//  "sn/<index>" = "<digest in hex>", so the Sensor Nodes keep their index after the Collector Node restarts.
+#include <stdlib.h>
+#include <os/mynewt.h>
+#include <console/console.h>
+#include "sensor_network/sensor_network.h"
+
+#if MYNEWT_VAL(SENSOR_NETWORK_JOIN)  //  If Sensor Nodes may join over the air...
+#include <config/config.h>
+
+#define DIGEST_TEXT_LENGTH (SENSOR_NETWORK_DIGEST_LENGTH * 2 + 1)  //  Digest in hex and terminating null
+
+static const char *_join = "JOIN ";  //  Prefix for console messages
+static const char *_node = "node ";  //  Common string
+
+//  Digests of the Sensor Nodes that are configured or have joined, for the Collector Node.
+static uint8_t node_digests[SENSOR_NETWORK_SIZE][SENSOR_NETWORK_DIGEST_LENGTH];
+static uint8_t node_bound[SENSOR_NETWORK_SIZE];        //  1 if a Sensor Node is configured or has joined at the index
+static uint8_t node_configured[SENSOR_NETWORK_SIZE];   //  1 if the Hardware ID is configured at the index
+
+static char *conf_get(int argc, char **argv, char *val, int val_len_max);
+static int conf_set(int argc, char **argv, char *val);
+static int conf_export(void (*export_func)(char *name, char *val), enum conf_export_tgt tgt);
+static void digest_to_text(const uint8_t *digest, char *text);
+
+//  Persistent storage of the joined Sensor Nodes: "sn/<index>" = "<digest in hex>"
+static struct conf_handler join_conf = {
+    .ch_name = "sn",
+    .ch_get = conf_get,
+    .ch_set = conf_set,
+    .ch_commit = NULL,
+    .ch_export = conf_export,
+};
+
+int sensor_network_join_init(void) {
+    //  For Collector Node: Bind the configured Hardware IDs and register the storage of the joined nodes.  Called by
+    //  sensor_network_init().  The nodes that joined before are restored when the app calls conf_load() after
+    //  sysinit(), since the storage is not ready during sysinit().  Return 0 if successful.
+    int i;
+    for (i = 0; i < SENSOR_NETWORK_SIZE; i++) {
+        const uint8_t *hardware_id = get_sensor_node_hw_id(i);
+        if (!hardware_id) { continue; }  //  Free for joining.
+        sensor_network_digest(hardware_id, node_digests[i]);
+        node_bound[i] = 1;  node_configured[i] = 1;
+    }
+    int rc = conf_register(&join_conf);
+    return rc;
+}
+
+int sensor_network_join_process(const uint8_t *frame, int size, uint8_t *reply) {
+    //  For Collector Node: Process the Join Request in the frame.  Assign a free Sensor Node index, or the same index
+    //  if the node has joined before, and store it persistently.  Write the Join Accept or Join Reject into reply,
+    //  which must have SENSOR_NETWORK_JOIN_SIZE bytes.  Return the reply size, or 0 if the frame is not a Join Request.
+    //  Called by the nRF24L01 receive callback, so the joins are never concurrent.
+    assert(frame);  assert(reply);
+    if (!sensor_network_is_join_frame(frame, size) || frame[1] != SENSOR_NETWORK_JOIN_REQUEST) { return 0; }
+    const uint8_t *digest = &frame[2];
+    int index = -1, i;
+    for (i = 0; i < SENSOR_NETWORK_SIZE && index < 0; i++) {
+        //  Rejoining after a restart gets the same index.
+        if (node_bound[i] && memcmp(node_digests[i], digest, SENSOR_NETWORK_DIGEST_LENGTH) == 0) { index = i; }
+    }
+    for (i = 0; i < SENSOR_NETWORK_SIZE && index < 0; i++) {
+        if (node_bound[i]) { continue; }
+        //  Bind the first free index and store it.
+        index = i;
+        memcpy(node_digests[i], digest, SENSOR_NETWORK_DIGEST_LENGTH);
+        node_bound[i] = 1;
+        char name[8], text[DIGEST_TEXT_LENGTH];
+        sprintf(name, "sn/%d", i);
+        digest_to_text(digest, text);
+        int rc = conf_save_one(name, text);
+        if (rc) { console_printf("%ssave failed %d\n", _join, rc); }  //  Still joined until restart.
+    }
+    memset(reply, 0, SENSOR_NETWORK_JOIN_SIZE);
+    reply[1] = (index >= 0) ? SENSOR_NETWORK_JOIN_ACCEPT : SENSOR_NETWORK_JOIN_REJECT;
+    memcpy(&reply[2], digest, SENSOR_NETWORK_DIGEST_LENGTH);
+    if (index >= 0) { reply[2 + SENSOR_NETWORK_DIGEST_LENGTH] = index; }
+    if (index >= 0) { console_printf("%saccept %s#%d\n", _join, _node, index + 1); }
+    else { console_printf("%sreject\n", _join); }
+    return SENSOR_NETWORK_JOIN_SIZE;
+}
+
+int sensor_network_join(const uint8_t *hardware_id, const struct sensor_network_join_radio *radio, struct sensor_network_node *node) {
+    //  For Sensor Node: Send Join Requests until the Collector Node replies, up to SENSOR_NETWORK_JOIN_RETRIES times.
+    //  Set node to the Sensor Node index that was assigned.  Return 0 if joined, SYS_ENOMEM if the Collector Node has
+    //  no free index, SYS_ETIMEOUT if no reply.
+    assert(hardware_id);  assert(radio);  assert(radio->send);  assert(radio->receive);  assert(node);
+    uint8_t request[SENSOR_NETWORK_JOIN_SIZE], reply[SENSOR_NETWORK_MAX_FRAME];
+    memset(request, 0, sizeof(request));
+    request[1] = SENSOR_NETWORK_JOIN_REQUEST;
+    sensor_network_digest(hardware_id, &request[2]);
+    int retry;
+    for (retry = 0; retry < MYNEWT_VAL(SENSOR_NETWORK_JOIN_RETRIES); retry++) {
+        //  Send to pipe 1, which every Collector Node listens on.
+        int rc = radio->send(get_sensor_node_addresses()[0], request, sizeof(request));
+        if (rc) { continue; }
+        int size = radio->receive(MYNEWT_VAL(SENSOR_NETWORK_JOIN_ADDRESS), reply, sizeof(reply), MYNEWT_VAL(SENSOR_NETWORK_JOIN_TIMEOUT));
+        //  Ignore replies to other joining Sensor Nodes.
+        if (!sensor_network_is_join_frame(reply, size)
+            || memcmp(&reply[2], &request[2], SENSOR_NETWORK_DIGEST_LENGTH) != 0) { continue; }
+        if (reply[1] == SENSOR_NETWORK_JOIN_REJECT) { return SYS_ENOMEM; }
+        int index = reply[2 + SENSOR_NETWORK_DIGEST_LENGTH];
+        if (reply[1] != SENSOR_NETWORK_JOIN_ACCEPT || index >= SENSOR_NETWORK_SIZE) { continue; }
+        sensor_network_set_node(index, node);
+        return 0;
+    }
+    return SYS_ETIMEOUT;
+}
+
+bool sensor_network_join_bound(int index) {
+    //  Return true if a Sensor Node is configured or has joined at the index.
+    assert(index >= 0 && index < SENSOR_NETWORK_SIZE);
+    return node_bound[index];
+}
+
+void sensor_network_digest(const uint8_t *hardware_id, uint8_t *digest) {
+    //  Compute the digest of the Hardware ID that identifies the Sensor Node in join frames: 64-bit FNV-1a hash.
+    assert(hardware_id);  assert(digest);
+    uint64_t h = 0xcbf29ce484222325ull;
+    int i;
+    for (i = 0; i < 12; i++) { h = (h ^ hardware_id[i]) * 0x100000001b3ull; }  //  12-byte Hardware ID
+    for (i = 0; i < SENSOR_NETWORK_DIGEST_LENGTH; i++) { digest[i] = h >> (56 - 8 * i); }
+}
+
+static char *conf_get(int argc, char **argv, char *val, int val_len_max) {
+    //  Return the digest of the joined Sensor Node "sn/<index>" in hex.
+    int index = (argc == 1) ? atoi(argv[0]) : -1;
+    if (index < 0 || index >= SENSOR_NETWORK_SIZE || !node_bound[index] || val_len_max < DIGEST_TEXT_LENGTH) { return NULL; }
+    digest_to_text(node_digests[index], val);
+    return val;
+}
+
+static int conf_set(int argc, char **argv, char *val) {
+    //  Restore the joined Sensor Node "sn/<index>" from the digest in hex.  Configured Hardware IDs take precedence.
+    int index = (argc == 1) ? atoi(argv[0]) : -1;
+    if (index < 0 || index >= SENSOR_NETWORK_SIZE || !val) { return SYS_ENOENT; }
+    if (node_configured[index]) { return 0; }
+    if (strlen(val) != DIGEST_TEXT_LENGTH - 1) { return SYS_EINVAL; }
+    int i;
+    for (i = 0; i < SENSOR_NETWORK_DIGEST_LENGTH; i++) {
+        char hex[3] = { val[i * 2], val[i * 2 + 1], 0 };
+        node_digests[index][i] = strtoul(hex, NULL, 16);
+    }
+    node_bound[index] = 1;
+    return 0;
+}
+
+static int conf_export(void (*export_func)(char *name, char *val), enum conf_export_tgt tgt) {
+    //  Export the joined Sensor Nodes.
+    char name[8], text[DIGEST_TEXT_LENGTH];
+    int i;
+    for (i = 0; i < SENSOR_NETWORK_SIZE; i++) {
+        if (!node_bound[i] || node_configured[i]) { continue; }
+        sprintf(name, "sn/%d", i);
+        digest_to_text(node_digests[i], text);
+        export_func(name, text);
+    }
+    return 0;
+}
+
+static void digest_to_text(const uint8_t *digest, char *text) {
+    //  Write the digest in hex.  text must have DIGEST_TEXT_LENGTH bytes.
+    int i;
+    for (i = 0; i < SENSOR_NETWORK_DIGEST_LENGTH; i++) { sprintf(&text[i * 2], "%02x", digest[i]); }
+}
+
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_JOIN)
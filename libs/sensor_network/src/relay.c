@@ -0,0 +1,106 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+//  Multi-Hop Relay for Sensor Nodes at the edge of the Collector Node's range.  A Relay Node listens on the same
+//  pipes as the Collector Node, so it hears the frames of the Sensor Nodes nearby, and forwards them to the Collector
+//  Node from its own pipe.  Frames end with [hop count, node ID, sequence number], so the Collector Node still
+//  identifies the sender of a forwarded frame.  Since the Collector Node may hear a frame directly and from one or
+//  more Relay Nodes, and Relay Nodes hear each other, every node remembers the last SENSOR_NETWORK_RELAY_SEEN frames
+//  by node ID and sequence number and drops the duplicates.  The hop count stops frames from circulating.
+//  This file has no radio code: The nRF24L01 driver polls the pipes and transmits the queued frames.
+#include <os/mynewt.h>
+#include "sensor_network/sensor_network.h"
+
+#if MYNEWT_VAL(SENSOR_NETWORK_RELAY)  //  If Sensor Nodes may relay frames...
+
+#if MYNEWT_VAL(SENSOR_NETWORK_JOIN)
+//  Join frames carry no hop count, node ID or sequence number, and the Join Accept is sent to the join address, which
+//  Relay Nodes don't listen on.  So a Sensor Node out of range of the Collector Node could never join.
+#error SENSOR_NETWORK_RELAY cannot be combined with SENSOR_NETWORK_JOIN
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_JOIN)
+
+#define HOPS(size)    ((size) - 3)  //  Position of the hop count in a frame
+#define NODE_ID(size) ((size) - 2)  //  Position of the node ID
+#define SEQ(size)     ((size) - 1)  //  Position of the sequence number
+
+void sensor_network_relay_init(struct sensor_network_relay *relay, uint8_t id) {
+    //  Init the relay state for the node ID, or 0 for the Collector Node.
+    assert(relay);
+    memset(relay, 0, sizeof(struct sensor_network_relay));
+    relay->id = id;
+}
+
+int sensor_network_relay_receive(struct sensor_network_relay *relay, const uint8_t *frame, int size) {
+    //  For Relay Node: Queue the Sensor Data frame that was heard, for forwarding with the hop count incremented.
+    //  Return 0 if queued, SYS_EALREADY if seen before or sent by this node, SYS_ERANGE if the hop count is at the
+    //  limit, SYS_ENOMEM if the queue is full, SYS_EINVAL if not a Sensor Data frame.
+    assert(relay);  assert(frame);
+    if (size < SENSOR_NETWORK_FRAME_TRAILER || size > SENSOR_NETWORK_MAX_FRAME || frame[0] == 0) { return SYS_EINVAL; }  //  Join frames start with 0 and are never relayed.
+    uint8_t id = frame[NODE_ID(size)];
+    if (id == relay->id || sensor_network_relay_seen(relay, id, frame[SEQ(size)])) {
+        relay->stats.duplicates++;
+        return SYS_EALREADY;
+    }
+    if (frame[HOPS(size)] >= MYNEWT_VAL(SENSOR_NETWORK_RELAY_MAX_HOPS)) {
+        relay->stats.expired++;
+        return SYS_ERANGE;
+    }
+    if (relay->queue_count >= MYNEWT_VAL(SENSOR_NETWORK_RELAY_QUEUE)) {
+        relay->stats.dropped++;
+        return SYS_ENOMEM;
+    }
+    //  Append to the queue with the hop count incremented.
+    int i = (relay->queue_head + relay->queue_count) % MYNEWT_VAL(SENSOR_NETWORK_RELAY_QUEUE);
+    memcpy(relay->queue[i], frame, size);
+    relay->queue[i][HOPS(size)]++;
+    relay->queue_size[i] = size;
+    relay->queue_count++;
+    relay->stats.forwarded++;
+    return 0;
+}
+
+int sensor_network_relay_next(struct sensor_network_relay *relay, uint8_t *frame, int size) {
+    //  For Relay Node: Copy the oldest queued frame into frame, which has size bytes, and remove it from the queue.
+    //  Return the frame size, or 0 if the queue is empty.
+    assert(relay);  assert(frame);
+    if (relay->queue_count == 0) { return 0; }
+    int i = relay->queue_head;
+    int n = relay->queue_size[i];  assert(n <= size);
+    memcpy(frame, relay->queue[i], n);
+    relay->queue_head = (i + 1) % MYNEWT_VAL(SENSOR_NETWORK_RELAY_QUEUE);
+    relay->queue_count--;
+    return n;
+}
+
+bool sensor_network_relay_seen(struct sensor_network_relay *relay, uint8_t id, uint8_t seq) {
+    //  Return true if the frame from the node ID with the sequence number has been seen.  Else remember it and return false.
+    assert(relay);
+    uint16_t key = (id << 8) | seq;
+    int i;
+    for (i = 0; i < relay->seen_count; i++) {
+        if (relay->seen[i] == key) { return true; }
+    }
+    //  Replace the oldest entry.
+    relay->seen[relay->seen_next] = key;
+    relay->seen_next = (relay->seen_next + 1) % MYNEWT_VAL(SENSOR_NETWORK_RELAY_SEEN);
+    if (relay->seen_count < MYNEWT_VAL(SENSOR_NETWORK_RELAY_SEEN)) { relay->seen_count++; }
+    return false;
+}
+
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_RELAY)
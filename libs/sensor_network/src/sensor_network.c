@@ -46,14 +46,27 @@ static const char *_node = " node ";  //  Common string
 static const uint8_t COLLECTOR_NODE_HW_ID[HARDWARE_ID_LENGTH] = 
     _HWID(MYNEWT_VAL(COLLECTOR_NODE_HW_ID));  //  Hardware ID of Collector Node (ESP8266 + nRF24L01) e.g. { 0x57, 0xff, 0x6a, 0x06, 0x78, 0x78, 0x54, 0x50, 0x49, 0x29, 0x24, 0x67 }
 
-static const uint8_t SENSOR_NODE_HW_IDS[SENSOR_NETWORK_SIZE][HARDWARE_ID_LENGTH] = { 
+static const uint8_t SENSOR_NODE_HW_IDS[SENSOR_NETWORK_PIPES][HARDWARE_ID_LENGTH] = { 
     _HWID(MYNEWT_VAL(SENSOR_NODE_HW_ID_1)),   //  Hardware ID of Sensor Node 1 (nRF24L01) e.g. { 0x38, 0xff, 0x6d, 0x06, 0x4e, 0x57, 0x34, 0x36, 0x25, 0x58, 0x08, 0x43 }
+#if SENSOR_NETWORK_PIPES > 1
     _HWID(MYNEWT_VAL(SENSOR_NODE_HW_ID_2)),   //  Hardware ID of Sensor Node 2 (nRF24L01) e.g. { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x02 }
+#endif  //  SENSOR_NETWORK_PIPES > 1
+#if SENSOR_NETWORK_PIPES > 2
     _HWID(MYNEWT_VAL(SENSOR_NODE_HW_ID_3)),   //  Hardware ID of Sensor Node 3 (nRF24L01) e.g. { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x03 }
+#endif  //  SENSOR_NETWORK_PIPES > 2
+#if SENSOR_NETWORK_PIPES > 3
     _HWID(MYNEWT_VAL(SENSOR_NODE_HW_ID_4)),   //  Hardware ID of Sensor Node 4 (nRF24L01) e.g. { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x04 }
+#endif  //  SENSOR_NETWORK_PIPES > 3
+#if SENSOR_NETWORK_PIPES > 4
     _HWID(MYNEWT_VAL(SENSOR_NODE_HW_ID_5)),   //  Hardware ID of Sensor Node 5 (nRF24L01) e.g. { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x05 }
+#endif  //  SENSOR_NETWORK_PIPES > 4
 };
 
+//  Hardware IDs of Sensor Nodes 6 onwards, 12 bytes per node, from SENSOR_NODE_HW_IDS_MORE.  0 if none.
+#define _IDS(...) __VA_ARGS__
+static const uint8_t SENSOR_NODE_HW_IDS_MORE[] = { _ID(_IDS MYNEWT_VAL(SENSOR_NODE_HW_IDS_MORE)) };
+#define SENSOR_NODE_HW_IDS_MORE_COUNT (sizeof(SENSOR_NODE_HW_IDS_MORE) / HARDWARE_ID_LENGTH)
+
 /////////////////////////////////////////////////////////
 //  Collector Node + Sensor Nodes Configuration: Follows page 13 of https://www.sparkfun.com/datasheets/Components/nRF24L01_prelim_prod_spec_1_2.pdf
 
@@ -63,29 +76,46 @@ static const uint8_t SENSOR_NODE_HW_IDS[SENSOR_NETWORK_SIZE][HARDWARE_ID_LENGTH]
 //  Map a Sensor Network Address + Node ID to Sensor Node Address e.g. ADDR(0xB3B4B5B6, 0xf1) = 0xB3B4B5B6f1
 #define ADDR(network_addr, node_id) (node_id + (network_addr << 8))
 
-//  Addresses of the 5 Sensor Nodes
-static const unsigned long long sensor_node_addresses[SENSOR_NETWORK_SIZE] = {
+//  Addresses of the Sensor Nodes.  The first SENSOR_NETWORK_PIPES addresses are configured and are also the addresses
+//  of pipes 1 to 5.  Nodes 6 onwards share the pipes and are allocated unique addresses by sensor_network_init().
+static unsigned long long sensor_node_addresses[SENSOR_NETWORK_SIZE] = {
     ADDR(SENSOR_NETWORK_ADDRESS, MYNEWT_VAL(SENSOR_NODE_OFFSET_1)),  //  Pipe 1 e.g. 0xB3B4B5B6f1
+#if SENSOR_NETWORK_PIPES > 1
     ADDR(SENSOR_NETWORK_ADDRESS, MYNEWT_VAL(SENSOR_NODE_OFFSET_2)),  //  Pipe 2
+#endif  //  SENSOR_NETWORK_PIPES > 1
+#if SENSOR_NETWORK_PIPES > 2
     ADDR(SENSOR_NETWORK_ADDRESS, MYNEWT_VAL(SENSOR_NODE_OFFSET_3)),  //  Pipe 3
+#endif  //  SENSOR_NETWORK_PIPES > 2
+#if SENSOR_NETWORK_PIPES > 3
     ADDR(SENSOR_NETWORK_ADDRESS, MYNEWT_VAL(SENSOR_NODE_OFFSET_4)),  //  Pipe 4
+#endif  //  SENSOR_NETWORK_PIPES > 3
+#if SENSOR_NETWORK_PIPES > 4
     ADDR(SENSOR_NETWORK_ADDRESS, MYNEWT_VAL(SENSOR_NODE_OFFSET_5)),  //  Pipe 5
+#endif  //  SENSOR_NETWORK_PIPES > 4
 };
 
-//  Assigned Sensor Network Address for this node, if this is a Sensor Node.
-static unsigned long long sensor_node_address = 0;
+//  Hash table that maps a Sensor Node address to the node index, for O(1) lookup of the sender of each received
+//  frame.  Open addressing with linear probing, at most half full.  Each slot contains the node index + 1, or 0 if empty.
+#define NODE_HASH_SIZE (SENSOR_NETWORK_SIZE <= 8 ? 16 : SENSOR_NETWORK_SIZE <= 32 ? 64 : 256)  //  Power of 2
+#define NODE_HASH(address) ((uint32_t) ((address) * 0x9e3779b1u) >> 16)  //  Multiplicative hash of the address
+static uint8_t node_hash[NODE_HASH_SIZE];
+static void add_node_hash(int index);
+static int allocate_node_address(void);
+
+#if MYNEWT_VAL(SENSOR_NETWORK_RELAY)  //  If Sensor Nodes may relay frames...
+static struct sensor_network_relay collector_relay;  //  Frames seen by the Collector Node, for dropping duplicates
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_RELAY)
+
+//  Role, index, pipe and address of this node.  Resolved once by sensor_network_init(), then read-only.
+struct sensor_network_node sensor_network_node = { SENSOR_NETWORK_ROLE_UNKNOWN, -1, 0, 0, 0 };
+static void resolve_node(const uint8_t *hardware_id, struct sensor_network_node *node);
 
 #define NODE_NAME_LENGTH 11  //  Enough for "B3B4B5B6f1" and terminating null.
 static char sensor_node_names_buf[SENSOR_NETWORK_SIZE * NODE_NAME_LENGTH];  //  Buffer for node names.
 
 //  Names (text addresses e.g. B3B4B5B6f1) of the Sensor Nodes, exported to remote_sensor_create() for setting the device name.
-static const char *sensor_node_names[SENSOR_NETWORK_SIZE] = {
-    sensor_node_names_buf,
-    sensor_node_names_buf + NODE_NAME_LENGTH,
-    sensor_node_names_buf + 2 * NODE_NAME_LENGTH,
-    sensor_node_names_buf + 3 * NODE_NAME_LENGTH,
-    sensor_node_names_buf + 4 * NODE_NAME_LENGTH,
-};
+//  Set by sensor_network_init().
+static const char *sensor_node_names[SENSOR_NETWORK_SIZE];
 
 static uint8_t hw_id[HARDWARE_ID_LENGTH];   //  Hardware ID
 static int hw_id_len = 0;                   //  Actual length of Hardware ID
@@ -97,11 +127,20 @@ static uint8_t device_id     [DEVICE_ID_LENGTH];          //  Binary device ID e
 static char    device_id_text[DEVICE_ID_TEXT_LENGTH];     //  Text version of the binary device ID, 2 hex digits per byte
                                                           //  e.g. abcdef...
 
+#if MYNEWT_VAL(DEVICE_TOKEN)  //  If we are sending the short Device Token instead of the Device ID...
+//  Device Token that will be sent in CoAP Server messages after the Device ID has been announced.
+#define DEVICE_TOKEN_LENGTH       4                                //  Token is the first 4 bytes of the binary device ID
+#define DEVICE_TOKEN_TEXT_LENGTH  (1 + (DEVICE_TOKEN_LENGTH * 8 + 5) / 6)  //  7 bytes in the base64url token (including terminating null)
+static char     device_token_text[DEVICE_TOKEN_TEXT_LENGTH];      //  Base64url version of the token e.g. q83v_w
+static uint32_t device_token_count;                                //  Number of CoAP Server messages that have asked for the token
+#endif  //  MYNEWT_VAL(DEVICE_TOKEN)
+
 /////////////////////////////////////////////////////////
 //  CoAP Connection Settings e.g. coap://coap.thethings.io/v2/things/IVRiBCcR6HPp_CcZIFfOZFxz_izni5xc_KO-kgSA2Y8
 //  COAP_HOST, COAP_PORT, COAP_URI are defined in targets/bluepill_my_sensor/syscfg.yml
 static const char COAP_HOST[] = MYNEWT_VAL(COAP_HOST);  //  CoAP hostname e.g. coap.thethings.io
 static const char COAP_URI[]  = MYNEWT_VAL(COAP_URI);   //  CoAP URI e.g. v2/things/IVRiBCcR6HPp_CcZIFfOZFxz_izni5xc_KO-kgSA2Y8
+static const char COAP_MIRROR_HOST[] = MYNEWT_VAL(COAP_MIRROR_HOST);  //  Optional second CoAP Server e.g. a local historian.  Empty if none.
 
 /////////////////////////////////////////////////////////
 //  Sensor Networks: Interfaces, Endpoints and Encoding
@@ -110,13 +149,59 @@ struct sensor_network_endpoint {  //  Represents one Server Endpoint e.g. ESP826
     uint8_t endpoint[MAX_ENDPOINT_SIZE];
 };
 
-static struct sensor_network_interface sensor_network_interfaces[MAX_INTERFACE_TYPES];  //  All Network Interfaces
-static struct sensor_network_endpoint sensor_network_endpoints[MAX_INTERFACE_TYPES];    //  All Server Endpoints
-static int sensor_network_encoding[MAX_INTERFACE_TYPES] = {  //  Encoding for each Network Interface
+//  Route of a destination class: The Network Interfaces that reach the destination, cheapest first.
+struct sensor_network_route {
+    uint8_t ifaces[MAX_NETWORK_INTERFACES];  //  Indexes of sensor_network_interfaces, ordered by cost.  Equal costs in order of registration.
+    uint8_t count;                           //  Number of interfaces in ifaces
+    uint16_t last_size;                      //  Payload size of the last message posted, for matching the MTU of the next message
+};
+
+static struct sensor_network_interface sensor_network_interfaces[MAX_NETWORK_INTERFACES];  //  All Network Interfaces
+static struct sensor_network_endpoint sensor_network_endpoints[MAX_NETWORK_INTERFACES];    //  Server Endpoint of each Network Interface
+static uint8_t sensor_network_interface_count;                                             //  Number of Network Interfaces registered
+static struct sensor_network_route sensor_network_routes[MAX_INTERFACE_TYPES];             //  Route of each destination class
+static int route_interface(uint8_t iface_type, uint16_t size, bool registered);
+static int register_route(uint8_t iface_type, uint16_t size);
+static int fit_interface(uint8_t iface_type, uint16_t size, int encoding);
+static void set_post_interface(struct sensor_coap_context *ctx, int iface);
+static int take_post_interface(struct sensor_coap_context *ctx);
+//  Network Interface taken by each message being composed, so that the payload size can be checked against its MTU.
+static struct {
+    struct sensor_coap_context *ctx;  //  Compose context of the message, or NULL if the entry is free
+    uint8_t iface;                    //  Index of sensor_network_interfaces
+} sensor_network_posts[MYNEWT_VAL(SENSOR_COAP_CONTEXTS)];
+#if MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0  //  If CoAP Server messages may be sent to multiple servers...
+static struct sensor_network_endpoint server_mirrors[MYNEWT_VAL(SENSOR_COAP_FANOUT)];  //  Other CoAP Servers that receive a copy of every CoAP Server message
+static uint8_t server_mirror_count;  //  Number of endpoints in server_mirrors
+static int server_mirror_iface = -1; //  Index of the Network Interface that registered server_mirrors
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0
+#if MYNEWT_VAL(SERVER_SENML) && !MYNEWT_VAL(SENSOR_COAP_SENML)
+#error SERVER_SENML requires SENSOR_COAP_SENML
+#endif  //  MYNEWT_VAL(SERVER_SENML) && !MYNEWT_VAL(SENSOR_COAP_SENML)
+#if MYNEWT_VAL(SERVER_SENML) == 2 && !MYNEWT_VAL(COAP_CBOR_ENCODING)
+#error SenML CBOR requires COAP_CBOR_ENCODING
+#endif  //  MYNEWT_VAL(SERVER_SENML) == 2 && !MYNEWT_VAL(COAP_CBOR_ENCODING)
+#if MYNEWT_VAL(SERVER_FLAT) && !MYNEWT_VAL(SENSOR_COAP_FLAT)
+#error SERVER_FLAT requires SENSOR_COAP_FLAT
+#endif  //  MYNEWT_VAL(SERVER_FLAT) && !MYNEWT_VAL(SENSOR_COAP_FLAT)
+#if MYNEWT_VAL(SERVER_FLAT) && MYNEWT_VAL(SERVER_SENML)
+#error SERVER_FLAT and SERVER_SENML cannot both be enabled
+#endif  //  MYNEWT_VAL(SERVER_FLAT) && MYNEWT_VAL(SERVER_SENML)
+#if MYNEWT_VAL(SERVER_COMPRESS) && !MYNEWT_VAL(SENSOR_COAP_COMPRESS)
+#error SERVER_COMPRESS requires SENSOR_COAP_COMPRESS
+#endif  //  MYNEWT_VAL(SERVER_COMPRESS) && !MYNEWT_VAL(SENSOR_COAP_COMPRESS)
+
+static int sensor_network_encoding[MAX_INTERFACE_TYPES] = {  //  Default encoding for each destination class
+#if MYNEWT_VAL(SERVER_SENML) == 1
+    APPLICATION_SENML_JSON,  //  Send to Server: SenML JSON encoding for payload
+#elif MYNEWT_VAL(SERVER_SENML) == 2
+    APPLICATION_SENML_CBOR,  //  Send to Server: SenML CBOR encoding for payload
+#else
     APPLICATION_JSON,  //  Send to Server: JSON encoding for payload
-    APPLICATION_CBOR,  //  Send to Collector: CBOR encoding for payload
+#endif  //  MYNEWT_VAL(SERVER_SENML)
+    APPLICATION_CBOR,  //  Send to Collector: CBOR encoding for payload.  Remote Sensor decodes only this format.
 };
-static const char *sensor_network_shortname[MAX_INTERFACE_TYPES] = {  //  Short name of each Network Interface
+static const char *sensor_network_shortname[MAX_INTERFACE_TYPES] = {  //  Short name of each destination class
     "svr",  //  Send to Server
     "col",  //  Send to Collector
 };
@@ -129,6 +214,11 @@ int register_server_transport(void) {
     uint8_t i = SERVER_INTERFACE_TYPE;
     int rc = sensor_network_register_transport(i);
     assert(rc == 0);
+    if (COAP_MIRROR_HOST[0]) {
+        //  Also send every CoAP Server message to the mirror server.
+        rc = sensor_network_add_server(COAP_MIRROR_HOST, MYNEWT_VAL(COAP_MIRROR_PORT));
+        assert(rc == 0);
+    }
     return rc;
 }
 
@@ -141,22 +231,61 @@ int register_collector_transport(void) {
 }
 
 int sensor_network_register_transport(uint8_t iface_type) {
-    //  Register the Network Interface as the network transport for CoAP Server or CoAP Collector.
+    //  Register the transport of the cheapest available Network Interface for CoAP Server or CoAP Collector.  If the
+    //  transport fails to register, the interface is marked unavailable and the next interface in the route is tried.
+    //  Return 0 if successful.
     assert(iface_type >= 0 && iface_type < MAX_INTERFACE_TYPES);
-    struct sensor_network_interface *iface = &sensor_network_interfaces[iface_type];
-    if (iface->transport_registered) { return 0; }  //  Quit if transport already registered and endpoint has been created.
+    assert(sensor_network_routes[iface_type].count > 0);  //  No Network Interface registered for the destination class.
+    return register_route(iface_type, 0);
+}
 
-    void *endpoint = &sensor_network_endpoints[iface_type];
-    //  If endpoint has not been created, register the transport for the interface and create the endpoint.
-    assert(iface->network_device);  assert(iface->register_transport_func);
-    const char *network_device = iface->network_device;
-    console_printf("%s%s %s\n", _net, sensor_network_shortname[iface_type], network_device);
+static int register_route(uint8_t iface_type, uint16_t size) {
+    //  Register the transport of the interface that a message of size bytes would take, falling over to the next
+    //  interface in the route if the registration fails.  Return 0 if successful.
+    int rc = SYS_ENOENT, i;
+    while ((i = route_interface(iface_type, size, false)) >= 0) {
+        struct sensor_network_interface *iface = &sensor_network_interfaces[i];
+        if (iface->transport_registered) { return 0; }  //  Quit if transport already registered and endpoint has been created.
+
+        void *endpoint = &sensor_network_endpoints[i];
+        //  If endpoint has not been created, register the transport for the interface and create the endpoint.
+        const char *network_device = iface->network_device;
+        console_printf("%s%s %s\n", _net, sensor_network_shortname[iface_type], network_device);
+
+        //  TODO: Host and port are not needed for Collector.
+        rc = iface->register_transport_func(network_device, endpoint, COAP_HOST, MYNEWT_VAL(COAP_PORT), MAX_ENDPOINT_SIZE);
+        if (rc == 0) { iface->transport_registered = 1;  return 0; }
+        //  Try the next interface in the route.
+        console_printf("%s%s %s failed %d\n", _net, sensor_network_shortname[iface_type], network_device, rc);
+        iface->unavailable = 1;
+    }
+    return rc;
+}
 
-    //  TODO: Host and port are not needed for Collector.
-    int rc = iface->register_transport_func(network_device, endpoint, COAP_HOST, MYNEWT_VAL(COAP_PORT), MAX_ENDPOINT_SIZE);
-    assert(rc == 0);
-    iface->transport_registered = 1;
+int sensor_network_add_server(const char *host, uint16_t port) {
+    //  Register another CoAP Server e.g. a local historian.  Every CoAP Server message is also sent to this server,
+    //  with the same URI.  The payload is encoded once and copied.  Up to SENSOR_COAP_FANOUT servers may be added.
+    //  Return 0 if successful.
+    assert(host);
+#if MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0  //  If CoAP Server messages may be sent to multiple servers...
+    uint8_t iface_type = SERVER_INTERFACE_TYPE;
+    //  Register the transport for the main CoAP Server first.  The mirrors are sent through the same interface.
+    int rc = sensor_network_register_transport(iface_type);
+    if (rc) { return rc; }
+    int i = route_interface(iface_type, 0, true);  assert(i >= 0);
+    if (server_mirror_count > 0) { i = server_mirror_iface; }  //  All mirrors go through the same interface.
+    struct sensor_network_interface *iface = &sensor_network_interfaces[i];
+    assert(iface->register_server_func);  //  Interface doesn't support multiple servers.
+    if (!iface->register_server_func || server_mirror_count >= MYNEWT_VAL(SENSOR_COAP_FANOUT)) { return -1; }
+    void *endpoint = &server_mirrors[server_mirror_count];
+    console_printf("%s%s mirror %s\n", _net, sensor_network_shortname[iface_type], host);
+    rc = iface->register_server_func(iface->network_device, endpoint, host, port, MAX_ENDPOINT_SIZE);
+    if (rc == 0) { server_mirror_iface = i;  server_mirror_count++; }
     return rc;
+#else  //  If CoAP Server messages are sent to 1 server...
+    assert(0);  //  SENSOR_COAP_FANOUT must be set.
+    return -1;
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0
 }
 
 /////////////////////////////////////////////////////////
@@ -164,43 +293,95 @@ int sensor_network_register_transport(uint8_t iface_type) {
 
 bool init_server_post(const char *uri) {
     //  Start composing the CoAP Server message with the sensor data in the payload.  This will 
-    //  block other tasks from composing and posting CoAP messages (through a semaphore).
-    //  We only have 1 memory buffer for composing CoAP messages so it needs to be locked.
+    //  block other tasks from composing and posting CoAP messages (through a semaphore)
+    //  only when all SENSOR_COAP_CONTEXTS compose contexts are busy.
     uint8_t i = SERVER_INTERFACE_TYPE;
     bool status = sensor_network_init_post(i, uri);
-    assert(status);
     return status;
 }
 
 bool init_collector_post(void) {
     //  Start composing the CoAP Collector message with the sensor data in the payload.  This will 
-    //  block other tasks from composing and posting CoAP messages (through a semaphore).
-    //  We only have 1 memory buffer for composing CoAP messages so it needs to be locked.
+    //  block other tasks from composing and posting CoAP messages (through a semaphore)
+    //  only when all SENSOR_COAP_CONTEXTS compose contexts are busy.
     uint8_t i = COLLECTOR_INTERFACE_TYPE;
     const char *uri = NULL;
     bool status = sensor_network_init_post(i, uri);
-    assert(status);
     return status;
 }
 
+int try_server_post(const char *uri) {
+    //  Start composing the CoAP Server message only if a compose context is free right now.  Never blocks, so it's
+    //  safe for high-priority sensor paths.  Returns 0 if successful, or SYS_EAGAIN if all compose contexts are busy
+    //  or the transport has not been registered.
+    uint8_t i = SERVER_INTERFACE_TYPE;
+    return sensor_network_init_post_wait(i, uri, SENSOR_COAP_NO_WAIT);
+}
+
+int try_collector_post(void) {
+    //  Start composing the CoAP Collector message only if a compose context is free right now.  Never blocks, so it's
+    //  safe for high-priority sensor paths.  Returns 0 if successful, or SYS_EAGAIN if all compose contexts are busy
+    //  or the transport has not been registered.
+    uint8_t i = COLLECTOR_INTERFACE_TYPE;
+    const char *uri = NULL;
+    return sensor_network_init_post_wait(i, uri, SENSOR_COAP_NO_WAIT);
+}
+
 bool sensor_network_init_post(uint8_t iface_type, const char *uri) {
     //  Start composing the CoAP Server or Collector message with the sensor data in the payload.  This will 
-    //  block other tasks from composing and posting CoAP messages (through a semaphore).
-    //  We only have 1 memory buffer for composing CoAP messages so it needs to be locked.
+    //  block other tasks from composing and posting CoAP messages (through a semaphore)
+    //  only when all SENSOR_COAP_CONTEXTS compose contexts are busy.
+    assert(iface_type >= 0 && iface_type < MAX_INTERFACE_TYPES);
+    assert(sensor_network_routes[iface_type].count > 0);  //  No Network Interface registered for the destination class.
+    //  If the transport of the cheapest interface has not been registered, register the transport and create the
+    //  endpoint.  If it fails, the message takes the next interface in the route.
+    register_route(iface_type, sensor_network_routes[iface_type].last_size);
+    //  Returns false if all compose contexts are still busy after the timeout, or if no interface is available.
+    int rc = sensor_network_init_post_wait(iface_type, uri, MYNEWT_VAL(SENSOR_COAP_ACQUIRE_TIMEOUT));
+    return (rc == 0);
+}
+
+int sensor_network_init_post_wait(uint8_t iface_type, const char *uri, uint32_t timeout_ms) {
+    //  Start composing the CoAP Server or Collector message, waiting at most timeout_ms milliseconds for a free
+    //  compose context.  SENSOR_COAP_NO_WAIT fails right away.  The transport is not registered here, since
+    //  connecting to WiFi may block for seconds.  Returns 0 if successful, SYS_EAGAIN if all compose contexts are
+    //  still busy or the transport has not been registered, or SYS_ENOMEM if out of mbufs.
     if (uri == NULL) { uri = COAP_URI; }
     assert(uri);  assert(iface_type >= 0 && iface_type < MAX_INTERFACE_TYPES);
-    struct sensor_network_interface *iface = &sensor_network_interfaces[iface_type];
-    assert(iface->network_device);  assert(iface->register_transport_func);
-    void *endpoint = &sensor_network_endpoints[iface_type];
-    int encoding = sensor_network_encoding[iface_type];
-    if (!iface->transport_registered) {
-        //  If transport has not been registered, register the transport for the interface and create the endpoint.
-        int rc = sensor_network_register_transport(iface_type);
+    //  Take the cheapest available interface whose transport has been registered.
+    int i = route_interface(iface_type, sensor_network_routes[iface_type].last_size, true);
+    if (i < 0) { return SYS_EAGAIN; }  //  Call register_server_transport() or register_collector_transport() first.
+    struct sensor_network_interface *iface = &sensor_network_interfaces[i];
+    void *endpoint = &sensor_network_endpoints[i];
+    int encoding = iface->encoding ? iface->encoding : sensor_network_encoding[iface_type];
+    struct sensor_coap_context *ctx = NULL;
+    int rc = init_sensor_post_wait(endpoint, uri, encoding, timeout_ms, &ctx);
+    if (rc != 0) { return rc; }
+#if MYNEWT_VAL(SERVER_FLAT)  //  If we are sending the flat payload layout to the CoAP Server...
+    if (iface_type == SERVER_INTERFACE_TYPE) {
+        //  The CP_* macros and payload skeletons will write {"device": ...,"t": ...} instead of {"values": [...]}.
+        rc = sensor_coap_set_layout(ctx, SENSOR_COAP_LAYOUT_FLAT);
         assert(rc == 0);
     }
-    bool status = init_sensor_post(endpoint, uri, encoding);
-    assert(status);
-    return status;
+#endif  //  MYNEWT_VAL(SERVER_FLAT)
+#if MYNEWT_VAL(SERVER_COMPRESS)  //  If we are compressing the CoAP Server payloads...
+    //  Only CoAP Server messages are compressed.  The Sensor Nodes decode only uncompressed CBOR.
+    if (iface_type == SERVER_INTERFACE_TYPE) { sensor_coap_set_compress(ctx, true); }
+#endif  //  MYNEWT_VAL(SERVER_COMPRESS)
+#if MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0  //  If CoAP Server messages may be sent to multiple servers...
+    if (iface_type == SERVER_INTERFACE_TYPE && i == server_mirror_iface) {
+        //  Send a copy of the payload to each mirror server.  The payload is encoded only once.  The mirrors are
+        //  skipped when the message takes another interface, which can't reach the mirror endpoints.
+        int m;
+        for (m = 0; m < server_mirror_count; m++) {
+            rc = sensor_coap_add_destination(ctx, (struct oc_server_handle *) &server_mirrors[m], uri);
+            assert(rc == 0);
+        }
+    }
+#endif  //  MYNEWT_VAL(SENSOR_COAP_FANOUT) > 0
+    //  Remember the interface, for checking the payload size against its MTU when posting.
+    set_post_interface(ctx, i);
+    return 0;
 }
 
 
@@ -215,7 +396,6 @@ bool do_server_post(void) {
     //  to compose and post CoAP messages.
     uint8_t i = SERVER_INTERFACE_TYPE;
     bool status = sensor_network_do_post(i);
-    assert(status);
     return status;
 }
 
@@ -225,7 +405,6 @@ bool do_collector_post(void) {
     //  to compose and post CoAP messages.
     uint8_t i = COLLECTOR_INTERFACE_TYPE;
     bool status = sensor_network_do_post(i);
-    assert(status);
     return status;
 }
 
@@ -234,44 +413,70 @@ bool sensor_network_do_post(uint8_t iface_type) {
     //  message to the background task, we release a semaphore that unblocks other requests
     //  to compose and post CoAP messages.
     assert(iface_type >= 0 && iface_type < MAX_INTERFACE_TYPES);
-    bool status = do_sensor_post();
+    struct sensor_coap_context *ctx = sensor_coap_current();  assert(ctx);
+    //  Remember the payload size, so that the next message starts with an interface with a large enough MTU.
+    int size = OS_MBUF_PKTLEN(ctx->payload);
+#if MYNEWT_VAL(COAP_JSON_ENCODING)  //  If we are encoding the CoAP payload in JSON...
+    size += ctx->json_len;  //  Not flushed to the payload yet.
+#endif  //  MYNEWT_VAL(COAP_JSON_ENCODING)
+    sensor_network_routes[iface_type].last_size = size;
+    //  The interface was chosen before the payload was composed.  If the payload doesn't fit, the interface would
+    //  drop or truncate it, so send the message through the next interface whose MTU fits.
+    int i = take_post_interface(ctx);  assert(i >= 0);
+    struct sensor_network_interface *iface = &sensor_network_interfaces[i];
+    if (iface->mtu && size > iface->mtu) {
+        int j = fit_interface(iface_type, size, ctx->content_format);
+        if (j < 0 || sensor_coap_set_server(ctx, (void *) &sensor_network_endpoints[j]) != 0) {
+            //  No interface fits the payload.  Discard the message.
+            console_printf("%s%s %s payload %d exceeds mtu %d\n", _net, sensor_network_shortname[iface_type], iface->network_device, size, iface->mtu);
+            sensor_coap_discard(ctx);
+            return false;
+        }
+        console_printf("%s%s %s payload %d rerouted to %s\n", _net, sensor_network_shortname[iface_type], iface->network_device, size, sensor_network_interfaces[j].network_device);
+    }
+    bool status = do_sensor_post(ctx);
     assert(status);
     return status;
 }
 
-/////////////////////////////////////////////////////////
-//  Query Collector and Sensor Nodes
-
-bool is_collector_node(void) {
-    //  Return true if this is the Collector Node.
-    //  This is the Collector Node if the Hardware ID matches the Collector Node Hardware ID.
-
-    //  Fetch the hardware ID.  This is unique across all microcontrollers.
-    const uint8_t *hardware_id = get_hardware_id();
-    //  if the Hardware ID matches the Collector Node Hardware ID...
-    if (memcmp(hardware_id, COLLECTOR_NODE_HW_ID, HARDWARE_ID_LENGTH) == 0) { return true; }
-    return false; 
+static void set_post_interface(struct sensor_coap_context *ctx, int iface) {
+    //  Remember the Network Interface taken by the message being composed with the context.
+    os_sr_t sr;
+    int i;
+    OS_ENTER_CRITICAL(sr);
+    for (i = 0; i < MYNEWT_VAL(SENSOR_COAP_CONTEXTS); i++) {
+        if (sensor_network_posts[i].ctx == NULL) {
+            sensor_network_posts[i].ctx = ctx;
+            sensor_network_posts[i].iface = iface;
+            break;
+        }
+    }
+    OS_EXIT_CRITICAL(sr);
+    assert(i < MYNEWT_VAL(SENSOR_COAP_CONTEXTS));  //  More messages than compose contexts.
 }
 
-bool is_sensor_node(void) {
-    //  Return true if this is a Sensor Node.
-    //  This is a Sensor Node if the Hardware ID matches one of the Sensor Node Hardware IDs.
-    if (sensor_node_address) { return true; }  //  sensor_node_address is set in sensor_network_init().
-    return false;
+static int take_post_interface(struct sensor_coap_context *ctx) {
+    //  Return the Network Interface taken by the message being composed with the context, and forget it.
+    //  Return -1 if not found.
+    os_sr_t sr;
+    int i, iface = -1;
+    OS_ENTER_CRITICAL(sr);
+    for (i = 0; i < MYNEWT_VAL(SENSOR_COAP_CONTEXTS); i++) {
+        if (sensor_network_posts[i].ctx == ctx) {
+            iface = sensor_network_posts[i].iface;
+            sensor_network_posts[i].ctx = NULL;
+            break;
+        }
+    }
+    OS_EXIT_CRITICAL(sr);
+    return iface;
 }
 
-bool is_standalone_node(void) {
-    //  Return true if this is a Standalone Node, i.e. not a Collector or Sensor Node.
-    if (!is_collector_node() && !is_sensor_node()) { return true; }
-    return false;
-}
+/////////////////////////////////////////////////////////
+//  Query Collector and Sensor Nodes
 
-bool should_send_to_collector(struct sensor_value *val, const char *device_name) {
-    //  Return true if this node should send to a Collector Node instead of CoAP Server.  Which means this must be a Sensor Node.
-    assert(val);
-    if (is_sensor_node()) { return true; }
-    return false;
-}
+//  is_collector_node(), is_sensor_node(), is_standalone_node() and should_send_to_collector() are inline accessors
+//  of sensor_network_node, defined in sensor_network.h.
 
 /////////////////////////////////////////////////////////
 //  Sensor Network Addresses
@@ -308,12 +513,45 @@ const char *get_device_id(void) {
     return device_id_text;
 }
 
+const char *get_device_token(void) {
+    //  Return the Device ID or Device Token to be sent in the next CoAP Server message.  Call once per message.
+    //  The full Device ID is sent in the first DEVICE_TOKEN_ANNOUNCE messages of every DEVICE_TOKEN_RENEW messages,
+    //  so that the server can map the token to the Device ID.  Other messages carry the short Device Token.
+    const char *id = get_device_id();
+#if MYNEWT_VAL(DEVICE_TOKEN)  //  If we are sending the short Device Token instead of the Device ID...
+    if (!id[0]) { return id; }  //  No Device ID since we are transmitting locally.
+    uint32_t count;
+    os_sr_t sr;
+    OS_ENTER_CRITICAL(sr);
+    if (!device_token_text[0]) { device_token_encode(device_id, DEVICE_TOKEN_LENGTH, device_token_text); }
+    count = device_token_count++;
+    OS_EXIT_CRITICAL(sr);
+    if (count % MYNEWT_VAL(DEVICE_TOKEN_RENEW) >= MYNEWT_VAL(DEVICE_TOKEN_ANNOUNCE)) { return device_token_text; }
+#endif  //  MYNEWT_VAL(DEVICE_TOKEN)
+    return id;
+}
+
+int device_token_encode(const uint8_t *id, int len, char *token) {
+    //  Encode the first len bytes of the binary Device ID in base64url without padding, e.g. 0xab 0xcd 0xef 0xff
+    //  becomes q83v_w.  token must have space for (len * 8 + 5) / 6 characters and a terminating null.
+    //  Return the token length.
+    static const char base64url[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    assert(id);  assert(token);
+    uint32_t bits = 0;  //  Bits not yet encoded
+    int nbits = 0, size = 0, i;
+    for (i = 0; i < len; i++) {
+        bits = (bits << 8) | id[i];
+        nbits += 8;
+        while (nbits >= 6) { nbits -= 6;  token[size++] = base64url[(bits >> nbits) & 0x3f]; }
+    }
+    if (nbits > 0) { token[size++] = base64url[(bits << (6 - nbits)) & 0x3f]; }
+    token[size] = 0;
+    return size;
+}
+
 //  Return the Collector Node address for this Sensor Network.
 unsigned long long get_collector_node_address(void) { return COLLECTOR_NODE_ADDRESS; }
 
-//  Return the Sensor Node address for this node, if this is a Sensor Node.
-unsigned long long get_sensor_node_address(void) { return sensor_node_address; }
-
 //  Return the list of Sensor Node addresses for this Sensor Network.
 const unsigned long long *get_sensor_node_addresses(void) { return sensor_node_addresses; }
 
@@ -326,35 +564,233 @@ const char **get_sensor_node_names(void) { return sensor_node_names; }
 void sensor_network_init(void) {
     //  Allocate Sensor Node address for this node.
 
+    //  Hash the configured Sensor Node addresses.  Allocate unique addresses to the nodes that share pipes.
+    int i;
+    for (i = 0; i < SENSOR_NETWORK_SIZE; i++) {
+        if (i >= SENSOR_NETWORK_PIPES) { sensor_node_addresses[i] = ADDR(SENSOR_NETWORK_ADDRESS, allocate_node_address()); }
+        assert(sensor_network_find_node(sensor_node_addresses[i]) < 0);  //  Sensor Node addresses must be unique.
+        add_node_hash(i);
+    }
     //  Set the Sensor Node names for remote_sensor_create().
-    for (int i = 0; i < SENSOR_NETWORK_SIZE; i++) {
+    for (i = 0; i < SENSOR_NETWORK_SIZE; i++) {
+        sensor_node_names[i] = sensor_node_names_buf + i * NODE_NAME_LENGTH;
         int len = sprintf((char *) sensor_node_names[i], "%010llx", sensor_node_addresses[i]);
         assert(len + 1 <= NODE_NAME_LENGTH);
     }
-    //  Get Sensor Node address if applicable.
-    const uint8_t *hardware_id = get_hardware_id();
+    //  Resolve the role of this node from the Hardware ID, once.  The role queries are single loads after this.
+    resolve_node(get_hardware_id(), &sensor_network_node);
+#if MYNEWT_VAL(SENSOR_NETWORK_JOIN)  //  If Sensor Nodes may join over the air...
+    //  On the Collector Node: Bind the configured Hardware IDs and restore the nodes that joined before.
+    if (is_collector_node()) { int rc = sensor_network_join_init();  assert(rc == 0); }
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_JOIN)
+    //  Display the type of node.
+    if (is_sensor_node()) { console_printf("%ssensor%s#%d\n", _net, _node, sensor_network_node.index + 1); }
+    else if (is_collector_node()) { console_printf("%scollector%s\n", _net, _node); }
+    else if (is_standalone_node()) { console_printf("%sstandalone%s\n", _net, _node); }
+
+    //  Start the Transmit Task, if enabled.
+    int rc = sensor_network_start_tx();  assert(rc == 0);
+}
+
+static void resolve_node(const uint8_t *hardware_id, struct sensor_network_node *node) {
+    //  Set the role, Sensor Node index, nRF24L01 pipe and address of the node with the Hardware ID.
+    //  This is the Collector Node if the Hardware ID matches the Collector Node Hardware ID, a Sensor Node if the
+    //  Hardware ID matches one of the Sensor Node Hardware IDs, else a Standalone Node (or a Sensor Node that
+    //  has not joined, if SENSOR_NETWORK_JOIN is enabled).
+    assert(hardware_id);  assert(node);
+    node->role = SENSOR_NETWORK_ROLE_STANDALONE;
+    node->index = -1;
+    node->pipe = 0;
+    node->id = 0;
+    node->address = 0;
+    if (memcmp(hardware_id, COLLECTOR_NODE_HW_ID, HARDWARE_ID_LENGTH) == 0) {
+        node->role = SENSOR_NETWORK_ROLE_COLLECTOR;
+        node->address = COLLECTOR_NODE_ADDRESS;  //  Pipe 0
+        return;
+    }
     int i;
     for (i = 0; i < SENSOR_NETWORK_SIZE; i++) {
-        if (memcmp(hardware_id, SENSOR_NODE_HW_IDS[i], HARDWARE_ID_LENGTH) == 0) {
-            sensor_node_address = sensor_node_addresses[i];
-            console_printf("%ssensor%s#%d\n", _net, _node, i + 1);
-            break;
+        const uint8_t *id = get_sensor_node_hw_id(i);
+        if (id && memcmp(hardware_id, id, HARDWARE_ID_LENGTH) == 0) {
+            sensor_network_set_node(i, node);
+            return;
         }
     }
-    //  Display the type of node.
-    if (is_collector_node()) { console_printf("%scollector%s\n", _net, _node); }
-    else if (is_standalone_node()) { console_printf("%sstandalone%s\n", _net, _node); }
+#if MYNEWT_VAL(SENSOR_NETWORK_JOIN)  //  If Sensor Nodes may join over the air...
+    //  Not configured: This is a Sensor Node that will join on first transmit.  Until then, it transmits to pipe 1.
+    node->role = SENSOR_NETWORK_ROLE_SENSOR;
+    node->pipe = 1;
+    node->address = sensor_node_addresses[0];
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_JOIN)
+}
+
+void sensor_network_set_node(int index, struct sensor_network_node *node) {
+    //  Set the node as the Sensor Node at the index of the Sensor Node table.
+    assert(index >= 0 && index < SENSOR_NETWORK_SIZE);  assert(node);
+    node->role = SENSOR_NETWORK_ROLE_SENSOR;
+    node->index = index;
+    node->pipe = index % SENSOR_NETWORK_PIPES + 1;  //  Pipes 1 to 5.  Nodes 6 onwards share the pipes.
+    node->id = (uint8_t) sensor_node_addresses[index];  //  Last byte of the node address, sent in-frame.
+    node->address = sensor_node_addresses[node->pipe - 1];  //  Transmit to the address of the pipe.
+}
+
+const uint8_t *get_sensor_node_hw_id(int index) {
+    //  Return the configured Hardware ID of the Sensor Node at the index, or NULL if not configured or all zeroes.
+    assert(index >= 0 && index < SENSOR_NETWORK_SIZE);
+    assert(SENSOR_NODE_HW_IDS_MORE_COUNT <= SENSOR_NETWORK_SIZE - SENSOR_NETWORK_PIPES);  //  Too many Hardware IDs.
+    const uint8_t *id = (index < SENSOR_NETWORK_PIPES) ? SENSOR_NODE_HW_IDS[index]
+        : (index - SENSOR_NETWORK_PIPES < (int) SENSOR_NODE_HW_IDS_MORE_COUNT) ? &SENSOR_NODE_HW_IDS_MORE[(index - SENSOR_NETWORK_PIPES) * HARDWARE_ID_LENGTH]
+        : NULL;
+    int i;
+    for (i = 0; id && i < HARDWARE_ID_LENGTH; i++) {
+        if (id[i]) { return id; }
+    }
+    return NULL;
+}
+
+int sensor_network_find_node(unsigned long long address) {
+    //  Return the index of the Sensor Node with the address, or -1 if not found.  Hashed, so the cost doesn't
+    //  grow with the number of Sensor Nodes.
+    uint32_t h = NODE_HASH(address);
+    int probe;
+    for (probe = 0; probe < NODE_HASH_SIZE; probe++) {
+        uint8_t slot = node_hash[(h + probe) & (NODE_HASH_SIZE - 1)];
+        if (slot == 0) { return -1; }  //  Empty slot: Not found.
+        if (sensor_node_addresses[slot - 1] == address) { return slot - 1; }
+    }
+    return -1;
+}
+
+int sensor_network_frame_node(int pipe, uint8_t *frame, int size) {
+    //  Return the index of the Sensor Node that transmitted the frame received on the pipe (1 to 5), or -1 if unknown
+    //  or seen before.  The node ID and hop count in the frame, if any, are erased.
+    assert(frame);  assert(size >= SENSOR_NETWORK_FRAME_TRAILER);
+    if (pipe < 1 || pipe > SENSOR_NETWORK_PIPES) { return -1; }
+    uint8_t hops = 0;
+#if MYNEWT_VAL(SENSOR_NETWORK_RELAY)  //  If Sensor Nodes may relay frames...
+    //  Drop the frame if it was heard before, directly or from a Relay Node.
+    hops = frame[size - 3];
+    frame[size - 3] = 0;
+    if (sensor_network_relay_seen(&collector_relay, frame[size - 2], frame[size - 1])) { return -1; }
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_RELAY)
+#if SENSOR_NETWORK_FRAME_NODE_ID  //  If the node ID is sent in-frame...
+    //  Look up the node ID in the frame, which is the last byte of the node address.
+    uint8_t id = frame[size - 2];
+    frame[size - 2] = 0;
+    int i = sensor_network_find_node(ADDR(SENSOR_NETWORK_ADDRESS, id));
+    if (i < 0) { return -1; }  //  Unknown node.
+    if (hops == 0 && i % SENSOR_NETWORK_PIPES + 1 != pipe) { return -1; }  //  Wrong pipe.  Forwarded frames may arrive on any pipe.
+#else
+    int i = pipe - 1;  //  Each Sensor Node has its own pipe.
+#endif  //  SENSOR_NETWORK_FRAME_NODE_ID
+#if MYNEWT_VAL(SENSOR_NETWORK_JOIN)  //  If Sensor Nodes may join over the air...
+    if (!sensor_network_join_bound(i)) { return -1; }  //  No node has joined at this index.
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_JOIN)
+    return i;
+}
+
+static void add_node_hash(int index) {
+    //  Add the Sensor Node address at the index to the hash table.
+    uint32_t h = NODE_HASH(sensor_node_addresses[index]);
+    int probe;
+    for (probe = 0; probe < NODE_HASH_SIZE; probe++) {
+        uint8_t *slot = &node_hash[(h + probe) & (NODE_HASH_SIZE - 1)];
+        if (*slot == 0) { *slot = index + 1;  return; }
+    }
+    assert(0);  //  Hash table full.
+}
+
+static int allocate_node_address(void) {
+    //  Return the next unused last byte for a Sensor Node address, starting from 1.  Skips the configured addresses,
+    //  so that every Collector and Sensor Node allocates the same addresses.
+    static int next_offset = 1;
+    while (next_offset <= 0xff && sensor_network_find_node(ADDR(SENSOR_NETWORK_ADDRESS, next_offset)) >= 0) { next_offset++; }
+    assert(next_offset <= 0xff);  //  Too many Sensor Nodes.
+    return next_offset++;
 }
 
 int sensor_network_register_interface(const struct sensor_network_interface *iface) {
-    //  Register the Network Interface (e.g. ESP8266, nRF24L01) for the Sensor Network.
+    //  Register the Network Interface (e.g. ESP8266, nRF24L01) for the Sensor Network.  The interface is added to the
+    //  route of its destination class, ordered by cost.  Return 0 if successful, SYS_EALREADY if the network device is
+    //  already registered, SYS_ENOMEM if MAX_NETWORK_INTERFACES interfaces are registered.
     assert(iface);
-    uint8_t i = iface->iface_type;  assert(i >= 0 && i < MAX_INTERFACE_TYPES);
+    uint8_t t = iface->iface_type;  assert(t >= 0 && t < MAX_INTERFACE_TYPES);
     assert(iface->network_device);  assert(iface->server_endpoint_size);  assert(iface->register_transport_func);
     assert(iface->server_endpoint_size <= MAX_ENDPOINT_SIZE);     //  Need to increase MAX_ENDPOINT_SIZE.
-    assert(sensor_network_interfaces[i].network_device == NULL);  //  Interface already registered.
+    int i;
+    for (i = 0; i < sensor_network_interface_count; i++) {
+        if (strcmp(sensor_network_interfaces[i].network_device, iface->network_device) == 0) { return SYS_EALREADY; }
+    }
+    if (sensor_network_interface_count >= MAX_NETWORK_INTERFACES) { return SYS_ENOMEM; }  //  Need to increase SENSOR_NETWORK_INTERFACES.
+    i = sensor_network_interface_count++;
     memcpy(&sensor_network_interfaces[i], iface, sizeof(struct sensor_network_interface));  //  Copy the interface.
     sensor_network_interfaces[i].transport_registered = 0;        //  We defer the registration of the transport till first use.
-    console_printf("%s%s %s\n", _net, sensor_network_shortname[i], sensor_network_interfaces[i].network_device);
+    sensor_network_interfaces[i].unavailable = 0;
+
+    //  Insert into the route after the interfaces with the same or lower cost.
+    struct sensor_network_route *route = &sensor_network_routes[t];
+    int pos = route->count;
+    while (pos > 0 && sensor_network_interfaces[route->ifaces[pos - 1]].cost > iface->cost) {
+        route->ifaces[pos] = route->ifaces[pos - 1];
+        pos--;
+    }
+    route->ifaces[pos] = i;
+    route->count++;
+    console_printf("%s%s %s cost %d\n", _net, sensor_network_shortname[t], sensor_network_interfaces[i].network_device, iface->cost);
     return 0;
 }
+
+const struct sensor_network_interface *sensor_network_route(uint8_t iface_type, uint16_t size) {
+    //  Return the Network Interface that the next message of size bytes (0 if unknown) for the destination class would
+    //  take: The cheapest available interface whose MTU fits the size, else the cheapest available interface.
+    //  NULL if none.
+    assert(iface_type >= 0 && iface_type < MAX_INTERFACE_TYPES);
+    int i = route_interface(iface_type, size, false);
+    return (i >= 0) ? &sensor_network_interfaces[i] : NULL;
+}
+
+int sensor_network_set_available(const char *network_device, bool available) {
+    //  Mark the Network Interface with the network device name as available or not, e.g. when the link goes down or
+    //  comes back up.  Return 0 if successful, SYS_ENOENT if the network device is not registered.
+    assert(network_device);
+    int i;
+    for (i = 0; i < sensor_network_interface_count; i++) {
+        struct sensor_network_interface *iface = &sensor_network_interfaces[i];
+        if (strcmp(iface->network_device, network_device) != 0) { continue; }
+        iface->unavailable = !available;
+        return 0;
+    }
+    return SYS_ENOENT;
+}
+
+static int route_interface(uint8_t iface_type, uint16_t size, bool registered) {
+    //  Return the index of the cheapest available interface in the route of the destination class whose MTU fits the
+    //  size, else the cheapest available interface, or -1 if none.  If registered is true, consider only the
+    //  interfaces whose transport has been registered.
+    struct sensor_network_route *route = &sensor_network_routes[iface_type];
+    int fallback = -1, n;
+    for (n = 0; n < route->count; n++) {
+        int i = route->ifaces[n];
+        struct sensor_network_interface *iface = &sensor_network_interfaces[i];
+        if (iface->unavailable || (registered && !iface->transport_registered)) { continue; }
+        if (iface->mtu == 0 || size <= iface->mtu) { return i; }
+        if (fallback < 0) { fallback = i; }  //  Message may be too big for this interface.
+    }
+    return fallback;
+}
+
+static int fit_interface(uint8_t iface_type, uint16_t size, int encoding) {
+    //  Return the index of the cheapest available interface in the route of the destination class whose transport
+    //  has been registered, whose MTU fits the size and which sends the encoding, or -1 if none.
+    struct sensor_network_route *route = &sensor_network_routes[iface_type];
+    int n;
+    for (n = 0; n < route->count; n++) {
+        int i = route->ifaces[n];
+        struct sensor_network_interface *iface = &sensor_network_interfaces[i];
+        if (iface->unavailable || !iface->transport_registered) { continue; }
+        if (iface->mtu && size > iface->mtu) { continue; }
+        if ((iface->encoding ? iface->encoding : sensor_network_encoding[iface_type]) != encoding) { continue; }
+        return i;
+    }
+    return -1;
+}
@@ -0,0 +1,169 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+//  Transmit Task for the CoAP messages.  Without it, the OIC Background Task transmits the messages on the default
+//  event queue, so a slow AT+CIPSEND to the ESP8266 or an nRF24L01 SPI transfer delays the sensor polling, which
+//  runs on the same event queue.  The Transmit Task owns a queue for each priority and always transmits the
+//  oldest message of the highest priority first: alerts, then normal messages, then batches.  Each queue holds
+//  up to TX_QUEUE_DEPTH messages, so producers see backpressure through sensor_network_tx_ready().
+#include <os/mynewt.h>
+#include <console/console.h>
+#include <oic/port/oc_connectivity.h>  //  For oc_send_buffer()
+#include <oic/messaging/coap/coap.h>   //  For coap_send_message()
+#include <sensor_coap/sensor_coap.h>
+#include "sensor_network/sensor_network.h"
+
+#if SENSOR_NETWORK_TX_PRIORITIES != SENSOR_COAP_PRIORITIES
+#error SENSOR_NETWORK_TX_PRIORITIES must be the same as SENSOR_COAP_PRIORITIES
+#endif  //  SENSOR_NETWORK_TX_PRIORITIES != SENSOR_COAP_PRIORITIES
+
+#if MYNEWT_VAL(TX_TASK)  //  If we are transmitting in the Transmit Task...
+
+static struct os_task tx_task;  //  Transmit Task.
+static os_stack_t tx_task_stack[MYNEWT_VAL(TX_TASK_STACK_SIZE)];  //  Stack space for the Transmit Task.
+static struct os_eventq tx_evq;  //  Wakes up the Transmit Task when a message is queued.
+static struct os_mqueue tx_queues[SENSOR_NETWORK_TX_PRIORITIES];  //  Messages to be transmitted, one queue per priority.
+static struct sensor_network_tx_stats tx_stats;  //  Queue depths and counters.  Updated in critical sections.
+
+static void tx_task_func(void *arg);
+static void tx_event(struct os_event *ev);
+
+int sensor_network_start_tx(void) {
+    //  Start the Transmit Task and route the CoAP messages from sensor_coap to the transmit queues.
+    //  Called by sensor_network_init().  Return 0 if successful.
+    int i, rc;
+    os_eventq_init(&tx_evq);
+    for (i = 0; i < SENSOR_NETWORK_TX_PRIORITIES; i++) {
+        rc = os_mqueue_init(&tx_queues[i], tx_event, NULL);  assert(rc == 0);
+    }
+    memset(&tx_stats, 0, sizeof(tx_stats));
+    rc = os_task_init(      //  Create a new task and start it...
+        &tx_task,           //  Task object will be saved here.
+        "tx",               //  Name of task.
+        tx_task_func,       //  Function to execute when task starts.
+        NULL,               //  Argument to be passed to above function.
+        MYNEWT_VAL(TX_TASK_PRIORITY),  //  Task priority: highest is 0, lowest is 255.  Main task is 127.
+        OS_WAIT_FOREVER,    //  Don't do sanity / watchdog checking.
+        tx_task_stack,      //  Stack space for the task.
+        MYNEWT_VAL(TX_TASK_STACK_SIZE));  //  Size of the stack (in 4-byte units).
+    assert(rc == 0);
+    sensor_coap_set_send_func(sensor_network_tx);
+    return rc;
+}
+
+void sensor_network_tx(struct os_mbuf *m, uint8_t priority) {
+    //  Queue the serialised CoAP message for the Transmit Task.  If the queue for the priority is full, drop the
+    //  message.  The mbuf chain is always consumed.
+    assert(m);  assert(priority < SENSOR_NETWORK_TX_PRIORITIES);
+    if (priority >= SENSOR_NETWORK_TX_PRIORITIES) { priority = SENSOR_COAP_PRIORITY_BULK; }
+    bool full = false;
+    os_sr_t sr;
+    OS_ENTER_CRITICAL(sr);
+    if (tx_stats.depth[priority] >= MYNEWT_VAL(TX_QUEUE_DEPTH)) {
+        full = true;
+        tx_stats.dropped[priority]++;
+    } else {
+        tx_stats.depth[priority]++;
+        if (tx_stats.depth[priority] > tx_stats.max_depth[priority]) { tx_stats.max_depth[priority] = tx_stats.depth[priority]; }
+    }
+    OS_EXIT_CRITICAL(sr);
+    if (full) { os_mbuf_free_chain(m);  return; }
+
+    //  Wake up the Transmit Task.
+    int rc = os_mqueue_put(&tx_queues[priority], &tx_evq, m);
+    if (rc) {
+        //  Not a packet header mbuf.  Should not happen for CoAP messages.
+        OS_ENTER_CRITICAL(sr);
+        tx_stats.depth[priority]--;
+        tx_stats.dropped[priority]++;
+        OS_EXIT_CRITICAL(sr);
+        os_mbuf_free_chain(m);
+    }
+}
+
+bool sensor_network_tx_ready(uint8_t priority) {
+    //  Return true if the transmit queue for the priority has room for another message.
+    assert(priority < SENSOR_NETWORK_TX_PRIORITIES);
+    return tx_stats.depth[priority] < MYNEWT_VAL(TX_QUEUE_DEPTH);
+}
+
+void sensor_network_tx_stats(struct sensor_network_tx_stats *stats) {
+    //  Copy the transmit queue statistics.
+    assert(stats);
+    os_sr_t sr;
+    OS_ENTER_CRITICAL(sr);
+    memcpy(stats, &tx_stats, sizeof(tx_stats));
+    OS_EXIT_CRITICAL(sr);
+}
+
+static void tx_task_func(void *arg) {
+    //  Wait for queued messages and transmit them, highest priority first.  The queues are checked again after
+    //  every message, so an alert queued while a batch is being sent goes out next.
+    for (;;) {
+        os_eventq_get(&tx_evq);  //  Wait for a message.  All queues are checked, whichever queue posted the event.
+        for (;;) {
+            struct os_mbuf *m = NULL;
+            int i;
+            for (i = 0; i < SENSOR_NETWORK_TX_PRIORITIES; i++) {
+                m = os_mqueue_get(&tx_queues[i]);
+                if (m) { break; }
+            }
+            if (!m) { break; }  //  All queues are empty.
+            os_sr_t sr;
+            OS_ENTER_CRITICAL(sr);
+            tx_stats.depth[i]--;
+            tx_stats.sent[i]++;
+            OS_EXIT_CRITICAL(sr);
+
+            //  Transmit with the network transport of the endpoint, e.g. oc_tx_ucast() in the ESP8266 driver.
+            //  The transport frees the mbuf chain.
+            oc_send_buffer(m);
+        }
+    }
+}
+
+static void tx_event(struct os_event *ev) {
+    //  Not called: The Transmit Task takes the events from its own event queue without running them.
+}
+
+#else  //  If we are transmitting in the CoAP Background Task...
+
+int sensor_network_start_tx(void) {
+    //  No Transmit Task.  The messages are forwarded to the CoAP Background Task.
+    return 0;
+}
+
+void sensor_network_tx(struct os_mbuf *m, uint8_t priority) {
+    //  Forward the message to the CoAP Background Task.  Priorities are not supported.
+    assert(m);
+    coap_send_message(m, 0);
+}
+
+bool sensor_network_tx_ready(uint8_t priority) {
+    //  The CoAP Background Task has no queue limit.
+    return true;
+}
+
+void sensor_network_tx_stats(struct sensor_network_tx_stats *stats) {
+    //  No statistics without the Transmit Task.
+    assert(stats);
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif  //  MYNEWT_VAL(TX_TASK)
@@ -0,0 +1,76 @@
+//  TODO: Use unit test convention
+//  Tests for the Device Token.  A stand-in for the CoAP Server learns the token of each Device ID that it receives,
+//  and maps later tokens back to the Device ID, like the server would.
+#include <os/os.h>
+#include <console/console.h>
+#include <sensor_coap/sensor_coap.h>
+#include <sensor_network/sensor_network.h>
+
+void test_device_token(void);
+
+#define SERVER_DEVICES  4   //  Number of devices remembered by the stand-in server.
+#define TEST_MESSAGES 250   //  Number of messages sent to the stand-in server.
+
+//  Stand-in server mapping from Device Token to Device ID.
+static struct {
+    char token[8];    //  Device Token e.g. q83v_w
+    char id[33];      //  Device ID e.g. abcdefff...
+} server_devices[SERVER_DEVICES];
+
+static int hex_digit(char c) {
+    //  Return the value of the hex digit.
+    return (c <= '9') ? (c - '0') : (c - 'a' + 10);
+}
+
+static const char *server_receive(const char *device) {
+    //  Stand-in server: Receive the "device" value of a message and return the Device ID.  A Device ID is remembered
+    //  under its token.  A token is mapped to the remembered Device ID.  Return NULL if the token is unknown.
+    int i;
+    if (strlen(device) == 32) {
+        //  Full Device ID.  Compute the token from the first 4 bytes and remember the mapping.
+        uint8_t id[4];
+        for (i = 0; i < 4; i++) { id[i] = (hex_digit(device[2 * i]) << 4) | hex_digit(device[2 * i + 1]); }
+        for (i = 0; i < SERVER_DEVICES; i++) {
+            if (server_devices[i].id[0] && strcmp(server_devices[i].id, device) != 0) { continue; }
+            device_token_encode(id, sizeof(id), server_devices[i].token);
+            strcpy(server_devices[i].id, device);
+            return server_devices[i].id;
+        }
+        assert(0);  //  Too many devices.
+        return NULL;
+    }
+    for (i = 0; i < SERVER_DEVICES; i++) {
+        if (strcmp(server_devices[i].token, device) == 0) { return server_devices[i].id; }
+    }
+    return NULL;
+}
+
+void test_device_token(void) {
+    //  Send the Device ID or Device Token to the stand-in server for each message.  Every message must map to the
+    //  Device ID.  Report the "device" item bytes per message.
+    static const uint8_t id[] = { 0xab, 0xcd, 0xef, 0xff };
+    char token[8];
+    int len = device_token_encode(id, sizeof(id), token);
+    assert(len == 6);  assert(strcmp(token, "q83v_w") == 0);
+
+    const char *device_id = get_device_id();  assert(device_id);
+    if (!device_id[0]) { console_printf("device token: no device ID\n");  return; }
+    memset(server_devices, 0, sizeof(server_devices));
+    int id_bytes = 0, token_bytes = 0, announced = 0, i;
+    for (i = 0; i < TEST_MESSAGES; i++) {
+        const char *device = get_device_token();  assert(device);
+        const char *received = server_receive(device);
+        assert(received);  assert(strcmp(received, device_id) == 0);
+        if (device == device_id) { announced++; }
+        id_bytes += sensor_coap_batch_item_size("device", device_id);
+        token_bytes += sensor_coap_batch_item_size("device", device);
+    }
+#if MYNEWT_VAL(DEVICE_TOKEN)  //  If we are sending the short Device Token instead of the Device ID...
+    assert(announced < TEST_MESSAGES);
+#else
+    assert(announced == TEST_MESSAGES);
+#endif  //  MYNEWT_VAL(DEVICE_TOKEN)
+    console_printf("device token: %d of %d messages announced the device ID, \"device\" item %d bytes before, %d bytes after\n",
+        announced, TEST_MESSAGES, id_bytes / TEST_MESSAGES, token_bytes / TEST_MESSAGES);
+    console_flush();
+}
@@ -0,0 +1,99 @@
+//  TODO: Use unit test convention
+//  Tests for the Over-The-Air Join.  Run on the native BSP (targets/unittest) with SENSOR_NETWORK_JOIN enabled and
+//  SENSOR_NETWORK_NODES set to e.g. 20.  A radio stand-in passes the Join Requests of the simulated Sensor Nodes to
+//  the Collector Node code in the same process and loses every third request, so that the retries are exercised.
+#include <os/os.h>
+#include <console/console.h>
+#include <sensor_network/sensor_network.h>
+
+void test_join(void);
+
+#if MYNEWT_VAL(SENSOR_NETWORK_JOIN)  //  If Sensor Nodes may join over the air...
+
+#define JOIN_LOSS 3  //  Lose every third Join Request.
+
+static uint8_t reply_frame[SENSOR_NETWORK_JOIN_SIZE];  //  Reply waiting to be received, if reply_size > 0
+static int reply_size;
+static int request_count;  //  Number of Join Requests sent
+
+static int stand_in_send(unsigned long long address, const uint8_t *frame, int size) {
+    //  Pass the Join Request to the Collector Node, unless lost.  Return 0 if sent.
+    assert(address == get_sensor_node_addresses()[0]);  //  Must be sent to pipe 1.
+    if (++request_count % JOIN_LOSS == 0) { return 0; }  //  Lost in the air.
+    reply_size = sensor_network_join_process(frame, size, reply_frame);
+    return 0;
+}
+
+static int stand_in_receive(unsigned long long address, uint8_t *frame, int size, uint32_t timeout_ms) {
+    //  Return the reply from the Collector Node, or 0 if none.
+    assert(address == MYNEWT_VAL(SENSOR_NETWORK_JOIN_ADDRESS));  assert(size >= reply_size);
+    int n = reply_size;
+    memcpy(frame, reply_frame, n);
+    reply_size = 0;
+    return n;
+}
+
+static const struct sensor_network_join_radio stand_in = { stand_in_send, stand_in_receive };
+
+static void simulated_hw_id(int n, uint8_t *hardware_id) {
+    //  Set the Hardware ID of simulated Sensor Node n.
+    memset(hardware_id, 0xee, 12);
+    hardware_id[10] = n >> 8;  hardware_id[11] = n;
+}
+
+void test_join(void) {
+    //  Join a simulated Sensor Node at every free index, check that they get different indexes and that they get
+    //  the same index when joining again.  Another Sensor Node is rejected when no index is free.
+    if (!is_collector_node()) { int rc = sensor_network_join_init();  assert(rc == 0); }
+    int free_count = 0, i;
+    for (i = 0; i < SENSOR_NETWORK_SIZE; i++) {
+        if (!sensor_network_join_bound(i)) { free_count++; }
+    }
+    assert(free_count > 0);  //  Configure fewer Hardware IDs than SENSOR_NETWORK_NODES.
+    static struct sensor_network_node nodes[SENSOR_NETWORK_SIZE];
+    uint8_t hardware_id[12], frame[SENSOR_NETWORK_JOIN_SIZE];
+    uint32_t start = os_cputime_get32();
+    for (i = 0; i < free_count; i++) {
+        simulated_hw_id(i, hardware_id);
+        int rc = sensor_network_join(hardware_id, &stand_in, &nodes[i]);
+        assert(rc == 0);
+        assert(nodes[i].role == SENSOR_NETWORK_ROLE_SENSOR);
+        assert(nodes[i].pipe == nodes[i].index % SENSOR_NETWORK_PIPES + 1);
+        assert(nodes[i].address == get_sensor_node_addresses()[nodes[i].pipe - 1]);
+        assert(sensor_network_join_bound(nodes[i].index));
+        int j;
+        for (j = 0; j < i; j++) { assert(nodes[j].index != nodes[i].index); }
+
+        //  A Sensor Data frame from the joined node is traced to it.
+        memset(frame, 0, sizeof(frame));
+        frame[0] = 0xa1;
+#if SENSOR_NETWORK_FRAME_NODE_ID  //  If the node ID is sent in-frame...
+        frame[sizeof(frame) - 2] = nodes[i].id;
+#endif  //  SENSOR_NETWORK_FRAME_NODE_ID
+        assert(sensor_network_frame_node(nodes[i].pipe, frame, sizeof(frame)) == nodes[i].index);
+    }
+    uint32_t ticks = os_cputime_get32() - start;
+    int joined_requests = request_count;
+
+    //  Joining again returns the same index.
+    struct sensor_network_node again;
+    simulated_hw_id(0, hardware_id);
+    int rc = sensor_network_join(hardware_id, &stand_in, &again);
+    assert(rc == 0);  assert(again.index == nodes[0].index);
+
+    //  No free index left.
+    simulated_hw_id(free_count, hardware_id);
+    rc = sensor_network_join(hardware_id, &stand_in, &again);
+    assert(rc == SYS_ENOMEM);
+
+    console_printf("join %d nodes: %d requests, %u ticks\n", free_count, joined_requests, (unsigned) ticks);
+    console_flush();
+}
+
+#else
+
+void test_join(void) {
+    console_printf("join disabled\n");  console_flush();
+}
+
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_JOIN)
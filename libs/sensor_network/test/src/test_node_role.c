@@ -0,0 +1,45 @@
+//  TODO: Use unit test convention
+//  Tests for the node role that is resolved once by sensor_network_init().  The role queries must agree with each
+//  other and with the Sensor Node addresses, and must be cheap enough to call for every reading.
+#include <os/os.h>
+#include <console/console.h>
+#include <sensor_coap/sensor_coap.h>
+#include <sensor_network/sensor_network.h>
+
+void test_node_role(void);
+
+#define ROLE_QUERIES 10000  //  Number of role queries timed.
+
+void test_node_role(void) {
+    //  Check that exactly one role is set and that the index, pipe and address match the role.  Report the time
+    //  for ROLE_QUERIES calls of the queries made for every reading.
+    const struct sensor_network_node *node = &sensor_network_node;
+    assert(node->role != SENSOR_NETWORK_ROLE_UNKNOWN);  //  sensor_network_init() must have been called.
+    int roles = (is_collector_node() ? 1 : 0) + (is_sensor_node() ? 1 : 0) + (is_standalone_node() ? 1 : 0);
+    assert(roles == 1);
+    if (is_sensor_node()) {
+        assert(node->index >= 0 && node->index < SENSOR_NETWORK_SIZE);
+        assert(node->pipe == node->index % SENSOR_NETWORK_PIPES + 1);
+        assert(get_sensor_node_address() == get_sensor_node_addresses()[node->pipe - 1]);
+        assert(sensor_network_find_node(get_sensor_node_addresses()[node->index]) == node->index);
+    } else {
+        assert(node->index == -1);  assert(node->pipe == 0);
+        assert(get_sensor_node_address() == 0);
+    }
+    if (is_collector_node()) { assert(node->address == get_collector_node_address()); }
+    if (is_standalone_node()) { assert(node->address == 0); }
+
+    //  Time the role queries made for every reading, as in send_sensor_data().
+    struct sensor_value val = { "t", SENSOR_VALUE_TYPE_INT32, 1715, 0 };
+    int count = 0, i;
+    uint32_t start = os_cputime_get32();
+    for (i = 0; i < ROLE_QUERIES; i++) {
+        if (should_send_to_collector(&val, "temp_stm32_0")) { count++; }
+        else if (is_collector_node() || is_standalone_node()) { count++; }
+    }
+    uint32_t ticks = os_cputime_get32() - start;
+    assert(count == ROLE_QUERIES);
+    console_printf("node role %d index %d pipe %d: %d queries in %u ticks\n", node->role, node->index, node->pipe,
+        ROLE_QUERIES, (unsigned) ticks);
+    console_flush();
+}
@@ -0,0 +1,88 @@
+//  TODO: Use unit test convention
+//  Benchmark for the Sensor Node table.  Run on the native BSP (targets/unittest) with SENSOR_NETWORK_NODES set to
+//  e.g. 5, 20 and 50.  Simulates a frame from every Sensor Node and checks that the Collector Node identifies the
+//  sender.  The hashed lookup should take the same time per frame for any number of Sensor Nodes, unlike a linear
+//  search of the addresses.
+#include <os/os.h>
+#include <console/console.h>
+#include <sensor_network/sensor_network.h>
+
+void test_node_table(void);
+
+#define LOOKUP_ROUNDS 100  //  Number of frames simulated per Sensor Node.
+
+static int linear_find_node(unsigned long long address) {
+    //  Return the index of the Sensor Node with the address by searching all addresses, for comparison.
+    const unsigned long long *addresses = get_sensor_node_addresses();
+    int i;
+    for (i = 0; i < SENSOR_NETWORK_SIZE; i++) {
+        if (addresses[i] == address) { return i; }
+    }
+    return -1;
+}
+
+void test_node_table(void) {
+    //  Check that every Sensor Node has a unique address and name, that a frame from every Sensor Node is
+    //  traced to that node, and report the lookup time per frame.
+    const unsigned long long *addresses = get_sensor_node_addresses();
+    const char **names = get_sensor_node_names();
+    assert(addresses);  assert(names);
+    uint8_t frame[MYNEWT_VAL(NRF24L01_TX_SIZE)];
+    int i, j, round;
+    for (i = 0; i < SENSOR_NETWORK_SIZE; i++) {
+        assert(sensor_network_find_node(addresses[i]) == i);
+        assert(names[i] && strlen(names[i]) == 10);
+        for (j = 0; j < i; j++) { assert(addresses[j] != addresses[i]);  assert(strcmp(names[j], names[i]) != 0); }
+    }
+    assert(sensor_network_find_node(get_collector_node_address()) == -1);
+
+    //  Simulate a frame from every Sensor Node, the way the nRF24L01 transport composes it.
+    int pipe, found = 0, expected = 0;
+    for (i = 0; i < SENSOR_NETWORK_SIZE; i++) {
+#if MYNEWT_VAL(SENSOR_NETWORK_JOIN)  //  If Sensor Nodes may join over the air...
+        if (!sensor_network_join_bound(i)) { continue; }  //  Frames are accepted only after joining.
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_JOIN)
+        expected++;
+    }
+    uint32_t start = os_cputime_get32();
+    for (round = 0; round < LOOKUP_ROUNDS; round++) {
+        for (i = 0; i < SENSOR_NETWORK_SIZE; i++) {
+            memset(frame, 0, sizeof(frame));
+            frame[0] = 0xa1;  frame[1] = 0x61;  frame[2] = 0x74;  //  CBOR payload {"t": ...}
+            pipe = i % SENSOR_NETWORK_PIPES + 1;
+#if SENSOR_NETWORK_FRAME_NODE_ID  //  If the node ID is sent in-frame...
+            frame[sizeof(frame) - 2] = (uint8_t) addresses[i];  //  Node ID
+#endif  //  SENSOR_NETWORK_FRAME_NODE_ID
+            frame[sizeof(frame) - 1] = (uint8_t) round;  //  Sequence number
+            if (sensor_network_frame_node(pipe, frame, sizeof(frame)) == i) { found++; }
+#if SENSOR_NETWORK_FRAME_NODE_ID  //  If the node ID is sent in-frame...
+            assert(frame[sizeof(frame) - 2] == 0);  //  Node ID erased.
+#endif  //  SENSOR_NETWORK_FRAME_NODE_ID
+        }
+    }
+    uint32_t hashed = os_cputime_get32() - start;
+    assert(found == LOOKUP_ROUNDS * expected);
+
+#if SENSOR_NETWORK_FRAME_NODE_ID  //  If the node ID is sent in-frame...
+    //  A node ID that is received on the wrong pipe or is unknown is rejected.
+    frame[sizeof(frame) - 2] = (uint8_t) addresses[SENSOR_NETWORK_PIPES];  //  Sensor Node 6 shares pipe 1.
+    assert(sensor_network_frame_node(2, frame, sizeof(frame)) == -1);
+    frame[sizeof(frame) - 2] = 0;
+    assert(sensor_network_frame_node(1, frame, sizeof(frame)) == -1);
+#endif  //  SENSOR_NETWORK_FRAME_NODE_ID
+
+    //  Time the linear search for comparison.
+    found = 0;
+    start = os_cputime_get32();
+    for (round = 0; round < LOOKUP_ROUNDS; round++) {
+        for (i = 0; i < SENSOR_NETWORK_SIZE; i++) {
+            if (linear_find_node(addresses[i]) == i) { found++; }
+        }
+    }
+    uint32_t linear = os_cputime_get32() - start;
+    assert(found == LOOKUP_ROUNDS * SENSOR_NETWORK_SIZE);
+    console_printf("node table %d nodes, %d pipes: hashed %u ticks, linear %u ticks per 100 frames\n",
+        SENSOR_NETWORK_SIZE, SENSOR_NETWORK_PIPES,
+        (unsigned) (hashed * 100 / found), (unsigned) (linear * 100 / found));
+    console_flush();
+}
@@ -0,0 +1,142 @@
+//  TODO: Use unit test convention
+//  Multi-node simulator for the Multi-Hop Relay.  Run on the native BSP (targets/unittest) with SENSOR_NETWORK_RELAY
+//  enabled.  Sensor Nodes and Relay Nodes are placed on a line, with the Collector Node at 0.  A frame is heard by
+//  every node within SIM_RANGE, except that each link loses SIM_LOSS_PERCENT of the frames.  The Relay Nodes forward
+//  the frames that they hear at their next poll, SENSOR_NETWORK_RELAY_POLL milliseconds later.  Reports the ratio of
+//  frames delivered to the Collector Node, without and with the Relay Nodes, and the latency added by the relays.
+#include <os/os.h>
+#include <console/console.h>
+#include <sensor_network/sensor_network.h>
+
+void test_relay(void);
+
+#if MYNEWT_VAL(SENSOR_NETWORK_RELAY)  //  If Sensor Nodes may relay frames...
+
+#define SIM_SENSORS       8    //  Number of simulated Sensor Nodes
+#define SIM_RELAYS        2    //  Number of simulated Relay Nodes
+#define SIM_ROUNDS        200  //  Number of frames sent by each Sensor Node
+#define SIM_RANGE         100  //  Radio range
+#define SIM_LOSS_PERCENT  10   //  Frames lost per link
+#define SIM_FRAME_SIZE    12   //  Frame size, same as NRF24L01_TX_SIZE
+
+//  Positions on the line: Sensor Nodes from 40 to 215, Relay Nodes at 90 and 170.
+static const int sensor_pos[SIM_SENSORS] = { 40, 65, 90, 115, 140, 165, 190, 215 };
+static const int relay_pos[SIM_RELAYS]   = { 90, 170 };
+
+static struct sensor_network_relay sim_relays[SIM_RELAYS];  //  State of each Relay Node
+static struct sensor_network_relay sim_collector;           //  Frames seen by the Collector Node
+static uint32_t sim_random = 1;                             //  Random number generator state
+
+//  Statistics of one simulation
+struct sim_result {
+    int delivered;       //  Frames delivered to the Collector Node
+    int relayed;         //  Frames delivered only through Relay Nodes
+    int latency_polls;   //  Total polls waited by the relayed frames
+};
+
+static bool heard(int from, int to) {
+    //  Return true if a frame sent at position from is heard at position to.
+    int distance = (from > to) ? from - to : to - from;
+    if (distance > SIM_RANGE) { return false; }
+    sim_random = sim_random * 1103515245 + 12345;  //  Same sequence for every simulation.
+    return (sim_random >> 16) % 100 >= SIM_LOSS_PERCENT;
+}
+
+static void deliver(const uint8_t *frame, int pos, int slot, int relay_count, int *sent_slot, struct sim_result *result) {
+    //  Transmit the frame from position pos in the slot to the Collector Node and the Relay Nodes in range.
+    int r;
+    if (heard(pos, 0) && !sensor_network_relay_seen(&sim_collector, frame[SIM_FRAME_SIZE - 2], frame[SIM_FRAME_SIZE - 1])) {
+        result->delivered++;
+        if (frame[SIM_FRAME_SIZE - 3] > 0) {
+            //  Latency from the slot that the Sensor Node sent the frame.
+            result->relayed++;
+            result->latency_polls += slot - sent_slot[frame[SIM_FRAME_SIZE - 2] - 1];
+        }
+    }
+    for (r = 0; r < relay_count; r++) {
+        if (relay_pos[r] != pos && heard(pos, relay_pos[r])) { sensor_network_relay_receive(&sim_relays[r], frame, SIM_FRAME_SIZE); }
+    }
+}
+
+static void simulate(int relay_count, struct sim_result *result) {
+    //  Send SIM_ROUNDS frames from every Sensor Node.  Each round takes SIM_RELAYS + 1 polls, so that every frame may
+    //  be forwarded SIM_RELAYS times before the next round.
+    uint8_t frame[SIM_FRAME_SIZE];
+    int sent_slot[SIM_SENSORS];
+    int round, slot = 0, s, r, i;
+    memset(result, 0, sizeof(struct sim_result));
+    sim_random = 1;
+    sensor_network_relay_init(&sim_collector, 0);
+    for (r = 0; r < SIM_RELAYS; r++) { sensor_network_relay_init(&sim_relays[r], SIM_SENSORS + 1 + r); }
+    for (round = 0; round < SIM_ROUNDS; round++) {
+        for (s = 0; s < SIM_SENSORS; s++) {
+            //  Node IDs start from 1.  Hop count 0.
+            memset(frame, 0, sizeof(frame));
+            frame[0] = 0xa1;  frame[SIM_FRAME_SIZE - 2] = s + 1;  frame[SIM_FRAME_SIZE - 1] = round;
+            sent_slot[s] = slot;
+            deliver(frame, sensor_pos[s], slot, relay_count, sent_slot, result);
+        }
+        for (i = 0; i < SIM_RELAYS + 1; i++) {
+            //  At each poll, every Relay Node forwards its queue.
+            slot++;
+            for (r = 0; r < relay_count; r++) {
+                while (sensor_network_relay_next(&sim_relays[r], frame, sizeof(frame)) > 0) {
+                    deliver(frame, relay_pos[r], slot, relay_count, sent_slot, result);
+                }
+            }
+        }
+    }
+}
+
+void test_relay(void) {
+    //  Check the duplicate suppression and hop limit of a Relay Node, then simulate the network without and with
+    //  the Relay Nodes.
+    struct sensor_network_relay *relay = &sim_relays[0];
+    uint8_t frame[SIM_FRAME_SIZE], out[SENSOR_NETWORK_MAX_FRAME];
+    sensor_network_relay_init(relay, 9);
+    memset(frame, 0, sizeof(frame));
+    frame[0] = 0xa1;  frame[SIM_FRAME_SIZE - 2] = 1;  frame[SIM_FRAME_SIZE - 1] = 7;
+    assert(sensor_network_relay_receive(relay, frame, sizeof(frame)) == 0);
+    assert(sensor_network_relay_receive(relay, frame, sizeof(frame)) == SYS_EALREADY);  //  Duplicate
+    assert(sensor_network_relay_next(relay, out, sizeof(out)) == SIM_FRAME_SIZE);
+    assert(out[SIM_FRAME_SIZE - 3] == 1);  assert(memcmp(out, frame, SIM_FRAME_SIZE - 3) == 0);
+    assert(sensor_network_relay_next(relay, out, sizeof(out)) == 0);
+    frame[SIM_FRAME_SIZE - 1] = 8;  frame[SIM_FRAME_SIZE - 3] = MYNEWT_VAL(SENSOR_NETWORK_RELAY_MAX_HOPS);
+    assert(sensor_network_relay_receive(relay, frame, sizeof(frame)) == SYS_ERANGE);  //  Hop limit
+    frame[SIM_FRAME_SIZE - 1] = 9;  frame[SIM_FRAME_SIZE - 3] = 0;  frame[SIM_FRAME_SIZE - 2] = 9;
+    assert(sensor_network_relay_receive(relay, frame, sizeof(frame)) == SYS_EALREADY);  //  Own frame
+    frame[0] = 0;  frame[SIM_FRAME_SIZE - 2] = 2;
+    assert(sensor_network_relay_receive(relay, frame, sizeof(frame)) == SYS_EINVAL);  //  Join frame
+    int i;
+    frame[0] = 0xa1;
+    for (i = 0; i <= MYNEWT_VAL(SENSOR_NETWORK_RELAY_QUEUE); i++) {
+        frame[SIM_FRAME_SIZE - 1] = 10 + i;
+        int rc = sensor_network_relay_receive(relay, frame, sizeof(frame));
+        assert(rc == ((i < MYNEWT_VAL(SENSOR_NETWORK_RELAY_QUEUE)) ? 0 : SYS_ENOMEM));  //  Queue full
+    }
+
+    //  Simulate the network.
+    struct sim_result direct, relayed;
+    simulate(0, &direct);
+    simulate(SIM_RELAYS, &relayed);
+    int sent = SIM_SENSORS * SIM_ROUNDS;
+    assert(relayed.delivered > direct.delivered);
+    assert(relayed.delivered <= sent);
+    unsigned latency = relayed.relayed ? relayed.latency_polls * MYNEWT_VAL(SENSOR_NETWORK_RELAY_POLL) / relayed.relayed : 0;
+    console_printf("relay delivered %d%% direct, %d%% with %d relays; %d relayed, added latency %u ms\n",
+        direct.delivered * 100 / sent, relayed.delivered * 100 / sent, SIM_RELAYS, relayed.relayed, latency);
+    unsigned duplicates = 0;
+    for (i = 0; i < SIM_RELAYS; i++) { duplicates += sim_relays[i].stats.duplicates; }
+    console_printf("relay forwarded %u, %u duplicates, %u expired, %u dropped at relay 1\n",
+        (unsigned) sim_relays[0].stats.forwarded, duplicates, (unsigned) sim_relays[0].stats.expired,
+        (unsigned) sim_relays[0].stats.dropped);
+    console_flush();
+}
+
+#else
+
+void test_relay(void) {
+    console_printf("relay disabled\n");  console_flush();
+}
+
+#endif  //  MYNEWT_VAL(SENSOR_NETWORK_RELAY)
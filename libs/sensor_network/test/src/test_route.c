@@ -0,0 +1,72 @@
+//  TODO: Use unit test convention
+//  Tests for the routing of messages to Network Interfaces.  Run on the native BSP (targets/unittest).  Registers
+//  3 stand-in interfaces for the CoAP Server: A cheap interface with a small MTU, WiFi and a costly backup modem.
+//  Checks that messages take the cheapest available interface whose MTU fits, and fall over when an interface is
+//  down or its transport fails to register.  SENSOR_NETWORK_INTERFACES must leave room for the 3 interfaces.
+#include <os/os.h>
+#include <console/console.h>
+#include <sensor_network/sensor_network.h>
+
+void test_route(void);
+
+static int register_count;  //  Number of transports registered
+
+static int stand_in_register(const char *network_device, void *server_endpoint, const char *host, uint16_t port, uint8_t server_endpoint_size) {
+    //  Register the transport.  Return 0 if successful.
+    assert(network_device);  assert(server_endpoint);  assert(server_endpoint_size >= sizeof(int));
+    register_count++;
+    return 0;
+}
+
+static int failed_register(const char *network_device, void *server_endpoint, const char *host, uint16_t port, uint8_t server_endpoint_size) {
+    //  Fail to register the transport, like a WiFi access point that can't be reached.
+    register_count++;
+    return -1;
+}
+
+//  Stand-in interfaces: Iface Type, Network Device, Endpoint Size, Register Transport, Register Server, Encoding, MTU, Cost
+static const struct sensor_network_interface short_iface  = { SERVER_INTERFACE_TYPE, "test_short", sizeof(int), failed_register, NULL, 0, 16, 2 };
+static const struct sensor_network_interface wifi_iface   = { SERVER_INTERFACE_TYPE, "test_wifi", sizeof(int), stand_in_register, NULL, 0, 0, 5 };
+static const struct sensor_network_interface modem_iface  = { SERVER_INTERFACE_TYPE, "test_modem", sizeof(int), stand_in_register, NULL, 0, 64, 20 };
+
+static const char *route_name(uint16_t size) {
+    //  Return the network device that a message of the size would take.
+    const struct sensor_network_interface *iface = sensor_network_route(SERVER_INTERFACE_TYPE, size);
+    assert(iface);
+    return iface->network_device;
+}
+
+void test_route(void) {
+    //  Register the interfaces out of order of cost.  The routes are ordered by cost.
+    int rc = sensor_network_register_interface(&modem_iface);  assert(rc == 0);
+    rc = sensor_network_register_interface(&wifi_iface);  assert(rc == 0);
+    rc = sensor_network_register_interface(&short_iface);  assert(rc == 0);
+    rc = sensor_network_register_interface(&wifi_iface);  assert(rc == SYS_EALREADY);
+
+    //  Cheapest interface whose MTU fits.
+    assert(strcmp(route_name(0), "test_short") == 0);
+    assert(strcmp(route_name(16), "test_short") == 0);
+    assert(strcmp(route_name(40), "test_wifi") == 0);
+    assert(strcmp(route_name(500), "test_wifi") == 0);  //  No MTU limit
+
+    //  WiFi down: Messages take the modem, or the cheapest interface if no MTU fits.
+    rc = sensor_network_set_available("test_wifi", false);  assert(rc == 0);
+    assert(strcmp(route_name(40), "test_modem") == 0);
+    assert(strcmp(route_name(500), "test_short") == 0);
+    rc = sensor_network_set_available("test_wifi", true);  assert(rc == 0);
+    rc = sensor_network_set_available("test_unknown", true);  assert(rc == SYS_ENOENT);
+
+    //  The cheapest transport fails to register, so the next interface is registered instead.
+    rc = sensor_network_register_transport(SERVER_INTERFACE_TYPE);  assert(rc == 0);
+    assert(register_count == 2);
+    assert(strcmp(route_name(0), "test_wifi") == 0);
+    rc = sensor_network_register_transport(SERVER_INTERFACE_TYPE);  assert(rc == 0);
+    assert(register_count == 2);  //  Already registered.
+
+    console_printf("route ok\n");  console_flush();
+
+    //  Don't route the other tests through the stand-in interfaces.
+    sensor_network_set_available("test_short", false);
+    sensor_network_set_available("test_wifi", false);
+    sensor_network_set_available("test_modem", false);
+}
@@ -0,0 +1,151 @@
+//  TODO: Use unit test convention
+//  Tests for the Transmit Task.  Messages are queued while a stand-in radio is busy, then transmitted in priority
+//  order.  The sampling jitter of the calling task is measured while the radio is busy.
+#include <os/os.h>
+#include <console/console.h>
+#include <oic/port/oc_connectivity.h>
+#include <oic/oc_buffer.h>
+#include <sensor_coap/sensor_coap.h>
+#include <sensor_network/sensor_network.h>
+
+void test_tx_queue(void);
+
+#if MYNEWT_VAL(TX_TASK)  //  If we are transmitting in the Transmit Task...
+
+#define TX_LINK_TICKS    10  //  Simulated time to transmit each message e.g. AT+CIPSEND handshake for ESP8266.
+#define TX_SAMPLE_TICKS   3  //  Sampling period of the calling task, like a sensor poll.
+#define TX_SAMPLES       20  //  Number of samples measured while the radio is busy.
+#define TX_MAX_MESSAGES  16  //  Max number of messages recorded by the stand-in radio.
+
+//  Stand-in endpoint for the radio.
+struct tx_endpoint {
+    struct oc_ep_hdr ep;  //  OIC network endpoint.  Don't change, must be first field.
+};
+
+static uint8_t tx_ep_size(const struct oc_endpoint *oe);
+static void tx_ucast(struct os_mbuf *m);
+
+static const struct oc_transport tx_transport = {
+    0,           //  uint8_t ot_flags;
+    tx_ep_size,  //  uint8_t (*ot_ep_size)(const struct oc_endpoint *);
+    NULL,        //  int (*ot_ep_has_conn)(const struct oc_endpoint *);
+    tx_ucast,    //  void (*ot_tx_ucast)(struct os_mbuf *);
+    NULL,        //  void (*ot_tx_mcast)(struct os_mbuf *);
+    NULL,        //  enum oc_resource_properties *ot_get_trans_security)(const struct oc_endpoint *);
+    NULL,        //  char *(*ot_ep_str)(char *ptr, int maxlen, const struct oc_endpoint *);
+    NULL,        //  int (*ot_init)(void);
+    NULL,        //  void (*ot_shutdown)(void);
+};
+
+static struct tx_endpoint endpoint;
+static struct os_sem started_sem;  //  Released by the radio when it starts transmitting a message.
+static struct os_sem gate_sem;     //  Holds the radio busy until released.
+static bool gate_open;             //  True if the radio transmits without waiting for gate_sem.
+static char received[TX_MAX_MESSAGES + 1];  //  Tag of each message transmitted, in order.
+static int received_count;         //  Number of messages transmitted.
+
+static uint8_t tx_ep_size(const struct oc_endpoint *oe) {
+    //  Return the size of the endpoint.
+    return sizeof(struct tx_endpoint);
+}
+
+static void tx_ucast(struct os_mbuf *m) {
+    //  Simulate the transmission of the message, like the ESP8266 driver.  Runs in the Transmit Task.
+    //  Record the tag in the first payload byte, then free the chain of mbufs.
+    assert(m);
+    os_error_t rc = os_sem_release(&started_sem);  assert(rc == OS_OK);
+    if (!gate_open) { rc = os_sem_pend(&gate_sem, OS_TIMEOUT_NEVER);  assert(rc == OS_OK); }
+    os_time_delay(TX_LINK_TICKS);
+    char tag = 0;
+    rc = os_mbuf_copydata(m, 0, 1, &tag);  assert(rc == 0);
+    if (received_count < TX_MAX_MESSAGES) { received[received_count++] = tag; }
+    os_mbuf_free_chain(m);
+}
+
+static void queue_message(char tag, uint8_t priority) {
+    //  Queue a 1-byte message with the tag for the stand-in radio.
+    struct os_mbuf *m = oc_allocate_mbuf((struct oc_endpoint *) &endpoint);  assert(m);
+    int rc = os_mbuf_append(m, &tag, 1);  assert(rc == 0);
+    sensor_network_tx(m, priority);
+}
+
+void test_tx_queue(void) {
+    //  Hold the radio busy with a batch, then queue more batches, a normal message and an alert.  The alert and the
+    //  normal message must overtake the batches, and the batches beyond TX_QUEUE_DEPTH must be dropped.  While the
+    //  radio transmits, the calling task samples every TX_SAMPLE_TICKS ticks and the jitter must stay within 1 tick.
+    //  Should be called by a task with higher priority than the Transmit Task, like the Main Task.
+    static bool started = false;
+    struct sensor_network_tx_stats before, stats;
+    int i, rc;
+    if (!started) {
+        int8_t transport_id = oc_transport_register(&tx_transport);  assert(transport_id >= 0);
+        endpoint.ep.oe_type = transport_id;
+        endpoint.ep.oe_flags = 0;
+        started = true;
+    }
+    rc = os_sem_init(&started_sem, 0);  assert(rc == OS_OK);
+    rc = os_sem_init(&gate_sem, 0);  assert(rc == OS_OK);
+    gate_open = false;
+    received_count = 0;
+    memset(received, 0, sizeof(received));
+    sensor_network_tx_stats(&before);
+
+    //  The first batch occupies the radio.
+    queue_message('B', SENSOR_COAP_PRIORITY_BULK);
+    rc = os_sem_pend(&started_sem, OS_TICKS_PER_SEC);  assert(rc == OS_OK);
+
+    //  Queue while the radio is busy.  Queueing never waits for the radio.
+    os_time_t start = os_time_get();
+    queue_message('b', SENSOR_COAP_PRIORITY_BULK);
+    queue_message('N', SENSOR_COAP_PRIORITY_NORMAL);
+    queue_message('A', SENSOR_COAP_PRIORITY_ALERT);
+    for (i = 1; i < MYNEWT_VAL(TX_QUEUE_DEPTH) + 2; i++) { queue_message('b', SENSOR_COAP_PRIORITY_BULK); }
+    os_time_t queue_ticks = os_time_get() - start;
+    assert(queue_ticks == 0);
+
+    //  The bulk queue is full and 2 batches were dropped.
+    sensor_network_tx_stats(&stats);
+    assert(stats.depth[SENSOR_COAP_PRIORITY_ALERT] == 1);
+    assert(stats.depth[SENSOR_COAP_PRIORITY_NORMAL] == 1);
+    assert(stats.depth[SENSOR_COAP_PRIORITY_BULK] == MYNEWT_VAL(TX_QUEUE_DEPTH));
+    assert(stats.dropped[SENSOR_COAP_PRIORITY_BULK] == before.dropped[SENSOR_COAP_PRIORITY_BULK] + 2);
+    assert(!sensor_network_tx_ready(SENSOR_COAP_PRIORITY_BULK));
+    assert(sensor_network_tx_ready(SENSOR_COAP_PRIORITY_ALERT));
+
+    //  Let the radio transmit.  Sample while the Transmit Task is busy with the radio.
+    int expected = 3 + MYNEWT_VAL(TX_QUEUE_DEPTH);
+    gate_open = true;
+    rc = os_sem_release(&gate_sem);  assert(rc == OS_OK);
+    int max_jitter = 0;
+    os_time_t last = os_time_get();
+    for (i = 0; i < TX_SAMPLES; i++) {
+        os_time_delay(TX_SAMPLE_TICKS);
+        os_time_t now = os_time_get();
+        int jitter = (int) (now - last) - TX_SAMPLE_TICKS;
+        if (jitter < 0) { jitter = -jitter; }
+        if (jitter > max_jitter) { max_jitter = jitter; }
+        last = now;
+    }
+    while (received_count < expected) { os_time_delay(TX_LINK_TICKS); }  //  Wait for the radio.
+
+    //  Transmitted in priority order: the batch on the radio, then the alert, the normal message and the batches.
+    console_printf("tx order %s, max depth %d, dropped %d, jitter %d ticks\n", received,
+        stats.max_depth[SENSOR_COAP_PRIORITY_BULK], (int) (stats.dropped[SENSOR_COAP_PRIORITY_BULK] - before.dropped[SENSOR_COAP_PRIORITY_BULK]), max_jitter);
+    assert(received_count == expected);
+    assert(received[0] == 'B');  assert(received[1] == 'A');  assert(received[2] == 'N');
+    for (i = 3; i < expected; i++) { assert(received[i] == 'b'); }
+    assert(max_jitter <= 1);
+    sensor_network_tx_stats(&stats);
+    for (i = 0; i < SENSOR_NETWORK_TX_PRIORITIES; i++) { assert(stats.depth[i] == 0); }
+    assert(sensor_network_tx_ready(SENSOR_COAP_PRIORITY_BULK));
+    console_flush();
+}
+
+#else  //  If we are transmitting in the CoAP Background Task...
+
+void test_tx_queue(void) {
+    //  Nothing to test without the Transmit Task.
+    console_printf("tx queue: TX_TASK disabled\n");
+}
+
+#endif  //  MYNEWT_VAL(TX_TASK)